@@ -10,12 +10,27 @@
 #define CONFIG_CPU_CLOCK_SPEED_HZ_ENV_VAR_KEY  "CPU_CLOCK_HZ"
 #define CONFIG_CPU_CLOCK_SPEED_HZ_DEFAULT_VALUE 600
 
+#define CONFIG_CPU_TRACE_ENV_VAR_KEY "CPU_TRACE"
+#define CONFIG_CPU_TRACE_DEFAULT_VALUE false
+
 #define CONFIG_LOG_LEVEL_ENV_VAR_KEY "LOG_LEVEL"
 #define CONFIG_LOG_LEVEL_DEFAULT_VALUE "info"
 
+#define CONFIG_BENCH_INSTRUCTIONS_ENV_VAR_KEY "BENCH_INSTRUCTIONS"
+#define CONFIG_BENCH_INSTRUCTIONS_DEFAULT_VALUE 10000000
+
+#define CONFIG_BENCH_FRAMES_ENV_VAR_KEY "BENCH_FRAMES"
+#define CONFIG_BENCH_FRAMES_DEFAULT_VALUE 0
+
+#define CONFIG_BENCH_DECODER_ENV_VAR_KEY "BENCH_DECODER"
+#define CONFIG_BENCH_DECODER_DEFAULT_VALUE CPU_DECODER_CACHED
+
 static uint32_t parse_string_to_u32(const char *str);
+static enum cpu_decoder parse_string_to_cpu_decoder(const char *str);
 static void config_init_log_level(void);
 static void config_init_cpu_clock_speed(void);
+static void config_init_cpu_trace(void);
+static void config_init_bench(void);
 
 static struct config cfg = {0};
 
@@ -29,6 +44,8 @@ void config_init_from_env(void)
     //TODO improve error handling. don't panic, collect all invalid values and print them all
     config_init_log_level();
     config_init_cpu_clock_speed();
+    config_init_cpu_trace();
+    config_init_bench();
 }
 
 void config_init_log_level(void)
@@ -47,6 +64,55 @@ static void config_init_cpu_clock_speed(void)
     }
 }
 
+static void config_init_cpu_trace(void)
+{
+    const char* cpu_trace_env_var_value = getenv(CONFIG_CPU_TRACE_ENV_VAR_KEY);
+    if (cpu_trace_env_var_value == NULL) {
+        cfg.cpu_trace = CONFIG_CPU_TRACE_DEFAULT_VALUE;
+    } else {
+        cfg.cpu_trace = parse_string_to_u32(cpu_trace_env_var_value) != 0;
+    }
+}
+
+static void config_init_bench(void)
+{
+    const char* bench_instructions_env_var_value = getenv(CONFIG_BENCH_INSTRUCTIONS_ENV_VAR_KEY);
+    if (bench_instructions_env_var_value == NULL) {
+        cfg.bench_instruction_count = CONFIG_BENCH_INSTRUCTIONS_DEFAULT_VALUE;
+    } else {
+        cfg.bench_instruction_count = parse_string_to_u32(bench_instructions_env_var_value);
+    }
+
+    const char* bench_frames_env_var_value = getenv(CONFIG_BENCH_FRAMES_ENV_VAR_KEY);
+    if (bench_frames_env_var_value == NULL) {
+        cfg.bench_frame_count = CONFIG_BENCH_FRAMES_DEFAULT_VALUE;
+    } else {
+        cfg.bench_frame_count = parse_string_to_u32(bench_frames_env_var_value);
+    }
+
+    const char* bench_decoder_env_var_value = getenv(CONFIG_BENCH_DECODER_ENV_VAR_KEY);
+    if (bench_decoder_env_var_value == NULL) {
+        cfg.bench_decoder = CONFIG_BENCH_DECODER_DEFAULT_VALUE;
+    } else {
+        cfg.bench_decoder = parse_string_to_cpu_decoder(bench_decoder_env_var_value);
+    }
+}
+
+static enum cpu_decoder parse_string_to_cpu_decoder(const char *str)
+{
+    if (strcmp(str, "cached") == 0) {
+        return CPU_DECODER_CACHED;
+    }
+    if (strcmp(str, "table") == 0) {
+        return CPU_DECODER_TABLE;
+    }
+    if (strcmp(str, "chain") == 0) {
+        return CPU_DECODER_CHAIN;
+    }
+    fprintf(stderr, "error: config: unknown decoder %s (expected cached, table or chain)\n", str);
+    exit(1);
+}
+
 //TODO refactor this to utils/str.{h,c}
 static uint32_t parse_string_to_u32(const char *str)
 {
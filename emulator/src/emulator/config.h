@@ -1,12 +1,31 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
+#include "cpu.h"
 #include "logging/level.h"
 
 struct config {
     enum log_level log_level;
     uint32_t cpu_clock_speed_hz;
+
+    /**
+     * @brief Whether the CPU records the instructions it executes (see struct trace)
+     */
+    bool cpu_trace;
+
+    /**
+     * @brief How long the bench command runs: a number of instructions or, when not 0, of frames (1/60s of emulated
+     * time each, at cpu_clock_speed_hz)
+     */
+    uint32_t bench_instruction_count;
+    uint32_t bench_frame_count;
+
+    /**
+     * @brief How the CPU decodes its instructions during the bench command
+     */
+    enum cpu_decoder bench_decoder;
 };
 
 /**
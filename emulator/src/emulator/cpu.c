@@ -10,9 +10,10 @@
 
 #include "utils/random.h"
 #include "utils/bits.h"
+#include "utils/math.h"
 #include "memory.h"
 #include "opcode.h"
-#include "disassembler.h"
+#include "trace.h"
 #include "display.h"
 #include "keyboard.h"
 #include "timer.h"
@@ -23,6 +24,23 @@
 
 #define FATAL_MSG_OPCODE_USING_VF_REGISTER "programs should not operate on VF register"
 
+/**
+ * @brief Stops the emulation on a runtime error of the program, dumping the execution trace that led to it first
+ */
+#define cpu_fatal(CPU, MESSAGE) cpu_fatalf((CPU), (MESSAGE), NULL)
+#define cpu_fatalf(CPU, FORMAT, ...)     \
+    do {                                 \
+        cpu_dump_trace(CPU);             \
+        log_fatalf(FORMAT, __VA_ARGS__); \
+    } while (0)
+
+/**
+ * @brief Dumps the execution trace to stderr, if there is one.
+ * 
+ * @param cpu 
+ */
+static void cpu_dump_trace(const struct cpu* cpu);
+
 /**
  * @brief Fetches an Opcode from memory at the address where program counter (PC) points to.
  * 
@@ -31,6 +49,14 @@
  */
 static Word fetch_opcode(struct cpu* cpu);
 
+/**
+ * @brief Gets the instruction at the address where program counter (PC) points to, decoding it on its first execution.
+ * 
+ * @param cpu 
+ * @return The decoded instruction, from the instruction cache
+ */
+static const struct instruction* cpu_fetch_instruction(struct cpu* cpu);
+
 /**
  * @brief Advances the PC (Program Counter) register to point to the next instruction.
  * 
@@ -77,26 +103,103 @@ static void cpu_stack_push(struct cpu* cpu, Address address);
 static Address cpu_stack_pop(struct cpu* cpu);
 
 /**
- * @brief Decodes and executes the given Opcode
+ * @brief Decodes the given Opcode: finds its handler and extracts its operands once and for all
  * 
- * @param cpu 
- * @param opcode The OpCode fetched from memory at the program counter address
+ * @param decoder How the handler is found (see enum cpu_decoder)
+ * @param opcode The OpCode fetched from memory
+ * @param instruction Where the decoded instruction is stored
+ */
+static void cpu_decode_instruction(enum cpu_decoder decoder, Word opcode, struct instruction* instruction);
+
+/**
+ * @brief Finds the handler of an Opcode by comparing it against the mask of every instruction in turn, like the CPU
+ * did before the dispatch tables. Only used to measure them (see CPU_DECODER_CHAIN)
+ * 
+ * @return NULL for unsupported opcodes
+ */
+static InstructionHandler decode_chain(Word opcode);
+
+/**
+ * @brief Finds the handler of an Opcode among the instructions sharing its most significant nibble
+ */
+typedef InstructionHandler (*GroupDecoder)(Word opcode);
+
+/**
+ * @defgroup cpu-impl-decode-group The Opcode group decoding functions group
+ * The instructions sharing the same most significant nibble are told apart by these functions, with a second lookup.
+ * They return NULL for unsupported opcodes.
+ */
+
+/**
+ * @brief Decodes 00E0 - CLS, 00EE - RET and 0nnn - SYS addr.
+ * 
+ * @param opcode 0???
+ * @ingroup cpu-impl-decode-group
+ */
+static InstructionHandler decode_group_0(Word opcode);
+
+/**
+ * @brief Decodes 5xy0 - SE Vx, Vy (the only one of its group).
+ * 
+ * @param opcode 5xy?
+ * @ingroup cpu-impl-decode-group
+ */
+static InstructionHandler decode_group_5(Word opcode);
+
+/**
+ * @brief Decodes the arithmetic and logic instructions 8xy0 to 8xyE, by their least significant nibble.
+ * 
+ * @param opcode 8xy?
+ * @ingroup cpu-impl-decode-group
+ */
+static InstructionHandler decode_group_8(Word opcode);
+
+/**
+ * @brief Decodes 9xy0 - SNE Vx, Vy (the only one of its group).
+ * 
+ * @param opcode 9xy?
+ * @ingroup cpu-impl-decode-group
+ */
+static InstructionHandler decode_group_9(Word opcode);
+
+/**
+ * @brief Decodes the keyboard instructions Ex9E and ExA1, by their least significant byte.
+ * 
+ * @param opcode Ex??
+ * @ingroup cpu-impl-decode-group
+ */
+static InstructionHandler decode_group_e(Word opcode);
+
+/**
+ * @brief Decodes the timer, memory and I register instructions Fx07 to Fx65, by their least significant byte.
+ * 
+ * @param opcode Fx??
+ * @ingroup cpu-impl-decode-group
  */
-static void cpu_decode_and_exec_opcode(struct cpu* cpu, Word opcode);
+static InstructionHandler decode_group_f(Word opcode);
 
 /**
  * @defgroup cpu-impl-exec-opcode-group The Opcode implementation functions group
  * The group of functions that implements the executions of all opcodes
  */
 
+/**
+ * @brief Stops the emulation: the opcode is not a Chip-8 instruction.
+ * 
+ * @param cpu 
+ * @param instruction An unsupported opcode
+ * @ingroup cpu-impl-exec-opcode-group
+ */
+static void exec_unsupported(struct cpu* cpu, const struct instruction* instruction);
+
 /**
  * @brief Clears the display.
  * 
  * @param cpu 
- * @param opcode 00E0 - CLS
+ * @param instruction 00E0 - CLS
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_display_clear(struct cpu* cpu, Word opcode);
+static void exec_display_clear(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Return from a subroutine.
@@ -105,10 +208,10 @@ static void exec_display_clear(struct cpu* cpu, Word opcode);
  * then subtracts 1 from the stack pointer.
  * 
  * @param cpu 
- * @param opcode 00EE - RET
+ * @param instruction 00EE - RET
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_return(struct cpu* cpu, Word opcode);
+static void exec_return(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Jumps to a machine code routine at nnn.
@@ -117,10 +220,10 @@ static void exec_return(struct cpu* cpu, Word opcode);
  * It is ignored by modern interpreters.
  * 
  * @param cpu 
- * @param opcode 0nnn - SYS addr
+ * @param instruction 0nnn - SYS addr
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_call(struct cpu* cpu, Word opcode);
+static void exec_call(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Jumps to location NNN (goto).
@@ -128,10 +231,10 @@ static void exec_call(struct cpu* cpu, Word opcode);
  * The interpreter sets the program counter to NNN.
  * 
  * @param cpu 
- * @param opcode 1nnn - JP addr
+ * @param instruction 1nnn - JP addr
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_goto(struct cpu* cpu, Word opcode);
+static void exec_goto(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Calls the subroutine at address NNN.
@@ -140,10 +243,10 @@ static void exec_goto(struct cpu* cpu, Word opcode);
  * The PC is then set to nnn.
  * 
  * @param cpu 
- * @param opcode 2nnn - CALL addr
+ * @param instruction 2nnn - CALL addr
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_call_subroutine(struct cpu* cpu, Word opcode);
+static void exec_call_subroutine(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skip next instruction if Vx = kk.
@@ -151,10 +254,10 @@ static void exec_call_subroutine(struct cpu* cpu, Word opcode);
  * The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
  * 
  * @param cpu 
- * @param opcode 3xkk - SE Vx, byte
+ * @param instruction 3xkk - SE Vx, byte
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_if_equals(struct cpu* cpu, Word opcode);
+static void exec_if_equals(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skip next instruction if Vx != kk.
@@ -162,10 +265,10 @@ static void exec_if_equals(struct cpu* cpu, Word opcode);
  * The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
  * 
  * @param cpu 
- * @param opcode 4xkk - SNE Vx, byte
+ * @param instruction 4xkk - SNE Vx, byte
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_if_not_equals(struct cpu* cpu, Word opcode);
+static void exec_if_not_equals(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skip next instruction if Vx = Vy.
@@ -173,10 +276,10 @@ static void exec_if_not_equals(struct cpu* cpu, Word opcode);
  * The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
  * 
  * @param cpu 
- * @param opcode 5xy0 - SE Vx, Vy
+ * @param instruction 5xy0 - SE Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_skip_next_if_vx_equals_vy(struct cpu* cpu, Word opcode);
+static void exec_skip_next_if_vx_equals_vy(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = kk.
@@ -184,10 +287,10 @@ static void exec_skip_next_if_vx_equals_vy(struct cpu* cpu, Word opcode);
  * The interpreter puts the value kk into register Vx.
  * 
  * @param cpu 
- * @param opcode 6xkk - LD Vx, byte
+ * @param instruction 6xkk - LD Vx, byte
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_register(struct cpu* cpu, Word opcode);
+static void exec_set_register(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vx + kk.
@@ -195,10 +298,10 @@ static void exec_set_register(struct cpu* cpu, Word opcode);
  * Adds the value kk to the value of register Vx, then stores the result in Vx. 
  * 
  * @param cpu 
- * @param opcode 7xkk - ADD Vx, byte
+ * @param instruction 7xkk - ADD Vx, byte
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_add_to_vx(struct cpu* cpu, Word opcode);
+static void exec_add_to_vx(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vy.
@@ -206,10 +309,10 @@ static void exec_add_to_vx(struct cpu* cpu, Word opcode);
  * Stores the value of register Vy in register Vx.
  * 
  * @param cpu 
- * @param opcode 8xy0 - LD Vx, Vy
+ * @param instruction 8xy0 - LD Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_from_vy(struct cpu* cpu, Word opcode);
+static void exec_set_vx_from_vy(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set Vx = Vx OR Vy.
@@ -219,10 +322,10 @@ static void exec_set_vx_from_vy(struct cpu* cpu, Word opcode);
  * then the same bit in the result is also 1. Otherwise, it is 0. 
  * 
  * @param cpu 
- * @param opcode 8xy1 - OR Vx, Vy
+ * @param instruction 8xy1 - OR Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_to_vx_or(struct cpu* cpu, Word opcode);
+static void exec_set_vx_to_vx_or(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set Vx = Vx AND Vy.
@@ -232,10 +335,10 @@ static void exec_set_vx_to_vx_or(struct cpu* cpu, Word opcode);
  * then the same bit in the result is also 1. Otherwise, it is 0. 
  * 
  * @param cpu 
- * @param opcode 8xy2 - AND Vx, Vy
+ * @param instruction 8xy2 - AND Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_to_vx_and(struct cpu* cpu, Word opcode);
+static void exec_set_vx_to_vx_and(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set Vx = Vx XOR Vy.
@@ -245,10 +348,10 @@ static void exec_set_vx_to_vx_and(struct cpu* cpu, Word opcode);
  * then the corresponding bit in the result is set to 1. Otherwise, it is 0.
  * 
  * @param cpu 
- * @param opcode 8xy3 - XOR Vx, Vy
+ * @param instruction 8xy3 - XOR Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_to_vx_xor(struct cpu* cpu, Word opcode);
+static void exec_set_vx_to_vx_xor(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vx + Vy, set VF = carry.
@@ -258,10 +361,10 @@ static void exec_set_vx_to_vx_xor(struct cpu* cpu, Word opcode);
  * Only the lowest 8 bits of the result are kept, and stored in Vx.
  * 
  * @param cpu 
- * @param opcode 8xy4 - ADD Vx, Vy
+ * @param instruction 8xy4 - ADD Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_vx_plus_vy(struct cpu* cpu, Word opcode);
+static void exec_vx_plus_vy(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vx - Vy, set VF = NOT borrow.
@@ -269,10 +372,10 @@ static void exec_vx_plus_vy(struct cpu* cpu, Word opcode);
  * If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
  * 
  * @param cpu 
- * @param opcode 8xy5 - SUB Vx, Vy
+ * @param instruction 8xy5 - SUB Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_vx_minus_vy(struct cpu* cpu, Word opcode);
+static void exec_vx_minus_vy(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vx SHR 1.
@@ -280,10 +383,10 @@ static void exec_vx_minus_vy(struct cpu* cpu, Word opcode);
  * If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
  * 
  * @param cpu 
- * @param opcode 8xy6 - SHR Vx {, Vy}
+ * @param instruction 8xy6 - SHR Vx {, Vy}
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_rshift_one(struct cpu* cpu, Word opcode);
+static void exec_set_vx_rshift_one(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vy - Vx, set VF = NOT borrow.
@@ -291,10 +394,10 @@ static void exec_set_vx_rshift_one(struct cpu* cpu, Word opcode);
  * If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
  * 
  * @param cpu 
- * @param opcode 8xy7 - SUBN Vx, Vy
+ * @param instruction 8xy7 - SUBN Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_vy_minus_vx(struct cpu* cpu, Word opcode);
+static void exec_set_vx_vy_minus_vx(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets Vx = Vx SHL 1.
@@ -302,10 +405,10 @@ static void exec_set_vx_vy_minus_vx(struct cpu* cpu, Word opcode);
  * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
  * 
  * @param cpu 
- * @param opcode 8xyE - SHL Vx {, Vy}
+ * @param instruction 8xyE - SHL Vx {, Vy}
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_lshift_one(struct cpu* cpu, Word opcode);
+static void exec_set_vx_lshift_one(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skips next instruction if Vx != Vy.
@@ -313,10 +416,10 @@ static void exec_set_vx_lshift_one(struct cpu* cpu, Word opcode);
  * The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
  * 
  * @param cpu 
- * @param opcode 9xy0 - SNE Vx, Vy
+ * @param instruction 9xy0 - SNE Vx, Vy
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_if_vx_not_equals_to_vy(struct cpu* cpu, Word opcode);
+static void exec_if_vx_not_equals_to_vy(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Sets I = nnn.
@@ -324,10 +427,10 @@ static void exec_if_vx_not_equals_to_vy(struct cpu* cpu, Word opcode);
  * The value of register I is set to nnn.
  * 
  * @param cpu 
- * @param opcode Annn - LD I, addr
+ * @param instruction Annn - LD I, addr
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_i_register(struct cpu* cpu, Word opcode);
+static void exec_set_i_register(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Jumps to location nnn + V0.
@@ -335,10 +438,10 @@ static void exec_set_i_register(struct cpu* cpu, Word opcode);
  * The program counter is set to nnn plus the value of V0.
  * 
  * @param cpu 
- * @param opcode Bnnn - JP V0, addr
+ * @param instruction Bnnn - JP V0, addr
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_jump_to_addr_plus_v0(struct cpu* cpu, Word opcode);
+static void exec_jump_to_addr_plus_v0(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set Vx = random byte AND kk.
@@ -347,10 +450,10 @@ static void exec_jump_to_addr_plus_v0(struct cpu* cpu, Word opcode);
  * The results are stored in Vx. See instruction 8xy2 for more information on AND.
  * 
  * @param cpu 
- * @param opcode Cxkk - RND Vx, byte
+ * @param instruction Cxkk - RND Vx, byte
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_rand_and(struct cpu* cpu, Word opcode);
+static void exec_set_vx_rand_and(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
@@ -363,10 +466,10 @@ static void exec_set_vx_rand_and(struct cpu* cpu, Word opcode);
  * it wraps around to the opposite side of the screen.
  * 
  * @param cpu 
- * @param opcode Dxyn - DRW Vx, Vy, nibble
+ * @param instruction Dxyn - DRW Vx, Vy, nibble
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_display_draw_sprite_at(struct cpu* cpu, Word opcode);
+static void exec_display_draw_sprite_at(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skip next instruction if key with the value of Vx is pressed.
@@ -375,10 +478,10 @@ static void exec_display_draw_sprite_at(struct cpu* cpu, Word opcode);
  * PC is increased by 2.
  * 
  * @param cpu 
- * @param opcode Ex9E - SKP Vx
+ * @param instruction Ex9E - SKP Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_if_key_equals_to_vx(struct cpu* cpu, Word opcode);
+static void exec_if_key_equals_to_vx(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Skip next instruction if key with the value of Vx is not pressed.
@@ -386,10 +489,10 @@ static void exec_if_key_equals_to_vx(struct cpu* cpu, Word opcode);
  * Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
  * 
  * @param cpu 
- * @param opcode ExA1 - SKNP Vx
+ * @param instruction ExA1 - SKNP Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_if_key_not_equals_to_vx(struct cpu* cpu, Word opcode);
+static void exec_if_key_not_equals_to_vx(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set Vx = delay timer value.
@@ -397,10 +500,10 @@ static void exec_if_key_not_equals_to_vx(struct cpu* cpu, Word opcode);
  * The value of DT is placed into Vx.
  * 
  * @param cpu 
- * @param opcode Fx07 - LD Vx, DT
+ * @param instruction Fx07 - LD Vx, DT
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_from_delay_timer(struct cpu* cpu, Word opcode);
+static void exec_set_vx_from_delay_timer(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Wait for a key press, store the value of the key in Vx.
@@ -408,10 +511,10 @@ static void exec_set_vx_from_delay_timer(struct cpu* cpu, Word opcode);
  * All execution stops until a key is pressed, then the value of that key is stored in Vx.
  * 
  * @param cpu 
- * @param opcode Fx0A - LD Vx, K
+ * @param instruction Fx0A - LD Vx, K
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_vx_from_key(struct cpu* cpu, Word opcode);
+static void exec_set_vx_from_key(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set delay timer = Vx.
@@ -419,10 +522,10 @@ static void exec_set_vx_from_key(struct cpu* cpu, Word opcode);
  * DT is set equal to the value of Vx.
  * 
  * @param cpu 
- * @param opcode Fx15 - LD DT, Vx
+ * @param instruction Fx15 - LD DT, Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_delay_timer_from_vx(struct cpu* cpu, Word opcode);
+static void exec_set_delay_timer_from_vx(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set sound timer = Vx.
@@ -430,10 +533,10 @@ static void exec_set_delay_timer_from_vx(struct cpu* cpu, Word opcode);
  * ST is set equal to the value of Vx.
  * 
  * @param cpu 
- * @param opcode Fx18 - LD ST, Vx
+ * @param instruction Fx18 - LD ST, Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_sound_timer(struct cpu* cpu, Word opcode);
+static void exec_set_sound_timer(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set I = I + Vx.
@@ -441,10 +544,10 @@ static void exec_set_sound_timer(struct cpu* cpu, Word opcode);
  * The values of I and Vx are added, and the results are stored in I.
  * 
  * @param cpu 
- * @param opcode Fx1E - ADD I, Vx
+ * @param instruction Fx1E - ADD I, Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_add_vx_to_i(struct cpu* cpu, Word opcode);
+static void exec_add_vx_to_i(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Set I = location of sprite for digit Vx.
@@ -452,10 +555,10 @@ static void exec_add_vx_to_i(struct cpu* cpu, Word opcode);
  * The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
  * 
  * @param cpu 
- * @param opcode Fx29 - LD F, Vx
+ * @param instruction Fx29 - LD F, Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_i_to_sprite_addr(struct cpu* cpu, Word opcode);
+static void exec_set_i_to_sprite_addr(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Store BCD representation of Vx in memory locations I, I+1, and I+2.
@@ -464,10 +567,10 @@ static void exec_set_i_to_sprite_addr(struct cpu* cpu, Word opcode);
  * the tens digit at location I+1, and the ones digit at location I+2.
  * 
  * @param cpu 
- * @param opcode Fx33 - LD B, Vx
+ * @param instruction Fx33 - LD B, Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_set_bcd(struct cpu* cpu, Word opcode);
+static void exec_set_bcd(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Store registers V0 through Vx in memory starting at location I.
@@ -475,10 +578,10 @@ static void exec_set_bcd(struct cpu* cpu, Word opcode);
  * The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
  * 
  * @param cpu 
- * @param opcode Fx55 - LD [I], Vx
+ * @param instruction Fx55 - LD [I], Vx
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_reg_dump(struct cpu* cpu, Word opcode);
+static void exec_reg_dump(struct cpu* cpu, const struct instruction* instruction);
 
 /**
  * @brief Read registers V0 through Vx from memory starting at location I.
@@ -486,17 +589,95 @@ static void exec_reg_dump(struct cpu* cpu, Word opcode);
  * The interpreter reads values from memory starting at location I into registers V0 through Vx.
  * 
  * @param cpu 
- * @param opcode Fx65 - LD Vx, [I]
+ * @param instruction Fx65 - LD Vx, [I]
  * @ingroup cpu-impl-exec-opcode-group
  */
-static void exec_reg_load(struct cpu* cpu, Word opcode);
+static void exec_reg_load(struct cpu* cpu, const struct instruction* instruction);
+
+/**
+ * @brief Opcode handlers by the most significant nibble of the opcode, for the nibbles of a single instruction.
+ * 
+ * Decoding takes a constant time: a single lookup (and a second one for the groups that share their first nibble)
+ * instead of comparing the opcode against every instruction pattern in turn.
+ */
+static const InstructionHandler opcode_handlers[16] = {
+    [0x1] = exec_goto,
+    [0x2] = exec_call_subroutine,
+    [0x3] = exec_if_equals,
+    [0x4] = exec_if_not_equals,
+    [0x6] = exec_set_register,
+    [0x7] = exec_add_to_vx,
+    [0xA] = exec_set_i_register,
+    [0xB] = exec_jump_to_addr_plus_v0,
+    [0xC] = exec_set_vx_rand_and,
+    [0xD] = exec_display_draw_sprite_at,
+};
+
+/**
+ * @brief Group decoders by the most significant nibble of the opcode, for the nibbles shared by several instructions.
+ */
+static const GroupDecoder opcode_group_decoders[16] = {
+    [0x0] = decode_group_0,
+    [0x5] = decode_group_5,
+    [0x8] = decode_group_8,
+    [0x9] = decode_group_9,
+    [0xE] = decode_group_e,
+    [0xF] = decode_group_f,
+};
+
+/**
+ * @brief 8xy? Opcode handlers by the least significant nibble of the opcode. NULL entries are unsupported opcodes.
+ */
+static const InstructionHandler opcode_handlers_group_8[16] = {
+    [0x0] = exec_set_vx_from_vy,
+    [0x1] = exec_set_vx_to_vx_or,
+    [0x2] = exec_set_vx_to_vx_and,
+    [0x3] = exec_set_vx_to_vx_xor,
+    [0x4] = exec_vx_plus_vy,
+    [0x5] = exec_vx_minus_vy,
+    [0x6] = exec_set_vx_rshift_one,
+    [0x7] = exec_set_vx_vy_minus_vx,
+    [0xE] = exec_set_vx_lshift_one,
+};
 
-void cpu_init(struct cpu* cpu, uint8_t* memory, struct display* display, struct timer* delay_timer, struct timer* sound_timer)
+/**
+ * @brief Ex?? Opcode handlers by the least significant byte of the opcode. NULL entries are unsupported opcodes.
+ */
+static const InstructionHandler opcode_handlers_group_e[256] = {
+    [0x9E] = exec_if_key_equals_to_vx,
+    [0xA1] = exec_if_key_not_equals_to_vx,
+};
+
+/**
+ * @brief Fx?? Opcode handlers by the least significant byte of the opcode. NULL entries are unsupported opcodes.
+ */
+static const InstructionHandler opcode_handlers_group_f[256] = {
+    [0x07] = exec_set_vx_from_delay_timer,
+    [0x0A] = exec_set_vx_from_key,
+    [0x15] = exec_set_delay_timer_from_vx,
+    [0x18] = exec_set_sound_timer,
+    [0x1E] = exec_add_vx_to_i,
+    [0x29] = exec_set_i_to_sprite_addr,
+    [0x33] = exec_set_bcd,
+    [0x55] = exec_reg_dump,
+    [0x65] = exec_reg_load,
+};
+
+void cpu_init(struct cpu* cpu,
+              uint8_t* memory,
+              struct display* display,
+              struct timer* delay_timer,
+              struct timer* sound_timer,
+              struct trace* trace)
 {
     cpu->memory = memory;
     cpu->display = display;
     cpu->delay_timer = delay_timer;
     cpu->sound_timer = sound_timer;
+    cpu->trace = trace;
+
+    cpu_invalidate_instructions(cpu, 0, MEMORY_SIZE);
+    cpu->decoder = CPU_DECODER_CACHED;
 
     memset(cpu->registers, 0, sizeof(cpu->registers));
     memset(cpu->stack, 0, sizeof(cpu->stack));
@@ -505,68 +686,154 @@ void cpu_init(struct cpu* cpu, uint8_t* memory, struct display* display, struct
     cpu->stack_count = 0;
 }
 
-void cpu_step(struct cpu* cpu)
+Word cpu_step(struct cpu* cpu)
 {
-    //NOTE this is just temporary until we find a better way to debug execution...
-    struct disassembler disassembler = { .file = stderr };
+    // both bytes of the opcode must be in memory
+    if (cpu->pc > MEMORY_SIZE - sizeof(Word)) {
+        cpu_fatalf(cpu, "program counter (PC) overflow. pc=" ADDRESS_FMT, cpu->pc);
+    }
+
+    // Fetch (and Decode, only the first time the instruction at this address is executed)
+    const struct instruction* instruction = cpu_fetch_instruction(cpu);
 
-    if (cpu->pc >= MEMORY_SIZE) {
-        fprintf(stderr, "error: program counter (PC) overflow\n");
-        exit(1);
+    // no I/O at all here: the trace is only printed when dumped
+#ifdef ENABLE_CPU_TRACE
+    if (cpu->trace != NULL) {
+        trace_record(cpu->trace, cpu->pc, instruction->opcode, cpu->i, cpu->registers);
     }
+#endif
 
-    // Fetch
-    Word opcode = fetch_opcode(cpu);
-    fprintf(stderr, ADDRESS_FMT ": OPCODE[" OPCODE_FMT "]: ", cpu->pc, opcode);
-    assert(opcode != 0);
+    assert(instruction->opcode != 0);
 
     cpu_pc_advance(cpu);
 
-    disassembler_disassemble(&disassembler, opcode);
-
-    // Decode and Execute
-    cpu_decode_and_exec_opcode(cpu, opcode);
-}
-
-static void cpu_decode_and_exec_opcode(struct cpu* cpu, Word opcode)
-{
-    if (opcode == 0x00E0)            { exec_display_clear(cpu, opcode); return; }
-    if (opcode == 0x00EE)            { exec_return(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x0000) { exec_call(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x1000) { exec_goto(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x2000) { exec_call_subroutine(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x3000) { exec_if_equals(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x4000) { exec_if_not_equals(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x5000) { exec_skip_next_if_vx_equals_vy(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x6000) { exec_set_register(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0x7000) { exec_add_to_vx(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8000) { exec_set_vx_from_vy(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8001) { exec_set_vx_to_vx_or(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8002) { exec_set_vx_to_vx_and(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8003) { exec_set_vx_to_vx_xor(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8004) { exec_vx_plus_vy(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8005) { exec_vx_minus_vy(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8006) { exec_set_vx_rshift_one(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x8007) { exec_set_vx_vy_minus_vx(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x800E) { exec_set_vx_lshift_one(cpu, opcode); return; }
-    if ((opcode & 0xF00F) == 0x9000) { exec_if_vx_not_equals_to_vy(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0xA000) { exec_set_i_register(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0xB000) { exec_jump_to_addr_plus_v0(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0xC000) { exec_set_vx_rand_and(cpu, opcode); return; }
-    if ((opcode & 0xF000) == 0xD000) { exec_display_draw_sprite_at(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xE09E) { exec_if_key_equals_to_vx(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xE0A1) { exec_if_key_not_equals_to_vx(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF007) { exec_set_vx_from_delay_timer(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF00A) { exec_set_vx_from_key(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF015) { exec_set_delay_timer_from_vx(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF018) { exec_set_sound_timer(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF01E) { exec_add_vx_to_i(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF029) { exec_set_i_to_sprite_addr(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF033) { exec_set_bcd(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF055) { exec_reg_dump(cpu, opcode); return; }
-    if ((opcode & 0xF0FF) == 0xF065) { exec_reg_load(cpu, opcode); return; }
-
-    log_fatalf("unsupported opcode. opcode=" OPCODE_FMT, opcode);
+    // Execute
+    instruction->handler(cpu, instruction);
+
+    return instruction->opcode;
+}
+
+void cpu_invalidate_instructions(struct cpu* cpu, Address address, size_t size)
+{
+    // the instruction starting the byte before also reads the first byte written
+    size_t first = address > 0 ? address - 1 : 0;
+    size_t last = MIN((size_t) address + size, (size_t) MEMORY_SIZE);
+
+    for (size_t a = first; a < last; a++) {
+        cpu->instructions[a].handler = NULL;
+    }
+}
+
+static const struct instruction* cpu_fetch_instruction(struct cpu* cpu)
+{
+    struct instruction* instruction = &cpu->instructions[cpu->pc];
+    if (instruction->handler == NULL || cpu->decoder != CPU_DECODER_CACHED) {
+        cpu_decode_instruction(cpu->decoder, fetch_opcode(cpu), instruction);
+    }
+    return instruction;
+}
+
+static void cpu_decode_instruction(enum cpu_decoder decoder, Word opcode, struct instruction* instruction)
+{
+    const size_t nibble = (opcode & 0xF000) >> (3 * 4);
+
+    InstructionHandler handler;
+    if (decoder == CPU_DECODER_CHAIN) {
+        handler = decode_chain(opcode);
+    } else {
+        handler = opcode_group_decoders[nibble] != NULL
+            ? opcode_group_decoders[nibble](opcode)
+            : opcode_handlers[nibble];
+    }
+
+    instruction->handler = handler != NULL ? handler : exec_unsupported;
+    instruction->opcode = opcode;
+    instruction->address = opcode_decode_address(opcode);
+    instruction->x = opcode_decode_register_x(opcode);
+    instruction->y = opcode_decode_register_y(opcode);
+    instruction->kk = opcode_decode_const_8bit(opcode);
+    instruction->n = opcode_decode_const_4bit(opcode);
+}
+
+static InstructionHandler decode_chain(Word opcode)
+{
+    if (opcode == 0x00E0)            { return exec_display_clear; }
+    if (opcode == 0x00EE)            { return exec_return; }
+    if ((opcode & 0xF000) == 0x0000) { return exec_call; }
+    if ((opcode & 0xF000) == 0x1000) { return exec_goto; }
+    if ((opcode & 0xF000) == 0x2000) { return exec_call_subroutine; }
+    if ((opcode & 0xF000) == 0x3000) { return exec_if_equals; }
+    if ((opcode & 0xF000) == 0x4000) { return exec_if_not_equals; }
+    if ((opcode & 0xF00F) == 0x5000) { return exec_skip_next_if_vx_equals_vy; }
+    if ((opcode & 0xF000) == 0x6000) { return exec_set_register; }
+    if ((opcode & 0xF000) == 0x7000) { return exec_add_to_vx; }
+    if ((opcode & 0xF00F) == 0x8000) { return exec_set_vx_from_vy; }
+    if ((opcode & 0xF00F) == 0x8001) { return exec_set_vx_to_vx_or; }
+    if ((opcode & 0xF00F) == 0x8002) { return exec_set_vx_to_vx_and; }
+    if ((opcode & 0xF00F) == 0x8003) { return exec_set_vx_to_vx_xor; }
+    if ((opcode & 0xF00F) == 0x8004) { return exec_vx_plus_vy; }
+    if ((opcode & 0xF00F) == 0x8005) { return exec_vx_minus_vy; }
+    if ((opcode & 0xF00F) == 0x8006) { return exec_set_vx_rshift_one; }
+    if ((opcode & 0xF00F) == 0x8007) { return exec_set_vx_vy_minus_vx; }
+    if ((opcode & 0xF00F) == 0x800E) { return exec_set_vx_lshift_one; }
+    if ((opcode & 0xF00F) == 0x9000) { return exec_if_vx_not_equals_to_vy; }
+    if ((opcode & 0xF000) == 0xA000) { return exec_set_i_register; }
+    if ((opcode & 0xF000) == 0xB000) { return exec_jump_to_addr_plus_v0; }
+    if ((opcode & 0xF000) == 0xC000) { return exec_set_vx_rand_and; }
+    if ((opcode & 0xF000) == 0xD000) { return exec_display_draw_sprite_at; }
+    if ((opcode & 0xF0FF) == 0xE09E) { return exec_if_key_equals_to_vx; }
+    if ((opcode & 0xF0FF) == 0xE0A1) { return exec_if_key_not_equals_to_vx; }
+    if ((opcode & 0xF0FF) == 0xF007) { return exec_set_vx_from_delay_timer; }
+    if ((opcode & 0xF0FF) == 0xF00A) { return exec_set_vx_from_key; }
+    if ((opcode & 0xF0FF) == 0xF015) { return exec_set_delay_timer_from_vx; }
+    if ((opcode & 0xF0FF) == 0xF018) { return exec_set_sound_timer; }
+    if ((opcode & 0xF0FF) == 0xF01E) { return exec_add_vx_to_i; }
+    if ((opcode & 0xF0FF) == 0xF029) { return exec_set_i_to_sprite_addr; }
+    if ((opcode & 0xF0FF) == 0xF033) { return exec_set_bcd; }
+    if ((opcode & 0xF0FF) == 0xF055) { return exec_reg_dump; }
+    if ((opcode & 0xF0FF) == 0xF065) { return exec_reg_load; }
+    return NULL;
+}
+
+static InstructionHandler decode_group_0(Word opcode)
+{
+    switch (opcode) {
+        case 0x00E0: return exec_display_clear;
+        case 0x00EE: return exec_return;
+        default:     return exec_call;
+    }
+}
+
+static InstructionHandler decode_group_5(Word opcode)
+{
+    return (opcode & 0x000F) == 0x0 ? exec_skip_next_if_vx_equals_vy : NULL;
+}
+
+static InstructionHandler decode_group_8(Word opcode)
+{
+    return opcode_handlers_group_8[opcode & 0x000F];
+}
+
+static InstructionHandler decode_group_9(Word opcode)
+{
+    return (opcode & 0x000F) == 0x0 ? exec_if_vx_not_equals_to_vy : NULL;
+}
+
+static InstructionHandler decode_group_e(Word opcode)
+{
+    return opcode_handlers_group_e[opcode & 0x00FF];
+}
+
+static InstructionHandler decode_group_f(Word opcode)
+{
+    return opcode_handlers_group_f[opcode & 0x00FF];
+}
+
+static void cpu_dump_trace(const struct cpu* cpu)
+{
+    if (cpu->trace != NULL) {
+        trace_dump(cpu->trace, stderr);
+    }
 }
 
 static Word fetch_opcode(struct cpu* cpu)
@@ -598,8 +865,7 @@ static void cpu_goto_address(struct cpu* cpu, Address address)
 static void cpu_stack_push(struct cpu* cpu, Address address)
 {
     if (cpu->stack_count >= STACK_CAPACITY) {
-        fprintf(stderr, "error: cpu: runtime: stack overflow\n");
-        exit(1);
+        cpu_fatal(cpu, "runtime: stack overflow");
     }
     cpu->stack[cpu->stack_count] = address;
     cpu->stack_count++;
@@ -608,134 +874,138 @@ static void cpu_stack_push(struct cpu* cpu, Address address)
 static Address cpu_stack_pop(struct cpu* cpu)
 {
     if (cpu->stack_count == 0) {
-        fprintf(stderr, "error: cpu: runtime: stack underflow\n");
-        exit(1);
+        cpu_fatal(cpu, "runtime: stack underflow");
     }
     cpu->stack_count--;
     return cpu->stack[cpu->stack_count];
 }
 
-static void exec_display_clear(struct cpu* cpu, Word opcode)
+static void exec_unsupported(struct cpu* cpu, const struct instruction* instruction)
 {
-    (void) opcode;
+    cpu_fatalf(cpu, "unsupported opcode. opcode=" OPCODE_FMT, instruction->opcode);
+}
+
+static void exec_display_clear(struct cpu* cpu, const struct instruction* instruction)
+{
+    (void) instruction;
     display_clear(cpu->display);
 }
 
-static void exec_return(struct cpu* cpu, Word opcode)
+static void exec_return(struct cpu* cpu, const struct instruction* instruction)
 {
-    (void) opcode;
+    (void) instruction;
 
     Address ret_addr = cpu_stack_pop(cpu);
     cpu_goto_address(cpu, ret_addr);
 }
 
-static void exec_call(struct cpu* cpu, Word opcode)
+static void exec_call(struct cpu* cpu, const struct instruction* instruction)
 {
     log_warn("obsolete instruction NATIVE CALL");
-    Address address = opcode_decode_address(opcode);
+    Address address = instruction->address;
     
     cpu_stack_push(cpu, cpu->pc);
     cpu_goto_address(cpu, address);
 }
 
-static void exec_goto(struct cpu* cpu, Word opcode)
+static void exec_goto(struct cpu* cpu, const struct instruction* instruction)
 {
-    Address address = opcode_decode_address(opcode);
+    Address address = instruction->address;
     cpu_goto_address(cpu, address);
 }
 
-static void exec_call_subroutine(struct cpu* cpu, Word opcode)
+static void exec_call_subroutine(struct cpu* cpu, const struct instruction* instruction)
 {
-    Address address = opcode_decode_address(opcode);
+    Address address = instruction->address;
     cpu_stack_push(cpu, cpu->pc);
     cpu_goto_address(cpu, address);
 }
 
-static void exec_if_equals(struct cpu* cpu, Word opcode)
+static void exec_if_equals(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Const value = opcode_decode_const_8bit(opcode);
+    Register x = instruction->x;
+    Const value = instruction->kk;
 
     if (cpu->registers[x] == value) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_if_not_equals(struct cpu* cpu, Word opcode)
+static void exec_if_not_equals(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Const value = opcode_decode_const_8bit(opcode);
+    Register x = instruction->x;
+    Const value = instruction->kk;
 
     if (cpu->registers[x] != value) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_skip_next_if_vx_equals_vy(struct cpu* cpu, Word opcode)
+static void exec_skip_next_if_vx_equals_vy(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     if (cpu->registers[x] == cpu->registers[y]) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_set_register(struct cpu* cpu, Word opcode)
+static void exec_set_register(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Const value = opcode_decode_const_8bit(opcode);
+    Register x = instruction->x;
+    Const value = instruction->kk;
 
     cpu->registers[x] = value;
 }
 
-static void exec_add_to_vx(struct cpu* cpu, Word opcode)
+static void exec_add_to_vx(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Const value = opcode_decode_const_8bit(opcode);
+    Register x = instruction->x;
+    Const value = instruction->kk;
 
     cpu->registers[x] += value;
 }
 
-static void exec_set_vx_from_vy(struct cpu* cpu, Word opcode)
+static void exec_set_vx_from_vy(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     cpu->registers[x] = cpu->registers[y];
 }
 
-static void exec_set_vx_to_vx_or(struct cpu* cpu, Word opcode)
+static void exec_set_vx_to_vx_or(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     cpu->registers[x] |= cpu->registers[y];
 }
 
-static void exec_set_vx_to_vx_and(struct cpu* cpu, Word opcode)
+static void exec_set_vx_to_vx_and(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     cpu->registers[x] &= cpu->registers[y];
 }
 
-static void exec_set_vx_to_vx_xor(struct cpu* cpu, Word opcode)
+static void exec_set_vx_to_vx_xor(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     cpu->registers[x] ^= cpu->registers[y];
 }
 
-static void exec_vx_plus_vy(struct cpu* cpu, Word opcode)
+static void exec_vx_plus_vy(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     if (x == VF || y == VF) {
-        log_fatal(FATAL_MSG_OPCODE_USING_VF_REGISTER);
+        cpu_fatal(cpu, FATAL_MSG_OPCODE_USING_VF_REGISTER);
     }
 
     size_t sum = cpu->registers[x] + cpu->registers[y];
@@ -750,13 +1020,13 @@ static void exec_vx_plus_vy(struct cpu* cpu, Word opcode)
     cpu->registers[x] = (Register) sum;
 }
 
-static void exec_vx_minus_vy(struct cpu* cpu, Word opcode)
+static void exec_vx_minus_vy(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     if (x == VF || y == VF) {
-        log_fatal(FATAL_MSG_OPCODE_USING_VF_REGISTER);
+        cpu_fatal(cpu, FATAL_MSG_OPCODE_USING_VF_REGISTER);
     }
 
     if (cpu->registers[x] > cpu->registers[y]) {
@@ -768,11 +1038,11 @@ static void exec_vx_minus_vy(struct cpu* cpu, Word opcode)
     cpu->registers[x] -= cpu->registers[y];
 }
 
-static void exec_set_vx_rshift_one(struct cpu* cpu, Word opcode)
+static void exec_set_vx_rshift_one(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
     if (x == VF) {
-        log_fatal(FATAL_MSG_OPCODE_USING_VF_REGISTER);
+        cpu_fatal(cpu, FATAL_MSG_OPCODE_USING_VF_REGISTER);
     }
 
     if (bit_is_set(cpu->registers[x], 0)) {
@@ -784,13 +1054,13 @@ static void exec_set_vx_rshift_one(struct cpu* cpu, Word opcode)
     cpu->registers[x] >>= 1;
 }
 
-static void exec_set_vx_vy_minus_vx(struct cpu* cpu, Word opcode)
+static void exec_set_vx_vy_minus_vx(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     if (x == VF || y == VF) {
-        log_fatal(FATAL_MSG_OPCODE_USING_VF_REGISTER);
+        cpu_fatal(cpu, FATAL_MSG_OPCODE_USING_VF_REGISTER);
     }
 
     if (cpu->registers[y] > cpu->registers[x]) {
@@ -802,11 +1072,11 @@ static void exec_set_vx_vy_minus_vx(struct cpu* cpu, Word opcode)
     cpu->registers[x] = cpu->registers[y] - cpu->registers[x];
 }
 
-static void exec_set_vx_lshift_one(struct cpu* cpu, Word opcode)
+static void exec_set_vx_lshift_one(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
     if (x == VF) {
-        log_fatal(FATAL_MSG_OPCODE_USING_VF_REGISTER);
+        cpu_fatal(cpu, FATAL_MSG_OPCODE_USING_VF_REGISTER);
     }
 
     static_assert(sizeof(Register) == 1, "implementation depends that register size equals 1");
@@ -819,38 +1089,38 @@ static void exec_set_vx_lshift_one(struct cpu* cpu, Word opcode)
     cpu->registers[x] <<= 1;
 }
 
-static void exec_if_vx_not_equals_to_vy(struct cpu* cpu, Word opcode)
+static void exec_if_vx_not_equals_to_vy(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
 
     if (cpu->registers[x] != cpu->registers[y]) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_set_i_register(struct cpu* cpu, Word opcode)
+static void exec_set_i_register(struct cpu* cpu, const struct instruction* instruction)
 {
-    Address address = opcode_decode_address(opcode);
+    Address address = instruction->address;
 
     cpu->i = address;
 }
 
-static void exec_jump_to_addr_plus_v0(struct cpu* cpu, Word opcode)
+static void exec_jump_to_addr_plus_v0(struct cpu* cpu, const struct instruction* instruction)
 {
-    Address address = opcode_decode_address(opcode);
+    Address address = instruction->address;
     cpu_goto_address(cpu, address + cpu->registers[V0]);
 }
 
-static void exec_set_vx_rand_and(struct cpu* cpu, Word opcode)
+static void exec_set_vx_rand_and(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
-    Const value = opcode_decode_const_8bit(opcode);
+    Register x = instruction->x;
+    Const value = instruction->kk;
     
     cpu->registers[x] = random_u8() & value;
 }
 
-static void exec_display_draw_sprite_at(struct cpu* cpu, Word opcode)
+static void exec_display_draw_sprite_at(struct cpu* cpu, const struct instruction* instruction)
 {
     // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
     //
@@ -869,9 +1139,9 @@ static void exec_display_draw_sprite_at(struct cpu* cpu, Word opcode)
     //
     // These sprites are 5 bytes long, or 8 (bits of each byte) x 5 (height, byte count) pixels
     //
-    Register x = opcode_decode_register_x(opcode);
-    Register y = opcode_decode_register_y(opcode);
-    Const value = opcode_decode_const_4bit(opcode);
+    Register x = instruction->x;
+    Register y = instruction->y;
+    Const value = instruction->n;
 
     // You can retrieve the color/value of a specific pixel in an SDL_Surface by using the SDL_GetRGB
     // https://stackoverflow.com/questions/53033971/how-to-get-the-color-of-a-specific-pixel-from-sdl-surface
@@ -888,37 +1158,37 @@ static void exec_display_draw_sprite_at(struct cpu* cpu, Word opcode)
     cpu->registers[VF] = pixel_erased ? 1 : 0;
 }
 
-static void exec_if_key_equals_to_vx(struct cpu* cpu, Word opcode)
+static void exec_if_key_equals_to_vx(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     if (keyboard_is_key_pressed(cpu->registers[x])) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_if_key_not_equals_to_vx(struct cpu* cpu, Word opcode)
+static void exec_if_key_not_equals_to_vx(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     if (!keyboard_is_key_pressed(cpu->registers[x])) {
         cpu_pc_advance(cpu);
     }
 }
 
-static void exec_set_vx_from_delay_timer(struct cpu* cpu, Word opcode)
+static void exec_set_vx_from_delay_timer(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     cpu->registers[x] = timer_get_value(cpu->delay_timer);
 }
 
-static void exec_set_vx_from_key(struct cpu* cpu, Word opcode)
+static void exec_set_vx_from_key(struct cpu* cpu, const struct instruction* instruction)
 {
     // Wait for a key press, store the value of the key in Vx.
     // All execution stops until a key is pressed, then the value of that key is stored in Vx.
     //
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
     KeyValue key;
     if (keyboard_get_pressed_key(&key)) {
         cpu->registers[x] = key;
@@ -927,39 +1197,39 @@ static void exec_set_vx_from_key(struct cpu* cpu, Word opcode)
     }
 }
 
-static void exec_set_delay_timer_from_vx(struct cpu* cpu, Word opcode)
+static void exec_set_delay_timer_from_vx(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     timer_set_value(cpu->delay_timer, cpu->registers[x]);
 }
 
-static void exec_set_sound_timer(struct cpu* cpu, Word opcode)
+static void exec_set_sound_timer(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     timer_set_value(cpu->sound_timer, cpu->registers[x]);
 }
 
-static void exec_add_vx_to_i(struct cpu* cpu, Word opcode)
+static void exec_add_vx_to_i(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     cpu->i += cpu->registers[x];
 }
 
-static void exec_set_i_to_sprite_addr(struct cpu* cpu, Word opcode)
+static void exec_set_i_to_sprite_addr(struct cpu* cpu, const struct instruction* instruction)
 {
     // Set I = location of sprite for digit Vx.
     // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
     // See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
     Const sprite_value = cpu->registers[x];
     Address sprite_addr = memory_address_from_sprite_value(sprite_value);
     cpu->i = sprite_addr;
 }
 
-static void exec_set_bcd(struct cpu* cpu, Word opcode)
+static void exec_set_bcd(struct cpu* cpu, const struct instruction* instruction)
 {
     // Store BCD representation of Vx in memory locations I, I+1, and I+2.
     // 
@@ -972,28 +1242,34 @@ static void exec_set_bcd(struct cpu* cpu, Word opcode)
     //              +-> MEM[I  ] = 2
     //              +-> MEM[I+1] = 5
     //              +-> MEM[I+2] = 4
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
     Register hundreds = (cpu->registers[x] % 1000) / 100;  // 2
     Register tens     = (cpu->registers[x] %  100) /  10;  // 5
     Register ones     = (cpu->registers[x] %   10) /   1;  // 4
     cpu->memory[cpu->i    ] = hundreds;
     cpu->memory[cpu->i + 1] = tens;
     cpu->memory[cpu->i + 2] = ones;
+
+    // the program may have overwritten its own code
+    cpu_invalidate_instructions(cpu, cpu->i, 3);
 }
 
-static void exec_reg_dump(struct cpu* cpu, Word opcode)
+static void exec_reg_dump(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     Address addr = cpu->i;
     for (Register i = 0; i <= x; i++, addr++) {
         cpu->memory[addr] = cpu->registers[i];
     }
+
+    // the program may have overwritten its own code
+    cpu_invalidate_instructions(cpu, cpu->i, x + 1);
 }
 
-static void exec_reg_load(struct cpu* cpu, Word opcode)
+static void exec_reg_load(struct cpu* cpu, const struct instruction* instruction)
 {
-    Register x = opcode_decode_register_x(opcode);
+    Register x = instruction->x;
 
     Address addr = cpu->i;
     for (Register i = 0; i <= x; i++, addr++) {
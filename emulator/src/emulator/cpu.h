@@ -5,11 +5,67 @@
 
 #include "memory.h"
 #include "register.h"
+#include "opcode.h"
 
 #define STACK_CAPACITY 12
 
 struct display;
 struct timer;
+struct trace;
+struct cpu;
+struct instruction;
+
+/**
+ * @brief The signature shared by every opcode implementation function
+ */
+typedef void (*InstructionHandler)(struct cpu* cpu, const struct instruction* instruction);
+
+/**
+ * @brief How the CPU decodes its instructions. Only the cached one is meant to run programs: the others are kept to
+ * measure what the instruction cache and the dispatch tables bring (see the bench command)
+ */
+enum cpu_decoder {
+    /**
+     * @brief Through the dispatch tables, the first time an address is executed only (the default)
+     */
+    CPU_DECODER_CACHED = 0,
+    /**
+     * @brief Through the dispatch tables, every time an instruction is executed
+     */
+    CPU_DECODER_TABLE,
+    /**
+     * @brief By comparing the opcode against the mask of every instruction in turn, every time an instruction is
+     * executed (how the CPU decoded before the dispatch tables)
+     */
+    CPU_DECODER_CHAIN,
+};
+
+/**
+ * @brief An instruction decoded once, the first time it is executed, and cached by its address.
+ *
+ * Every operand is extracted, whatever the instruction: each handler uses the ones it needs.
+ */
+struct instruction {
+    /**
+     * @brief The implementation of the instruction. NULL when the address was not decoded yet (or was overwritten)
+     */
+    InstructionHandler handler;
+    Word opcode;
+    /**
+     * @brief The nnn operand (lowest 12 bits)
+     */
+    Address address;
+    Register x;
+    Register y;
+    /**
+     * @brief The kk operand (lowest byte)
+     */
+    Const kk;
+    /**
+     * @brief The n operand (lowest nibble)
+     */
+    Const n;
+};
 
 struct cpu {
     //NOTE until we check if it's worth implementing bus and/or a memory data structure, we have this...
@@ -18,6 +74,11 @@ struct cpu {
     struct timer* delay_timer;
     struct timer* sound_timer;
 
+    /**
+     * @brief Where every executed instruction is recorded. NULL when tracing is disabled
+     */
+    struct trace* trace;
+
     /**
      * @brief General Purpose Registers (GPR's). The spec calls this 'V' (V0 to VF)
      */
@@ -35,11 +96,40 @@ struct cpu {
      */
     Address stack[STACK_CAPACITY];
     size_t stack_count;
+
+    /**
+     * @brief The decoded instructions by their address, so that an instruction executed again is not fetched and
+     * decoded again. Entries are invalidated when the memory they were decoded from is written to.
+     */
+    struct instruction instructions[MEMORY_SIZE];
+    enum cpu_decoder decoder;
 };
 
-void cpu_init(struct cpu* cpu, uint8_t* memory, struct display* display, struct timer* delay_timer, struct timer* sound_timer);
+/**
+ * @brief Initializes the CPU
+ * 
+ * @param trace Where to record the executed instructions (only when built with ENABLE_CPU_TRACE). NULL to disable it
+ */
+void cpu_init(struct cpu* cpu,
+              uint8_t* memory,
+              struct display* display,
+              struct timer* delay_timer,
+              struct timer* sound_timer,
+              struct trace* trace);
 
 /**
  * @brief Executes a single instruction.
+ * 
+ * @return Word The Opcode executed
+ */
+Word cpu_step(struct cpu* cpu);
+
+/**
+ * @brief Invalidates the decoded instructions of a range of memory, which must be done whenever it is written to
+ * outside of the CPU (the CPU takes care of its own writes).
+ * 
+ * @param cpu 
+ * @param address The first address written to
+ * @param size The number of bytes written
  */
-void cpu_step(struct cpu* cpu);
+void cpu_invalidate_instructions(struct cpu* cpu, Address address, size_t size);
@@ -0,0 +1,138 @@
+/**
+ * Tests of the decoded instruction cache of the CPU: a program overwriting an instruction it already executed (with
+ * Fx55 or Fx33) must run the new instruction the next time, not the one decoded before.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cpu.h"
+#include "memory.h"
+#include "display.h"
+#include "timer.h"
+#include "test.h"
+
+#define ARRAY_LEN(XS) (sizeof(XS) / sizeof((XS)[0]))
+
+static uint8_t memory[MEMORY_SIZE];
+static struct display display;
+static struct timer delay_timer;
+static struct timer sound_timer;
+static struct cpu cpu;
+
+/**
+ * @brief Resets the CPU and loads the given opcodes at |address|
+ */
+static void load(Address address, const Word* opcodes, size_t opcode_count)
+{
+    for (size_t i = 0; i < opcode_count; i++) {
+        memory[address + 2 * i] = (uint8_t) (opcodes[i] >> 8);
+        memory[address + 2 * i + 1] = (uint8_t) (opcodes[i] & 0xFF);
+    }
+    cpu_invalidate_instructions(&cpu, address, 2 * opcode_count);
+}
+
+/**
+ * @brief Runs |count| instructions from |pc|
+ */
+static Word run(Address pc, size_t count)
+{
+    Word opcode = 0;
+    cpu.pc = pc;
+    for (size_t i = 0; i < count; i++) {
+        opcode = cpu_step(&cpu);
+    }
+    return opcode;
+}
+
+static void setup(void)
+{
+    memset(memory, 0, sizeof(memory));
+    cpu_init(&cpu, memory, &display, &delay_timer, &sound_timer, NULL);
+}
+
+/**
+ * @brief Fx55 stores registers over an instruction that was decoded already
+ */
+static void test_reg_dump_over_executed_instruction(void)
+{
+    setup();
+
+    // the target, then the code rewriting it into 6577 (LD V5, 0x77) before jumping back to it
+    const Word target[] = { 0x6542 };
+    const Word writer[] = { 0xA300, 0x6065, 0x6177, 0xF155, 0x1300 };
+    load(0x300, target, 1);
+    load(0x200, writer, ARRAY_LEN(writer));
+
+    CHECK(run(0x300, 1) == 0x6542);
+    CHECK(cpu.registers[5] == 0x42);
+
+    CHECK(run(0x200, ARRAY_LEN(writer)) == 0x1300);
+    CHECK(cpu.pc == 0x300);
+    CHECK(memory[0x300] == 0x65 && memory[0x301] == 0x77);
+
+    CHECK(run(0x300, 1) == 0x6577);
+    CHECK(cpu.registers[5] == 0x77);
+}
+
+/**
+ * @brief Fx33 stores a BCD over the second byte of an instruction that was decoded already (the write starts one byte
+ * after the instruction)
+ */
+static void test_bcd_over_executed_instruction(void)
+{
+    setup();
+
+    // 6100 (LD V1, 0) becomes 6102 (LD V1, 2) with the hundreds of 254 written at 0x301
+    const Word target[] = { 0x6100 };
+    const Word writer[] = { 0xA301, 0x62FE, 0xF233, 0x1300 };
+    load(0x300, target, 1);
+    load(0x200, writer, ARRAY_LEN(writer));
+
+    CHECK(run(0x300, 1) == 0x6100);
+    CHECK(cpu.registers[1] == 0);
+
+    CHECK(run(0x200, ARRAY_LEN(writer)) == 0x1300);
+    CHECK(memory[0x301] == 2 && memory[0x302] == 5 && memory[0x303] == 4);
+
+    CHECK(run(0x300, 1) == 0x6102);
+    CHECK(cpu.registers[1] == 2);
+}
+
+/**
+ * @brief An instruction overwritten by itself: Fx55 storing over its own address runs the new code the next time
+ */
+static void test_reg_dump_over_itself(void)
+{
+    setup();
+
+    // F155 at 0x202 stores V0 V1 over itself (6A2A: LD VA, 0x2A), and 1202 jumps back there
+    const Word program[] = { 0xA202, 0xF155, 0x1202 };
+    load(0x200, program, ARRAY_LEN(program));
+    cpu.registers[0] = 0x6A;
+    cpu.registers[1] = 0x2A;
+
+    CHECK(run(0x200, 3) == 0x1202);
+    CHECK(run(0x202, 1) == 0x6A2A);
+    CHECK(cpu.registers[0xA] == 0x2A);
+}
+
+int main(void)
+{
+    display_init_headless(&display);
+    timer_init(&delay_timer);
+    timer_init(&sound_timer);
+
+    test_reg_dump_over_executed_instruction();
+    test_bcd_over_executed_instruction();
+    test_reg_dump_over_itself();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all cpu checks passed\n");
+    return 0;
+}
@@ -5,21 +5,38 @@
 #include <SDL2/SDL.h>
 
 #include "memory.h"
-#include "utils/bits.h"
 #include "logging/logger.h"
 
 #define LOG_TAG "display"
 
 static void init_sdl(struct display* d);
 
+/**
+ * @brief Rotates a row to the right, the rightmost pixels wrapping around to the left edge
+ */
+static DisplayRow display_row_rotate_right(DisplayRow row, uint8_t count);
+
 void display_init(struct display* d)
 {
+    d->headless = false;
     init_sdl(d);
     display_clear(d);
 }
 
+void display_init_headless(struct display* d)
+{
+    d->window = NULL;
+    d->renderer = NULL;
+    d->headless = true;
+    display_clear(d);
+}
+
 void display_free(struct display* d)
 {
+    if (d->headless) {
+        return;
+    }
+
     SDL_DestroyRenderer(d->renderer);
     SDL_DestroyWindow(d->window);
     SDL_Quit();
@@ -29,11 +46,15 @@ void display_clear(struct display* d)
 {
     // SDL_SetRenderDrawColor(d->renderer, 0, 0, 0, 0);
     // SDL_RenderClear(d->renderer);
-    memset(d->buffer, 0, sizeof(d->buffer));
+    memset(d->rows, 0, sizeof(d->rows));
 }
 
 void display_render(struct display* d)
 {
+    if (d->headless) {
+        return;
+    }
+
     // Background
     SDL_SetRenderDrawColor(d->renderer, 0, 0, 0, 0);
     SDL_RenderClear(d->renderer);
@@ -45,7 +66,7 @@ void display_render(struct display* d)
 
     for (uint8_t i = 0; i < DISPLAY_WIDTH; i++) {
         for (uint8_t j = 0; j < DISPLAY_HEIGHT; j++) {
-            Pixel pixel = d->buffer[i][j];
+            Pixel pixel = display_get_pixel(d, i, j);
 
             r.x = i * DISPLAY_SCALE + 0 * DISPLAY_SCALE;
             r.y = j * DISPLAY_SCALE;
@@ -63,6 +84,10 @@ void display_render(struct display* d)
 
 void display_render_flush(struct display* d)
 {
+    if (d->headless) {
+        return;
+    }
+
     SDL_RenderPresent(d->renderer);
 }
 
@@ -105,27 +130,25 @@ bool display_draw_sprite(struct display* d, Register x, Register y, uint8_t* spr
 {
     uint8_t pixel_x = x % DISPLAY_WIDTH;
     uint8_t pixel_y = y % DISPLAY_HEIGHT;
-    
-    bool pixel_erased = false;
-
-    for (uint8_t i = 0; i < sprite_len; i++, pixel_y = (pixel_y + 1) % DISPLAY_HEIGHT) {
-        uint8_t sprite_byte = sprite[i];
-        uint8_t offset_x = 0;
 
-        for (int8_t bit = 7; bit >= 0; bit--, offset_x++) {
-            Pixel new_pixel = bit_is_set(sprite_byte, bit);
-            Pixel* current_pixel = &d->buffer[(pixel_x + offset_x) % DISPLAY_WIDTH][pixel_y];
+    // the 8 columns covered by the sprite
+    DisplayRow window = display_row_rotate_right((DisplayRow) 0xFF << (DISPLAY_WIDTH - 8), pixel_x);
+    DisplayRow erased = 0;
 
-            if (*current_pixel && !new_pixel) {
-                pixel_erased = true;
-            }
-            // if (*current_pixel != new_pixel) {
-            //     pixel_erased = true;
-            // }
+    for (uint8_t i = 0; i < sprite_len; i++, pixel_y = (pixel_y + 1) % DISPLAY_HEIGHT) {
+        // the sprite byte as the leftmost 8 pixels of a row, then moved to its column
+        DisplayRow line = display_row_rotate_right((DisplayRow) sprite[i] << (DISPLAY_WIDTH - 8), pixel_x);
 
-            *current_pixel ^= new_pixel;
-        }
+        // a pixel counts as erased when it is set on the screen and unset in the sprite (within its 8 columns)
+        erased |= d->rows[pixel_y] & ~line & window;
+        d->rows[pixel_y] ^= line;
     }
 
-    return pixel_erased;
+    return erased != 0;
+}
+
+static DisplayRow display_row_rotate_right(DisplayRow row, uint8_t count)
+{
+    // count is in [0, DISPLAY_WIDTH): the mask avoids shifting by the width (undefined) when it is 0
+    return (row >> count) | (row << ((DISPLAY_WIDTH - count) & (DISPLAY_WIDTH - 1)));
 }
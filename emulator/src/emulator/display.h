@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
 
 #include <SDL2/SDL.h>
 
@@ -16,17 +18,52 @@
  */
 typedef bool Pixel;
 
+/**
+ * @brief A row of pixels, one bit each. The leftmost pixel (x = 0) is the most significant bit
+ */
+typedef uint64_t DisplayRow;
+static_assert(sizeof(DisplayRow) * CHAR_BIT == DISPLAY_WIDTH, "a display row must hold exactly one bit per pixel");
+
 struct display {
-    Pixel buffer[DISPLAY_WIDTH][DISPLAY_HEIGHT];
+    /**
+     * @brief The screen, row by row: drawing a sprite line is a single XOR (and its collision a single AND)
+     */
+    DisplayRow rows[DISPLAY_HEIGHT];
     SDL_Window* window;
     SDL_Renderer* renderer;
+
+    /**
+     * @brief No SDL window nor renderer: sprites are drawn to the buffer, which is never rendered
+     */
+    bool headless;
 };
 
 void display_init(struct display* d);
+
+/**
+ * @brief Initializes a display without SDL, for running programs with no screen at all (see machine_bench)
+ */
+void display_init_headless(struct display* d);
 void display_free(struct display* d);
 
 void display_clear(struct display* d);
 void display_render(struct display* d);
 void display_render_flush(struct display* d);
 
+/**
+ * @brief XORs a sprite onto the screen at (x, y), wrapping around its edges.
+ * 
+ * @param d 
+ * @param x The column of the leftmost pixel of the sprite (modulo DISPLAY_WIDTH)
+ * @param y The row of the first line of the sprite (modulo DISPLAY_HEIGHT)
+ * @param sprite One byte per line, 8 pixels wide, the most significant bit being the leftmost pixel
+ * @param sprite_len The number of lines of the sprite
+ * @return The collision flag: true if a pixel of the screen is set where a sprite pixel is unset, within the 8
+ *         columns of the sprite. false otherwise
+ */
 bool display_draw_sprite(struct display* d, Register x, Register y, uint8_t* sprite, uint8_t sprite_len);
+
+static inline Pixel display_get_pixel(const struct display* d, uint8_t x, uint8_t y)
+{
+    return (d->rows[y] >> (DISPLAY_WIDTH - 1 - x)) & 1;
+}
@@ -0,0 +1,195 @@
+/**
+ * Tests of display_draw_sprite on the bit-packed rows: every pixel and the collision flag (VF) must be the same as
+ * with the former implementation, a Pixel per byte drawn bit by bit, which is kept here as the reference. Sprites are
+ * drawn at every position (so wrapping around both edges), over random screens.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "display.h"
+#include "test.h"
+
+/**
+ * @brief The screen as it used to be stored: a Pixel per byte, column-major
+ */
+struct reference_display {
+    Pixel buffer[DISPLAY_WIDTH][DISPLAY_HEIGHT];
+};
+
+/**
+ * @brief The former display_draw_sprite, pixel by pixel
+ */
+static bool reference_draw_sprite(struct reference_display* d, uint8_t x, uint8_t y, const uint8_t* sprite,
+                                  uint8_t sprite_len)
+{
+    uint8_t pixel_x = x % DISPLAY_WIDTH;
+    uint8_t pixel_y = y % DISPLAY_HEIGHT;
+
+    bool pixel_erased = false;
+
+    for (uint8_t i = 0; i < sprite_len; i++, pixel_y = (pixel_y + 1) % DISPLAY_HEIGHT) {
+        uint8_t offset_x = 0;
+
+        for (int8_t bit = 7; bit >= 0; bit--, offset_x++) {
+            Pixel new_pixel = (sprite[i] >> bit) & 1;
+            Pixel* current_pixel = &d->buffer[(pixel_x + offset_x) % DISPLAY_WIDTH][pixel_y];
+
+            if (*current_pixel && !new_pixel) {
+                pixel_erased = true;
+            }
+            *current_pixel ^= new_pixel;
+        }
+    }
+
+    return pixel_erased;
+}
+
+/**
+ * @brief xorshift32: the same sequence on every run
+ */
+static uint32_t next_random(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool same_pixels(const struct display* d, const struct reference_display* reference)
+{
+    for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+        for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+            if (display_get_pixel(d, x, y) != reference->buffer[x][y]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void test_draw_and_erase(void)
+{
+    struct display d;
+    display_init_headless(&d);
+
+    // the font's "0"
+    uint8_t sprite[] = { 0xF0, 0x90, 0x90, 0x90, 0xF0 };
+
+    CHECK(!display_draw_sprite(&d, 0, 0, sprite, sizeof(sprite)));
+    CHECK(display_get_pixel(&d, 0, 0));
+    CHECK(display_get_pixel(&d, 3, 0));
+    CHECK(!display_get_pixel(&d, 4, 0));
+    CHECK(!display_get_pixel(&d, 1, 1));
+    CHECK(display_get_pixel(&d, 3, 4));
+
+    // the "0" is set where the next one is not: at its own hole
+    CHECK(display_draw_sprite(&d, 1, 0, sprite, sizeof(sprite)));
+    CHECK(!display_get_pixel(&d, 1, 0));
+    CHECK(display_get_pixel(&d, 0, 0));
+    CHECK(display_get_pixel(&d, 4, 0));
+
+    // drawing both again erases them
+    display_draw_sprite(&d, 1, 0, sprite, sizeof(sprite));
+    display_draw_sprite(&d, 0, 0, sprite, sizeof(sprite));
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+        CHECK(d.rows[y] == 0);
+    }
+
+    // pixels outside of the 8 columns of the sprite never count
+    uint8_t line = 0xFF;
+    CHECK(!display_draw_sprite(&d, 0, 0, &line, 1));
+    CHECK(!display_draw_sprite(&d, 8, 0, &line, 1));
+    CHECK(!display_draw_sprite(&d, 16, 0, sprite, 0));
+
+    display_free(&d);
+}
+
+static void test_wrap_around(void)
+{
+    struct display d;
+    display_init_headless(&d);
+
+    uint8_t sprite[] = { 0xFF, 0x81 };
+
+    // 4 pixels on each side of the right edge, and the second line on the first row
+    CHECK(!display_draw_sprite(&d, DISPLAY_WIDTH - 4, DISPLAY_HEIGHT - 1, sprite, sizeof(sprite)));
+    CHECK(display_get_pixel(&d, DISPLAY_WIDTH - 4, DISPLAY_HEIGHT - 1));
+    CHECK(display_get_pixel(&d, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1));
+    CHECK(display_get_pixel(&d, 0, DISPLAY_HEIGHT - 1));
+    CHECK(display_get_pixel(&d, 3, DISPLAY_HEIGHT - 1));
+    CHECK(!display_get_pixel(&d, 4, DISPLAY_HEIGHT - 1));
+    CHECK(display_get_pixel(&d, DISPLAY_WIDTH - 4, 0));
+    CHECK(!display_get_pixel(&d, DISPLAY_WIDTH - 3, 0));
+    CHECK(display_get_pixel(&d, 3, 0));
+
+    // the coordinates themselves wrap around
+    display_draw_sprite(&d, 2 * DISPLAY_WIDTH - 4, 2 * DISPLAY_HEIGHT - 1, sprite, sizeof(sprite));
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+        CHECK(d.rows[y] == 0);
+    }
+
+    display_free(&d);
+}
+
+static void test_same_as_reference(void)
+{
+    struct display d;
+    display_init_headless(&d);
+
+    struct reference_display reference;
+    memset(&reference, 0, sizeof(reference));
+
+    uint32_t state = 0x2545F491;
+    uint8_t sprite[15];
+
+    size_t collisions = 0;
+    for (size_t round = 0; round < 20000; round++) {
+        for (size_t i = 0; i < sizeof(sprite); i++) {
+            sprite[i] = (uint8_t) next_random(&state);
+        }
+        // Vx and Vy are bytes: beyond the screen too
+        uint8_t x = (uint8_t) next_random(&state);
+        uint8_t y = (uint8_t) next_random(&state);
+        uint8_t len = (uint8_t) (next_random(&state) % (sizeof(sprite) + 1));
+
+        bool erased = display_draw_sprite(&d, x, y, sprite, len);
+        bool expected = reference_draw_sprite(&reference, x, y, sprite, len);
+        CHECK(erased == expected);
+        collisions += expected ? 1 : 0;
+
+        if (!same_pixels(&d, &reference)) {
+            fprintf(stderr, "screens differ after drawing %u lines at (%u, %u)\n", len, x, y);
+            test_failures++;
+            break;
+        }
+
+        // from time to time, start over from a blank screen (as CLS does)
+        if (round % 64 == 63) {
+            display_clear(&d);
+            memset(&reference, 0, sizeof(reference));
+        }
+    }
+
+    // both outcomes were checked
+    CHECK(collisions > 0);
+    CHECK(collisions < 20000);
+
+    display_free(&d);
+}
+
+int main(void)
+{
+    test_draw_and_erase();
+    test_wrap_around();
+    test_same_as_reference();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all display checks passed\n");
+    return 0;
+}
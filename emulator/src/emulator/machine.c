@@ -15,15 +15,31 @@
 #include "commons/buffer.h"
 #include "opcode.h"
 #include "disassembler.h"
+#include "profiler.h"
+#include "utils/math.h"
 #include "logging/logger.h"
 
 #define PROGRAM_MAX_SIZE (MEMORY_SIZE - MEMORY_PROGRAM_STARTING_ADDRESS)
 
+// The rate of the timers (and of the frames run by machine_bench)
+#define FRAME_RATE_HZ 60
+
 #define LOG_TAG "machine"
 
 static Word machine_first_opcode(struct machine* m);
+static void machine_init_with_display(struct machine* m, bool headless);
 
 void machine_init(struct machine* m)
+{
+    machine_init_with_display(m, false);
+}
+
+void machine_init_headless(struct machine* m)
+{
+    machine_init_with_display(m, true);
+}
+
+static void machine_init_with_display(struct machine* m, bool headless)
 {
     log_info("initializing...");
 
@@ -35,9 +51,23 @@ void machine_init(struct machine* m)
 
     memory_init(m->memory);
 
-    display_init(&m->display);
+    if (headless) {
+        display_init_headless(&m->display);
+    } else {
+        display_init(&m->display);
+    }
+
+    struct trace* trace = NULL;
+    if (config()->cpu_trace) {
+#ifdef ENABLE_CPU_TRACE
+        trace_init(&m->trace);
+        trace = &m->trace;
+#else
+        log_warn("CPU_TRACE is ignored: the emulator was built without ENABLE_CPU_TRACE");
+#endif
+    }
 
-    cpu_init(&m->cpu, m->memory, &m->display, &m->delay_timer, &m->sound_timer);
+    cpu_init(&m->cpu, m->memory, &m->display, &m->delay_timer, &m->sound_timer, trace);
 
     log_info("initialization succeeded");
 }
@@ -64,6 +94,7 @@ void machine_load_rom(struct machine* m, const char* rom_file_path)
 
     // copy program rom bytes to memory area beginning at the correct starting offset
     memcpy(&m->memory[MEMORY_PROGRAM_STARTING_ADDRESS], rom.data, rom.capacity);
+    cpu_invalidate_instructions(&m->cpu, MEMORY_PROGRAM_STARTING_ADDRESS, PROGRAM_MAX_SIZE);
 
     buffer_free(&rom);
 }
@@ -118,6 +149,9 @@ void machine_run(struct machine* m)
                         if (event.key.keysym.sym == SDLK_ESCAPE) {
                             goto loop_exit;
                         }
+                        if (event.key.keysym.sym == SDLK_F12 && m->cpu.trace != NULL) {
+                            trace_dump(m->cpu.trace, stderr);
+                        }
                     } break;
 
                     default:
@@ -181,6 +215,72 @@ loop_exit:
     log_info("finishing emulation...");
 }
 
+void machine_bench(struct machine* m, FILE* file)
+{
+    const struct config* cfg = config();
+    const uint64_t instructions_per_frame = MAX(cfg->cpu_clock_speed_hz / FRAME_RATE_HZ, 1);
+    const uint64_t instruction_limit = cfg->bench_frame_count > 0
+        ? cfg->bench_frame_count * instructions_per_frame
+        : cfg->bench_instruction_count;
+
+    // too big for the stack (a counter per opcode)
+    struct profiler* profiler = malloc(sizeof(*profiler));
+    if (profiler == NULL) {
+        log_error("bench: failed to allocate the profiler");
+        exit(1);
+    }
+    profiler_init(profiler);
+
+    static const char* const decoder_names[] = {
+        [CPU_DECODER_CACHED] = "cached",
+        [CPU_DECODER_TABLE] = "table",
+        [CPU_DECODER_CHAIN] = "chain",
+    };
+    m->cpu.decoder = cfg->bench_decoder;
+
+    log_infof("bench: running %llu instructions...", (unsigned long long) instruction_limit);
+
+    uint64_t frame_count = 0;
+    uint64_t frame_instructions_left = instructions_per_frame;
+
+    uint64_t start_time_moment = SDL_GetPerformanceCounter();
+    while (profiler->instruction_count < instruction_limit) {
+        Word opcode = cpu_step(&m->cpu);
+        profiler_record(profiler, opcode);
+
+        // emulated time, not the wall clock: the programs waiting on their timers behave as if paced
+        if (--frame_instructions_left == 0) {
+            timer_tick(&m->delay_timer);
+            timer_tick(&m->sound_timer);
+            frame_count++;
+            frame_instructions_left = instructions_per_frame;
+        }
+    }
+    uint64_t end_time_moment = SDL_GetPerformanceCounter();
+
+    double elapsed_time_s = (double) (end_time_moment - start_time_moment) / SDL_GetPerformanceFrequency();
+    if (elapsed_time_s <= 0) {
+        elapsed_time_s = 1.0 / SDL_GetPerformanceFrequency();
+    }
+    double instructions_per_s = (double) profiler->instruction_count / elapsed_time_s;
+
+    fprintf(file, "instructions...: %llu\n", (unsigned long long) profiler->instruction_count);
+    fprintf(file, "frames.........: %llu (%llu instructions each)\n",
+            (unsigned long long) frame_count, (unsigned long long) instructions_per_frame);
+    fprintf(file, "decoder........: %s\n", decoder_names[m->cpu.decoder]);
+    fprintf(file, "elapsed time...: %.3lf s\n", elapsed_time_s);
+    fprintf(file, "speed..........: %.2lf MIPS (%.0lfx real time at %u Hz)\n",
+            instructions_per_s / 1e6, instructions_per_s / cfg->cpu_clock_speed_hz, cfg->cpu_clock_speed_hz);
+    fprintf(file, "\n");
+    profiler_print_histogram(profiler, file);
+
+    if (m->cpu.trace != NULL) {
+        trace_dump(m->cpu.trace, stderr);
+    }
+
+    free(profiler);
+}
+
 static Word machine_first_opcode(struct machine* m)
 {
     Address addr = MEMORY_PROGRAM_STARTING_ADDRESS;
@@ -8,6 +8,7 @@
 #include "cpu.h"
 #include "display.h"
 #include "timer.h"
+#include "trace.h"
 
 #define STACK_CAPACITY 12
 
@@ -17,11 +18,30 @@ struct machine {
     struct display display;
     struct timer delay_timer;
     struct timer sound_timer;
+    struct trace trace;
 };
 
 void machine_init(struct machine* m);
+
+/**
+ * @brief Initializes the machine without SDL: no window is ever opened (see display_init_headless)
+ */
+void machine_init_headless(struct machine* m);
 void machine_free(struct machine* m);
 
 void machine_load_rom(struct machine* m, const char* rom_file_path);
 void machine_disassemble(struct machine* m, FILE* file);
 void machine_run(struct machine* m);
+
+/**
+ * @brief Runs the loaded program as fast as possible, with no pacing, no rendering and no input, then reports the
+ * emulation speed and how many times each instruction was executed.
+ * 
+ * It runs config()->bench_frame_count frames or, when 0, config()->bench_instruction_count instructions.
+ * Timers are ticked every frame (1/60s of emulated time at config()->cpu_clock_speed_hz), not by the wall clock,
+ * so a program waiting on its delay timer runs the same whatever the host speed.
+ * 
+ * @param m The machine. It should be headless (see machine_init_headless)
+ * @param file Where the report is printed to
+ */
+void machine_bench(struct machine* m, FILE* file);
@@ -19,6 +19,7 @@
 enum cli_command {
     CLI_COMMAND_DISASSEMBLE,
     CLI_COMMAND_RUN,
+    CLI_COMMAND_BENCH,
 };
 
 static const char usage[] =
@@ -30,6 +31,10 @@ static const char usage[] =
     "        Load and run the Chip-8 program rom at ROM_PATH\n"
     "    disassemble\n"
     "        Load and disassemble the Chip-8 program rom at ROM_PATH\n"
+    "    bench\n"
+    "        Run the Chip-8 program rom at ROM_PATH as fast as possible, without any window,\n"
+    "        then report the emulation speed and how many times each instruction was executed.\n"
+    "        BENCH_INSTRUCTIONS (default: 10000000) or BENCH_FRAMES set how long it runs\n"
     "\n"
     "ROM_PATH:\n"
     "    File path for a Chip-8 Program ROM\n"
@@ -58,7 +63,11 @@ int main(int argc, const char** argv)
     const char* rom_file_path = argv[2];
 
     struct machine machine;
-    machine_init(&machine);
+    if (command == CLI_COMMAND_BENCH) {
+        machine_init_headless(&machine);
+    } else {
+        machine_init(&machine);
+    }
     machine_load_rom(&machine, rom_file_path);
 
     switch (command)
@@ -70,6 +79,10 @@ int main(int argc, const char** argv)
         case CLI_COMMAND_RUN:
             machine_run(&machine);
             break;
+
+        case CLI_COMMAND_BENCH:
+            machine_bench(&machine, stdout);
+            break;
         
         default: assert(false && "unreachable: unknown command");
     }
@@ -85,7 +98,10 @@ int cli_parse_command(const char* arg, enum cli_command* out_command)
     static const char cmd_run[] = "run";
     static const size_t cmd_run_size = sizeof(cmd_run); // this is size, not length
 
-    static const size_t max_arg_size = MAX(cmd_disassemble_size, cmd_run_size);
+    static const char cmd_bench[] = "bench";
+    static const size_t cmd_bench_size = sizeof(cmd_bench); // this is size, not length
+
+    static const size_t max_arg_size = MAX(MAX(cmd_disassemble_size, cmd_run_size), cmd_bench_size);
     
     size_t arg_len = strnlen(arg, max_arg_size);
     if (arg_len >= max_arg_size) {
@@ -103,5 +119,10 @@ int cli_parse_command(const char* arg, enum cli_command* out_command)
         return 0;
     }
 
+    if (strncmp(arg, cmd_bench, cmd_bench_size) == 0) {
+        *out_command = CLI_COMMAND_BENCH;
+        return 0;
+    }
+
     return 1;
 }
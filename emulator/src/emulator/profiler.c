@@ -0,0 +1,111 @@
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief An instruction: the Opcodes matching its pattern once masked.
+ */
+struct profiler_instruction {
+    Word mask;
+    Word pattern;
+    const char* name;
+};
+
+/**
+ * @brief Every instruction, in the order they are matched (the more specific patterns first)
+ */
+static const struct profiler_instruction instructions[] = {
+    { 0xFFFF, 0x00E0, "00E0 - CLS" },
+    { 0xFFFF, 0x00EE, "00EE - RET" },
+    { 0xF000, 0x0000, "0nnn - SYS addr" },
+    { 0xF000, 0x1000, "1nnn - JP addr" },
+    { 0xF000, 0x2000, "2nnn - CALL addr" },
+    { 0xF000, 0x3000, "3xkk - SE Vx, byte" },
+    { 0xF000, 0x4000, "4xkk - SNE Vx, byte" },
+    { 0xF00F, 0x5000, "5xy0 - SE Vx, Vy" },
+    { 0xF000, 0x6000, "6xkk - LD Vx, byte" },
+    { 0xF000, 0x7000, "7xkk - ADD Vx, byte" },
+    { 0xF00F, 0x8000, "8xy0 - LD Vx, Vy" },
+    { 0xF00F, 0x8001, "8xy1 - OR Vx, Vy" },
+    { 0xF00F, 0x8002, "8xy2 - AND Vx, Vy" },
+    { 0xF00F, 0x8003, "8xy3 - XOR Vx, Vy" },
+    { 0xF00F, 0x8004, "8xy4 - ADD Vx, Vy" },
+    { 0xF00F, 0x8005, "8xy5 - SUB Vx, Vy" },
+    { 0xF00F, 0x8006, "8xy6 - SHR Vx" },
+    { 0xF00F, 0x8007, "8xy7 - SUBN Vx, Vy" },
+    { 0xF00F, 0x800E, "8xyE - SHL Vx" },
+    { 0xF00F, 0x9000, "9xy0 - SNE Vx, Vy" },
+    { 0xF000, 0xA000, "Annn - LD I, addr" },
+    { 0xF000, 0xB000, "Bnnn - JP V0, addr" },
+    { 0xF000, 0xC000, "Cxkk - RND Vx, byte" },
+    { 0xF000, 0xD000, "Dxyn - DRW Vx, Vy, nibble" },
+    { 0xF0FF, 0xE09E, "Ex9E - SKP Vx" },
+    { 0xF0FF, 0xE0A1, "ExA1 - SKNP Vx" },
+    { 0xF0FF, 0xF007, "Fx07 - LD Vx, DT" },
+    { 0xF0FF, 0xF00A, "Fx0A - LD Vx, K" },
+    { 0xF0FF, 0xF015, "Fx15 - LD DT, Vx" },
+    { 0xF0FF, 0xF018, "Fx18 - LD ST, Vx" },
+    { 0xF0FF, 0xF01E, "Fx1E - ADD I, Vx" },
+    { 0xF0FF, 0xF029, "Fx29 - LD F, Vx" },
+    { 0xF0FF, 0xF033, "Fx33 - LD B, Vx" },
+    { 0xF0FF, 0xF055, "Fx55 - LD [I], Vx" },
+    { 0xF0FF, 0xF065, "Fx65 - LD Vx, [I]" },
+};
+
+#define INSTRUCTION_COUNT (sizeof(instructions) / sizeof(instructions[0]))
+
+struct profiler_histogram_entry {
+    const char* name;
+    uint64_t count;
+};
+
+static int profiler_histogram_entry_compare(const void* a, const void* b);
+
+void profiler_init(struct profiler* p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+void profiler_print_histogram(const struct profiler* p, FILE* file)
+{
+    // the last entry collects the opcodes matching no instruction
+    struct profiler_histogram_entry histogram[INSTRUCTION_COUNT + 1] = {0};
+    for (size_t i = 0; i < INSTRUCTION_COUNT; i++) {
+        histogram[i].name = instructions[i].name;
+    }
+    histogram[INSTRUCTION_COUNT].name = "unsupported";
+
+    for (uint32_t opcode = 0; opcode <= WORD_MAX; opcode++) {
+        uint64_t count = p->opcode_counts[opcode];
+        if (count == 0) {
+            continue;
+        }
+
+        size_t i = 0;
+        while (i < INSTRUCTION_COUNT && (opcode & instructions[i].mask) != instructions[i].pattern) {
+            i++;
+        }
+        histogram[i].count += count;
+    }
+
+    qsort(histogram, INSTRUCTION_COUNT + 1, sizeof(histogram[0]), profiler_histogram_entry_compare);
+
+    fprintf(file, "%-28s %14s %8s\n", "instruction", "count", "share");
+    for (size_t i = 0; i < INSTRUCTION_COUNT + 1 && histogram[i].count > 0; i++) {
+        double share = 100.0 * (double) histogram[i].count / (double) p->instruction_count;
+        fprintf(file, "%-28s %14llu %7.2lf%%\n", histogram[i].name, (unsigned long long) histogram[i].count, share);
+    }
+}
+
+static int profiler_histogram_entry_compare(const void* a, const void* b)
+{
+    const struct profiler_histogram_entry* entry_a = a;
+    const struct profiler_histogram_entry* entry_b = b;
+
+    // most executed first
+    if (entry_a->count != entry_b->count) {
+        return entry_a->count < entry_b->count ? 1 : -1;
+    }
+    return strcmp(entry_a->name, entry_b->name);
+}
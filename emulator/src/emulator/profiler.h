@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "opcode.h"
+
+/**
+ * @brief Counts of the executed instructions.
+ *
+ * Every raw Opcode gets its own counter, so recording an instruction costs a single increment.
+ * The counters are only grouped by instruction (8xy4 - ADD Vx, Vy...) when the histogram is printed.
+ */
+struct profiler {
+    uint64_t opcode_counts[WORD_MAX + 1];
+    uint64_t instruction_count;
+};
+
+void profiler_init(struct profiler* p);
+
+/**
+ * @brief Records the execution of an instruction
+ * 
+ * @param p 
+ * @param opcode The Opcode just executed
+ */
+static inline void profiler_record(struct profiler* p, Word opcode)
+{
+    p->opcode_counts[opcode]++;
+    p->instruction_count++;
+}
+
+/**
+ * @brief Prints how many times each instruction was executed, most executed first.
+ * 
+ * @param p 
+ * @param file Where the histogram is printed to
+ */
+void profiler_print_histogram(const struct profiler* p, FILE* file);
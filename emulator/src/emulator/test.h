@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief The checks of the test programs (*.test.c). A failed CHECK is reported on stderr and the test goes on, so
+ *        that a single run lists every failure: main ends with test_failed to turn them into the exit code.
+ */
+
+static size_t test_failures = 0;
+
+#define CHECK(COND)                                                                  \
+    do {                                                                             \
+        if (!(COND)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND); \
+            test_failures++;                                                         \
+        }                                                                            \
+    } while (0)
+
+/**
+ * @brief Reports how many checks failed, if any. Returns true when the test failed
+ */
+static inline bool test_failed(void)
+{
+    if (test_failures == 0) {
+        return false;
+    }
+    fprintf(stderr, "%zu check(s) failed\n", test_failures);
+    return true;
+}
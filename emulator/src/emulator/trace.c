@@ -0,0 +1,35 @@
+#include "trace.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "disassembler.h"
+
+static_assert((TRACE_CAPACITY & (TRACE_CAPACITY - 1)) == 0, "TRACE_CAPACITY must be a power of two");
+
+void trace_init(struct trace* t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void trace_dump(const struct trace* t, FILE* file)
+{
+    struct disassembler disassembler = { .file = file };
+
+    size_t first = t->count > TRACE_CAPACITY ? t->count - TRACE_CAPACITY : 0;
+
+    fprintf(file, "=== execution trace: last %zu of %zu instructions ===\n", t->count - first, t->count);
+    for (size_t n = first; n < t->count; n++) {
+        const struct trace_record* record = &t->records[n & (TRACE_CAPACITY - 1)];
+
+        fprintf(file, ADDRESS_FMT ": OPCODE[" OPCODE_FMT "]: I=" ADDRESS_FMT " V=", record->pc, record->opcode,
+                record->i);
+        for (size_t r = 0; r < REGISTER_COUNT; r++) {
+            fprintf(file, "%02X", record->registers[r]);
+        }
+        fprintf(file, ": ");
+
+        disassembler_disassemble(&disassembler, record->opcode);
+    }
+    fprintf(file, "=== end of execution trace ===\n");
+}
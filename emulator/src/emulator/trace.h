@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "register.h"
+#include "opcode.h"
+
+/**
+ * @brief Number of instructions kept by the trace (a power of two): the oldest ones are overwritten
+ */
+#define TRACE_CAPACITY 1024
+
+/**
+ * @brief The state of the CPU right before an instruction is executed
+ */
+struct trace_record {
+    Address pc;
+    Word opcode;
+    Address i;
+    uint8_t registers[REGISTER_COUNT];
+};
+
+/**
+ * @brief An in-memory ring buffer of the last executed instructions.
+ *
+ * Recording an instruction is a copy of a few bytes: no I/O happens until the trace is dumped, on demand or when the
+ * program crashes. The CPU only records to it when built with ENABLE_CPU_TRACE (see CMakeLists.txt) and configured
+ * with CPU_TRACE=1.
+ */
+struct trace {
+    struct trace_record records[TRACE_CAPACITY];
+
+    /**
+     * @brief Total number of instructions recorded. Only the last TRACE_CAPACITY of them are kept
+     */
+    size_t count;
+};
+
+void trace_init(struct trace* t);
+
+/**
+ * @brief Records the instruction about to be executed
+ * 
+ * @param t 
+ * @param pc The address of the instruction
+ * @param opcode The Opcode of the instruction
+ * @param i The I register
+ * @param registers The general purpose registers (REGISTER_COUNT of them)
+ */
+static inline void trace_record(struct trace* t, Address pc, Word opcode, Address i, const uint8_t* registers)
+{
+    struct trace_record* record = &t->records[t->count & (TRACE_CAPACITY - 1)];
+    record->pc = pc;
+    record->opcode = opcode;
+    record->i = i;
+    for (size_t r = 0; r < REGISTER_COUNT; r++) {
+        record->registers[r] = registers[r];
+    }
+    t->count++;
+}
+
+/**
+ * @brief Prints the recorded instructions, oldest first, disassembled.
+ * 
+ * @param t 
+ * @param file Where the trace is printed to
+ */
+void trace_dump(const struct trace* t, FILE* file);
@@ -0,0 +1,312 @@
+///////////////////////////
+// Interface Declaration //
+///////////////////////////
+#ifndef DYNAMIC_ARRAY_H
+#define DYNAMIC_ARRAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define DYNAMIC_ARRAY_INITIAL_CAPACITY 8
+#define DYNAMIC_ARRAY_GROW_FACTOR      2
+
+/**
+ * uint8_t dynamic array
+ */
+struct dynamic_array {
+
+    /**
+     * Buffer that will hold all the items
+     */
+    uint8_t* items;
+
+    /**
+     * Number of inserted items
+     */
+    size_t length;
+
+    /**
+     * Total items buffer capacity in bytes
+     */
+    size_t capacity;
+};
+
+void dynamic_array_init(struct dynamic_array* self);
+ int dynamic_array_init_with_capacity(struct dynamic_array* self, size_t initial_capacity);
+void dynamic_array_free(struct dynamic_array* self);
+bool dynamic_array_is_full(const struct dynamic_array* self);
+bool dynamic_array_would_overflow(const struct dynamic_array* self, size_t byte_count);
+ int dynamic_array_push_back_byte(struct dynamic_array* self, uint8_t item);
+ int dynamic_array_push_back(struct dynamic_array* self, const uint8_t* buffer, size_t buffer_len);
+ int dynamic_array_ensure_capacity(struct dynamic_array* self, size_t required_capacity);
+
+/**
+ * @brief the growth policy shared by every dynamic array: the capacity at least doubles, so n appends cost O(n)
+ *        copies overall, but it never grows more than that (unless |required_capacity| itself is bigger).
+ *
+ * @return the new capacity or 0 on overflow.
+ */
+static inline size_t dynamic_array_grown_capacity(size_t capacity, size_t required_capacity, size_t item_size)
+{
+    size_t new_capacity = (capacity == 0) ? DYNAMIC_ARRAY_INITIAL_CAPACITY : capacity;
+    while (new_capacity < required_capacity) {
+        if (new_capacity > SIZE_MAX / DYNAMIC_ARRAY_GROW_FACTOR) {
+            new_capacity = required_capacity;
+            break;
+        }
+        new_capacity *= DYNAMIC_ARRAY_GROW_FACTOR;
+    }
+
+    if (new_capacity > SIZE_MAX / item_size) {
+        return 0;
+    }
+    return new_capacity;
+}
+
+/**
+ * Typed dynamic array template.
+ *
+ * DYNAMIC_ARRAY_DEFINE(NAME, T) defines `struct NAME` (items/length/capacity, like struct dynamic_array) and its
+ * static inline functions. Every function that may allocate returns 0 on success and 1 on allocation failure
+ * (the array is left untouched then).
+ *
+ * - NAME_init(self)                      empty array, nothing allocated
+ * - NAME_free(self)
+ * - NAME_clear(self)                     drops every item but keeps the capacity (for reuse without reallocating)
+ * - NAME_reserve(self, capacity)         makes room for |capacity| items in total, exactly
+ * - NAME_push_back(self, item)           amortized O(1)
+ * - NAME_append(self, items, count)      bulk append, at most one reallocation per call
+ * - NAME_shrink_to_fit(self)             releases the unused capacity
+ *
+ * Example:
+ *     DYNAMIC_ARRAY_DEFINE(int_array, int)
+ *
+ *     struct int_array numbers;
+ *     int_array_init(&numbers);
+ *     int_array_push_back(&numbers, 42);
+ *     int_array_free(&numbers);
+ */
+#define DYNAMIC_ARRAY_DEFINE(NAME, T)                                                                                  \
+    struct NAME {                                                                                                      \
+        T* items;                                                                                                      \
+        size_t length;                                                                                                 \
+        size_t capacity;                                                                                               \
+    };                                                                                                                 \
+                                                                                                                       \
+    static inline void NAME##_init(struct NAME* self)                                                                  \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        *self = (struct NAME) { .items = NULL, .length = 0, .capacity = 0 };                                           \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void NAME##_free(struct NAME* self)                                                                  \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        free(self->items);                                                                                             \
+        NAME##_init(self);                                                                                             \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void NAME##_clear(struct NAME* self)                                                                 \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        self->length = 0;                                                                                              \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int NAME##_realloc(struct NAME* self, size_t capacity)                                               \
+    {                                                                                                                  \
+        T* items = (T*) realloc(self->items, capacity * sizeof(T));                                                    \
+        if (items == NULL) {                                                                                           \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        self->items = items;                                                                                           \
+        self->capacity = capacity;                                                                                     \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int NAME##_reserve(struct NAME* self, size_t capacity)                                               \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        if (capacity <= self->capacity) {                                                                              \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        if (capacity > SIZE_MAX / sizeof(T)) {                                                                         \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        return NAME##_realloc(self, capacity);                                                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* makes room for |count| more items following the shared growth policy */                                         \
+    static inline int NAME##_grow(struct NAME* self, size_t count)                                                     \
+    {                                                                                                                  \
+        if (count <= self->capacity - self->length) {                                                                  \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        if (count > SIZE_MAX - self->length) {                                                                         \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        size_t capacity = dynamic_array_grown_capacity(self->capacity, self->length + count, sizeof(T));               \
+        if (capacity == 0) {                                                                                           \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        return NAME##_realloc(self, capacity);                                                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int NAME##_push_back(struct NAME* self, T item)                                                      \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        if (NAME##_grow(self, 1) != 0) {                                                                               \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        self->items[self->length++] = item;                                                                            \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int NAME##_append(struct NAME* self, const T* items, size_t count)                                   \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        assert(items != NULL || count == 0);                                                                           \
+        if (count == 0) {                                                                                              \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        if (NAME##_grow(self, count) != 0) {                                                                           \
+            return 1;                                                                                                  \
+        }                                                                                                              \
+        memcpy(self->items + self->length, items, count * sizeof(T));                                                 \
+        self->length += count;                                                                                         \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int NAME##_shrink_to_fit(struct NAME* self)                                                          \
+    {                                                                                                                  \
+        assert(self != NULL);                                                                                          \
+        if (self->length == self->capacity) {                                                                          \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        if (self->length == 0) {                                                                                       \
+            NAME##_free(self);                                                                                         \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        return NAME##_realloc(self, self->length);                                                                     \
+    }
+
+#endif // DYNAMIC_ARRAY_H
+
+////////////////////////////////
+// Implementation Definitions //
+////////////////////////////////
+#ifdef DYNAMIC_ARRAY_IMPLEMENTATION
+
+void dynamic_array_init(struct dynamic_array* self)
+{
+    assert(self != NULL);
+
+    *self = (struct dynamic_array) {
+        .items = NULL,
+        .capacity = 0,
+        .length = 0,
+    };
+}
+
+int dynamic_array_init_with_capacity(struct dynamic_array* self, size_t initial_capacity)
+{
+    assert(self != NULL);
+    assert(initial_capacity > 0);
+
+    void* buffer = calloc(1, initial_capacity);
+    if (buffer == NULL) {
+        return 1;
+    }
+
+    *self = (struct dynamic_array) {
+        .items = (uint8_t*) buffer,
+        .capacity = initial_capacity,
+        .length = 0,
+    };
+
+    return 0;
+}
+
+void dynamic_array_free(struct dynamic_array* self)
+{
+    assert(self != NULL);
+
+    if (self->items) {
+        free(self->items);
+        self->items = NULL;
+    }
+    self->capacity = 0;
+    self->length = 0;
+}
+
+bool dynamic_array_is_full(const struct dynamic_array* self)
+{
+    assert(self != NULL);
+    return self->length >= self->capacity;
+}
+
+bool dynamic_array_would_overflow(const struct dynamic_array* self, size_t byte_count)
+{
+    assert(self != NULL);
+    if (byte_count == 0) {
+        return dynamic_array_is_full(self);
+    }
+    return self->length + byte_count > self->capacity;
+}
+
+int dynamic_array_push_back_byte(struct dynamic_array* self, uint8_t item)
+{
+    assert(self != NULL);
+
+    if (dynamic_array_ensure_capacity(self, self->length + 1) != 0) {
+        return 1;
+    }
+    self->items[self->length] = item;
+    self->length++;
+    return 0;
+}
+
+int dynamic_array_push_back(struct dynamic_array* self, const uint8_t* buffer, size_t buffer_len)
+{
+    assert(self != NULL);
+    assert(buffer != NULL);
+    assert(buffer_len > 0);
+
+    if (buffer_len > SIZE_MAX - self->length) {
+        return 1;
+    }
+    if (dynamic_array_ensure_capacity(self, self->length + buffer_len) != 0) {
+        return 1;
+    }
+    memcpy(self->items + self->length, buffer, buffer_len);
+    self->length += buffer_len;
+    return 0;
+}
+
+int dynamic_array_ensure_capacity(struct dynamic_array* self, size_t required_capacity)
+{
+    assert(self);
+    if (required_capacity <= self->capacity) {
+        return 0;
+    }
+
+    size_t new_capacity = dynamic_array_grown_capacity(self->capacity, required_capacity, sizeof(uint8_t));
+    if (new_capacity == 0) {
+        return 1;
+    }
+
+    // the array is left untouched on failure
+    uint8_t* items = (uint8_t*) realloc(self->items, new_capacity);
+    if (items == NULL) {
+        return 1;
+    }
+    self->items = items;
+    self->capacity = new_capacity;
+    return 0;
+}
+
+#undef DYNAMIC_ARRAY_IMPLEMENTATION
+#endif // DYNAMIC_ARRAY_IMPLEMENTATION
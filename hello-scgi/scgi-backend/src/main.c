@@ -143,7 +143,8 @@ void connection_handle(struct scgi_context* ctx)
     struct scgi_parser parser = {0};
     scgi_parser_init(&parser, ctx->req.input_buffer, headers_size + 1 /* ',' */);
     int rc = scgi_parser_parse(&parser);
-    fprintf(stderr, "info: scgi parser: parsing finished. rc=%d state=%d\n", rc, parser.state);
+    fprintf(stderr, "info: scgi parser: parsing finished. rc=%d state=%d headers=%zu\n", rc, parser.state, parser.headers.length);
+    scgi_parser_free(&parser);
 
     // Send a simple string response
     int response_status_code = 200;
@@ -22,6 +22,16 @@ void scgi_parser_init(struct scgi_parser* parser, const char* input_buffer, size
     parser->state = SCGI_PARSER_STATE_PARSING_HEADER_NAME;
     parser->input_buffer = parser->cursor_start = parser->cursor_end = input_buffer;
     parser->input_buffer_size = input_buffer_size;
+    scgi_header_list_init(&parser->headers);
+    parser->body = NULL;
+    parser->body_len = 0;
+}
+
+void scgi_parser_free(struct scgi_parser* parser)
+{
+    assert(parser != NULL);
+
+    scgi_header_list_free(&parser->headers);
 }
 
 int scgi_parser_parse(struct scgi_parser* parser)
@@ -81,18 +91,18 @@ int scgi_parser_parse(struct scgi_parser* parser)
                     continue;
                 }
                 // '\0' found!
-                char header_name[256] = {0};
-                size_t header_name_byte_len = scgi_parser_cursor_size(parser);
-                if (header_name_byte_len >= sizeof(header_name) - 1) {
-                    //TODO improve this logic...
-                    fprintf(stderr, "error: scgi parsing failed: header name has too many bytes/chars\n");
+                struct scgi_header header = {
+                    .name = parser->cursor_start,
+                    .name_len = scgi_parser_cursor_size(parser),
+                };
+                if (scgi_header_list_push_back(&parser->headers, header) != 0) {
+                    fprintf(stderr, "error: scgi parsing failed: out of memory for headers\n");
                     return 1;
                 }
-                memcpy(header_name, parser->cursor_start, header_name_byte_len);
                 parser->state = SCGI_PARSER_STATE_PARSING_HEADER_VALUE;
                 parser->cursor_end++; // skip '\0'
                 parser->cursor_start = parser->cursor_end;
-                fprintf(stderr, "debug: scgi parsing: got header name: \"%s\"\n", header_name);
+                fprintf(stderr, "debug: scgi parsing: got header name: \"%.*s\"\n", (int) header.name_len, header.name);
             } break;
 
             case SCGI_PARSER_STATE_PARSING_HEADER_VALUE: {
@@ -101,18 +111,13 @@ int scgi_parser_parse(struct scgi_parser* parser)
                     continue;
                 }
                 // '\0' found!
-                char header_value[256] = {0};
-                size_t header_value_byte_len = scgi_parser_cursor_size(parser);
-                if (header_value_byte_len >= sizeof(header_value) - 1) {
-                    //TODO improve this logic...
-                    fprintf(stderr, "error: scgi parsing failed: header value has too many bytes/chars\n");
-                    return 1;
-                }
-                memcpy(header_value, parser->cursor_start, header_value_byte_len);
+                struct scgi_header* header = &parser->headers.items[parser->headers.length - 1];
+                header->value = parser->cursor_start;
+                header->value_len = scgi_parser_cursor_size(parser);
                 parser->state = SCGI_PARSER_STATE_PARSING_HEADER_NAME;
                 parser->cursor_end++; // skip '\0'
                 parser->cursor_start = parser->cursor_end;
-                fprintf(stderr, "debug: scgi parsing: got header value: \"%s\"\n", header_value);
+                fprintf(stderr, "debug: scgi parsing: got header value: \"%.*s\"\n", (int) header->value_len, header->value);
             } break;
 
             case SCGI_PARSER_STATE_PARSING_BODY: {
@@ -129,17 +134,11 @@ int scgi_parser_parse(struct scgi_parser* parser)
         }
     }
     if (scgi_parser_eof(parser) && parser->state == SCGI_PARSER_STATE_PARSING_BODY) {
-        char body[256] = {0};
-        size_t body_byte_len = scgi_parser_cursor_size(parser);
-        if (body_byte_len >= sizeof(body) - 1) {
-            //TODO improve this logic...
-            fprintf(stderr, "error: scgi parsing failed: body has too many bytes/chars\n");
-            return 1;
-        }
-        memcpy(body, parser->cursor_start, body_byte_len);
+        parser->body = parser->cursor_start;
+        parser->body_len = scgi_parser_cursor_size(parser);
         parser->state = SCGI_PARSER_STATE_DONE;
         parser->cursor_start = parser->cursor_end;
-        fprintf(stderr, "debug: scgi parsing: got body: \"%s\"\n", body);
+        fprintf(stderr, "debug: scgi parsing: got body: \"%.*s\"\n", (int) parser->body_len, parser->body);
         return 0;
     }
     fprintf(stderr, "error: scgi parsing: illegal state\n");
@@ -169,37 +168,42 @@ int scgi_send_text(const struct scgi_connection* conn, int status_code, const ch
     assert(text != NULL);
     assert(text_len > 0);
 
-    char output_buffer[SCGI_OUTPUT_BUFFER_SIZE] = {0};
-
-    if (text_len > SCGI_OUTPUT_BUFFER_SIZE) {
-        fprintf(stderr,
-            "error: output buffer overflow. output_buffer_size=%d text_len=%zu\n",
-            SCGI_OUTPUT_BUFFER_SIZE, text_len
-        );
-        return 1;
-    }
+    struct scgi_byte_buffer output;
+    scgi_byte_buffer_init(&output);
 
-    int bytes_formatted = snprintf(output_buffer, SCGI_OUTPUT_BUFFER_SIZE,
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
         "Status: %d OK\r\n"
         "Content-Length: %zu\r\n"
         "Content-Type: text/plain; charset=utf-8\r\n"
-        "\r\n"
-        "%s",
-        status_code, text_len, text
+        "\r\n",
+        status_code, text_len
     );
-    fprintf(stderr, "debug: %d bytes formatted to the output buffer\n", bytes_formatted);
-    assert(bytes_formatted > 0);
-    assert((size_t) bytes_formatted < SCGI_OUTPUT_BUFFER_SIZE);
-    
-    fprintf(stderr, "debug: sending output buffer:\n\"%s\"\n", output_buffer);
-    ssize_t bytes_sent = send(conn->client_socket_fd, output_buffer, bytes_formatted, 0);
+    assert(head_len > 0);
+    assert((size_t) head_len < sizeof(head));
+
+    // a single allocation for the whole response
+    if (scgi_byte_buffer_reserve(&output, (size_t) head_len + text_len) != 0
+        || scgi_byte_buffer_append(&output, head, (size_t) head_len) != 0
+        || scgi_byte_buffer_append(&output, text, text_len) != 0)
+    {
+        fprintf(stderr, "error: failed to allocate the output buffer. text_len=%zu\n", text_len);
+        scgi_byte_buffer_free(&output);
+        return 1;
+    }
+    fprintf(stderr, "debug: %zu bytes formatted to the output buffer\n", output.length);
+
+    fprintf(stderr, "debug: sending output buffer:\n\"%.*s\"\n", (int) output.length, output.items);
+    ssize_t bytes_sent = send(conn->client_socket_fd, output.items, output.length, 0);
     fprintf(stderr, "debug: send(): bytes_sent=%ld\n", bytes_sent);
     if (bytes_sent == -1) {
         int error_code = errno;
         const char* err_cause = strerror(error_code);
         fprintf(stderr, "error: send(): failed: %s\n", err_cause);
+        scgi_byte_buffer_free(&output);
         return 1;
     }
 
+    scgi_byte_buffer_free(&output);
     return 0;
 }
@@ -4,9 +4,9 @@
 #include <stdbool.h>
 
 #include "mem.h"
+#include "dynamic-array.h"
 
 #define SCGI_INPUT_BUFFER_SIZE   4096
-#define SCGI_OUTPUT_BUFFER_SIZE  4096
 #define SCGI_READ_CHUNK_SIZE      100
 #define SCGI_HEADERS_MAX_SIZE    1024
 #define SCGI_REQ_MAX_BUFFER_SIZE 4096
@@ -21,7 +21,6 @@ struct scgi_request {
 
 struct scgi_response_writer {
     int status_code;
-    char output_buffer[SCGI_OUTPUT_BUFFER_SIZE];
 };
 
 struct scgi_context {
@@ -39,6 +38,19 @@ enum scgi_parser_state {
     SCGI_PARSER_STATE_DONE,
 };
 
+/**
+ * A request header. Both name and value point into the parser input buffer (they are not null-terminated).
+ */
+struct scgi_header {
+    const char* name;
+    size_t name_len;
+    const char* value;
+    size_t value_len;
+};
+
+DYNAMIC_ARRAY_DEFINE(scgi_header_list, struct scgi_header)
+DYNAMIC_ARRAY_DEFINE(scgi_byte_buffer, char)
+
 struct scgi_parser {
     enum scgi_parser_state state;
 
@@ -47,8 +59,14 @@ struct scgi_parser {
 
     const char* cursor_start;
     const char* cursor_end;
+
+    struct scgi_header_list headers;
+
+    const char* body;
+    size_t body_len;
 };
 
 void scgi_parser_init (struct scgi_parser* parser, const char* input_buffer, size_t input_buffer_size);
+void scgi_parser_free (struct scgi_parser* parser);
 int  scgi_parser_parse(struct scgi_parser* parser);
 int scgi_send_text(const struct scgi_connection* conn, int status_code, const char* text, size_t text_len);
@@ -17,7 +17,8 @@ int main(void) {
     scgi_parser_init(&parser, scgi_request, sizeof(scgi_request));
 
     int rc = scgi_parser_parse(&parser);
-    fprintf(stderr, "info: rc=%d state=%d\n", rc, parser.state);
-    
+    fprintf(stderr, "info: rc=%d state=%d headers=%zu\n", rc, parser.state, parser.headers.length);
+    scgi_parser_free(&parser);
+
     return rc;
 }
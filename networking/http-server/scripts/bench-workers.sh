@@ -0,0 +1,75 @@
+#!/bin/bash
+# Measures requests/sec scaling with the number of workers (HTTP_SERVER_WORKERS).
+#
+# Usage: ./scripts/bench-workers.sh [build-dir] [max-workers]
+#
+# Uses the http-bench load generator built next to the server (also run by `cmake --build <dir> --target bench`).
+# BENCH_RATE=<requests/sec> sends at a fixed rate instead of as fast as possible. BENCH_IO_BACKEND=io_uring runs the
+# server on its io_uring backend instead of epoll, to compare both under the same load: the I/O syscalls the workers
+# made per request (from the http_io_syscalls_total metric, scraped with curl) tell how much of the work each one
+# batches. For meaningful numbers build with -DSANITIZE=OFF and pin the load generator away from the server cores
+# (e.g. via taskset).
+set -eu -o pipefail
+
+BUILD_DIR="${1:-$PWD/build}"
+MAX_WORKERS="${2:-$(nproc)}"
+
+PORT="${BENCH_PORT:-18080}"
+DURATION="${BENCH_DURATION:-10}"
+THREADS="${BENCH_THREADS:-4}"
+CONNECTIONS="${BENCH_CONNECTIONS:-256}"
+RATE="${BENCH_RATE:-0}"
+IO_BACKEND="${BENCH_IO_BACKEND:-epoll}"
+
+SERVER_BIN="$BUILD_DIR/http-server"
+BENCH_BIN="$BUILD_DIR/http-bench"
+SERVER_PID=""
+
+for bin in "$SERVER_BIN" "$BENCH_BIN"; do
+    if [ ! -x "$bin" ]; then
+        echo "error: $bin not found. build it first" >&2
+        exit 1
+    fi
+done
+
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=""
+    fi
+}
+trap stop_server EXIT
+
+# the I/O syscalls of every worker so far. /metrics is cached for a second: the caller waits that long between two
+# scrapes.
+io_syscalls() {
+    curl -sf "http://127.0.0.1:$PORT/metrics" | awk '/^http_io_syscalls_total/ { total += $NF } END { print total + 0 }'
+}
+
+echo "io backend: $IO_BACKEND"
+printf "%-8s %-14s %-12s %-12s %-16s\n" "workers" "requests/sec" "p99 (ms)" "p99.9 (ms)" "syscalls/request"
+
+workers=1
+while [ "$workers" -le "$MAX_WORKERS" ]; do
+    HTTP_SERVER_PORT="$PORT" HTTP_SERVER_METRICS=1 HTTP_SERVER_WORKERS="$workers" HTTP_SERVER_IO_BACKEND="$IO_BACKEND" "$SERVER_BIN" >/dev/null 2>&1 &
+    SERVER_PID=$!
+    sleep 0.5
+    syscalls_before=$(io_syscalls)
+
+    # the corrected latencies (first column)
+    report=$("$BENCH_BIN" -t"$THREADS" -c"$CONNECTIONS" -d"$DURATION" -r"$RATE" "http://127.0.0.1:$PORT/")
+    rps=$(awk '/^requests\/sec:/ { print $2 }' <<< "$report")
+    p99=$(awk '$1 == "p99" { sub("ms", "", $2); print $2 }' <<< "$report")
+    p999=$(awk '$1 == "p99.9" { sub("ms", "", $2); print $2 }' <<< "$report")
+    requests=$(awk '/^requests:/ { print $2 }' <<< "$report")
+
+    sleep 1.1
+    syscalls_after=$(io_syscalls)
+    per_request=$(awk -v n="$((syscalls_after - syscalls_before))" -v r="$requests" \
+                      'BEGIN { printf("%.2f", r > 0 ? n / r : 0) }')
+    printf "%-8s %-14s %-12s %-12s %-16s\n" "$workers" "$rps" "$p99" "$p999" "$per_request"
+
+    stop_server
+    workers=$((workers * 2))
+done
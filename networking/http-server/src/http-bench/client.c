@@ -0,0 +1,484 @@
+#include "client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+#include <http-server/commons.h>
+#include <http-server/io.h>
+#include <http-server/net.h>
+#include <http-server/stopwatch.h>
+
+static void bench_client_connect(struct bench_client* client, struct bench_connection* conn);
+static void bench_client_reconnect(struct bench_client* client, struct bench_connection* conn);
+static void bench_client_on_events(struct bench_client* client, struct bench_connection* conn, uint32_t events);
+static void bench_client_send(struct bench_client* client, struct bench_connection* conn, uint64_t now_ns);
+static void bench_client_continue_send(struct bench_client* client, struct bench_connection* conn);
+static void bench_client_receive(struct bench_client* client, struct bench_connection* conn);
+static void bench_client_on_response(struct bench_client* client, struct bench_connection* conn);
+static void bench_client_send_due(struct bench_client* client, uint64_t now_ns);
+static int bench_client_next_timeout_ms(const struct bench_client* client, uint64_t now_ns, uint64_t end_ns);
+static enum result bench_connection_parse_head(struct bench_connection* conn, size_t head_size);
+
+enum result bench_client_init(struct bench_client* client,
+                              size_t id,
+                              const struct bench_config* config,
+                              size_t first_connection,
+                              size_t connection_count)
+{
+    assert(client != NULL);
+    assert(config != NULL);
+    assert(connection_count > 0);
+
+    client->id = id;
+    client->config = config;
+    client->first_connection = first_connection;
+    client->connection_count = connection_count;
+    client->interval_ns = config->rate > 0 ? (uint64_t) (1e9 * (double) config->connections / config->rate) : 0;
+    client->stats = (struct bench_stats) {0};
+    client->started_ns = 0;
+    client->stopped_ns = 0;
+    histogram_init(&client->latency);
+    histogram_init(&client->service_time);
+
+    client->connections = calloc(connection_count, sizeof(struct bench_connection));
+    if (client->connections == NULL) {
+        fprintf(stderr, "error: failed to allocate %zu connections\n", connection_count);
+        return RESULT_ERR;
+    }
+    for (size_t i = 0; i < connection_count; i++) {
+        client->connections[i].socket = -1;
+        client->connections[i].state = BENCH_CONNECTION_CLOSED;
+    }
+
+    if (event_loop_init(&client->loop, EVENT_LOOP_BACKEND_EPOLL, 0) != RESULT_OK) {
+        free(client->connections);
+        client->connections = NULL;
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+void bench_client_free(struct bench_client* client)
+{
+    assert(client != NULL);
+
+    if (client->connections != NULL) {
+        for (size_t i = 0; i < client->connection_count; i++) {
+            if (client->connections[i].socket >= 0) {
+                close(client->connections[i].socket);
+            }
+        }
+        free(client->connections);
+        client->connections = NULL;
+    }
+
+    event_loop_free(&client->loop);
+}
+
+enum result bench_client_run(struct bench_client* client)
+{
+    assert(client != NULL);
+
+    const struct bench_config* config = client->config;
+
+    client->started_ns = clock_monotonic_ns();
+    const uint64_t end_ns = client->started_ns + config->duration_ns;
+
+    for (size_t i = 0; i < client->connection_count; i++) {
+        struct bench_connection* conn = &client->connections[i];
+
+        // at a fixed rate, the connections take turns over the interval instead of all sending at once
+        const size_t global_index = client->first_connection + i;
+        conn->intended_ns = client->started_ns + client->interval_ns * global_index / config->connections;
+
+        bench_client_connect(client, conn);
+    }
+
+    struct epoll_event events[BENCH_MAX_EVENTS];
+
+    while (true) {
+        uint64_t now_ns = clock_monotonic_ns();
+        if (now_ns >= end_ns) {
+            break;
+        }
+
+        bool any_open = false;
+        for (size_t i = 0; i < client->connection_count && !any_open; i++) {
+            any_open = client->connections[i].state != BENCH_CONNECTION_CLOSED;
+        }
+        if (!any_open) {
+            fprintf(stderr, "error: client %zu: every connection failed\n", client->id);
+            client->stopped_ns = now_ns;
+            return RESULT_ERR;
+        }
+
+        const int timeout_ms = bench_client_next_timeout_ms(client, now_ns, end_ns);
+        int ready_count = event_loop_wait(&client->loop, events, BENCH_MAX_EVENTS, timeout_ms);
+        if (ready_count < 0) {
+            client->stopped_ns = clock_monotonic_ns();
+            return RESULT_ERR;
+        }
+
+        for (int i = 0; i < ready_count; i++) {
+            bench_client_on_events(client, events[i].data.ptr, events[i].events);
+        }
+
+        if (client->interval_ns > 0) {
+            bench_client_send_due(client, clock_monotonic_ns());
+        }
+    }
+
+    // the requests still in flight are not counted
+    client->stopped_ns = clock_monotonic_ns();
+    return RESULT_OK;
+}
+
+static void bench_client_connect(struct bench_client* client, struct bench_connection* conn)
+{
+    conn->state = BENCH_CONNECTION_CLOSED;
+
+    conn->socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->socket < 0) {
+        int error_code = errno;
+        fprintf(stderr, "error: socket: %s\n", strerror(error_code));
+        client->stats.errors++;
+        return;
+    }
+
+    const int opt = 1;
+    setsockopt(conn->socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (connect(conn->socket, (const struct sockaddr*) &client->config->address, sizeof(client->config->address)) != 0
+        && errno != EINPROGRESS)
+    {
+        int error_code = errno;
+        fprintf(stderr, "error: connect: %s\n", strerror(error_code));
+        goto err;
+    }
+
+    if (event_loop_add(&client->loop, conn->socket, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, conn) != RESULT_OK) {
+        goto err;
+    }
+
+    conn->state = BENCH_CONNECTION_CONNECTING;
+    return;
+
+err:
+    client->stats.errors++;
+    close(conn->socket);
+    conn->socket = -1;
+}
+
+/**
+ * @brief replaces a connection the server closed. Its schedule carries on.
+ */
+static void bench_client_reconnect(struct bench_client* client, struct bench_connection* conn)
+{
+    close(conn->socket);
+    conn->socket = -1;
+    client->stats.reconnects++;
+    bench_client_connect(client, conn);
+}
+
+static void bench_client_on_events(struct bench_client* client, struct bench_connection* conn, uint32_t events)
+{
+    switch (conn->state) {
+        case BENCH_CONNECTION_CONNECTING: {
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                return;
+            }
+
+            int error_code = 0;
+            socklen_t error_code_len = sizeof(error_code);
+            getsockopt(conn->socket, SOL_SOCKET, SO_ERROR, &error_code, &error_code_len);
+            if (error_code != 0) {
+                fprintf(stderr, "error: connect: %s\n", strerror(error_code));
+                client->stats.errors++;
+                close(conn->socket);
+                conn->socket = -1;
+                conn->state = BENCH_CONNECTION_CLOSED;
+                return;
+            }
+
+            conn->state = BENCH_CONNECTION_IDLE;
+            const uint64_t now_ns = clock_monotonic_ns();
+            if (client->interval_ns == 0 || conn->intended_ns <= now_ns) {
+                bench_client_send(client, conn, now_ns);
+            }
+            return;
+        }
+
+        case BENCH_CONNECTION_IDLE:
+            // nothing is expected from the server: it is closing the connection
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+                bench_client_reconnect(client, conn);
+            }
+            return;
+
+        case BENCH_CONNECTION_SENDING:
+            bench_client_continue_send(client, conn);
+            return;
+
+        case BENCH_CONNECTION_RECEIVING:
+            bench_client_receive(client, conn);
+            return;
+
+        case BENCH_CONNECTION_CLOSED:
+            return;
+    }
+}
+
+static void bench_client_send(struct bench_client* client, struct bench_connection* conn, uint64_t now_ns)
+{
+    if (client->interval_ns == 0) {
+        conn->intended_ns = now_ns;
+    }
+    conn->sent_ns = now_ns;
+    conn->request_sent = 0;
+    conn->head_len = 0;
+    conn->head_complete = false;
+    conn->body_remaining = 0;
+    conn->close_after = false;
+    conn->state = BENCH_CONNECTION_SENDING;
+
+    bench_client_continue_send(client, conn);
+}
+
+static void bench_client_continue_send(struct bench_client* client, struct bench_connection* conn)
+{
+    const struct bench_config* config = client->config;
+
+    while (conn->request_sent < config->request_len) {
+        size_t bytes_sent = 0;
+        enum io_status status = send_nonblocking(conn->socket,
+                                                 (const uint8_t*) config->request + conn->request_sent,
+                                                 config->request_len - conn->request_sent,
+                                                 &bytes_sent);
+        switch (status) {
+            case IO_STATUS_OK:
+                conn->request_sent += bytes_sent;
+                break;
+            case IO_STATUS_WOULD_BLOCK:
+                return;
+            case IO_STATUS_EOF:
+            case IO_STATUS_ERR:
+                client->stats.errors++;
+                bench_client_reconnect(client, conn);
+                return;
+        }
+    }
+
+    conn->state = BENCH_CONNECTION_RECEIVING;
+
+    // the response may already be there: its edge could have been consumed while sending
+    bench_client_receive(client, conn);
+}
+
+static void bench_client_receive(struct bench_client* client, struct bench_connection* conn)
+{
+    while (conn->state == BENCH_CONNECTION_RECEIVING) {
+        uint8_t* buffer;
+        size_t buffer_size;
+        if (!conn->head_complete) {
+            buffer = (uint8_t*) conn->head + conn->head_len;
+            buffer_size = sizeof(conn->head) - conn->head_len;
+            if (buffer_size == 0) {
+                fprintf(stderr, "error: response head too large\n");
+                client->stats.errors++;
+                bench_client_reconnect(client, conn);
+                return;
+            }
+        } else {
+            buffer = (uint8_t*) client->discard;
+            buffer_size = MIN(sizeof(client->discard), conn->body_remaining);
+        }
+
+        size_t bytes_read = 0;
+        enum io_status status = recv_nonblocking(conn->socket, buffer, buffer_size, &bytes_read);
+        switch (status) {
+            case IO_STATUS_OK:
+                break;
+            case IO_STATUS_WOULD_BLOCK:
+                return;
+            case IO_STATUS_EOF:
+            case IO_STATUS_ERR:
+                client->stats.errors++;
+                bench_client_reconnect(client, conn);
+                return;
+        }
+
+        client->stats.bytes_received += bytes_read;
+
+        if (conn->head_complete) {
+            conn->body_remaining -= bytes_read;
+        } else {
+            // the terminator may straddle the previous read
+            const size_t search_start = conn->head_len > 3 ? conn->head_len - 3 : 0;
+            conn->head_len += bytes_read;
+
+            const char* end = memmem(conn->head + search_start, conn->head_len - search_start, "\r\n\r\n", 4);
+            if (end == NULL) {
+                continue;
+            }
+
+            const size_t head_size = (size_t) (end - conn->head) + 4;
+            if (bench_connection_parse_head(conn, head_size) != RESULT_OK) {
+                fprintf(stderr, "error: malformed or unsupported response head\n");
+                client->stats.errors++;
+                bench_client_reconnect(client, conn);
+                return;
+            }
+
+            // a single request is in flight, so anything past the body is a server bug
+            const size_t body_received = conn->head_len - head_size;
+            if (body_received > conn->body_remaining) {
+                fprintf(stderr, "error: received more than the response Content-Length\n");
+                client->stats.errors++;
+                bench_client_reconnect(client, conn);
+                return;
+            }
+            conn->body_remaining -= body_received;
+            conn->head_complete = true;
+        }
+
+        if (conn->body_remaining == 0) {
+            bench_client_on_response(client, conn);
+        }
+    }
+}
+
+static void bench_client_on_response(struct bench_client* client, struct bench_connection* conn)
+{
+    const uint64_t now_ns = clock_monotonic_ns();
+
+    histogram_record(&client->latency, now_ns - conn->intended_ns);
+    histogram_record(&client->service_time, now_ns - conn->sent_ns);
+    client->stats.requests++;
+    if (conn->status_code < 200 || conn->status_code > 299) {
+        client->stats.non_2xx++;
+    }
+
+    conn->state = BENCH_CONNECTION_IDLE;
+    if (client->interval_ns > 0) {
+        conn->intended_ns += client->interval_ns;
+    }
+
+    if (conn->close_after) {
+        bench_client_reconnect(client, conn);
+        return;
+    }
+
+    // late (fixed rate) or closed loop: right away
+    if (client->interval_ns == 0 || conn->intended_ns <= now_ns) {
+        bench_client_send(client, conn, now_ns);
+    }
+}
+
+/**
+ * @brief sends the requests of the idle connections whose time has come (fixed rate).
+ */
+static void bench_client_send_due(struct bench_client* client, uint64_t now_ns)
+{
+    for (size_t i = 0; i < client->connection_count; i++) {
+        struct bench_connection* conn = &client->connections[i];
+        if (conn->state == BENCH_CONNECTION_IDLE && conn->intended_ns <= now_ns) {
+            bench_client_send(client, conn, now_ns);
+        }
+    }
+}
+
+static int bench_client_next_timeout_ms(const struct bench_client* client, uint64_t now_ns, uint64_t end_ns)
+{
+    uint64_t deadline_ns = end_ns;
+    if (client->interval_ns > 0) {
+        for (size_t i = 0; i < client->connection_count; i++) {
+            const struct bench_connection* conn = &client->connections[i];
+            if (conn->state == BENCH_CONNECTION_IDLE) {
+                deadline_ns = MIN(deadline_ns, conn->intended_ns);
+            }
+        }
+    }
+
+    if (deadline_ns <= now_ns) {
+        return 0;
+    }
+
+    // rounded up: polling through the last ms would steal the cpu from a server on the same machine. So requests
+    // may leave up to 1ms late (epoll resolution), which the latencies measured from the intended time include.
+    const uint64_t timeout_ms = (deadline_ns - now_ns + 999999) / 1000000;
+    return (int) MIN(timeout_ms, (uint64_t) INT_MAX);
+}
+
+/**
+ * @brief reads the status code and the framing headers of the response head (|head_size| bytes, the final empty
+ *        line included). Only Content-Length framing is supported.
+ */
+static enum result bench_connection_parse_head(struct bench_connection* conn, size_t head_size)
+{
+    const char* head = conn->head;
+    const char* head_end = head + head_size - 2;
+
+    // "HTTP/1.1 200 ..."
+    if (head_size < 16 || memcmp(head, "HTTP/1.", 7) != 0 || head[8] != ' ') {
+        return RESULT_ERR;
+    }
+    int status_code = 0;
+    for (size_t i = 9; i < 12; i++) {
+        if (head[i] < '0' || head[i] > '9') {
+            return RESULT_ERR;
+        }
+        status_code = status_code * 10 + (head[i] - '0');
+    }
+    conn->status_code = status_code;
+
+    bool has_content_length = false;
+    size_t content_length = 0;
+
+    const char* line = (const char*) memchr(head, '\n', head_size) + 1;
+    while (line < head_end) {
+        const char* line_end = memchr(line, '\n', (size_t) (head_end - line));
+        if (line_end == NULL) {
+            return RESULT_ERR;
+        }
+
+        const size_t line_len = (size_t) (line_end - line);
+        if (line_len > 15 && strncasecmp(line, "content-length:", 15) == 0) {
+            has_content_length = true;
+            content_length = 0;
+            for (const char* c = line + 15; c < line_end; c++) {
+                if (*c >= '0' && *c <= '9') {
+                    content_length = content_length * 10 + (size_t) (*c - '0');
+                } else if (*c != ' ' && *c != '\t' && *c != '\r') {
+                    return RESULT_ERR;
+                }
+            }
+        } else if (line_len > 18 && strncasecmp(line, "transfer-encoding:", 18) == 0) {
+            return RESULT_ERR;
+        } else if (line_len > 11 && strncasecmp(line, "connection:", 11) == 0) {
+            conn->close_after = memmem(line, line_len, "close", 5) != NULL;
+        }
+
+        line = line_end + 1;
+    }
+
+    // these never have a body
+    if (!has_content_length && (status_code == 204 || status_code == 304 || status_code < 200)) {
+        has_content_length = true;
+    }
+    if (!has_content_length) {
+        return RESULT_ERR;
+    }
+
+    conn->body_remaining = content_length;
+    return RESULT_OK;
+}
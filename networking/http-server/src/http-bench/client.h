@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <netinet/in.h>
+
+#include <http-server/error.h>
+#include <http-server/event-loop.h>
+#include <http-server/histogram.h>
+
+/**
+ * @brief response heads bigger than this are reported as errors
+ */
+#define BENCH_RESPONSE_HEAD_MAX_SIZE 8192
+
+#define BENCH_MAX_EVENTS 256
+
+struct bench_config {
+    struct sockaddr_in address;
+
+    /**
+     * @brief the request every connection sends over and over
+     */
+    const char* request;
+    size_t request_len;
+
+    size_t connections;
+    size_t threads;
+    uint64_t duration_ns;
+
+    /**
+     * @brief total requests per second over every connection (fixed rate), or 0 for a closed loop where every
+     *        connection sends its next request as soon as it gets a response
+     */
+    double rate;
+};
+
+enum bench_connection_state {
+    BENCH_CONNECTION_CONNECTING = 0,
+
+    /**
+     * connected, waiting for the time of the next request (fixed rate)
+     */
+    BENCH_CONNECTION_IDLE,
+    BENCH_CONNECTION_SENDING,
+    BENCH_CONNECTION_RECEIVING,
+
+    /**
+     * failed to connect: never used again
+     */
+    BENCH_CONNECTION_CLOSED,
+};
+
+/**
+ * @brief a keep-alive connection with at most one request in flight.
+ */
+struct bench_connection {
+    int socket;
+    enum bench_connection_state state;
+
+    /**
+     * @brief when the request in flight (or the next one) was supposed to be sent, and when it actually was. They
+     *        only differ at a fixed rate, when the previous response came back late.
+     */
+    uint64_t intended_ns;
+    uint64_t sent_ns;
+
+    size_t request_sent;
+
+    /**
+     * @brief the response head received so far (and the first body bytes)
+     */
+    char head[BENCH_RESPONSE_HEAD_MAX_SIZE];
+    size_t head_len;
+    bool head_complete;
+
+    int status_code;
+    size_t body_remaining;
+
+    /**
+     * @brief the server answered with "Connection: close": the connection is re-opened after the response
+     */
+    bool close_after;
+};
+
+struct bench_stats {
+    uint64_t requests;
+    uint64_t bytes_received;
+    uint64_t errors;
+    uint64_t non_2xx;
+    uint64_t reconnects;
+};
+
+/**
+ * @brief one load generator thread: a share of the connections on its own epoll event loop.
+ */
+struct bench_client {
+    size_t id;
+    const struct bench_config* config;
+
+    struct event_loop loop;
+
+    struct bench_connection* connections;
+    size_t first_connection;
+    size_t connection_count;
+
+    /**
+     * @brief the time between two requests of a connection at a fixed rate (0 for a closed loop)
+     */
+    uint64_t interval_ns;
+
+    /**
+     * @brief response times measured from when requests were supposed to be sent (so corrected for coordinated
+     *        omission at a fixed rate) and from when they actually were.
+     */
+    struct histogram latency;
+    struct histogram service_time;
+
+    struct bench_stats stats;
+
+    uint64_t started_ns;
+    uint64_t stopped_ns;
+
+    /**
+     * @brief response bodies are read here and thrown away
+     */
+    char discard[64 * 1024];
+};
+
+/**
+ * @brief |first_connection| is the index of the first connection of this client among every connection, so that
+ *        fixed rate schedules are staggered over the whole set.
+ */
+enum result bench_client_init(struct bench_client* client,
+                              size_t id,
+                              const struct bench_config* config,
+                              size_t first_connection,
+                              size_t connection_count);
+void bench_client_free(struct bench_client* client);
+
+/**
+ * @brief opens the connections and drives them for config->duration_ns.
+ */
+enum result bench_client_run(struct bench_client* client);
@@ -0,0 +1,307 @@
+/**
+ * A load generator for http-server: keep-alive connections spread over threads, each with its own epoll loop,
+ * reporting throughput and latency quantiles.
+ *
+ * Without -r (closed loop), every connection sends its next request as soon as it gets a response, which measures
+ * the max throughput but hides the stalls (coordinated omission): the report also shows the latencies corrected for
+ * the requests a stall delayed. With -r, requests are sent on a fixed schedule and latencies are measured from when
+ * they were supposed to be sent, however late the previous response came back.
+ *
+ * Usage: http-bench [-c connections] [-t threads] [-d seconds] [-r requests/sec] http://host[:port]/path
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <http-server/commons.h>
+#include <http-server/histogram.h>
+
+#include "client.h"
+
+#define DEFAULT_CONNECTIONS 64
+#define DEFAULT_THREADS 2
+#define DEFAULT_DURATION_SECONDS 10
+
+#define REQUEST_MAX_SIZE 4096
+
+static const double reported_quantiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+static const char* const reported_quantile_names[] = {"p50", "p90", "p99", "p99.9", "max"};
+
+static void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [-c connections] [-t threads] [-d seconds] [-r requests/sec] http://host[:port]/path\n"
+            "  -c  connections kept open (default %d)\n"
+            "  -t  threads (default %d)\n"
+            "  -d  duration in seconds (default %d)\n"
+            "  -r  total requests/sec sent on a fixed schedule (default: closed loop, as fast as possible)\n",
+            program,
+            DEFAULT_CONNECTIONS,
+            DEFAULT_THREADS,
+            DEFAULT_DURATION_SECONDS);
+}
+
+/**
+ * @brief parses "http://host[:port]/path" into |address| and the GET request for it.
+ */
+static enum result request_init_from_url(const char* url,
+                                         struct sockaddr_in* address,
+                                         char* request,
+                                         size_t request_size,
+                                         size_t* out_request_len)
+{
+    static const char scheme[] = "http://";
+    if (strncmp(url, scheme, sizeof(scheme) - 1) != 0) {
+        fprintf(stderr, "error: only http:// urls are supported\n");
+        return RESULT_ERR;
+    }
+
+    const char* authority = url + sizeof(scheme) - 1;
+    const char* path = strchr(authority, '/');
+    const size_t authority_len = path != NULL ? (size_t) (path - authority) : strlen(authority);
+    if (path == NULL) {
+        path = "/";
+    }
+
+    char host[256];
+    if (authority_len == 0 || authority_len >= sizeof(host)) {
+        fprintf(stderr, "error: bad host in %s\n", url);
+        return RESULT_ERR;
+    }
+    memcpy(host, authority, authority_len);
+    host[authority_len] = '\0';
+
+    unsigned long long port = 80;
+    char* port_separator = strchr(host, ':');
+    if (port_separator != NULL) {
+        *port_separator = '\0';
+        if (parse_ull(port_separator + 1, &port) != RESULT_OK || port == 0 || port > UINT16_MAX) {
+            fprintf(stderr, "error: bad port in %s\n", url);
+            return RESULT_ERR;
+        }
+    }
+
+    // no resolver: the load generator should not measure DNS anyway
+    const char* ip = strcmp(host, "localhost") == 0 ? "127.0.0.1" : host;
+    *address = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t) port),
+    };
+    if (inet_pton(AF_INET, ip, &address->sin_addr) != 1) {
+        fprintf(stderr, "error: %s is not an IPv4 address\n", host);
+        return RESULT_ERR;
+    }
+
+    int request_len = snprintf(request,
+                               request_size,
+                               "GET %s HTTP/1.1\r\nHost: %.*s\r\nUser-Agent: http-bench\r\n\r\n",
+                               path,
+                               (int) authority_len,
+                               authority);
+    if (request_len < 0 || (size_t) request_len >= request_size) {
+        fprintf(stderr, "error: url too long\n");
+        return RESULT_ERR;
+    }
+    *out_request_len = (size_t) request_len;
+
+    return RESULT_OK;
+}
+
+static void* client_thread(void* arg)
+{
+    struct bench_client* client = arg;
+    if (bench_client_run(client) != RESULT_OK) {
+        client->stats.errors++;
+    }
+    return NULL;
+}
+
+static void print_bytes_per_second(double bytes_per_second)
+{
+    static const char* const units[] = {"B", "KB", "MB", "GB"};
+    size_t unit = 0;
+    while (bytes_per_second >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        bytes_per_second /= 1024;
+        unit++;
+    }
+    printf("transfer/sec:  %.2f %s\n", bytes_per_second, units[unit]);
+}
+
+static void print_latencies(const struct histogram* corrected, const struct histogram* uncorrected)
+{
+    printf("\n%-8s %14s %14s\n", "latency", "corrected", "uncorrected");
+    for (size_t i = 0; i < sizeof(reported_quantiles) / sizeof(reported_quantiles[0]); i++) {
+        printf("%-8s %12.3fms %12.3fms\n",
+               reported_quantile_names[i],
+               (double) histogram_value_at_quantile(corrected, reported_quantiles[i]) / 1e6,
+               (double) histogram_value_at_quantile(uncorrected, reported_quantiles[i]) / 1e6);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long long connections = DEFAULT_CONNECTIONS;
+    unsigned long long threads = DEFAULT_THREADS;
+    unsigned long long duration_seconds = DEFAULT_DURATION_SECONDS;
+    unsigned long long rate = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:r:h")) != -1) {
+        unsigned long long* value;
+        switch (opt) {
+            case 'c':
+                value = &connections;
+                break;
+            case 't':
+                value = &threads;
+                break;
+            case 'd':
+                value = &duration_seconds;
+                break;
+            case 'r':
+                value = &rate;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+        if (parse_ull(optarg, value) != RESULT_OK) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1 || connections == 0 || threads == 0 || duration_seconds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads > connections) {
+        threads = connections;
+    }
+
+    static char request[REQUEST_MAX_SIZE];
+    struct bench_config config = {
+        .connections = connections,
+        .threads = threads,
+        .duration_ns = duration_seconds * UINT64_C(1000000000),
+        .rate = (double) rate,
+        .request = request,
+    };
+    if (request_init_from_url(argv[optind], &config.address, request, sizeof(request), &config.request_len)
+        != RESULT_OK)
+    {
+        return 1;
+    }
+
+    // a server closing a connection must not kill the load generator (sends use MSG_NOSIGNAL, but connect may not)
+    signal(SIGPIPE, SIG_IGN);
+
+    struct bench_client* clients = calloc(threads, sizeof(struct bench_client));
+    pthread_t* thread_ids = calloc(threads, sizeof(pthread_t));
+    struct histogram* corrected = malloc(sizeof(struct histogram));
+    struct histogram* uncorrected = malloc(sizeof(struct histogram));
+    if (clients == NULL || thread_ids == NULL || corrected == NULL || uncorrected == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    size_t initialized_count = 0;
+    size_t first_connection = 0;
+    for (size_t i = 0; i < threads; i++) {
+        // the first threads take the remainder
+        const size_t connection_count = connections / threads + (i < connections % threads ? 1 : 0);
+        if (bench_client_init(&clients[i], i, &config, first_connection, connection_count) != RESULT_OK) {
+            break;
+        }
+        first_connection += connection_count;
+        initialized_count++;
+    }
+
+    size_t started_count = 0;
+    if (initialized_count == threads) {
+        printf("running %llus against %s: %llu connections over %llu threads, ",
+               duration_seconds,
+               argv[optind],
+               connections,
+               threads);
+        if (rate > 0) {
+            printf("%llu requests/sec\n", rate);
+        } else {
+            printf("closed loop\n");
+        }
+        fflush(stdout);
+
+        for (; started_count < threads; started_count++) {
+            int error_code = pthread_create(&thread_ids[started_count], NULL, client_thread, &clients[started_count]);
+            if (error_code != 0) {
+                fprintf(stderr, "error: pthread_create: %s\n", strerror(error_code));
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < started_count; i++) {
+        pthread_join(thread_ids[i], NULL);
+    }
+
+    const bool completed = started_count == threads;
+    if (completed) {
+        struct bench_stats total = {0};
+        uint64_t elapsed_ns = 0;
+        histogram_init(corrected);
+        histogram_init(uncorrected);
+
+        for (size_t i = 0; i < threads; i++) {
+            const struct bench_client* client = &clients[i];
+            total.requests += client->stats.requests;
+            total.bytes_received += client->stats.bytes_received;
+            total.errors += client->stats.errors;
+            total.non_2xx += client->stats.non_2xx;
+            total.reconnects += client->stats.reconnects;
+            elapsed_ns = MAX(elapsed_ns, client->stopped_ns - client->started_ns);
+
+            if (rate > 0) {
+                histogram_merge(corrected, &client->latency);
+                histogram_merge(uncorrected, &client->service_time);
+            } else {
+                histogram_merge(uncorrected, &client->latency);
+            }
+        }
+
+        if (rate == 0 && total.requests > 0) {
+            // what each connection achieved on average is the best guess of when it should have sent
+            const uint64_t expected_interval = elapsed_ns * connections / total.requests;
+            for (size_t i = 0; i < threads; i++) {
+                histogram_merge_corrected(corrected, &clients[i].latency, expected_interval);
+            }
+        }
+
+        const double elapsed_seconds = (double) elapsed_ns / 1e9;
+        printf("requests:      %llu in %.2fs\n", (unsigned long long) total.requests, elapsed_seconds);
+        printf("errors:        %llu (non-2xx: %llu, reconnects: %llu)\n",
+               (unsigned long long) total.errors,
+               (unsigned long long) total.non_2xx,
+               (unsigned long long) total.reconnects);
+        printf("requests/sec:  %.2f\n", (double) total.requests / elapsed_seconds);
+        print_bytes_per_second((double) total.bytes_received / elapsed_seconds);
+        print_latencies(corrected, uncorrected);
+    }
+
+    for (size_t i = 0; i < initialized_count; i++) {
+        bench_client_free(&clients[i]);
+    }
+    free(uncorrected);
+    free(corrected);
+    free(thread_ids);
+    free(clients);
+
+    return completed ? 0 : 1;
+}
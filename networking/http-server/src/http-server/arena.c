@@ -0,0 +1,59 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdalign.h>
+#include <assert.h>
+
+#include "commons.h"
+
+void arena_init(struct arena* arena, void* data, size_t size)
+{
+    assert(arena != NULL);
+    assert(data != NULL);
+    assert(((uintptr_t) data % alignof(max_align_t)) == 0);
+
+    arena->data = data;
+    arena->size = size;
+    arena->used = 0;
+    arena->high_water = 0;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    assert(arena != NULL);
+
+    const size_t alignment = alignof(max_align_t);
+    const size_t offset = (arena->used + alignment - 1) / alignment * alignment;
+    if (offset > arena->size || size > arena->size - offset) {
+        return NULL;
+    }
+
+    arena->used = offset + size;
+    arena->high_water = MAX(arena->high_water, arena->used);
+
+    return arena->data + offset;
+}
+
+size_t arena_available(const struct arena* arena)
+{
+    assert(arena != NULL);
+
+    const size_t alignment = alignof(max_align_t);
+    const size_t offset = (arena->used + alignment - 1) / alignment * alignment;
+    return offset < arena->size ? arena->size - offset : 0;
+}
+
+void arena_rewind(struct arena* arena, size_t mark)
+{
+    assert(arena != NULL);
+    assert(mark <= arena->used);
+
+    arena->used = mark;
+}
+
+void arena_reset(struct arena* arena)
+{
+    assert(arena != NULL);
+
+    arena->used = 0;
+}
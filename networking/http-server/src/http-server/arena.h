@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A bump allocator over a caller-provided block of memory.
+ *
+ * Allocations are never freed one by one: everything goes away at once with arena_reset, which makes it a good
+ * fit for data that lives exactly as long as a request.
+ */
+struct arena {
+    uint8_t* data;
+    size_t size;
+    size_t used;
+
+    /**
+     * @brief the peak of used since arena_init
+     */
+    size_t high_water;
+};
+
+void arena_init(struct arena* arena, void* data, size_t size);
+
+/**
+ * @return |size| uninitialized bytes aligned for any type or NULL when the arena is full.
+ */
+void* arena_alloc(struct arena* arena, size_t size);
+
+/**
+ * @return the most bytes a single arena_alloc can still get.
+ */
+size_t arena_available(const struct arena* arena);
+
+/**
+ * @brief drops every allocation made after |mark|, a previous value of arena->used.
+ */
+void arena_rewind(struct arena* arena, size_t mark);
+
+/**
+ * @brief drops every allocation made so far.
+ */
+void arena_reset(struct arena* arena);
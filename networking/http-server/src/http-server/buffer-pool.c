@@ -0,0 +1,139 @@
+#include "buffer-pool.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <assert.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+// released buffers are poisoned, so a use after release is still reported although nothing is actually freed
+#define POISON(ADDR, SIZE)   __asan_poison_memory_region((ADDR), (SIZE))
+#define UNPOISON(ADDR, SIZE) __asan_unpoison_memory_region((ADDR), (SIZE))
+#else
+#define POISON(ADDR, SIZE)   ((void) (ADDR), (void) (SIZE))
+#define UNPOISON(ADDR, SIZE) ((void) (ADDR), (void) (SIZE))
+#endif
+
+#include "commons.h"
+#include "log.h"
+#define LOG_NAME "buffer-pool"
+
+struct buffer_pool_slab {
+    struct buffer_pool_slab* next;
+
+    // keeps the buffers that follow the header aligned for any type
+    max_align_t buffers[];
+};
+
+/**
+ * @brief a released buffer. The free list links are stored in the buffers themselves.
+ */
+struct buffer_pool_free_buffer {
+    struct buffer_pool_free_buffer* next;
+};
+
+static enum result buffer_pool_grow(struct buffer_pool* pool);
+
+void buffer_pool_init(struct buffer_pool* pool, size_t buffer_size, size_t buffers_per_slab)
+{
+    assert(pool != NULL);
+    assert(buffer_size > 0);
+    assert(buffers_per_slab > 0);
+
+    const size_t alignment = alignof(max_align_t);
+    buffer_size = MAX(buffer_size, sizeof(struct buffer_pool_free_buffer));
+
+    pool->buffer_size = (buffer_size + alignment - 1) / alignment * alignment;
+    pool->buffers_per_slab = buffers_per_slab;
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->stats = (struct buffer_pool_stats) {0};
+}
+
+void buffer_pool_free(struct buffer_pool* pool)
+{
+    assert(pool != NULL);
+
+    if (pool->stats.in_use > 0) {
+        LOG_WARNF("freeing a pool with %zu buffers still in use", pool->stats.in_use);
+    }
+
+    struct buffer_pool_slab* slab = pool->slabs;
+    while (slab != NULL) {
+        struct buffer_pool_slab* next = slab->next;
+        UNPOISON(slab->buffers, pool->buffer_size * pool->buffers_per_slab);
+        free(slab);
+        slab = next;
+    }
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->stats.capacity = 0;
+}
+
+void* buffer_pool_acquire(struct buffer_pool* pool)
+{
+    assert(pool != NULL);
+
+    if (pool->free_list != NULL) {
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+        if (buffer_pool_grow(pool) != RESULT_OK) {
+            return NULL;
+        }
+    }
+
+    struct buffer_pool_free_buffer* buffer = pool->free_list;
+    UNPOISON(buffer, pool->buffer_size);
+    pool->free_list = buffer->next;
+
+    pool->stats.in_use++;
+    pool->stats.high_water = MAX(pool->stats.high_water, pool->stats.in_use);
+
+    return buffer;
+}
+
+void buffer_pool_release(struct buffer_pool* pool, void* buffer)
+{
+    assert(pool != NULL);
+    assert(buffer != NULL);
+    assert(pool->stats.in_use > 0);
+
+    struct buffer_pool_free_buffer* free_buffer = buffer;
+    free_buffer->next = pool->free_list;
+    pool->free_list = free_buffer;
+    POISON(free_buffer, pool->buffer_size);
+
+    pool->stats.in_use--;
+}
+
+/**
+ * @brief allocates a new slab and pushes all its buffers on the free list.
+ */
+static enum result buffer_pool_grow(struct buffer_pool* pool)
+{
+    struct buffer_pool_slab* slab = malloc(sizeof(struct buffer_pool_slab) + pool->buffer_size * pool->buffers_per_slab);
+    if (slab == NULL) {
+        LOG_ERRORF("failed to allocate a slab of %zu buffers (%zu bytes each)", pool->buffers_per_slab, pool->buffer_size);
+        return RESULT_ERR;
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    // pushed backwards, so buffers are handed out in address order
+    uint8_t* buffers = (uint8_t*) slab->buffers;
+    for (size_t i = pool->buffers_per_slab; i > 0; i--) {
+        struct buffer_pool_free_buffer* buffer = (struct buffer_pool_free_buffer*) (buffers + (i - 1) * pool->buffer_size);
+        buffer->next = pool->free_list;
+        pool->free_list = buffer;
+        POISON(buffer, pool->buffer_size);
+    }
+
+    pool->stats.capacity += pool->buffers_per_slab;
+
+    return RESULT_OK;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "error.h"
+
+/**
+ * A free list of fixed-size buffers carved out of larger slabs.
+ *
+ * Buffers are never returned to the system until the pool is freed, so once the pool has grown to the peak
+ * demand, acquiring and releasing buffers never calls malloc/free. It is not thread-safe: each worker owns its
+ * own pools.
+ */
+
+struct buffer_pool_stats {
+    /**
+     * @brief acquisitions served from the free list
+     */
+    size_t hits;
+
+    /**
+     * @brief acquisitions that found the free list empty and had to allocate a new slab
+     */
+    size_t misses;
+
+    /**
+     * @brief buffers currently acquired
+     */
+    size_t in_use;
+
+    /**
+     * @brief the peak of in_use
+     */
+    size_t high_water;
+
+    /**
+     * @brief buffers owned by the pool (in use or free)
+     */
+    size_t capacity;
+};
+
+struct buffer_pool_slab;
+struct buffer_pool_free_buffer;
+
+struct buffer_pool {
+    size_t buffer_size;
+    size_t buffers_per_slab;
+
+    struct buffer_pool_slab* slabs;
+    struct buffer_pool_free_buffer* free_list;
+
+    struct buffer_pool_stats stats;
+};
+
+/**
+ * @brief buffers are aligned for any type and |buffer_size| is rounded up accordingly. No memory is allocated
+ *        until the first acquisition.
+ */
+void buffer_pool_init(struct buffer_pool* pool, size_t buffer_size, size_t buffers_per_slab);
+
+/**
+ * @brief releases every slab. Buffers still in use become dangling.
+ */
+void buffer_pool_free(struct buffer_pool* pool);
+
+/**
+ * @return an uninitialized buffer of at least |buffer_size| bytes or NULL when a new slab can't be allocated.
+ */
+void* buffer_pool_acquire(struct buffer_pool* pool);
+
+/**
+ * @brief gives back a |buffer| acquired from this same pool.
+ */
+void buffer_pool_release(struct buffer_pool* pool, void* buffer);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <regex.h>
 #include "error.h"
 
@@ -8,6 +9,11 @@
 
 #define ARRAY_SIZE(XS) (sizeof(XS) / sizeof(XS[0]))
 
+/**
+ * @brief the struct of type |TYPE| embedding |PTR| as its |MEMBER| (for intrusive links).
+ */
+#define CONTAINER_OF(PTR, TYPE, MEMBER) ((TYPE*) ((char*) (PTR) - offsetof(TYPE, MEMBER)))
+
 enum result parse_ull(const char* input, unsigned long long* output);
 void regex_must_compile(regex_t* regex, const char* pattern, int flags);
 
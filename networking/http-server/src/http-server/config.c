@@ -2,23 +2,46 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 
+#include <unistd.h>
+
 #include "commons.h"
 #include "str.h"
 #include "log.h"
 #define LOG_NAME "config"
 
 #define DEFAULT_DEBUG false
+#define DEFAULT_METRICS false
 #define DEFAULT_HOST "127.0.0.1"
 #define DEFAULT_PORT 8080
 #define DEFAULT_TCP_BACKLOG 16
 #define DEFAULT_READ_TIMEOUT_MS 3000
-#define DEFAULT_WRITE_TIMEOUT_MS 1
+#define DEFAULT_WRITE_TIMEOUT_MS 3000
 #define DEFAULT_CONNECTION_TIMEOUT_MS 9000
+#define DEFAULT_SHUTDOWN_TIMEOUT_MS 10000
+#define DEFAULT_WORKERS 1
+#define MAX_WORKERS 1024
+#define DEFAULT_FILE_CACHE_ENTRIES 256
+#define MAX_FILE_CACHE_ENTRIES (1024 * 1024)
+#define DEFAULT_MAX_BODY_SIZE (8 * 1024 * 1024)
+#define DEFAULT_RESPONSE_CACHE_SIZE (16 * 1024 * 1024)
+#define DEFAULT_COMPRESSION_LEVEL 6
+#define DEFAULT_RATE_LIMIT_CLIENTS (64 * 1024)
+#define MAX_RATE_LIMIT_CLIENTS (16 * 1024 * 1024)
+#define MAX_COMPRESSION_LEVEL 9
+
+/**
+ * @brief only variables with this prefix may be set by the env file
+ */
+#define ENV_FILE_KEY_PREFIX "HTTP_SERVER_"
+#define ENV_FILE_LINE_MAX 4096
 
+static enum result config_load_env_file(void);
+static enum result config_snapshot_env(void);
 static void config_init_debug(void);
 static void config_init_host(void);
 static enum result config_init_port(void);
@@ -26,21 +49,51 @@ static enum result config_init_tcp_backlog(void);
 static enum result config_init_read_timeout_ms(void);
 static enum result config_init_write_timeout_ms(void);
 static enum result config_init_connection_timeout_ms(void);
+static enum result config_init_shutdown_timeout_ms(void);
+static enum result config_init_workers(void);
+static enum result config_init_io_backend(void);
+static void config_init_document_root(void);
+static enum result config_init_file_cache_entries(void);
+static enum result config_init_max_body_size(void);
+static enum result config_init_response_cache_size(void);
+static enum result config_init_max_connections(void);
+static enum result config_init_max_in_flight(void);
+static enum result config_init_rate_limit(void);
+static enum result config_init_rate_limit_burst(void);
+static enum result config_init_rate_limit_clients(void);
+static enum result config_init_compression_level(void);
+static void config_init_metrics(void);
+static enum result config_init_log_level(void);
+static enum result config_init_log_format(void);
 
 /**
  * @brief the global config instance
  */
 static struct config config = {0};
 
+/**
+ * @brief a copy of the environment taken before the env file is loaded (NULL when there is no env file)
+ */
+static char** original_env = NULL;
+
 const struct config* config_get(void)
 {
     return &config;
 }
 
+char* const* config_original_env(void)
+{
+    return original_env != NULL ? original_env : environ;
+}
+
 enum result config_init_from_env(void)
 {
     bool failed = false;
 
+    if (config_load_env_file() != RESULT_OK) {
+        failed = true;
+    }
+
     config_init_debug();
     config_init_host();
 
@@ -64,6 +117,66 @@ enum result config_init_from_env(void)
         failed = true;
     }
 
+    if (config_init_shutdown_timeout_ms() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_workers() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_io_backend() != RESULT_OK) {
+        failed = true;
+    }
+
+    config_init_document_root();
+
+    if (config_init_file_cache_entries() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_max_body_size() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_response_cache_size() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_max_connections() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_max_in_flight() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_rate_limit() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_rate_limit_burst() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_rate_limit_clients() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_compression_level() != RESULT_OK) {
+        failed = true;
+    }
+
+    config_init_metrics();
+
+    if (config_init_log_level() != RESULT_OK) {
+        failed = true;
+    }
+
+    if (config_init_log_format() != RESULT_OK) {
+        failed = true;
+    }
+
     if (failed) {
         LOG_ERROR("failed to load configuration from environment variables");
         return RESULT_ERR;
@@ -72,6 +185,118 @@ enum result config_init_from_env(void)
     return RESULT_OK;
 }
 
+/**
+ * @brief loads the KEY=VALUE lines of HTTP_SERVER_ENV_FILE into the environment. Blank lines and lines starting with
+ *        '#' are skipped, and values are taken as they are (no quoting).
+ */
+static enum result config_load_env_file(void)
+{
+    const char* key = "HTTP_SERVER_ENV_FILE";
+    const char* path = getenv(key);
+    if (path == NULL || path[0] == '\0') {
+        return RESULT_OK;
+    }
+
+    if (original_env == NULL && config_snapshot_env() != RESULT_OK) {
+        return RESULT_ERR;
+    }
+
+    FILE* file = fopen(path, "re");
+    if (file == NULL) {
+        int error_code = errno;
+        LOG_ERRORF("%s: failed to open \"%s\": %s", key, path, strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    enum result result = RESULT_OK;
+    char line[ENV_FILE_LINE_MAX];
+    size_t line_number = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            LOG_ERRORF("%s: line %zu: too long", key, line_number);
+            result = RESULT_ERR;
+            break;
+        }
+
+        struct str_slice trimmed = str_slice_trim(str_slice_from_buffer(line, len));
+        if (trimmed.len == 0 || trimmed.ptr[0] == '#') {
+            continue;
+        }
+
+        const char* equal = memchr(trimmed.ptr, '=', trimmed.len);
+        if (equal == NULL) {
+            LOG_ERRORF("%s: line %zu: expected KEY=VALUE", key, line_number);
+            result = RESULT_ERR;
+            continue;
+        }
+
+        const size_t prefix_len = strlen(ENV_FILE_KEY_PREFIX);
+        const struct str_slice name = str_slice_trim(str_slice_from_buffer(trimmed.ptr, (size_t) (equal - trimmed.ptr)));
+        if (name.len <= prefix_len || strncmp(name.ptr, ENV_FILE_KEY_PREFIX, prefix_len) != 0) {
+            LOG_ERRORF("%s: line %zu: only %s* variables can be set", key, line_number, ENV_FILE_KEY_PREFIX);
+            result = RESULT_ERR;
+            continue;
+        }
+
+        const struct str_slice value = str_slice_trim(
+            str_slice_from_buffer(equal + 1, (size_t) (trimmed.ptr + trimmed.len - (equal + 1))));
+
+        // both are slices of |line|, which can be cut in place
+        line[name.ptr + name.len - line] = '\0';
+        line[value.ptr + value.len - line] = '\0';
+        if (setenv(name.ptr, value.ptr, 1) != 0) {
+            int error_code = errno;
+            LOG_ERRORF("%s: line %zu: setenv failed: %s", key, line_number, strerror(error_code));
+            result = RESULT_ERR;
+        }
+    }
+
+    if (ferror(file)) {
+        LOG_ERRORF("%s: failed to read \"%s\"", key, path);
+        result = RESULT_ERR;
+    }
+
+    fclose(file);
+    return result;
+}
+
+/**
+ * @brief copies the environment into original_env. setenv may replace (and free) the strings of environ, so they are
+ *        copied too. It lives as long as the process.
+ */
+static enum result config_snapshot_env(void)
+{
+    size_t env_count = 0;
+    while (environ[env_count] != NULL) {
+        env_count++;
+    }
+
+    char** env = calloc(env_count + 1, sizeof(char*));
+    if (env == NULL) {
+        LOG_ERROR("failed to copy the environment: out of memory");
+        return RESULT_ERR;
+    }
+
+    for (size_t i = 0; i < env_count; i++) {
+        env[i] = strdup(environ[i]);
+        if (env[i] == NULL) {
+            LOG_ERROR("failed to copy the environment: out of memory");
+            for (size_t j = 0; j < i; j++) {
+                free(env[j]);
+            }
+            free(env);
+            return RESULT_ERR;
+        }
+    }
+
+    original_env = env;
+    return RESULT_OK;
+}
+
 static void config_init_debug(void)
 {
     if (getenv("HTTP_SERVER_DEBUG") == NULL) {
@@ -202,3 +427,358 @@ static enum result config_init_connection_timeout_ms(void)
 
     return RESULT_OK;
 }
+
+static enum result config_init_shutdown_timeout_ms(void)
+{
+    const char* key = "HTTP_SERVER_SHUTDOWN_TIMEOUT_MS";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.shutdown_timeout_ms = DEFAULT_SHUTDOWN_TIMEOUT_MS;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > INT_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.shutdown_timeout_ms = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_workers(void)
+{
+    const char* key = "HTTP_SERVER_WORKERS";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.workers = DEFAULT_WORKERS;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > MAX_WORKERS) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    // 0 means one worker per online cpu
+    if (parsed_value == 0) {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        parsed_value = (online_cpus > 0) ? (unsigned long long) online_cpus : 1;
+    }
+
+    config.workers = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static void config_init_document_root(void)
+{
+    const char* value = getenv("HTTP_SERVER_DOCUMENT_ROOT");
+    if (value == NULL || value[0] == '\0') {
+        config.document_root = NULL;
+    } else {
+        config.document_root = value;
+    }
+}
+
+static enum result config_init_file_cache_entries(void)
+{
+    const char* key = "HTTP_SERVER_FILE_CACHE_ENTRIES";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.file_cache_entries = DEFAULT_FILE_CACHE_ENTRIES;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value == 0) {
+        LOG_ERRORF("%s: bad value: at least one entry is needed", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > MAX_FILE_CACHE_ENTRIES) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.file_cache_entries = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_max_body_size(void)
+{
+    const char* key = "HTTP_SERVER_MAX_BODY_SIZE";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.max_body_size = DEFAULT_MAX_BODY_SIZE;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > SIZE_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.max_body_size = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_response_cache_size(void)
+{
+    const char* key = "HTTP_SERVER_RESPONSE_CACHE_SIZE";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.response_cache_size = DEFAULT_RESPONSE_CACHE_SIZE;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > SIZE_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.response_cache_size = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_max_connections(void)
+{
+    const char* key = "HTTP_SERVER_MAX_CONNECTIONS";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.max_connections = 0;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > SIZE_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.max_connections = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_max_in_flight(void)
+{
+    const char* key = "HTTP_SERVER_MAX_IN_FLIGHT";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.max_in_flight = 0;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > SIZE_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.max_in_flight = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_rate_limit(void)
+{
+    const char* key = "HTTP_SERVER_RATE_LIMIT";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.rate_limit = 0;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > UINT32_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.rate_limit = (uint32_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief defaults to a second worth of requests. Must come after config_init_rate_limit.
+ */
+static enum result config_init_rate_limit_burst(void)
+{
+    const char* key = "HTTP_SERVER_RATE_LIMIT_BURST";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.rate_limit_burst = config.rate_limit;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value == 0) {
+        LOG_ERRORF("%s: bad value: at least one request is needed", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > UINT32_MAX) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.rate_limit_burst = (uint32_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_rate_limit_clients(void)
+{
+    const char* key = "HTTP_SERVER_RATE_LIMIT_CLIENTS";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.rate_limit_clients = DEFAULT_RATE_LIMIT_CLIENTS;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value == 0) {
+        LOG_ERRORF("%s: bad value: at least one client is needed", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > MAX_RATE_LIMIT_CLIENTS) {
+        LOG_ERRORF("%s: bad value: value is too big", key);
+        return RESULT_ERR;
+    }
+
+    config.rate_limit_clients = (size_t) parsed_value;
+
+    return RESULT_OK;
+}
+
+static enum result config_init_compression_level(void)
+{
+    const char* key = "HTTP_SERVER_COMPRESSION_LEVEL";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.compression_level = DEFAULT_COMPRESSION_LEVEL;
+        return RESULT_OK;
+    }
+
+    unsigned long long parsed_value;
+    if (parse_ull(value, &parsed_value) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: Not a Number", key);
+        return RESULT_ERR;
+    }
+    if (parsed_value > MAX_COMPRESSION_LEVEL) {
+        LOG_ERRORF("%s: bad value: expected 0 (disabled) to %d", key, MAX_COMPRESSION_LEVEL);
+        return RESULT_ERR;
+    }
+
+    config.compression_level = (int) parsed_value;
+
+    return RESULT_OK;
+}
+
+static void config_init_metrics(void)
+{
+    if (getenv("HTTP_SERVER_METRICS") == NULL) {
+        config.metrics = DEFAULT_METRICS;
+    } else {
+        config.metrics = true;
+    }
+}
+
+static enum result config_init_io_backend(void)
+{
+    const char* key = "HTTP_SERVER_IO_BACKEND";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.io_backend = EVENT_LOOP_BACKEND_EPOLL;
+        return RESULT_OK;
+    }
+
+    if (event_loop_backend_parse(value, &config.io_backend) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: expected epoll or io_uring", key);
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+static enum result config_init_log_level(void)
+{
+    const char* key = "HTTP_SERVER_LOG_LEVEL";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.log_level = config.debug ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO;
+        return RESULT_OK;
+    }
+
+    if (log_level_parse(value, &config.log_level) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: expected one of debug, info, warn, error or off", key);
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+static enum result config_init_log_format(void)
+{
+    const char* key = "HTTP_SERVER_LOG_FORMAT";
+    const char* value = getenv(key);
+    if (value == NULL) {
+        config.log_format = LOG_FORMAT_TEXT;
+        return RESULT_OK;
+    }
+
+    if (log_format_parse(value, &config.log_format) != RESULT_OK) {
+        LOG_ERRORF("%s: bad value: expected text or json", key);
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
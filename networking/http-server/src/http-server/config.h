@@ -5,6 +5,8 @@
 #include <stddef.h>
 
 #include "error.h"
+#include "log.h"
+#include "event-loop.h"
 
 /**
  * The application configuration
@@ -17,6 +19,83 @@ struct config {
     size_t read_timeout_ms;
     size_t write_timeout_ms;
     size_t connection_timeout_ms;
+
+    /**
+     * How long in-flight requests are given to complete on shutdown (SIGTERM) or reload (SIGHUP), before the
+     * connections left are closed anyway.
+     */
+    size_t shutdown_timeout_ms;
+
+    /**
+     * Number of worker threads. Each one owns a listening socket (SO_REUSEPORT) and an event loop.
+     */
+    size_t workers;
+
+    /**
+     * How every worker waits for its sockets: epoll (the default) or io_uring.
+     */
+    enum event_loop_backend io_backend;
+
+    /**
+     * Directory served as static files (GET/HEAD). NULL when static files are not served.
+     */
+    const char* document_root;
+
+    /**
+     * Number of open files kept by each worker for the document root.
+     */
+    size_t file_cache_entries;
+
+    /**
+     * Largest request body accepted (413 beyond). Bodies are streamed, so it does not change the memory used.
+     */
+    size_t max_body_size;
+
+    /**
+     * Bytes of responses cached for the routes that allow it, shared by every worker. 0 disables the cache.
+     */
+    size_t response_cache_size;
+
+    /**
+     * Most client connections open at once, split evenly among the workers. The connections accepted beyond it get a
+     * 503 right away and are closed. 0 means unlimited.
+     */
+    size_t max_connections;
+
+    /**
+     * Most connections with a request in flight at once, split evenly among the workers. A request starting beyond it
+     * gets a 503 before it is even parsed, and its connection is closed. 0 means unlimited.
+     */
+    size_t max_in_flight;
+
+    /**
+     * Requests per second allowed to every client address once its burst of rate_limit_burst requests is spent. The
+     * requests beyond it get a 429. 0 disables rate limiting.
+     */
+    uint32_t rate_limit;
+    uint32_t rate_limit_burst;
+
+    /**
+     * Number of client addresses whose rate is tracked (the least recently seen ones are forgotten beyond it).
+     */
+    size_t rate_limit_clients;
+
+    /**
+     * zlib level (1-9) of the compressed responses (gzip or deflate, as the client accepts). 0 disables compression.
+     */
+    int compression_level;
+
+    /**
+     * Whether GET /metrics is served. Off unless HTTP_SERVER_METRICS is set: the metrics tell anyone about the load
+     * and the limits of the server.
+     */
+    bool metrics;
+
+    /**
+     * Lowest level logged (debug when `debug` is set, info otherwise) and the log output format.
+     */
+    enum log_level log_level;
+    enum log_format log_format;
 };
 
 /**
@@ -26,5 +105,15 @@ const struct config* config_get(void);
 
 /**
  * @brief Initializes the configuration from environment variables values.
+ *
+ * When HTTP_SERVER_ENV_FILE names a file, its HTTP_SERVER_* KEY=VALUE lines are loaded into the environment first
+ * (overriding it). That file is read again by the process taking over on a reload, so it is how the configuration
+ * of a running server changes.
  */
 enum result config_init_from_env(void);
+
+/**
+ * @brief the environment the process was started with, before HTTP_SERVER_ENV_FILE was loaded into it: what a process
+ *        taking over must start with, so that the variables removed from the file since are gone for it.
+ */
+char* const* config_original_env(void);
@@ -0,0 +1,2 @@
+#define DYNAMIC_ARRAY_IMPLEMENTATION
+#include "dynamic-array.h"
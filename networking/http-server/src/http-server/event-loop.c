@@ -0,0 +1,1243 @@
+#include "event-loop.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "commons.h"
+#include "stopwatch.h"
+#include "log.h"
+#define LOG_NAME "event-loop"
+
+/**
+ * @brief submission entries of the io_uring backend. A full ring is flushed on the spot, so it only bounds how many
+ *        requests are batched with a single wait.
+ */
+#define EVENT_LOOP_URING_ENTRIES 256
+
+/**
+ * @brief the user data of the requests whose completions are ignored (removals, cancellations, sends and closes)
+ */
+#define EVENT_LOOP_URING_IGNORED UINT64_MAX
+
+/**
+ * @brief the provided buffer group streams receive into
+ */
+#define EVENT_LOOP_URING_BUFFER_GROUP 0
+
+/**
+ * @brief the requests a registration may have in flight, stored in the top byte of their user data
+ */
+enum event_loop_uring_op {
+    EVENT_LOOP_URING_OP_POLL = 0,
+    EVENT_LOOP_URING_OP_ACCEPT,
+    EVENT_LOOP_URING_OP_RECV,
+};
+
+static enum result event_loop_uring_check_ops(const struct event_loop* loop);
+static enum result event_loop_uring_init_buffers(struct event_loop* loop, size_t max_streams);
+static enum result event_loop_uring_check_recv_multishot(struct event_loop* loop);
+static void event_loop_uring_provide_buffer(struct event_loop* loop, uint16_t id);
+static struct event_loop_registration* event_loop_uring_register(struct event_loop* loop, int fd,
+                                                                 enum event_loop_registration_kind kind,
+                                                                 uint32_t events, void* data);
+static enum result event_loop_uring_add(struct event_loop* loop, int fd, uint32_t events, void* data);
+static enum result event_loop_uring_add_listener(struct event_loop* loop, int fd, void* data);
+static enum result event_loop_uring_add_stream(struct event_loop* loop, int fd, uint32_t events, void* data);
+static enum result event_loop_uring_remove(struct event_loop* loop, int fd);
+static enum result event_loop_uring_cancel(struct event_loop* loop, int fd, uint64_t user_data);
+static void event_loop_uring_take_accepted(struct event_loop* loop, int fd, uint64_t user_data);
+static enum result event_loop_uring_poll(struct event_loop* loop, int fd);
+static enum result event_loop_uring_accept_multishot(struct event_loop* loop, int fd);
+static enum result event_loop_uring_recv_multishot(struct event_loop* loop, int fd);
+static enum io_status event_loop_uring_accept(struct event_loop* loop, int fd, int* out_fd, uint32_t* out_address);
+static enum io_status event_loop_uring_recv(struct event_loop* loop, int fd, uint8_t* buffer, size_t buffer_size,
+                                            size_t* out_bytes_read);
+static void event_loop_uring_send_and_close(struct event_loop* loop, int fd, const void* data, size_t len);
+static int event_loop_uring_wait(struct event_loop* loop, struct epoll_event* events, int max_events, int timeout_ms);
+static int event_loop_uring_reap(struct event_loop* loop, struct epoll_event* events, int max_events);
+static uint32_t event_loop_uring_on_accept(struct event_loop* loop, int fd, int32_t res, uint32_t flags);
+static enum result event_loop_uring_park_accept(struct event_loop* loop, int fd, int32_t res);
+static enum result event_loop_uring_unpark_accepts(struct event_loop* loop);
+static uint32_t event_loop_uring_on_recv(struct event_loop* loop, int fd, int32_t res, uint32_t flags);
+
+static inline uint64_t event_loop_uring_user_data(const struct event_loop_registration* registration, int fd,
+                                                  enum event_loop_uring_op op)
+{
+    return ((uint64_t) op << 56) | ((uint64_t) (registration->generation & 0xFFFFFF) << 32) | (uint32_t) fd;
+}
+
+static inline uint8_t* event_loop_uring_buffer(const struct event_loop* loop, uint16_t id)
+{
+    return loop->buffer_data + (size_t) id * EVENT_LOOP_URING_RECV_BUFFER_SIZE;
+}
+
+enum result event_loop_backend_parse(const char* value, enum event_loop_backend* out_backend)
+{
+    assert(value != NULL);
+    assert(out_backend != NULL);
+
+    if (strcmp(value, "epoll") == 0) {
+        *out_backend = EVENT_LOOP_BACKEND_EPOLL;
+        return RESULT_OK;
+    }
+    if (strcmp(value, "io_uring") == 0) {
+        *out_backend = EVENT_LOOP_BACKEND_IO_URING;
+        return RESULT_OK;
+    }
+    return RESULT_ERR;
+}
+
+const char* event_loop_backend_cstr(enum event_loop_backend backend)
+{
+    switch (backend) {
+        case EVENT_LOOP_BACKEND_EPOLL:
+            return "epoll";
+        case EVENT_LOOP_BACKEND_IO_URING:
+            return "io_uring";
+    }
+    return "unknown";
+}
+
+enum result event_loop_init(struct event_loop* loop, enum event_loop_backend backend, size_t max_streams)
+{
+    assert(loop != NULL);
+
+    loop->backend = backend;
+    loop->epoll_fd = -1;
+    loop->ring.fd = -1;
+    event_loop_registration_list_init(&loop->registrations);
+    loop->wait_id = 0;
+    loop->buffer_ring = NULL;
+    loop->buffer_ring_size = 0;
+    loop->buffer_count = 0;
+    loop->buffer_ring_tail = 0;
+    loop->buffer_data = NULL;
+    loop->buffers = NULL;
+    loop->buffers_free = 0;
+    event_loop_fd_list_init(&loop->starved);
+    event_loop_fd_list_init(&loop->received);
+    event_loop_accepted_list_init(&loop->accepted);
+    loop->accepted_start = 0;
+    event_loop_fd_list_init(&loop->parked);
+    loop->parked_until_ms = 0;
+    loop->park_backoff_ms = EVENT_LOOP_URING_ACCEPT_BACKOFF_MIN_MS;
+
+    switch (backend) {
+        case EVENT_LOOP_BACKEND_EPOLL:
+            loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (loop->epoll_fd < 0) {
+                int error_code = errno;
+                LOG_ERRORF("epoll_create1 failed: %s", strerror(error_code));
+                return RESULT_ERR;
+            }
+            break;
+
+        case EVENT_LOOP_BACKEND_IO_URING:
+            if (uring_init(&loop->ring, EVENT_LOOP_URING_ENTRIES) != RESULT_OK) {
+                return RESULT_ERR;
+            }
+            // what the kernel lacks is found out here, not on the first connection
+            if (event_loop_uring_check_ops(loop) != RESULT_OK
+                || event_loop_uring_init_buffers(loop, max_streams) != RESULT_OK
+                || event_loop_uring_check_recv_multishot(loop) != RESULT_OK)
+            {
+                event_loop_free(loop);
+                return RESULT_ERR;
+            }
+            break;
+    }
+
+    return RESULT_OK;
+}
+
+void event_loop_free(struct event_loop* loop)
+{
+    assert(loop != NULL);
+
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+
+    // every request still in flight is cancelled with the ring, which also unregisters the buffer ring
+    if (loop->ring.fd >= 0) {
+        uring_free(&loop->ring);
+        event_loop_registration_list_free(&loop->registrations);
+
+        for (size_t i = loop->accepted_start; i < loop->accepted.length; i++) {
+            if (loop->accepted.items[i].fd >= 0) {
+                close(loop->accepted.items[i].fd);
+            }
+        }
+        event_loop_accepted_list_free(&loop->accepted);
+        event_loop_fd_list_free(&loop->starved);
+        event_loop_fd_list_free(&loop->received);
+        event_loop_fd_list_free(&loop->parked);
+
+        if (loop->buffer_ring != NULL) {
+            munmap(loop->buffer_ring, loop->buffer_ring_size);
+            loop->buffer_ring = NULL;
+        }
+        free(loop->buffer_data);
+        loop->buffer_data = NULL;
+        free(loop->buffers);
+        loop->buffers = NULL;
+    }
+}
+
+enum result event_loop_add(struct event_loop* loop, int fd, uint32_t events, void* data)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(data != NULL);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_add(loop, fd, events, data);
+    }
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = data,
+    };
+
+    io_count_syscall();
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("epoll_ctl(ADD) failed: fd=%d: %s", fd, strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+enum result event_loop_add_listener(struct event_loop* loop, int fd, void* data)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(data != NULL);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_add_listener(loop, fd, data);
+    }
+
+    return event_loop_add(loop, fd, EPOLLIN | EPOLLET, data);
+}
+
+enum result event_loop_add_stream(struct event_loop* loop, int fd, uint32_t events, void* data)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(data != NULL);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_add_stream(loop, fd, events, data);
+    }
+
+    return event_loop_add(loop, fd, events, data);
+}
+
+enum result event_loop_remove(struct event_loop* loop, int fd)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_remove(loop, fd);
+    }
+
+    io_count_syscall();
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("epoll_ctl(DEL) failed: fd=%d: %s", fd, strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+void event_loop_forget(struct event_loop* loop, int fd)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        event_loop_uring_remove(loop, fd);
+    }
+}
+
+enum io_status event_loop_accept(struct event_loop* loop, int fd, int* out_fd, uint32_t* out_address)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(out_fd != NULL);
+
+    *out_fd = -1;
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_accept(loop, fd, out_fd, out_address);
+    }
+
+    while (true) {
+        struct sockaddr_in address;
+        socklen_t address_len = sizeof(address);
+
+        io_count_syscall();
+        int client_fd = accept4(fd, (struct sockaddr*) &address, &address_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd >= 0) {
+            *out_fd = client_fd;
+            if (out_address != NULL) {
+                *out_address = address.sin_addr.s_addr;
+            }
+            return IO_STATUS_OK;
+        }
+
+        int error_code = errno;
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK) {
+            return IO_STATUS_WOULD_BLOCK;
+        }
+        // the client gave up before being accepted (or a signal): the next one may be waiting
+        if (error_code == EINTR || error_code == ECONNABORTED) {
+            continue;
+        }
+
+        LOG_ERRORF("accept4 failed: fd=%d: %s", fd, strerror(error_code));
+        return IO_STATUS_ERR;
+    }
+}
+
+enum io_status event_loop_recv(struct event_loop* loop, int fd, uint8_t* buffer, size_t buffer_size, size_t* out_bytes_read)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(buffer != NULL);
+    assert(out_bytes_read != NULL);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_recv(loop, fd, buffer, buffer_size, out_bytes_read);
+    }
+
+    return recv_nonblocking(fd, buffer, buffer_size, out_bytes_read);
+}
+
+void event_loop_send_and_close(struct event_loop* loop, int fd, const void* data, size_t len)
+{
+    assert(loop != NULL);
+    assert(fd >= 0);
+    assert(data != NULL);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        event_loop_uring_send_and_close(loop, fd, data, len);
+        return;
+    }
+
+    io_count_syscall();
+    (void) send(fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    io_count_syscall();
+    close(fd);
+}
+
+int event_loop_wait(struct event_loop* loop, struct epoll_event* events, int max_events, int timeout_ms)
+{
+    assert(loop != NULL);
+    assert(events != NULL);
+    assert(max_events > 0);
+
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+        return event_loop_uring_wait(loop, events, max_events, timeout_ms);
+    }
+
+    io_count_syscall();
+    int ready_count = epoll_wait(loop->epoll_fd, events, max_events, timeout_ms);
+    if (ready_count < 0) {
+        int error_code = errno;
+        if (error_code == EINTR) {
+            return 0;
+        }
+        LOG_ERRORF("epoll_wait failed: %s", strerror(error_code));
+        return -1;
+    }
+
+    return ready_count;
+}
+
+/**
+ * @brief checks that the kernel supports every request the io_uring backend makes.
+ */
+static enum result event_loop_uring_check_ops(const struct event_loop* loop)
+{
+    static const struct {
+        uint8_t opcode;
+        const char* name;
+    } ops[] = {
+        { IORING_OP_POLL_ADD, "POLL_ADD" },
+        { IORING_OP_POLL_REMOVE, "POLL_REMOVE" },
+        { IORING_OP_ACCEPT, "ACCEPT" },
+        { IORING_OP_RECV, "RECV" },
+        { IORING_OP_SEND, "SEND" },
+        { IORING_OP_CLOSE, "CLOSE" },
+        { IORING_OP_ASYNC_CANCEL, "ASYNC_CANCEL" },
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(ops); i++) {
+        if (!uring_supports(&loop->ring, ops[i].opcode)) {
+            LOG_ERRORF("io_uring: %s requests are not supported (the io_uring backend needs Linux 6.0 or later)",
+                       ops[i].name);
+            return RESULT_ERR;
+        }
+    }
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief the kernel accepts multishot recvs (6.0+) only if it fails none. There is no probe for the flags of a
+ *        request: one is tried on a socket pair with a byte waiting, which must complete with it and go on.
+ */
+static enum result event_loop_uring_check_recv_multishot(struct event_loop* loop)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("io_uring: failed to check multishot recvs: socketpair failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    enum result result = RESULT_ERR;
+    const uint8_t byte = 0;
+    struct io_uring_sqe* sqe = NULL;
+    if (send(fds[1], &byte, sizeof(byte), MSG_NOSIGNAL) != (ssize_t) sizeof(byte)
+        || (sqe = uring_get_sqe(&loop->ring)) == NULL)
+    {
+        LOG_ERROR("io_uring: failed to check multishot recvs");
+        goto out;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = EVENT_LOOP_URING_BUFFER_GROUP;
+    sqe->user_data = EVENT_LOOP_URING_IGNORED;
+
+    // the byte is there already, so it completes right away (or fails right away)
+    const struct io_uring_cqe* cqe = NULL;
+    if (uring_enter(&loop->ring, 1, 1000) != RESULT_OK || (cqe = uring_peek_cqe(&loop->ring)) == NULL) {
+        LOG_ERROR("io_uring: failed to check multishot recvs: no completion");
+        goto out;
+    }
+    if (cqe->res != (int32_t) sizeof(byte) || !(cqe->flags & IORING_CQE_F_MORE)) {
+        LOG_ERRORF("io_uring: multishot recvs are not supported (res=%d; the io_uring backend needs Linux 6.0 or "
+                   "later)", cqe->res);
+        goto out;
+    }
+
+    // still armed: cancelled. Its completions (and the buffer it took) are dropped by the first wait.
+    if (event_loop_uring_cancel(loop, fds[0], EVENT_LOOP_URING_IGNORED) != RESULT_OK) {
+        goto out;
+    }
+    result = RESULT_OK;
+
+out:
+    close(fds[0]);
+    close(fds[1]);
+    return result;
+}
+
+/**
+ * @brief maps the provided buffer ring, registers it as EVENT_LOOP_URING_BUFFER_GROUP and hands every buffer over.
+ *        The buffers are only allocated: the pages the kernel never fills are never backed.
+ */
+static enum result event_loop_uring_init_buffers(struct event_loop* loop, size_t max_streams)
+{
+    static_assert((EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX & (EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX - 1)) == 0,
+                  "the provided buffer ring size must be a power of 2");
+    static_assert(EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX <= UINT16_MAX, "buffer ids are 16 bits");
+
+    // the ring size must be a power of 2
+    uint32_t buffer_count = EVENT_LOOP_URING_RECV_BUFFER_COUNT_DEFAULT;
+    if (max_streams > 0 && max_streams <= EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX / EVENT_LOOP_URING_RECV_QUEUE_MAX) {
+        buffer_count = EVENT_LOOP_URING_RECV_BUFFER_COUNT_MIN;
+        while (buffer_count < max_streams * EVENT_LOOP_URING_RECV_QUEUE_MAX) {
+            buffer_count *= 2;
+        }
+    } else if (max_streams > 0) {
+        buffer_count = EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX;
+    }
+    loop->buffer_count = buffer_count;
+    LOG_DEBUGF("provided buffers: count=%u size=%u", buffer_count, EVENT_LOOP_URING_RECV_BUFFER_SIZE);
+
+    // the ring has to be page aligned
+    loop->buffer_ring_size = buffer_count * sizeof(struct io_uring_buf);
+    void* buffer_ring = mmap(NULL, loop->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_ring == MAP_FAILED) {
+        int error_code = errno;
+        LOG_ERRORF("failed to map the provided buffer ring: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+    loop->buffer_ring = buffer_ring;
+
+    loop->buffer_data = malloc((size_t) buffer_count * EVENT_LOOP_URING_RECV_BUFFER_SIZE);
+    loop->buffers = calloc(buffer_count, sizeof(struct event_loop_buffer));
+    if (loop->buffer_data == NULL || loop->buffers == NULL) {
+        LOG_ERROR("failed to allocate the provided buffers: out of memory");
+        return RESULT_ERR;
+    }
+
+    struct io_uring_buf_reg registration = {
+        .ring_addr = (uint64_t) (uintptr_t) loop->buffer_ring,
+        .ring_entries = buffer_count,
+        .bgid = EVENT_LOOP_URING_BUFFER_GROUP,
+    };
+    if (uring_register(&loop->ring, IORING_REGISTER_PBUF_RING, &registration, 1) != RESULT_OK) {
+        LOG_ERROR("io_uring: provided buffer rings are not supported (the io_uring backend needs Linux 6.0 or later)");
+        return RESULT_ERR;
+    }
+
+    for (uint32_t id = 0; id < buffer_count; id++) {
+        event_loop_uring_provide_buffer(loop, (uint16_t) id);
+    }
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief gives the buffer |id| (back) to the kernel, for the multishot recvs to fill.
+ */
+static void event_loop_uring_provide_buffer(struct event_loop* loop, uint16_t id)
+{
+    const size_t index = loop->buffer_ring_tail & (loop->buffer_count - 1);
+    struct io_uring_buf* buf = &loop->buffer_ring->bufs[index];
+    buf->addr = (uint64_t) (uintptr_t) event_loop_uring_buffer(loop, id);
+    buf->len = EVENT_LOOP_URING_RECV_BUFFER_SIZE;
+    buf->bid = id;
+
+    loop->buffer_ring_tail++;
+    __atomic_store_n(&loop->buffer_ring->tail, loop->buffer_ring_tail, __ATOMIC_RELEASE);
+    loop->buffers_free++;
+}
+
+static struct event_loop_registration* event_loop_uring_register(struct event_loop* loop, int fd,
+                                                                 enum event_loop_registration_kind kind,
+                                                                 uint32_t events, void* data)
+{
+    struct event_loop_registration_list* registrations = &loop->registrations;
+    while (registrations->length <= (size_t) fd) {
+        if (event_loop_registration_list_push_back(registrations, (struct event_loop_registration) {0}) != 0) {
+            LOG_ERRORF("failed to register fd=%d: out of memory", fd);
+            return NULL;
+        }
+    }
+
+    struct event_loop_registration* registration = &registrations->items[fd];
+    assert(registration->data == NULL);
+    registration->data = data;
+    registration->events = events;
+    registration->wait_id = loop->wait_id - 1;
+    registration->kind = kind;
+    registration->accept_parked = false;
+    registration->recv_state = EVENT_LOOP_RECV_IDLE;
+    registration->recv_count = 0;
+    registration->recv_offset = 0;
+    registration->recv_eof = false;
+    registration->recv_error = 0;
+
+    return registration;
+}
+
+static enum result event_loop_uring_add(struct event_loop* loop, int fd, uint32_t events, void* data)
+{
+    struct event_loop_registration* registration =
+        event_loop_uring_register(loop, fd, EVENT_LOOP_REGISTRATION_POLL, events, data);
+    if (registration == NULL) {
+        return RESULT_ERR;
+    }
+
+    if (event_loop_uring_poll(loop, fd) != RESULT_OK) {
+        registration->data = NULL;
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+static enum result event_loop_uring_add_listener(struct event_loop* loop, int fd, void* data)
+{
+    struct event_loop_registration* registration =
+        event_loop_uring_register(loop, fd, EVENT_LOOP_REGISTRATION_LISTENER, EPOLLIN, data);
+    if (registration == NULL) {
+        return RESULT_ERR;
+    }
+
+    if (event_loop_uring_accept_multishot(loop, fd) != RESULT_OK) {
+        registration->data = NULL;
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+static enum result event_loop_uring_add_stream(struct event_loop* loop, int fd, uint32_t events, void* data)
+{
+    // the recv reports readability (and the end of the stream): the poll is only left with the rest
+    const uint32_t poll_events = events & ~(uint32_t) (EPOLLIN | EPOLLRDHUP | EPOLLET);
+
+    struct event_loop_registration* registration =
+        event_loop_uring_register(loop, fd, EVENT_LOOP_REGISTRATION_STREAM, poll_events, data);
+    if (registration == NULL) {
+        return RESULT_ERR;
+    }
+
+    if ((poll_events != 0 && event_loop_uring_poll(loop, fd) != RESULT_OK)
+        || event_loop_uring_recv_multishot(loop, fd) != RESULT_OK)
+    {
+        registration->data = NULL;
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+static enum result event_loop_uring_remove(struct event_loop* loop, int fd)
+{
+    if ((size_t) fd >= loop->registrations.length || loop->registrations.items[fd].data == NULL) {
+        LOG_ERRORF("fd=%d is not registered", fd);
+        return RESULT_ERR;
+    }
+
+    struct event_loop_registration* registration = &loop->registrations.items[fd];
+    enum result result = RESULT_OK;
+
+    if (registration->events != 0 && registration->kind != EVENT_LOOP_REGISTRATION_LISTENER) {
+        struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+        if (sqe == NULL) {
+            LOG_ERRORF("failed to cancel the poll of fd=%d: submission ring full", fd);
+            result = RESULT_ERR;
+        } else {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_POLL);
+            sqe->user_data = EVENT_LOOP_URING_IGNORED;
+        }
+    }
+
+    switch (registration->kind) {
+        case EVENT_LOOP_REGISTRATION_POLL:
+            break;
+
+        case EVENT_LOOP_REGISTRATION_LISTENER: {
+            const uint64_t user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_ACCEPT);
+            if (event_loop_uring_cancel(loop, fd, user_data) != RESULT_OK) {
+                result = RESULT_ERR;
+            }
+            event_loop_uring_take_accepted(loop, fd, user_data);
+            break;
+        }
+
+        case EVENT_LOOP_REGISTRATION_STREAM:
+            if (registration->recv_state == EVENT_LOOP_RECV_ARMED
+                && event_loop_uring_cancel(loop, fd,
+                                           event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_RECV))
+                       != RESULT_OK)
+            {
+                result = RESULT_ERR;
+            }
+
+            // the buffers it did not read go back to the kernel
+            while (registration->recv_count > 0) {
+                const uint16_t id = registration->recv_head;
+                registration->recv_head = loop->buffers[id].next;
+                registration->recv_count--;
+                event_loop_uring_provide_buffer(loop, id);
+            }
+            registration->recv_offset = 0;
+            registration->recv_state = EVENT_LOOP_RECV_IDLE;
+            break;
+    }
+
+    // whatever is still queued for it is stale from now on
+    registration->data = NULL;
+    registration->generation++;
+
+    // about to be closed: the fd it frees may be what a parked listener waits for
+    if (registration->kind != EVENT_LOOP_REGISTRATION_LISTENER && loop->parked.length > 0
+        && event_loop_uring_unpark_accepts(loop) != RESULT_OK)
+    {
+        result = RESULT_ERR;
+    }
+
+    return result;
+}
+
+/**
+ * @brief cancels the request of |fd| with the given |user_data|. Its completions still arrive (stale by then).
+ */
+static enum result event_loop_uring_cancel(struct event_loop* loop, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        LOG_ERRORF("failed to cancel a request of fd=%d: submission ring full", fd);
+        return RESULT_ERR;
+    }
+
+    // by user data, not by fd: the fd is usually closed before the cancellation is submitted
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = EVENT_LOOP_URING_IGNORED;
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief submits the cancellation of a listener's multishot accept right away, and moves the connections it accepted
+ *        in the meantime (completed, not reaped yet) to the accepted list, so that none is left behind.
+ */
+static void event_loop_uring_take_accepted(struct event_loop* loop, int fd, uint64_t user_data)
+{
+    if (uring_enter(&loop->ring, 0, 0) != RESULT_OK) {
+        LOG_WARNF("failed to submit the cancellation of the accept of fd=%d", fd);
+    }
+
+    const unsigned tail = __atomic_load_n(loop->ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (unsigned head = *loop->ring.cq_head; head != tail; head++) {
+        struct io_uring_cqe* cqe = &loop->ring.cqes[head & loop->ring.cq_mask];
+        if (cqe->user_data != user_data) {
+            continue;
+        }
+
+        if (cqe->res >= 0) {
+            const struct event_loop_accepted accepted = { .listen_fd = fd, .fd = cqe->res };
+            if (event_loop_accepted_list_push_back(&loop->accepted, accepted) != 0) {
+                LOG_ERRORF("dropping a connection accepted on fd=%d: out of memory", fd);
+                close(cqe->res);
+            }
+        }
+        cqe->user_data = EVENT_LOOP_URING_IGNORED;
+    }
+}
+
+/**
+ * @brief (re-)arms the multishot poll of a registered |fd|. It is submitted with the next wait.
+ */
+static enum result event_loop_uring_poll(struct event_loop* loop, int fd)
+{
+    const struct event_loop_registration* registration = &loop->registrations.items[fd];
+
+    struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        LOG_ERRORF("failed to poll fd=%d: submission ring full", fd);
+        return RESULT_ERR;
+    }
+
+    // multishot polls are edge-triggered unless asked otherwise (IORING_POLL_ADD_LEVEL)
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = registration->events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_POLL);
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief (re-)arms the multishot accept of a registered listener |fd|. It is submitted with the next wait.
+ */
+static enum result event_loop_uring_accept_multishot(struct event_loop* loop, int fd)
+{
+    const struct event_loop_registration* registration = &loop->registrations.items[fd];
+
+    struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        LOG_ERRORF("failed to accept on fd=%d: submission ring full", fd);
+        return RESULT_ERR;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_ACCEPT);
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief (re-)arms the multishot recv of a registered stream |fd|, into the provided buffers. It is submitted with
+ *        the next wait.
+ */
+static enum result event_loop_uring_recv_multishot(struct event_loop* loop, int fd)
+{
+    struct event_loop_registration* registration = &loop->registrations.items[fd];
+
+    struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        LOG_ERRORF("failed to receive on fd=%d: submission ring full", fd);
+        return RESULT_ERR;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = EVENT_LOOP_URING_BUFFER_GROUP;
+    sqe->user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_RECV);
+
+    registration->recv_state = EVENT_LOOP_RECV_ARMED;
+    return RESULT_OK;
+}
+
+static enum io_status event_loop_uring_accept(struct event_loop* loop, int fd, int* out_fd, uint32_t* out_address)
+{
+    struct event_loop_accepted_list* accepted = &loop->accepted;
+
+    for (size_t i = loop->accepted_start; i < accepted->length; i++) {
+        if (accepted->items[i].fd < 0 || accepted->items[i].listen_fd != fd) {
+            continue;
+        }
+
+        *out_fd = accepted->items[i].fd;
+        accepted->items[i].fd = -1;
+
+        // the taken ones at the front are dropped
+        while (loop->accepted_start < accepted->length && accepted->items[loop->accepted_start].fd < 0) {
+            loop->accepted_start++;
+        }
+        if (loop->accepted_start == accepted->length) {
+            event_loop_accepted_list_clear(accepted);
+            loop->accepted_start = 0;
+        }
+
+        // only asked for when it is needed: a multishot accept does not return it
+        if (out_address != NULL) {
+            struct sockaddr_in address = {0};
+            socklen_t address_len = sizeof(address);
+            io_count_syscall();
+            if (getpeername(*out_fd, (struct sockaddr*) &address, &address_len) != 0) {
+                address.sin_addr.s_addr = 0;
+            }
+            *out_address = address.sin_addr.s_addr;
+        }
+        return IO_STATUS_OK;
+    }
+
+    return IO_STATUS_WOULD_BLOCK;
+}
+
+static enum io_status event_loop_uring_recv(struct event_loop* loop, int fd, uint8_t* buffer, size_t buffer_size,
+                                            size_t* out_bytes_read)
+{
+    *out_bytes_read = 0;
+
+    assert((size_t) fd < loop->registrations.length);
+    struct event_loop_registration* registration = &loop->registrations.items[fd];
+    assert(registration->data != NULL && registration->kind == EVENT_LOOP_REGISTRATION_STREAM);
+
+    size_t copied = 0;
+    while (copied < buffer_size && registration->recv_count > 0) {
+        const uint16_t id = registration->recv_head;
+        const struct event_loop_buffer* received = &loop->buffers[id];
+
+        const size_t len = MIN(received->len - registration->recv_offset, buffer_size - copied);
+        memcpy(buffer + copied, event_loop_uring_buffer(loop, id) + registration->recv_offset, len);
+        copied += len;
+        registration->recv_offset += (uint32_t) len;
+
+        if (registration->recv_offset == received->len) {
+            registration->recv_head = received->next;
+            registration->recv_count--;
+            registration->recv_offset = 0;
+            event_loop_uring_provide_buffer(loop, id);
+        }
+    }
+
+    if (copied > 0) {
+        *out_bytes_read = copied;
+        return IO_STATUS_OK;
+    }
+
+    if (registration->recv_error != 0) {
+        LOG_WARNF("recv failed: fd=%d: %s", fd, strerror(registration->recv_error));
+        return IO_STATUS_ERR;
+    }
+    if (registration->recv_eof) {
+        return IO_STATUS_EOF;
+    }
+
+    // paused (or ended) with data queued, which is all read now: it goes on
+    if (registration->recv_state == EVENT_LOOP_RECV_IDLE && event_loop_uring_recv_multishot(loop, fd) != RESULT_OK) {
+        return IO_STATUS_ERR;
+    }
+    return IO_STATUS_WOULD_BLOCK;
+}
+
+static void event_loop_uring_send_and_close(struct event_loop* loop, int fd, const void* data, size_t len)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        io_count_syscall();
+        close(fd);
+        return;
+    }
+
+    // the close runs once the send completed, whether it succeeded or not (a hard link)
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) data;
+    sqe->len = (uint32_t) len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = EVENT_LOOP_URING_IGNORED;
+
+    sqe = uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        io_count_syscall();
+        close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = EVENT_LOOP_URING_IGNORED;
+}
+
+static int event_loop_uring_wait(struct event_loop* loop, struct epoll_event* events, int max_events, int timeout_ms)
+{
+    loop->wait_id++;
+
+    // the streams that did not read what they were reported are not reading for now (waiting to send, or at their
+    // limit of requests in flight): they wait on their socket buffer instead of taking more provided buffers, until
+    // they read again (see event_loop_uring_recv)
+    for (size_t i = 0; i < loop->received.length; i++) {
+        const int fd = loop->received.items[i];
+        struct event_loop_registration* registration = &loop->registrations.items[fd];
+        if (registration->data == NULL || registration->kind != EVENT_LOOP_REGISTRATION_STREAM
+            || registration->recv_count == 0 || registration->recv_state != EVENT_LOOP_RECV_ARMED)
+        {
+            continue;
+        }
+
+        const uint64_t user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_RECV);
+        if (event_loop_uring_cancel(loop, fd, user_data) != RESULT_OK) {
+            return -1;
+        }
+        registration->recv_state = EVENT_LOOP_RECV_CANCELLING;
+    }
+    event_loop_fd_list_clear(&loop->received);
+
+    // the recvs stopped for lack of buffers go on once some were given back, oldest first and no more of them than
+    // there are free buffers (each would take one at least)
+    if (loop->starved.length > 0 && loop->buffers_free > 0) {
+        size_t resumed = 0;
+        size_t i = 0;
+        for (; i < loop->starved.length && resumed < loop->buffers_free; i++) {
+            const int fd = loop->starved.items[i];
+            const struct event_loop_registration* registration = &loop->registrations.items[fd];
+            if (registration->data == NULL || registration->kind != EVENT_LOOP_REGISTRATION_STREAM
+                || registration->recv_state != EVENT_LOOP_RECV_STARVED)
+            {
+                continue;
+            }
+            if (event_loop_uring_recv_multishot(loop, fd) != RESULT_OK) {
+                return -1;
+            }
+            resumed++;
+        }
+
+        const size_t left = loop->starved.length - i;
+        memmove(loop->starved.items, loop->starved.items + i, left * sizeof(*loop->starved.items));
+        loop->starved.length = left;
+    }
+
+    // the parked listeners are given another try once their wait is over, which bounds this one
+    if (loop->parked.length > 0) {
+        const uint64_t now_ms = clock_monotonic_ms();
+        if (now_ms >= loop->parked_until_ms) {
+            if (event_loop_uring_unpark_accepts(loop) != RESULT_OK) {
+                return -1;
+            }
+        } else if (timeout_ms < 0 || (uint64_t) timeout_ms > loop->parked_until_ms - now_ms) {
+            timeout_ms = (int) (loop->parked_until_ms - now_ms);
+        }
+    }
+
+    // events already completed: only the pending requests (if any) need a syscall
+    int ready_count = event_loop_uring_reap(loop, events, max_events);
+    if (ready_count != 0) {
+        if (ready_count > 0 && uring_has_pending_sqes(&loop->ring) && uring_enter(&loop->ring, 0, 0) != RESULT_OK) {
+            return -1;
+        }
+        return ready_count;
+    }
+
+    // submits the requests and waits in a single syscall
+    if (uring_enter(&loop->ring, 1, timeout_ms) != RESULT_OK) {
+        return -1;
+    }
+
+    return event_loop_uring_reap(loop, events, max_events);
+}
+
+/**
+ * @brief turns the completions into events, merging the ones of the same fd.
+ */
+static int event_loop_uring_reap(struct event_loop* loop, struct epoll_event* events, int max_events)
+{
+    int ready_count = 0;
+
+    struct io_uring_cqe* cqe;
+    while (ready_count < max_events && (cqe = uring_peek_cqe(&loop->ring)) != NULL) {
+        const uint64_t user_data = cqe->user_data;
+        const int32_t res = cqe->res;
+        const uint32_t flags = cqe->flags;
+        uring_cq_advance(&loop->ring);
+
+        // a buffer was taken from the ring, even for a completion that ends up dropped
+        if (flags & IORING_CQE_F_BUFFER) {
+            loop->buffers_free--;
+        }
+
+        const int fd = (int) (uint32_t) user_data;
+        const enum event_loop_uring_op op = (enum event_loop_uring_op) (user_data >> 56);
+        struct event_loop_registration* registration = NULL;
+        if (user_data != EVENT_LOOP_URING_IGNORED && (size_t) fd < loop->registrations.length) {
+            registration = &loop->registrations.items[fd];
+            if (registration->data == NULL || event_loop_uring_user_data(registration, fd, op) != user_data) {
+                // removed (or closed and reused) since
+                registration = NULL;
+            }
+        }
+
+        if (registration == NULL) {
+            if (flags & IORING_CQE_F_BUFFER) {
+                event_loop_uring_provide_buffer(loop, (uint16_t) (flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            if (op == EVENT_LOOP_URING_OP_ACCEPT && user_data != EVENT_LOOP_URING_IGNORED && res >= 0) {
+                LOG_WARNF("closing a connection accepted on fd=%d after it was removed", fd);
+                close(res);
+            }
+            continue;
+        }
+
+        uint32_t ready_events = 0;
+        switch (op) {
+            case EVENT_LOOP_URING_OP_POLL:
+                // the multishot poll ended (the completion ring overflowed, or it was cancelled): it goes on with a
+                // new one
+                if (!(flags & IORING_CQE_F_MORE) && (res >= 0 || res == -ECANCELED)) {
+                    if (event_loop_uring_poll(loop, fd) != RESULT_OK) {
+                        return -1;
+                    }
+                }
+                if (res != -ECANCELED) {
+                    ready_events = res < 0 ? EPOLLERR : (uint32_t) res;
+                }
+                break;
+
+            case EVENT_LOOP_URING_OP_ACCEPT:
+                ready_events = event_loop_uring_on_accept(loop, fd, res, flags);
+                break;
+
+            case EVENT_LOOP_URING_OP_RECV:
+                ready_events = event_loop_uring_on_recv(loop, fd, res, flags);
+                break;
+
+            default:
+                continue;
+        }
+
+        if (ready_events == 0) {
+            continue;
+        }
+        if (ready_events == UINT32_MAX) {
+            return -1;
+        }
+
+        if (registration->wait_id == loop->wait_id) {
+            events[registration->event_index].events |= ready_events;
+            continue;
+        }
+
+        registration->wait_id = loop->wait_id;
+        registration->event_index = (uint32_t) ready_count;
+        events[ready_count] = (struct epoll_event) {
+            .events = ready_events,
+            .data.ptr = registration->data,
+        };
+        ready_count++;
+    }
+
+    return ready_count;
+}
+
+/**
+ * @brief queues the connection a listener's multishot accept completed with.
+ *
+ * @return the events to report (0 for none), UINT32_MAX on failure
+ */
+static uint32_t event_loop_uring_on_accept(struct event_loop* loop, int fd, int32_t res, uint32_t flags)
+{
+    const bool more = (flags & IORING_CQE_F_MORE) != 0;
+
+    // out of fds or memory: accepting again right away would only fail again, over and over
+    if (res == -EMFILE || res == -ENFILE || res == -ENOMEM || res == -ENOBUFS) {
+        if (!more && event_loop_uring_park_accept(loop, fd, res) != RESULT_OK) {
+            return UINT32_MAX;
+        }
+        return 0;
+    }
+
+    // the multishot accept ended (the completion ring overflowed, or it failed): it goes on with a new one
+    if (!more && event_loop_uring_accept_multishot(loop, fd) != RESULT_OK) {
+        return UINT32_MAX;
+    }
+
+    if (res < 0) {
+        if (res != -ECANCELED && res != -ECONNABORTED && res != -EINTR) {
+            LOG_WARNF("accept failed: fd=%d: %s", fd, strerror(-res));
+        }
+        return 0;
+    }
+
+    const struct event_loop_accepted accepted = { .listen_fd = fd, .fd = res };
+    if (event_loop_accepted_list_push_back(&loop->accepted, accepted) != 0) {
+        LOG_ERRORF("dropping a connection accepted on fd=%d: out of memory", fd);
+        close(res);
+        return 0;
+    }
+
+    loop->park_backoff_ms = EVENT_LOOP_URING_ACCEPT_BACKOFF_MIN_MS;
+    return EPOLLIN;
+}
+
+/**
+ * @brief stops accepting on a listener whose accept failed with |res| for lack of resources, until a registered fd
+ *        is closed or the backoff is over (see event_loop_uring_wait).
+ */
+static enum result event_loop_uring_park_accept(struct event_loop* loop, int fd, int32_t res)
+{
+    struct event_loop_registration* registration = &loop->registrations.items[fd];
+    if (registration->accept_parked) {
+        return RESULT_OK;
+    }
+
+    if (event_loop_fd_list_push_back(&loop->parked, fd) != 0) {
+        LOG_ERRORF("failed to park the accept of fd=%d: out of memory", fd);
+        return RESULT_ERR;
+    }
+    registration->accept_parked = true;
+
+    const uint64_t until_ms = clock_monotonic_ms() + loop->park_backoff_ms;
+    if (loop->parked.length == 1 || until_ms < loop->parked_until_ms) {
+        loop->parked_until_ms = until_ms;
+    }
+
+    LOG_WARNF("accept failed: fd=%d: %s. accepting again in %ums at the latest", fd, strerror(-res),
+              loop->park_backoff_ms);
+    loop->park_backoff_ms = MIN(loop->park_backoff_ms * 2, EVENT_LOOP_URING_ACCEPT_BACKOFF_MAX_MS);
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief re-arms the accept of every parked listener (the ones removed since are dropped).
+ */
+static enum result event_loop_uring_unpark_accepts(struct event_loop* loop)
+{
+    for (size_t i = 0; i < loop->parked.length; i++) {
+        const int fd = loop->parked.items[i];
+        struct event_loop_registration* registration = &loop->registrations.items[fd];
+        if (registration->data == NULL || registration->kind != EVENT_LOOP_REGISTRATION_LISTENER
+            || !registration->accept_parked)
+        {
+            continue;
+        }
+
+        registration->accept_parked = false;
+        if (event_loop_uring_accept_multishot(loop, fd) != RESULT_OK) {
+            return RESULT_ERR;
+        }
+    }
+    event_loop_fd_list_clear(&loop->parked);
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief queues the buffer a stream's multishot recv completed with (or how the stream ended).
+ *
+ * @return the events to report (0 for none), UINT32_MAX on failure
+ */
+static uint32_t event_loop_uring_on_recv(struct event_loop* loop, int fd, int32_t res, uint32_t flags)
+{
+    struct event_loop_registration* registration = &loop->registrations.items[fd];
+    const bool more = (flags & IORING_CQE_F_MORE) != 0;
+    const bool cancelling = registration->recv_state == EVENT_LOOP_RECV_CANCELLING;
+    if (!more) {
+        registration->recv_state = EVENT_LOOP_RECV_IDLE;
+    }
+
+    if (res > 0) {
+        assert(flags & IORING_CQE_F_BUFFER);
+        const uint16_t id = (uint16_t) (flags >> IORING_CQE_BUFFER_SHIFT);
+        loop->buffers[id].len = (uint32_t) res;
+        if (registration->recv_count == 0) {
+            registration->recv_head = id;
+        } else {
+            loop->buffers[registration->recv_tail].next = id;
+        }
+        registration->recv_tail = id;
+        registration->recv_count++;
+
+        // checked on the next wait (see event_loop_uring_wait)
+        if (registration->recv_count == 1 && registration->recv_state == EVENT_LOOP_RECV_ARMED
+            && event_loop_fd_list_push_back(&loop->received, fd) != 0)
+        {
+            LOG_ERRORF("failed to track the recv of fd=%d: out of memory", fd);
+            return UINT32_MAX;
+        }
+
+        // not read fast enough: it waits on the socket buffer until the queue is read
+        if (more && registration->recv_count >= EVENT_LOOP_URING_RECV_QUEUE_MAX
+            && registration->recv_state == EVENT_LOOP_RECV_ARMED)
+        {
+            const uint64_t user_data = event_loop_uring_user_data(registration, fd, EVENT_LOOP_URING_OP_RECV);
+            if (event_loop_uring_cancel(loop, fd, user_data) != RESULT_OK) {
+                return UINT32_MAX;
+            }
+            registration->recv_state = EVENT_LOOP_RECV_CANCELLING;
+        }
+        return EPOLLIN;
+    }
+
+    if (res == 0) {
+        registration->recv_eof = true;
+        return EPOLLIN | EPOLLRDHUP;
+    }
+
+    if (res == -ENOBUFS) {
+        // every provided buffer is taken: it goes on once some are given back (see event_loop_uring_wait)
+        registration->recv_state = EVENT_LOOP_RECV_STARVED;
+        if (event_loop_fd_list_push_back(&loop->starved, fd) != 0) {
+            LOG_ERRORF("failed to queue the recv of fd=%d: out of memory", fd);
+            return UINT32_MAX;
+        }
+        return 0;
+    }
+
+    if (res == -ECANCELED && cancelling) {
+        // paused: if the queue was read in the meantime, nobody will ask for more
+        if (registration->recv_count == 0 && event_loop_uring_recv_multishot(loop, fd) != RESULT_OK) {
+            return UINT32_MAX;
+        }
+        return 0;
+    }
+
+    registration->recv_error = -res;
+    return EPOLLIN;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <sys/epoll.h>
+
+#include "error.h"
+#include "io.h"
+#include "uring.h"
+#include "dynamic-array.h"
+
+enum event_loop_backend {
+    EVENT_LOOP_BACKEND_EPOLL = 0,
+
+    /**
+     * an io_uring, completion based where it pays off: listening sockets get a multishot accept and streams a
+     * multishot recv into a ring of provided buffers, so accepting and receiving cost no syscall of their own. Other
+     * fds (and the writability of streams) are watched with multishot polls. Every request is batched with the next
+     * wait. Needs Linux 6.0 or later (multishot recv).
+     */
+    EVENT_LOOP_BACKEND_IO_URING,
+};
+
+/**
+ * @brief io_uring backend: the provided buffers streams receive into, shared by every stream of the loop. There are
+ *        EVENT_LOOP_URING_RECV_QUEUE_MAX of them per stream the loop may hold (rounded up to a power of 2, within the
+ *        bounds below), or the default count when that is not known.
+ */
+#define EVENT_LOOP_URING_RECV_BUFFER_SIZE 4096
+#define EVENT_LOOP_URING_RECV_BUFFER_COUNT_MIN 256
+#define EVENT_LOOP_URING_RECV_BUFFER_COUNT_MAX 32768
+#define EVENT_LOOP_URING_RECV_BUFFER_COUNT_DEFAULT 4096
+
+/**
+ * @brief io_uring backend: the received buffers a stream holds (not read yet) before its multishot recv is paused,
+ *        so that a client sending faster than it is answered waits on its socket buffer instead of taking every
+ *        provided buffer. A stream that did not read what it was reported is paused on the next wait too.
+ */
+#define EVENT_LOOP_URING_RECV_QUEUE_MAX 2
+
+/**
+ * @brief io_uring backend: how long a listener whose accept failed for lack of resources (fds, memory) waits before
+ *        accepting again, doubled on every failure in a row. Closing any registered fd ends the wait early.
+ */
+#define EVENT_LOOP_URING_ACCEPT_BACKOFF_MIN_MS 10
+#define EVENT_LOOP_URING_ACCEPT_BACKOFF_MAX_MS 1000
+
+enum event_loop_registration_kind {
+    EVENT_LOOP_REGISTRATION_POLL = 0,
+    EVENT_LOOP_REGISTRATION_LISTENER,
+    EVENT_LOOP_REGISTRATION_STREAM,
+};
+
+enum event_loop_recv_state {
+    /**
+     * no multishot recv: the next event_loop_recv that finds nothing queued starts one
+     */
+    EVENT_LOOP_RECV_IDLE = 0,
+    EVENT_LOOP_RECV_ARMED,
+
+    /**
+     * paused (see EVENT_LOOP_URING_RECV_QUEUE_MAX) but not over yet: it still completes
+     */
+    EVENT_LOOP_RECV_CANCELLING,
+
+    /**
+     * stopped for lack of provided buffers: started again once some are given back
+     */
+    EVENT_LOOP_RECV_STARVED,
+};
+
+/**
+ * @brief what the io_uring backend knows about a fd. Completions carry the fd and the generation of its registration,
+ *        so the ones still queued for a removed fd (or a reused fd number) are told apart and dropped.
+ */
+struct event_loop_registration {
+    void* data;
+    uint32_t events;
+    uint32_t generation;
+
+    /**
+     * @brief the wait (and the slot in its events) this fd was last reported in, to report it once per wait
+     */
+    uint32_t wait_id;
+    uint32_t event_index;
+
+    enum event_loop_registration_kind kind;
+
+    /**
+     * @brief listeners only: the multishot accept ended for lack of resources and waits to be re-armed (see
+     *        EVENT_LOOP_URING_ACCEPT_BACKOFF_MIN_MS)
+     */
+    bool accept_parked;
+
+    /**
+     * @brief streams only: the multishot recv and the buffers it filled that were not read yet, oldest first (linked
+     *        through struct event_loop_buffer). The first recv_offset bytes of the first one were read already.
+     */
+    enum event_loop_recv_state recv_state;
+    uint16_t recv_head;
+    uint16_t recv_tail;
+    uint16_t recv_count;
+    uint32_t recv_offset;
+
+    /**
+     * @brief how the stream ended (0 when it did not fail), reported once every queued buffer is read
+     */
+    bool recv_eof;
+    int recv_error;
+};
+
+/**
+ * @brief a provided buffer filled by a multishot recv, queued on its stream until read
+ */
+struct event_loop_buffer {
+    uint32_t len;
+    uint16_t next;
+};
+
+/**
+ * @brief a connection accepted by a multishot accept, until event_loop_accept takes it
+ */
+struct event_loop_accepted {
+    int listen_fd;
+    int fd;
+};
+
+DYNAMIC_ARRAY_DEFINE(event_loop_registration_list, struct event_loop_registration)
+DYNAMIC_ARRAY_DEFINE(event_loop_accepted_list, struct event_loop_accepted)
+DYNAMIC_ARRAY_DEFINE(event_loop_fd_list, int)
+
+/**
+ * A thin wrapper over a linux epoll instance, or over an io_uring doing the same (see enum event_loop_backend).
+ *
+ * All file descriptors are expected to be registered as non-blocking and edge-triggered (EPOLLET), which means
+ * the handlers must always drain the fd (read/write until EAGAIN) before waiting again. Either way a fd is reported
+ * at most once per wait.
+ */
+struct event_loop {
+    enum event_loop_backend backend;
+    int epoll_fd;
+
+    /**
+     * @brief io_uring backend only. Registrations are indexed by fd.
+     */
+    struct uring ring;
+    struct event_loop_registration_list registrations;
+    uint32_t wait_id;
+
+    /**
+     * @brief io_uring backend only: the provided buffer ring (registered as buffer group 0), the buffers themselves
+     *        and how many of them the kernel can still fill.
+     */
+    struct io_uring_buf_ring* buffer_ring;
+    size_t buffer_ring_size;
+    uint32_t buffer_count;
+    uint16_t buffer_ring_tail;
+    uint8_t* buffer_data;
+    struct event_loop_buffer* buffers;
+    size_t buffers_free;
+
+    /**
+     * @brief io_uring backend only: the streams whose recv stopped for lack of buffers (oldest first), the ones that
+     *        received something since the last wait, and the connections accepted and not taken yet (from
+     *        accepted_start on)
+     */
+    struct event_loop_fd_list starved;
+    struct event_loop_fd_list received;
+    struct event_loop_accepted_list accepted;
+    size_t accepted_start;
+
+    /**
+     * @brief io_uring backend only: the listeners that stopped accepting for lack of resources, until when (at the
+     *        latest) and how long the next ones will wait
+     */
+    struct event_loop_fd_list parked;
+    uint64_t parked_until_ms;
+    uint32_t park_backoff_ms;
+};
+
+/**
+ * @brief parses a backend name: "epoll" or "io_uring".
+ */
+enum result event_loop_backend_parse(const char* value, enum event_loop_backend* out_backend);
+const char* event_loop_backend_cstr(enum event_loop_backend backend);
+
+/**
+ * @brief |max_streams| is the most streams (see event_loop_add_stream) registered at once, 0 when unknown. The
+ *        io_uring backend sizes its provided buffers after it.
+ */
+enum result event_loop_init(struct event_loop* loop, enum event_loop_backend backend, size_t max_streams);
+
+/**
+ * @brief frees the loop. Also valid on a loop whose epoll_fd and ring.fd were set to -1 and never initialized.
+ */
+void event_loop_free(struct event_loop* loop);
+
+/**
+ * @brief registers |fd| for the given epoll |events|. |data| is handed back as-is by event_loop_wait.
+ */
+enum result event_loop_add(struct event_loop* loop, int fd, uint32_t events, void* data);
+
+/**
+ * @brief registers a non-blocking listening socket, reported EPOLLIN (edge-triggered) when connections are waiting
+ *        for event_loop_accept.
+ */
+enum result event_loop_add_listener(struct event_loop* loop, int fd, void* data);
+
+/**
+ * @brief registers a non-blocking connected socket for the given epoll |events|, whose data must then be read with
+ *        event_loop_recv only.
+ */
+enum result event_loop_add_stream(struct event_loop* loop, int fd, uint32_t events, void* data);
+
+/**
+ * @brief stops watching |fd|. The connections a removed listener had accepted already can still be taken with
+ *        event_loop_accept.
+ */
+enum result event_loop_remove(struct event_loop* loop, int fd);
+
+/**
+ * @brief to be called right before closing a registered |fd|. epoll forgets closed fds on its own, but io_uring
+ *        requests hold a reference to the socket (which would never really be closed): they are cancelled, and the
+ *        events (and data) already queued for the fd are dropped.
+ */
+void event_loop_forget(struct event_loop* loop, int fd);
+
+/**
+ * @brief accepts the next connection of the listening socket |fd| (see event_loop_add_listener), non-blocking and
+ *        close-on-exec. Its IPv4 address (network byte order) is stored in |out_address| unless NULL.
+ *
+ * @return IO_STATUS_WOULD_BLOCK when none is waiting.
+ */
+enum io_status event_loop_accept(struct event_loop* loop, int fd, int* out_fd, uint32_t* out_address);
+
+/**
+ * @brief reads what a stream (see event_loop_add_stream) received, like recv_nonblocking (see io.h).
+ */
+enum io_status event_loop_recv(struct event_loop* loop, int fd, uint8_t* buffer, size_t buffer_size, size_t* out_bytes_read);
+
+/**
+ * @brief sends |len| bytes of |data| (which must outlive the loop, e.g. static) on a socket that is not registered,
+ *        and closes it, whether the send succeeded or not. Best effort: nothing is retried.
+ */
+void event_loop_send_and_close(struct event_loop* loop, int fd, const void* data, size_t len);
+
+/**
+ * @brief waits for events up to |timeout_ms| (-1 means forever).
+ *
+ * @return the number of ready events (0 on timeout or when interrupted by a signal) or -1 on failure.
+ */
+int event_loop_wait(struct event_loop* loop, struct epoll_event* events, int max_events, int timeout_ms);
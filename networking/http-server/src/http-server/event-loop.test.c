@@ -0,0 +1,222 @@
+/**
+ * Tests of the io_uring backend of the event loop (event-loop.h) when it runs out of resources.
+ *
+ * - out of fds: a listener whose accept fails with EMFILE must wait before accepting again, instead of failing over
+ *   and over (every wait returning at once), and accept the waiting connections once fds are available again.
+ * - a stream not reading: it must stop taking provided buffers after the wait it did not read on, and still receive
+ *   everything once it reads again.
+ *
+ * Skipped when io_uring is not available.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <http-server/commons.h>
+#include <http-server/stopwatch.h>
+#include <http-server/event-loop.h>
+#include <http-server/test.h>
+
+#define CLIENT_COUNT 2
+
+/**
+ * @brief how long the listener is watched while out of fds, and the most waits it may take meanwhile (a few per
+ *        backoff step)
+ */
+#define OUT_OF_FDS_MS 300
+#define OUT_OF_FDS_MAX_WAITS 32
+
+#define STEP_TIMEOUT_MS 5000
+
+#define MAX_EVENTS 16
+
+/**
+ * @brief what the client of the stream sends, one chunk per wait
+ */
+#define CHUNK_COUNT 4
+#define CHUNK_SIZE 100
+
+/**
+ * @brief a non-blocking listening socket on a free loopback port, whose address is stored in |out_address|.
+ */
+static int listen_loopback(struct sockaddr_in* out_address)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t address_len = sizeof(address);
+    if (bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(fd, 16) != 0
+        || getsockname(fd, (struct sockaddr*) &address, &address_len) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    *out_address = address;
+    return fd;
+}
+
+/**
+ * @brief the lowest fd number not in use, which is the one the next accept would get.
+ */
+static int lowest_free_fd(void)
+{
+    int fd = dup(STDIN_FILENO);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return fd;
+}
+
+static void test_accept_out_of_fds(void)
+{
+    struct event_loop loop;
+    if (event_loop_init(&loop, EVENT_LOOP_BACKEND_IO_URING, 0) != RESULT_OK) {
+        printf("io_uring is not available: skipped\n");
+        return;
+    }
+
+    struct sockaddr_in address;
+    int listen_fd = listen_loopback(&address);
+    CHECK(listen_fd >= 0);
+
+    static int listener_data;
+    CHECK(event_loop_add_listener(&loop, listen_fd, &listener_data) == RESULT_OK);
+
+    // connected by the kernel (in the backlog), whether accepted or not
+    int clients[CLIENT_COUNT];
+    for (size_t i = 0; i < CLIENT_COUNT; i++) {
+        clients[i] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        CHECK(clients[i] >= 0);
+        CHECK(connect(clients[i], (struct sockaddr*) &address, sizeof(address)) == 0);
+    }
+
+    struct rlimit saved_limit;
+    CHECK(getrlimit(RLIMIT_NOFILE, &saved_limit) == 0);
+    struct rlimit limit = saved_limit;
+    limit.rlim_cur = (rlim_t) lowest_free_fd();
+    CHECK(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    struct epoll_event events[MAX_EVENTS];
+    size_t wait_count = 0;
+    size_t accepted_count = 0;
+    const uint64_t out_of_fds_until_ms = clock_monotonic_ms() + OUT_OF_FDS_MS;
+    while (clock_monotonic_ms() < out_of_fds_until_ms && wait_count <= OUT_OF_FDS_MAX_WAITS) {
+        int ready_count = event_loop_wait(&loop, events, MAX_EVENTS, OUT_OF_FDS_MS);
+        CHECK(ready_count >= 0);
+        for (int i = 0; i < ready_count; i++) {
+            int fd;
+            while (event_loop_accept(&loop, listen_fd, &fd, NULL) == IO_STATUS_OK) {
+                accepted_count++;
+                close(fd);
+            }
+        }
+        wait_count++;
+    }
+    CHECK(wait_count <= OUT_OF_FDS_MAX_WAITS);
+    CHECK(accepted_count == 0);
+
+    CHECK(setrlimit(RLIMIT_NOFILE, &saved_limit) == 0);
+
+    const uint64_t deadline_ms = clock_monotonic_ms() + STEP_TIMEOUT_MS;
+    while (accepted_count < CLIENT_COUNT && clock_monotonic_ms() < deadline_ms) {
+        int ready_count = event_loop_wait(&loop, events, MAX_EVENTS, STEP_TIMEOUT_MS);
+        CHECK(ready_count >= 0);
+        int fd;
+        while (event_loop_accept(&loop, listen_fd, &fd, NULL) == IO_STATUS_OK) {
+            accepted_count++;
+            close(fd);
+        }
+    }
+    CHECK(accepted_count == CLIENT_COUNT);
+
+    for (size_t i = 0; i < CLIENT_COUNT; i++) {
+        close(clients[i]);
+    }
+    event_loop_remove(&loop, listen_fd);
+    event_loop_free(&loop);
+    close(listen_fd);
+}
+
+static void test_recv_not_reading(void)
+{
+    struct event_loop loop;
+    if (event_loop_init(&loop, EVENT_LOOP_BACKEND_IO_URING, 0) != RESULT_OK) {
+        printf("io_uring is not available: skipped\n");
+        return;
+    }
+
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+
+    static int stream_data;
+    CHECK(event_loop_add_stream(&loop, fds[0], EPOLLIN | EPOLLRDHUP | EPOLLET, &stream_data) == RESULT_OK);
+
+    uint8_t sent[CHUNK_COUNT * CHUNK_SIZE];
+    for (size_t i = 0; i < sizeof(sent); i++) {
+        sent[i] = (uint8_t) (i * 7);
+    }
+
+    // reported, never read
+    struct epoll_event events[MAX_EVENTS];
+    const size_t buffers_free = loop.buffers_free;
+    for (size_t i = 0; i < CHUNK_COUNT; i++) {
+        CHECK(send(fds[1], sent + i * CHUNK_SIZE, CHUNK_SIZE, 0) == CHUNK_SIZE);
+        CHECK(event_loop_wait(&loop, events, MAX_EVENTS, 100) >= 0);
+    }
+    CHECK(buffers_free - loop.buffers_free <= EVENT_LOOP_URING_RECV_QUEUE_MAX);
+
+    uint8_t received[sizeof(sent)];
+    size_t received_len = 0;
+    const uint64_t deadline_ms = clock_monotonic_ms() + STEP_TIMEOUT_MS;
+    while (received_len < sizeof(received) && clock_monotonic_ms() < deadline_ms) {
+        size_t bytes_read;
+        enum io_status status;
+        while ((status = event_loop_recv(&loop, fds[0], received + received_len, sizeof(received) - received_len,
+                                         &bytes_read)) == IO_STATUS_OK)
+        {
+            received_len += bytes_read;
+        }
+        CHECK(status == IO_STATUS_WOULD_BLOCK);
+        if (received_len < sizeof(received)) {
+            CHECK(event_loop_wait(&loop, events, MAX_EVENTS, STEP_TIMEOUT_MS) >= 0);
+        }
+    }
+    CHECK(received_len == sizeof(sent));
+    CHECK(memcmp(received, sent, sizeof(sent)) == 0);
+
+    event_loop_forget(&loop, fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    event_loop_free(&loop);
+}
+
+int main(void)
+{
+    test_accept_out_of_fds();
+    test_recv_not_reading();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all event loop checks passed\n");
+    return 0;
+}
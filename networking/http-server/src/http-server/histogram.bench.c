@@ -0,0 +1,79 @@
+/**
+ * Microbenchmark: the cost of histogram_record (what every request pays per timed stage) and of a quantile
+ * lookup (what a /metrics scrape pays per quantile).
+ *
+ * The values look like request latencies: mostly a few µs, with a long tail up to seconds.
+ *
+ * Usage: histogram-bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/stopwatch.h>
+#include <http-server/histogram.h>
+
+#define DEFAULT_ITERATIONS 100000000
+#define VALUE_COUNT 4096
+
+int main(int argc, char* argv[])
+{
+    size_t iterations = DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        unsigned long long value;
+        if (parse_ull(argv[1], &value) != RESULT_OK || value == 0) {
+            fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+            return 1;
+        }
+        iterations = (size_t) value;
+    }
+
+    // precomputed so the loop only measures the recording
+    static uint64_t values[VALUE_COUNT];
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < VALUE_COUNT; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        // 2^10 to 2^30 ns, most of them at the low end
+        const unsigned magnitude = 10 + (unsigned) ((state & 0xff) * (state & 0xff) / (255 * 255 / 20));
+        values[i] = (UINT64_C(1) << magnitude) + (state >> 40) % (UINT64_C(1) << magnitude);
+    }
+
+    struct histogram* h = malloc(sizeof(struct histogram));
+    if (h == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+    histogram_init(h);
+
+    struct stopwatch sw;
+    stopwatch_start(&sw);
+    for (size_t i = 0; i < iterations; i++) {
+        histogram_record(h, values[i & (VALUE_COUNT - 1)]);
+    }
+    stopwatch_stop(&sw);
+    printf("record   %8.2f ns/sample  (count=%llu)\n",
+           (double) stopwatch_get_ns(&sw) / (double) iterations,
+           (unsigned long long) atomic_load(&h->count));
+
+    const size_t lookups = 10000;
+    uint64_t checksum = 0;
+    stopwatch_start(&sw);
+    for (size_t i = 0; i < lookups; i++) {
+        checksum += histogram_value_at_quantile(h, 0.999);
+    }
+    stopwatch_stop(&sw);
+    printf("quantile %8.2f ns/lookup  (p50=%lluns p99=%lluns p99.9=%lluns checksum=%llu)\n",
+           (double) stopwatch_get_ns(&sw) / (double) lookups,
+           (unsigned long long) histogram_value_at_quantile(h, 0.5),
+           (unsigned long long) histogram_value_at_quantile(h, 0.99),
+           (unsigned long long) histogram_value_at_quantile(h, 0.999),
+           (unsigned long long) checksum);
+
+    free(h);
+    return 0;
+}
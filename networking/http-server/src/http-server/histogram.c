@@ -0,0 +1,109 @@
+#include "histogram.h"
+
+#include <assert.h>
+
+#include "commons.h"
+
+void histogram_init(struct histogram* h)
+{
+    assert(h != NULL);
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        atomic_init(&h->counts[i], 0);
+    }
+    atomic_init(&h->count, 0);
+    atomic_init(&h->sum, 0);
+    atomic_init(&h->max, 0);
+}
+
+void histogram_merge(struct histogram* dst, const struct histogram* src)
+{
+    assert(dst != NULL);
+    assert(src != NULL);
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        histogram_counter_add(&dst->counts[i], atomic_load_explicit(&src->counts[i], memory_order_relaxed));
+    }
+    histogram_counter_add(&dst->count, atomic_load_explicit(&src->count, memory_order_relaxed));
+    histogram_counter_add(&dst->sum, atomic_load_explicit(&src->sum, memory_order_relaxed));
+
+    const uint64_t src_max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (src_max > atomic_load_explicit(&dst->max, memory_order_relaxed)) {
+        atomic_store_explicit(&dst->max, src_max, memory_order_relaxed);
+    }
+}
+
+void histogram_merge_corrected(struct histogram* dst, const struct histogram* src, uint64_t expected_interval)
+{
+    assert(dst != NULL);
+    assert(src != NULL);
+
+    histogram_merge(dst, src);
+    if (expected_interval == 0) {
+        return;
+    }
+
+    const uint64_t src_max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        const uint64_t count = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+
+        const uint64_t value = MIN(histogram_bucket_highest_value(i), src_max);
+        for (uint64_t missing = value - MIN(value, expected_interval); missing >= expected_interval; missing -= expected_interval) {
+            histogram_record_n(dst, missing, count);
+        }
+    }
+}
+
+uint64_t histogram_value_at_quantile(const struct histogram* h, double quantile)
+{
+    assert(h != NULL);
+
+    // the buckets are the source of truth: |count| may lag behind them while the owner is recording
+    uint64_t total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        total += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    quantile = MIN(MAX(quantile, 0.0), 1.0);
+
+    // the rank of the sample, rounded up
+    const double exact_rank = quantile * (double) total;
+    uint64_t rank = (uint64_t) exact_rank;
+    if ((double) rank < exact_rank || rank == 0) {
+        rank++;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            // nothing was recorded above the max, even if its bucket goes higher
+            return MIN(histogram_bucket_highest_value(i), atomic_load_explicit(&h->max, memory_order_relaxed));
+        }
+    }
+
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+uint64_t histogram_bucket_lowest_value(size_t index)
+{
+    assert(index < HISTOGRAM_BUCKET_COUNT);
+
+    // the inverse of histogram_bucket_index: (shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT <= index, except for shift 0
+    const unsigned shift = index < HISTOGRAM_SUB_BUCKET_COUNT ? 0 : (unsigned) (index >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    return (uint64_t) (index - ((size_t) shift << HISTOGRAM_SUB_BUCKET_BITS)) << shift;
+}
+
+uint64_t histogram_bucket_highest_value(size_t index)
+{
+    assert(index < HISTOGRAM_BUCKET_COUNT);
+
+    const unsigned shift = index < HISTOGRAM_SUB_BUCKET_COUNT ? 0 : (unsigned) (index >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    return histogram_bucket_lowest_value(index) + (UINT64_C(1) << shift) - 1;
+}
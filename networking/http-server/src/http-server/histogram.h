@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/**
+ * A log-linear (HDR style) histogram of non-negative integer values, typically latencies in ns.
+ *
+ * Values are grouped by power of 2, and every power of 2 is split into HISTOGRAM_SUB_BUCKET_COUNT linear buckets,
+ * so any value is known within 1/HISTOGRAM_SUB_BUCKET_COUNT (~3%) of itself whatever its magnitude. Recording is a
+ * count-leading-zeros, a shift and a few increments: no loop, no division and no allocation.
+ *
+ * A histogram has a single writer, but can be read (merged) from any thread at any time: counters are atomics only
+ * ever accessed with relaxed loads and stores, which compile to plain moves. Readers may see a sample counted in
+ * its bucket but not yet in |count|, which is fine for monitoring.
+ */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKET_COUNT (UINT64_C(1) << HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief values are tracked up to 2^40 - 1 (over 18 minutes in ns). Bigger ones are counted as that.
+ */
+#define HISTOGRAM_VALUE_BITS 40
+#define HISTOGRAM_MAX_VALUE ((UINT64_C(1) << HISTOGRAM_VALUE_BITS) - 1)
+
+#define HISTOGRAM_BUCKET_COUNT \
+    ((size_t) (HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+struct histogram {
+    _Atomic uint64_t counts[HISTOGRAM_BUCKET_COUNT];
+    _Atomic uint64_t count;
+
+    /**
+     * @brief of the recorded values (not clamped), for the mean
+     */
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+};
+
+void histogram_init(struct histogram* h);
+
+/**
+ * @brief adds every sample of |src| to |dst|. |src| can be written concurrently (by its owner thread).
+ */
+void histogram_merge(struct histogram* dst, const struct histogram* src);
+
+/**
+ * @brief adds every sample of |src| to |dst|, corrected for coordinated omission.
+ *
+ * A load generator waiting for a response does not send the requests it was expected to send meanwhile, so a stall
+ * ends up as a single slow sample instead of all the requests it delayed. Given the |expected_interval| between two
+ * requests of a connection, every sample bigger than it also adds the samples the missing requests would have had:
+ * value - expected_interval, value - 2 * expected_interval... (like HdrHistogram copyCorrectedForCoordinatedOmission).
+ * An |expected_interval| of 0 is a plain merge.
+ */
+void histogram_merge_corrected(struct histogram* dst, const struct histogram* src, uint64_t expected_interval);
+
+/**
+ * @brief the value under which |quantile| (in [0, 1]) of the samples fall, as the highest value of its bucket
+ *        (so it is never under-estimated), or 0 when the histogram is empty.
+ */
+uint64_t histogram_value_at_quantile(const struct histogram* h, double quantile);
+
+/**
+ * @brief the range of values counted in the bucket |index|.
+ */
+uint64_t histogram_bucket_lowest_value(size_t index);
+uint64_t histogram_bucket_highest_value(size_t index);
+
+static inline size_t histogram_bucket_index(uint64_t value)
+{
+    if (value > HISTOGRAM_MAX_VALUE) {
+        value = HISTOGRAM_MAX_VALUE;
+    }
+
+    // values under HISTOGRAM_SUB_BUCKET_COUNT get a bucket each (shift 0), just like the next power of 2
+    const unsigned magnitude = 63 - (unsigned) __builtin_clzll(value | HISTOGRAM_SUB_BUCKET_COUNT);
+    const unsigned shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+    return ((size_t) shift << HISTOGRAM_SUB_BUCKET_BITS) + (size_t) (value >> shift);
+}
+
+/**
+ * @brief only ever called by the owner thread of |counter|: a load and a store instead of an atomic add.
+ */
+static inline void histogram_counter_add(_Atomic uint64_t* counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * @brief records |n| samples of |value| at once.
+ */
+static inline void histogram_record_n(struct histogram* h, uint64_t value, uint64_t n)
+{
+    histogram_counter_add(&h->counts[histogram_bucket_index(value)], n);
+    histogram_counter_add(&h->count, n);
+    histogram_counter_add(&h->sum, value * n);
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+    }
+}
+
+static inline void histogram_record(struct histogram* h, uint64_t value)
+{
+    histogram_record_n(h, value, 1);
+}
@@ -0,0 +1,115 @@
+/**
+ * Tests of the histogram.h bucketing (every value lands in a bucket containing it, within the advertised precision)
+ * and of the quantiles, against exact quantiles of known distributions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/histogram.h>
+#include <http-server/test.h>
+
+/**
+ * @brief whether |actual| (a bucket highest value) is |expected| within the histogram precision
+ */
+static bool is_close(uint64_t actual, uint64_t expected)
+{
+    return actual >= expected && actual - expected <= expected / HISTOGRAM_SUB_BUCKET_COUNT;
+}
+
+static void test_buckets(void)
+{
+    // buckets are contiguous and cover every value up to the max
+    CHECK(histogram_bucket_lowest_value(0) == 0);
+    for (size_t i = 1; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        CHECK(histogram_bucket_lowest_value(i) == histogram_bucket_highest_value(i - 1) + 1);
+    }
+    CHECK(histogram_bucket_highest_value(HISTOGRAM_BUCKET_COUNT - 1) == HISTOGRAM_MAX_VALUE);
+
+    // every value around every power of 2 lands in the bucket containing it
+    for (unsigned bit = 0; bit < HISTOGRAM_VALUE_BITS; bit++) {
+        const uint64_t power = UINT64_C(1) << bit;
+        for (uint64_t value = power > 64 ? power - 64 : 0; value < power + 64; value++) {
+            const size_t index = histogram_bucket_index(value);
+            CHECK(index < HISTOGRAM_BUCKET_COUNT);
+            CHECK(histogram_bucket_lowest_value(index) <= value && value <= histogram_bucket_highest_value(index));
+            CHECK(histogram_bucket_highest_value(index) - histogram_bucket_lowest_value(index)
+                  <= MAX(value / HISTOGRAM_SUB_BUCKET_COUNT, (uint64_t) 1));
+        }
+    }
+
+    // too big values are clamped
+    CHECK(histogram_bucket_index(UINT64_MAX) == HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+static void test_quantiles(void)
+{
+    struct histogram* h = malloc(sizeof(struct histogram));
+    struct histogram* other = malloc(sizeof(struct histogram));
+    if (h == NULL || other == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+
+    histogram_init(h);
+    CHECK(histogram_value_at_quantile(h, 0.5) == 0);
+
+    // 1..100000 ns: the exact q quantile is q * 100000
+    for (uint64_t value = 1; value <= 100000; value++) {
+        histogram_record(h, value);
+    }
+    CHECK(atomic_load(&h->count) == 100000);
+    CHECK(atomic_load(&h->sum) == UINT64_C(100000) * 100001 / 2);
+    CHECK(atomic_load(&h->max) == 100000);
+    CHECK(is_close(histogram_value_at_quantile(h, 0.5), 50000));
+    CHECK(is_close(histogram_value_at_quantile(h, 0.9), 90000));
+    CHECK(is_close(histogram_value_at_quantile(h, 0.99), 99000));
+    CHECK(histogram_value_at_quantile(h, 1.0) == 100000);
+    CHECK(histogram_value_at_quantile(h, 0.0) == 1);
+
+    // a long tail: 990 fast samples and 10 slow ones
+    histogram_init(other);
+    histogram_record_n(other, 1000, 990);
+    histogram_record_n(other, 5000000, 10);
+    CHECK(is_close(histogram_value_at_quantile(other, 0.5), 1000));
+    CHECK(is_close(histogram_value_at_quantile(other, 0.99), 1000));
+    CHECK(histogram_value_at_quantile(other, 0.991) == 5000000);
+
+    // merging is the same as recording everything in one
+    histogram_merge(h, other);
+    CHECK(atomic_load(&h->count) == 101000);
+    CHECK(atomic_load(&h->max) == 5000000);
+    CHECK(histogram_value_at_quantile(h, 1.0) == 5000000);
+    CHECK(is_close(histogram_value_at_quantile(h, 0.5), 50500 - 990));
+
+    // a 10 ms stall of a connection expected to send every 1 ms hides 9 requests: 9 ms, 8 ms... 1 ms late
+    histogram_init(h);
+    histogram_init(other);
+    histogram_record_n(other, 100000, 99);
+    histogram_record(other, 10000000);
+    histogram_merge_corrected(h, other, 1000000);
+    CHECK(atomic_load(&h->count) == 109);
+    CHECK(atomic_load(&h->max) == 10000000);
+    CHECK(is_close(histogram_value_at_quantile(h, 0.5), 100000));
+    CHECK(is_close(histogram_value_at_quantile(h, 0.95), 5000000));
+    CHECK(is_close(histogram_value_at_quantile(h, 0.917), 1000000));
+
+    free(other);
+    free(h);
+}
+
+int main(void)
+{
+    test_buckets();
+    test_quantiles();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all histogram checks passed (%zu buckets)\n", (size_t) HISTOGRAM_BUCKET_COUNT);
+    return 0;
+}
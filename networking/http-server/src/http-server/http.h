@@ -1,9 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "error.h"
 #include "str.h"
 
 #include "dynamic-array.h"
+#include "http/method.h"
 
 #define HTTP_REQUEST_METHOD_BUFFER_SIZE 8
 #define HTTP_REQUEST_METHOD_MAX_SIZE HTTP_REQUEST_METHOD_BUFFER_SIZE - 1  // leave room for the trailing '\0'
@@ -33,35 +36,38 @@ struct http_request_start_line {
 };
 
 /**
- * @brief a simple http request
+ * @brief a parsed request head. Every slice is a view into the connection receive buffer.
  */
-struct http_request {
+struct http_request_head {
+    struct http_request_start_line start_line;
+    enum http_method method;
 
-    /**
-     * @brief the raw unsafe request message data read from the connection socket.
-     */
-    struct dynamic_array data;
+    struct http_header headers[HTTP_REQUEST_HEADERS_BUFFER_SIZE];
+    size_t header_count;
 
     /**
-     * @brief the client connection socket file descriptor
+     * @brief whether the client wants the connection to persist after the response (Connection + http version)
      */
-    int conn;
-
-    struct http_request_start_line start_line;
+    bool keep_alive;
 
-    struct http_header headers[HTTP_REQUEST_HEADERS_BUFFER_SIZE];
+    size_t content_length;
 
-    struct str_slice body;
+    /**
+     * @brief the body is framed by the chunked transfer coding (Content-Length is 0 then)
+     */
+    bool chunked;
 };
 
+/**
+ * @brief finds the first header named |name| (case-insensitive).
+ *
+ * @return false when the request has no such header.
+ */
+bool http_request_head_find_header(const struct http_request_head* head, const char* name, struct str_slice* out_value);
+
 enum result http_headers_validate(uint8_t* unsafe_cstr_buffer,
                                   size_t unsafe_cstr_buffer_size,
                                   size_t *out_end_of_headers_offset);
 
-/**
- * @deprecated
- */
-enum result http_request_poll_and_read(struct http_request* req);
-
 enum result http_method_parse(struct str_slice input, struct str_slice* out);
 
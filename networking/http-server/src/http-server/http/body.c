@@ -0,0 +1,198 @@
+#include "body.h"
+
+#include <assert.h>
+
+#include <http-server/commons.h>
+
+static enum http_body_status http_body_decoder_fail(struct http_body_decoder* decoder, size_t consumed, size_t* out_consumed);
+static int hex_digit_value(char c);
+
+void http_body_decoder_init(struct http_body_decoder* decoder, bool chunked, size_t content_length)
+{
+    assert(decoder != NULL);
+
+    decoder->chunked = chunked;
+    decoder->received = 0;
+    decoder->line_len = 0;
+    decoder->has_chunk_size = false;
+
+    if (chunked) {
+        decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_SIZE;
+        decoder->remaining = 0;
+    } else {
+        decoder->state = content_length > 0 ? HTTP_BODY_DECODER_STATE_DATA : HTTP_BODY_DECODER_STATE_DONE;
+        decoder->remaining = content_length;
+    }
+}
+
+enum http_body_status http_body_decoder_execute(struct http_body_decoder* decoder,
+                                                const char* input,
+                                                size_t input_len,
+                                                size_t* out_consumed,
+                                                struct str_slice* out_data)
+{
+    assert(decoder != NULL);
+    assert(input != NULL || input_len == 0);
+    assert(out_consumed != NULL);
+    assert(out_data != NULL);
+
+    *out_data = str_slice_empty();
+
+    if (decoder->state == HTTP_BODY_DECODER_STATE_ERROR) {
+        *out_consumed = 0;
+        return HTTP_BODY_STATUS_ERROR;
+    }
+
+    size_t i = 0;
+    while (decoder->state != HTTP_BODY_DECODER_STATE_DONE) {
+        // the data runs are handed out as they are, without looking at each byte
+        if (decoder->state == HTTP_BODY_DECODER_STATE_DATA) {
+            const size_t data_len = (size_t) MIN(decoder->remaining, (uint64_t) (input_len - i));
+            if (data_len == 0) {
+                break;
+            }
+
+            *out_data = str_slice_from_buffer(input + i, data_len);
+            i += data_len;
+            decoder->remaining -= data_len;
+            decoder->received += data_len;
+
+            if (decoder->remaining == 0) {
+                decoder->state = decoder->chunked ? HTTP_BODY_DECODER_STATE_CHUNK_DATA_CR : HTTP_BODY_DECODER_STATE_DONE;
+            }
+            break;
+        }
+
+        if (i == input_len) {
+            break;
+        }
+
+        const char c = input[i];
+        switch (decoder->state) {
+            case HTTP_BODY_DECODER_STATE_CHUNK_SIZE: {
+                const int digit = hex_digit_value(c);
+                if (digit >= 0) {
+                    if (decoder->remaining > (UINT64_MAX >> 4)) {
+                        return http_body_decoder_fail(decoder, i, out_consumed);
+                    }
+                    decoder->remaining = (decoder->remaining << 4) | (uint64_t) digit;
+                    decoder->has_chunk_size = true;
+                } else if (!decoder->has_chunk_size) {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                } else if (c == '\r') {
+                    decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_SIZE_LF;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_EXTENSION;
+                } else {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->line_len++;
+                break;
+            }
+
+            case HTTP_BODY_DECODER_STATE_CHUNK_EXTENSION:
+                if (c == '\r') {
+                    decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_SIZE_LF;
+                } else if ((unsigned char) c < 0x20 && c != '\t') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->line_len++;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_CHUNK_SIZE_LF:
+                if (c != '\n') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->line_len = 0;
+                decoder->has_chunk_size = false;
+                // the last chunk has a size of 0
+                decoder->state = decoder->remaining > 0 ? HTTP_BODY_DECODER_STATE_DATA
+                                                        : HTTP_BODY_DECODER_STATE_TRAILER_LINE_START;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_CHUNK_DATA_CR:
+                if (c != '\r') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_DATA_LF;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_CHUNK_DATA_LF:
+                if (c != '\n') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->state = HTTP_BODY_DECODER_STATE_CHUNK_SIZE;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_TRAILER_LINE_START:
+                if (c == '\r') {
+                    decoder->state = HTTP_BODY_DECODER_STATE_END_LF;
+                    break;
+                }
+                if ((unsigned char) c < 0x20 && c != '\t') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->state = HTTP_BODY_DECODER_STATE_TRAILER_LINE;
+                decoder->line_len = 1;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_TRAILER_LINE:
+                if (c == '\r') {
+                    decoder->state = HTTP_BODY_DECODER_STATE_TRAILER_LINE_LF;
+                } else if ((unsigned char) c < 0x20 && c != '\t') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->line_len++;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_TRAILER_LINE_LF:
+                if (c != '\n') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->state = HTTP_BODY_DECODER_STATE_TRAILER_LINE_START;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_END_LF:
+                if (c != '\n') {
+                    return http_body_decoder_fail(decoder, i, out_consumed);
+                }
+                decoder->state = HTTP_BODY_DECODER_STATE_DONE;
+                break;
+
+            case HTTP_BODY_DECODER_STATE_DATA:
+            case HTTP_BODY_DECODER_STATE_DONE:
+            case HTTP_BODY_DECODER_STATE_ERROR:
+                assert(false && "unreachable");
+                break;
+        }
+        i++;
+
+        if (decoder->line_len > HTTP_BODY_LINE_MAX_SIZE) {
+            return http_body_decoder_fail(decoder, i, out_consumed);
+        }
+    }
+
+    *out_consumed = i;
+    return decoder->state == HTTP_BODY_DECODER_STATE_DONE ? HTTP_BODY_STATUS_DONE : HTTP_BODY_STATUS_INCOMPLETE;
+}
+
+static enum http_body_status http_body_decoder_fail(struct http_body_decoder* decoder, size_t consumed, size_t* out_consumed)
+{
+    decoder->state = HTTP_BODY_DECODER_STATE_ERROR;
+    *out_consumed = consumed;
+    return HTTP_BODY_STATUS_ERROR;
+}
+
+static int hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
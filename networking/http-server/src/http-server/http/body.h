@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/str.h>
+
+/**
+ * @brief chunk size lines (extensions included) and trailer lines longer than this are rejected
+ */
+#define HTTP_BODY_LINE_MAX_SIZE 1024
+
+enum http_body_status {
+    /**
+     * The body goes on: call http_body_decoder_execute again with the bytes after the consumed ones (once more
+     * data arrives if every byte given was consumed).
+     */
+    HTTP_BODY_STATUS_INCOMPLETE = 0,
+
+    /**
+     * The body is complete. The bytes after the consumed ones belong to the next request.
+     */
+    HTTP_BODY_STATUS_DONE,
+
+    /**
+     * The chunked framing is malformed. The connection can't be used anymore.
+     */
+    HTTP_BODY_STATUS_ERROR,
+};
+
+enum http_body_decoder_state {
+    HTTP_BODY_DECODER_STATE_DATA = 0,
+    HTTP_BODY_DECODER_STATE_CHUNK_SIZE,
+    HTTP_BODY_DECODER_STATE_CHUNK_EXTENSION,
+    HTTP_BODY_DECODER_STATE_CHUNK_SIZE_LF,
+    HTTP_BODY_DECODER_STATE_CHUNK_DATA_CR,
+    HTTP_BODY_DECODER_STATE_CHUNK_DATA_LF,
+    HTTP_BODY_DECODER_STATE_TRAILER_LINE_START,
+    HTTP_BODY_DECODER_STATE_TRAILER_LINE,
+    HTTP_BODY_DECODER_STATE_TRAILER_LINE_LF,
+    HTTP_BODY_DECODER_STATE_END_LF,
+    HTTP_BODY_DECODER_STATE_DONE,
+
+    /**
+     * the framing was malformed: every later call fails too
+     */
+    HTTP_BODY_DECODER_STATE_ERROR,
+};
+
+/**
+ * @brief a resumable decoder of a request body framed by Content-Length or by the chunked transfer coding.
+ *
+ * Like the request head parser, it never copies anything: the body comes out as views into the given bytes,
+ * one run of data at a time, and it resumes exactly where it stopped no matter how the body is split across reads.
+ * Chunk extensions and trailers are skipped.
+ */
+struct http_body_decoder {
+    enum http_body_decoder_state state;
+    bool chunked;
+
+    /**
+     * @brief data bytes left in the body (Content-Length) or in the current chunk
+     */
+    uint64_t remaining;
+
+    /**
+     * @brief data bytes decoded so far, for the max body size
+     */
+    uint64_t received;
+
+    /**
+     * @brief bytes of the chunk size or trailer line being decoded
+     */
+    size_t line_len;
+    bool has_chunk_size;
+};
+
+void http_body_decoder_init(struct http_body_decoder* decoder, bool chunked, size_t content_length);
+
+/**
+ * @brief decodes |input| up to the next run of body data.
+ *
+ * @param out_consumed the bytes of |input| used (framing and data). At least 1 unless |input| is empty or the
+ *                     decoder is done.
+ * @param out_data the body data found, as a view into |input| (maybe empty).
+ */
+enum http_body_status http_body_decoder_execute(struct http_body_decoder* decoder,
+                                                const char* input,
+                                                size_t input_len,
+                                                size_t* out_consumed,
+                                                struct str_slice* out_data);
+
+static inline bool http_body_decoder_is_done(const struct http_body_decoder* decoder)
+{
+    return decoder->state == HTTP_BODY_DECODER_STATE_DONE;
+}
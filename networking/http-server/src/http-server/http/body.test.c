@@ -0,0 +1,236 @@
+/**
+ * Tests of the http/body.h decoder.
+ *
+ * Random bodies are framed with Content-Length or chunked (random chunk sizes, extensions and trailers), followed
+ * by the start of a pipelined request, then fed to the decoder split at random points. The decoded data must be
+ * the original body, and the decoder must stop exactly where the next request starts. A corpus of malformed
+ * framings must be rejected.
+ *
+ * Usage: http-body-test [iterations] [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/body.h>
+#include <http-server/test.h>
+
+#define DEFAULT_ITERATIONS 20000
+#define DEFAULT_SEED 0x9e3779b97f4a7c15ULL
+#define MAX_BODY_SIZE 3000
+#define MAX_MESSAGE_SIZE (MAX_BODY_SIZE * 8 + 4096)
+
+static const char next_request[] = "GET /next HTTP/1.1\r\n";
+
+static uint64_t random_state;
+
+static uint64_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+/**
+ * @brief frames |body| as chunked, with random chunk sizes, extensions and trailers.
+ */
+static size_t frame_chunked(const char* body, size_t body_len, char* out)
+{
+    size_t len = 0;
+    size_t offset = 0;
+    while (offset < body_len) {
+        // MIN evaluates its arguments twice
+        const size_t max_chunk_len = (size_t) (1 + random_next() % 700);
+        const size_t chunk_len = MIN(body_len - offset, max_chunk_len);
+        len += (size_t) sprintf(out + len, random_next() % 2 == 0 ? "%zx" : "%zX", chunk_len);
+        if (random_next() % 4 == 0) {
+            len += (size_t) sprintf(out + len, " ;name=\"value\";flag");
+        }
+        len += (size_t) sprintf(out + len, "\r\n");
+        memcpy(out + len, body + offset, chunk_len);
+        len += chunk_len;
+        len += (size_t) sprintf(out + len, "\r\n");
+        offset += chunk_len;
+    }
+
+    len += (size_t) sprintf(out + len, random_next() % 2 == 0 ? "0\r\n" : "000;last\r\n");
+    if (random_next() % 3 == 0) {
+        len += (size_t) sprintf(out + len, "Checksum: abc\r\nOther:\tx\r\n");
+    }
+    len += (size_t) sprintf(out + len, "\r\n");
+
+    return len;
+}
+
+/**
+ * @brief decodes |message| in random pieces, like reads of random sizes would give them.
+ *
+ * @return the status of the last call. |out_body| gets the data and |out_consumed| the bytes used.
+ */
+static enum http_body_status decode_in_pieces(struct http_body_decoder* decoder,
+                                              const char* message,
+                                              size_t message_len,
+                                              char* out_body,
+                                              size_t* out_body_len,
+                                              size_t* out_consumed)
+{
+    size_t available = 0;
+    size_t consumed = 0;
+    *out_body_len = 0;
+
+    enum http_body_status status = HTTP_BODY_STATUS_INCOMPLETE;
+    while (status == HTTP_BODY_STATUS_INCOMPLETE) {
+        if (consumed == available) {
+            if (available == message_len) {
+                break;
+            }
+            available = MIN(message_len, available + 1 + (size_t) (random_next() % 64));
+        }
+
+        size_t step_consumed = 0;
+        struct str_slice data;
+        status = http_body_decoder_execute(decoder, message + consumed, available - consumed, &step_consumed, &data);
+        if (data.len > 0) {
+            memcpy(out_body + *out_body_len, data.ptr, data.len);
+            *out_body_len += data.len;
+        }
+        consumed += step_consumed;
+    }
+
+    *out_consumed = consumed;
+    return status;
+}
+
+static void test_random_bodies(size_t iterations)
+{
+    static char body[MAX_BODY_SIZE];
+    static char message[MAX_MESSAGE_SIZE];
+    static char decoded[MAX_MESSAGE_SIZE];
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        const size_t body_len = (size_t) (random_next() % MAX_BODY_SIZE);
+        for (size_t i = 0; i < body_len; i++) {
+            // any byte, the framing bytes included
+            body[i] = (char) (random_next() % 4 == 0 ? (uint64_t) "\r\n0;"[random_next() % 4] : random_next());
+        }
+
+        const bool chunked = random_next() % 2 == 0;
+        size_t message_len = 0;
+        if (chunked) {
+            message_len = frame_chunked(body, body_len, message);
+        } else {
+            memcpy(message, body, body_len);
+            message_len = body_len;
+        }
+        const size_t body_end = message_len;
+        memcpy(message + message_len, next_request, sizeof(next_request) - 1);
+        message_len += sizeof(next_request) - 1;
+
+        struct http_body_decoder decoder;
+        http_body_decoder_init(&decoder, chunked, body_len);
+
+        size_t decoded_len = 0;
+        size_t consumed = 0;
+        enum http_body_status status = decode_in_pieces(&decoder, message, message_len, decoded, &decoded_len, &consumed);
+
+        CHECK(status == HTTP_BODY_STATUS_DONE);
+        CHECK(http_body_decoder_is_done(&decoder));
+        CHECK(consumed == body_end);
+        CHECK(decoded_len == body_len);
+        CHECK(decoder.received == body_len);
+        CHECK(memcmp(decoded, body, MIN(decoded_len, body_len)) == 0);
+
+        if (test_failures > 0) {
+            fprintf(stderr, "iteration %zu: chunked=%d body_len=%zu\n", iteration, (int) chunked, body_len);
+            return;
+        }
+    }
+}
+
+static void test_malformed(void)
+{
+    static const char* const corpus[] = {
+        "",
+        "\r\n",
+        "g\r\n",
+        ";ext\r\n",
+        "5\n",
+        "5\r\rhello\r\n0\r\n\r\n",
+        "5\r\nhelloX\r\n0\r\n\r\n",
+        "5\r\nhello\r\r0\r\n\r\n",
+        "5\r\nhello\r\n0\r\n\r\r",
+        "5;\x01\r\nhello\r\n0\r\n\r\n",
+        "0\r\nTrailer: \x7f\x01\r\n\r\n",
+        "0\r\nTrailer: x\n",
+        "11111111111111111\r\n",
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(corpus); i++) {
+        struct http_body_decoder decoder;
+        http_body_decoder_init(&decoder, true, 0);
+
+        // the empty input is still incomplete
+        size_t consumed = 0;
+        char decoded[64];
+        size_t decoded_len = 0;
+        enum http_body_status status =
+            decode_in_pieces(&decoder, corpus[i], strlen(corpus[i]), decoded, &decoded_len, &consumed);
+        if (corpus[i][0] == '\0') {
+            CHECK(status == HTTP_BODY_STATUS_INCOMPLETE);
+            continue;
+        }
+        if (status != HTTP_BODY_STATUS_ERROR) {
+            fprintf(stderr, "corpus %zu was not rejected\n", i);
+        }
+        CHECK(status == HTTP_BODY_STATUS_ERROR);
+
+        // and stays so
+        struct str_slice data;
+        CHECK(http_body_decoder_execute(&decoder, "0\r\n\r\n", 5, &consumed, &data) == HTTP_BODY_STATUS_ERROR);
+    }
+
+    // an endless chunk extension
+    static char long_line[HTTP_BODY_LINE_MAX_SIZE + 16];
+    memset(long_line, 'x', sizeof(long_line));
+    long_line[0] = '1';
+    long_line[1] = ';';
+
+    struct http_body_decoder decoder;
+    http_body_decoder_init(&decoder, true, 0);
+    size_t consumed = 0;
+    struct str_slice data;
+    CHECK(http_body_decoder_execute(&decoder, long_line, sizeof(long_line), &consumed, &data) == HTTP_BODY_STATUS_ERROR);
+
+    // no body at all
+    http_body_decoder_init(&decoder, false, 0);
+    CHECK(http_body_decoder_is_done(&decoder));
+    CHECK(http_body_decoder_execute(&decoder, "GET", 3, &consumed, &data) == HTTP_BODY_STATUS_DONE);
+    CHECK(consumed == 0);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long long iterations = DEFAULT_ITERATIONS;
+    unsigned long long seed = DEFAULT_SEED;
+    if ((argc > 1 && parse_ull(argv[1], &iterations) != RESULT_OK)
+        || (argc > 2 && (parse_ull(argv[2], &seed) != RESULT_OK || seed == 0)))
+    {
+        fprintf(stderr, "usage: %s [iterations] [seed]\n", argv[0]);
+        return 1;
+    }
+    random_state = seed;
+
+    test_random_bodies((size_t) iterations);
+    test_malformed();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all body decoder checks passed\n");
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include "compression.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <http-server/commons.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/compression"
+
+/**
+ * @brief zlib window bits: 15 is the largest window, +16 asks for the gzip wrapper instead of the zlib one
+ */
+#define HTTP_COMPRESSION_WINDOW_BITS 15
+#define HTTP_COMPRESSION_GZIP_WINDOW_BITS (HTTP_COMPRESSION_WINDOW_BITS + 16)
+#define HTTP_COMPRESSION_MEM_LEVEL 8
+
+/**
+ * @brief q-values are parsed as thousandths ("0.5" is 500)
+ */
+#define HTTP_COMPRESSION_Q_MAX 1000
+
+static z_stream* http_compressor_stream(struct http_compressor* compressor, enum http_content_coding coding);
+static enum result http_compressor_deflate(z_stream* stream,
+                                           struct str_slice input,
+                                           uint8_t* output,
+                                           size_t capacity,
+                                           size_t* out_len);
+static int http_content_coding_parse_q(struct str_slice params);
+static bool http_content_coding_token_equals(struct str_slice token, const char* name);
+
+const char* http_content_coding_cstr(enum http_content_coding coding)
+{
+    switch (coding) {
+        case HTTP_CONTENT_CODING_GZIP:
+            return "gzip";
+        case HTTP_CONTENT_CODING_DEFLATE:
+            return "deflate";
+        case HTTP_CONTENT_CODING_IDENTITY:
+        case HTTP_CONTENT_CODING_COUNT:
+            break;
+    }
+    return NULL;
+}
+
+enum http_content_coding http_content_coding_negotiate(const struct http_request_head* request_head)
+{
+    assert(request_head != NULL);
+
+    struct str_slice accept_encoding;
+    if (!http_request_head_find_header(request_head, "Accept-Encoding", &accept_encoding)) {
+        return HTTP_CONTENT_CODING_IDENTITY;
+    }
+
+    // -1: not listed (only "*" may make it acceptable then)
+    int gzip_q = -1;
+    int deflate_q = -1;
+    int any_q = -1;
+
+    while (accept_encoding.len > 0) {
+        const char* comma = memchr(accept_encoding.ptr, ',', accept_encoding.len);
+        const size_t item_len = comma != NULL ? (size_t) (comma - accept_encoding.ptr) : accept_encoding.len;
+        const struct str_slice item = str_slice_from_buffer(accept_encoding.ptr, item_len);
+
+        const char* semicolon = memchr(item.ptr, ';', item.len);
+        const size_t token_len = semicolon != NULL ? (size_t) (semicolon - item.ptr) : item.len;
+        const struct str_slice token = str_slice_trim(str_slice_from_buffer(item.ptr, token_len));
+        const struct str_slice params = semicolon != NULL
+            ? str_slice_from_buffer(semicolon + 1, item.len - token_len - 1)
+            : str_slice_empty();
+
+        if (http_content_coding_token_equals(token, "gzip") || http_content_coding_token_equals(token, "x-gzip")) {
+            gzip_q = http_content_coding_parse_q(params);
+        } else if (http_content_coding_token_equals(token, "deflate")) {
+            deflate_q = http_content_coding_parse_q(params);
+        } else if (http_content_coding_token_equals(token, "*")) {
+            any_q = http_content_coding_parse_q(params);
+        }
+
+        if (comma == NULL) {
+            break;
+        }
+        accept_encoding.ptr = comma + 1;
+        accept_encoding.len -= item_len + 1;
+    }
+
+    gzip_q = gzip_q >= 0 ? gzip_q : MAX(any_q, 0);
+    deflate_q = deflate_q >= 0 ? deflate_q : MAX(any_q, 0);
+
+    if (gzip_q > 0 && gzip_q >= deflate_q) {
+        return HTTP_CONTENT_CODING_GZIP;
+    }
+    if (deflate_q > 0) {
+        return HTTP_CONTENT_CODING_DEFLATE;
+    }
+    return HTTP_CONTENT_CODING_IDENTITY;
+}
+
+bool http_content_type_is_compressible(struct str_slice content_type)
+{
+    static const char* const compressible_types[] = {
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "application/wasm",
+        "image/svg+xml",
+    };
+
+    // the media type, without its parameters
+    const char* semicolon = memchr(content_type.ptr, ';', content_type.len);
+    if (semicolon != NULL) {
+        content_type.len = (size_t) (semicolon - content_type.ptr);
+    }
+    content_type = str_slice_trim(content_type);
+
+    if (content_type.len > 5 && strncasecmp(content_type.ptr, "text/", 5) == 0) {
+        return true;
+    }
+
+    // structured syntax suffixes (application/problem+json, application/atom+xml...)
+    if (content_type.len > 5
+        && (strncasecmp(content_type.ptr + content_type.len - 5, "+json", 5) == 0
+            || strncasecmp(content_type.ptr + content_type.len - 4, "+xml", 4) == 0))
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(compressible_types); i++) {
+        if (http_content_coding_token_equals(content_type, compressible_types[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void http_compressor_init(struct http_compressor* compressor, int level)
+{
+    assert(compressor != NULL);
+    assert(level >= 0 && level <= Z_BEST_COMPRESSION);
+
+    memset(compressor, 0, sizeof(*compressor));
+    compressor->level = level;
+}
+
+void http_compressor_free(struct http_compressor* compressor)
+{
+    assert(compressor != NULL);
+
+    for (size_t i = 0; i < HTTP_CONTENT_CODING_COUNT; i++) {
+        if (compressor->initialized[i]) {
+            deflateEnd(&compressor->streams[i]);
+            compressor->initialized[i] = false;
+        }
+    }
+}
+
+enum result http_compressor_compress_into(struct http_compressor* compressor,
+                                          enum http_content_coding coding,
+                                          struct str_slice input,
+                                          void* output,
+                                          size_t capacity,
+                                          size_t* out_len)
+{
+    assert(compressor != NULL);
+    assert(output != NULL || capacity == 0);
+    assert(out_len != NULL);
+
+    z_stream* stream = http_compressor_stream(compressor, coding);
+    if (stream == NULL) {
+        return RESULT_ERR;
+    }
+
+    return http_compressor_deflate(stream, input, output, capacity, out_len);
+}
+
+enum result http_compressor_compress(struct http_compressor* compressor,
+                                     enum http_content_coding coding,
+                                     struct str_slice input,
+                                     void** out_data,
+                                     size_t* out_len)
+{
+    assert(compressor != NULL);
+    assert(out_data != NULL);
+    assert(out_len != NULL);
+
+    z_stream* stream = http_compressor_stream(compressor, coding);
+    if (stream == NULL) {
+        return RESULT_ERR;
+    }
+
+    // never grown: the bound covers incompressible input
+    const size_t capacity = deflateBound(stream, (uLong) input.len);
+    uint8_t* output = malloc(capacity);
+    if (output == NULL) {
+        LOG_ERROR("failed to allocate the compressed body");
+        return RESULT_ERR;
+    }
+
+    size_t len = 0;
+    if (http_compressor_deflate(stream, input, output, capacity, &len) != RESULT_OK) {
+        free(output);
+        return RESULT_ERR;
+    }
+
+    // shrinking in place, or else the larger buffer does
+    uint8_t* shrunk = realloc(output, MAX(len, (size_t) 1));
+    *out_data = shrunk != NULL ? shrunk : output;
+    *out_len = len;
+    return RESULT_OK;
+}
+
+/**
+ * @brief the stream of |coding|, set up on first use and reset for a new body afterwards.
+ *
+ * @return NULL on a zlib failure.
+ */
+static z_stream* http_compressor_stream(struct http_compressor* compressor, enum http_content_coding coding)
+{
+    assert(http_compressor_is_enabled(compressor));
+    assert(coding == HTTP_CONTENT_CODING_GZIP || coding == HTTP_CONTENT_CODING_DEFLATE);
+
+    z_stream* stream = &compressor->streams[coding];
+    if (!compressor->initialized[coding]) {
+        const int window_bits = coding == HTTP_CONTENT_CODING_GZIP
+            ? HTTP_COMPRESSION_GZIP_WINDOW_BITS
+            : HTTP_COMPRESSION_WINDOW_BITS;
+        // zalloc/zfree/opaque are Z_NULL (zeroed by init): zlib uses malloc/free
+        int rc = deflateInit2(stream, compressor->level, Z_DEFLATED, window_bits, HTTP_COMPRESSION_MEM_LEVEL,
+                              Z_DEFAULT_STRATEGY);
+        if (rc != Z_OK) {
+            LOG_ERRORF("deflateInit2 failed: %d", rc);
+            return NULL;
+        }
+        compressor->initialized[coding] = true;
+    } else if (deflateReset(stream) != Z_OK) {
+        LOG_ERROR("deflateReset failed");
+        return NULL;
+    }
+
+    return stream;
+}
+
+/**
+ * @brief runs a reset |stream| over the whole of |input| into |output|.
+ *
+ * @return RESULT_ERR on a zlib failure or when |capacity| bytes are not enough.
+ */
+static enum result http_compressor_deflate(z_stream* stream,
+                                           struct str_slice input,
+                                           uint8_t* output,
+                                           size_t capacity,
+                                           size_t* out_len)
+{
+    const uint8_t* next_in = (const uint8_t*) input.ptr;
+    size_t remaining_in = input.len;
+    uint8_t* next_out = output;
+    size_t remaining_out = capacity;
+
+    // left over by the previous body (deflateReset keeps them)
+    stream->avail_in = 0;
+    stream->avail_out = 0;
+
+    while (true) {
+        // avail_in/avail_out are 32 bits wide, so big bodies are fed (and written) in slices
+        if (stream->avail_in == 0) {
+            const size_t slice_len = MIN(remaining_in, (size_t) UINT_MAX);
+            stream->next_in = (Bytef*) next_in;
+            stream->avail_in = (uInt) slice_len;
+            next_in += slice_len;
+            remaining_in -= slice_len;
+        }
+        if (stream->avail_out == 0) {
+            if (remaining_out == 0) {
+                return RESULT_ERR;
+            }
+            const size_t slice_len = MIN(remaining_out, (size_t) UINT_MAX);
+            stream->next_out = next_out;
+            stream->avail_out = (uInt) slice_len;
+            next_out += slice_len;
+            remaining_out -= slice_len;
+        }
+
+        const int flush = remaining_in == 0 ? Z_FINISH : Z_NO_FLUSH;
+        const int rc = deflate(stream, flush);
+        if (rc == Z_STREAM_END) {
+            break;
+        }
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            LOG_ERRORF("deflate failed: %d", rc);
+            return RESULT_ERR;
+        }
+    }
+
+    *out_len = (size_t) (next_out - output) - stream->avail_out;
+    return RESULT_OK;
+}
+
+/**
+ * @brief the q parameter among |params| (1 when there is none, 0 when malformed), in thousandths.
+ */
+static int http_content_coding_parse_q(struct str_slice params)
+{
+    while (params.len > 0) {
+        const char* semicolon = memchr(params.ptr, ';', params.len);
+        const size_t param_len = semicolon != NULL ? (size_t) (semicolon - params.ptr) : params.len;
+        const struct str_slice param = str_slice_trim(str_slice_from_buffer(params.ptr, param_len));
+
+        if (param.len >= 2 && (param.ptr[0] == 'q' || param.ptr[0] == 'Q') && param.ptr[1] == '=') {
+            // qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+            const char* value = param.ptr + 2;
+            const size_t value_len = param.len - 2;
+            if (value_len == 0 || (value[0] != '0' && value[0] != '1')) {
+                return 0;
+            }
+
+            int q = (value[0] - '0') * HTTP_COMPRESSION_Q_MAX;
+            if (value_len > 1) {
+                if (value[1] != '.' || value_len > 5) {
+                    return 0;
+                }
+                int scale = HTTP_COMPRESSION_Q_MAX / 10;
+                for (size_t i = 2; i < value_len; i++, scale /= 10) {
+                    if (value[i] < '0' || value[i] > '9') {
+                        return 0;
+                    }
+                    q += (value[i] - '0') * scale;
+                }
+            }
+            return MIN(q, HTTP_COMPRESSION_Q_MAX);
+        }
+
+        if (semicolon == NULL) {
+            break;
+        }
+        params.ptr = semicolon + 1;
+        params.len -= param_len + 1;
+    }
+
+    return HTTP_COMPRESSION_Q_MAX;
+}
+
+static bool http_content_coding_token_equals(struct str_slice token, const char* name)
+{
+    return str_slice_eq_ignore_case(token, str_slice_from_cstr_trusted(name));
+}
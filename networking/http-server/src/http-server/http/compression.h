@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <zlib.h>
+
+#include <http-server/error.h>
+#include <http-server/str.h>
+#include <http-server/http.h>
+
+/**
+ * @brief bodies smaller than this are sent as they are: the coding overhead (and the CPU) is not worth it
+ */
+#define HTTP_COMPRESSION_MIN_SIZE 256
+
+enum http_content_coding {
+    HTTP_CONTENT_CODING_IDENTITY = 0,
+    HTTP_CONTENT_CODING_GZIP,
+
+    /**
+     * the zlib format (RFC 1950), which is what HTTP calls "deflate"
+     */
+    HTTP_CONTENT_CODING_DEFLATE,
+
+    HTTP_CONTENT_CODING_COUNT,
+};
+
+/**
+ * @brief the Content-Encoding value of |coding| (NULL for identity).
+ */
+const char* http_content_coding_cstr(enum http_content_coding coding);
+
+/**
+ * @brief the coding to answer |request_head| with, from its Accept-Encoding (q-values and "*" included). gzip wins
+ *        ties, and identity is the answer without the header or when neither gzip nor deflate is acceptable.
+ */
+enum http_content_coding http_content_coding_negotiate(const struct http_request_head* request_head);
+
+/**
+ * @brief whether bodies of |content_type| are worth compressing (text and the structured text formats, but not the
+ *        media formats which are compressed already).
+ */
+bool http_content_type_is_compressible(struct str_slice content_type);
+
+/**
+ * @brief compresses bodies of a single thread.
+ *
+ * Every coding has its own z_stream, set up on first use and only reset from one body to the next: the (large)
+ * deflate state is allocated once per thread, never per response.
+ */
+struct http_compressor {
+    /**
+     * @brief zlib level (1-9), 0 when compression is disabled
+     */
+    int level;
+
+    z_stream streams[HTTP_CONTENT_CODING_COUNT];
+    bool initialized[HTTP_CONTENT_CODING_COUNT];
+};
+
+void http_compressor_init(struct http_compressor* compressor, int level);
+void http_compressor_free(struct http_compressor* compressor);
+
+static inline bool http_compressor_is_enabled(const struct http_compressor* compressor)
+{
+    return compressor->level > 0;
+}
+
+/**
+ * @brief compresses |input| with |coding| (not identity) into |output|, in a single pass.
+ *
+ * @return RESULT_ERR on a zlib failure or when the compressed body takes more than |capacity| bytes.
+ */
+enum result http_compressor_compress_into(struct http_compressor* compressor,
+                                          enum http_content_coding coding,
+                                          struct str_slice input,
+                                          void* output,
+                                          size_t capacity,
+                                          size_t* out_len);
+
+/**
+ * @brief compresses |input| with |coding| (not identity) to a buffer of its own, malloc'ed once (at the zlib bound)
+ *        and shrunk to fit. For the bodies that outlive the request (or that were malloc'ed already).
+ *
+ * @return RESULT_ERR on a zlib or allocation failure. Nothing is allocated then.
+ */
+enum result http_compressor_compress(struct http_compressor* compressor,
+                                     enum http_content_coding coding,
+                                     struct str_slice input,
+                                     void** out_data,
+                                     size_t* out_len);
@@ -0,0 +1,208 @@
+/**
+ * Tests of the http/compression.h stage: Accept-Encoding negotiation (q-values, "*", ties), the compressible content
+ * types and gzip/deflate round trips through a compressor whose streams are reused from one body to the next, into
+ * buffers of its own or into a given one (as big as a request arena, which a body has to fit).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zlib.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/compression.h>
+#include <http-server/test.h>
+
+static enum http_content_coding negotiate(const char* accept_encoding)
+{
+    struct http_request_head request;
+    memset(&request, 0, sizeof(request));
+    if (accept_encoding != NULL) {
+        request.headers[0].key = str_slice_from_cstr_trusted("accept-encoding");
+        request.headers[0].value = str_slice_from_cstr_trusted(accept_encoding);
+        request.header_count = 1;
+    }
+    return http_content_coding_negotiate(&request);
+}
+
+static bool is_compressible(const char* content_type)
+{
+    return http_content_type_is_compressible(str_slice_from_cstr_trusted(content_type));
+}
+
+/**
+ * @return whether |data| inflates back to |expected| (windowBits 15 + 32 detects the gzip or zlib wrapper)
+ */
+static bool inflates_to(const void* data, size_t len, const char* expected, size_t expected_len, bool gzip)
+{
+    const uint8_t* bytes = data;
+    if (len < 2 || (gzip != (bytes[0] == 0x1f && bytes[1] == 0x8b))) {
+        return false;
+    }
+
+    char* output = malloc(expected_len + 1);
+    if (output == NULL) {
+        return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        free(output);
+        return false;
+    }
+    stream.next_in = (Bytef*) data;
+    stream.avail_in = (uInt) len;
+    stream.next_out = (Bytef*) output;
+    stream.avail_out = (uInt) expected_len + 1;
+
+    const int rc = inflate(&stream, Z_FINISH);
+    const bool equal = rc == Z_STREAM_END
+                       && stream.total_out == expected_len
+                       && memcmp(output, expected, expected_len) == 0;
+    inflateEnd(&stream);
+    free(output);
+
+    return equal;
+}
+
+static void test_negotiation(void)
+{
+    CHECK(negotiate(NULL) == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("identity") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("br") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("gzip") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("GZIP") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("x-gzip") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("deflate") == HTTP_CONTENT_CODING_DEFLATE);
+    CHECK(negotiate("gzip, deflate, br") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("deflate, gzip") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("gzip;q=0.5, deflate") == HTTP_CONTENT_CODING_DEFLATE);
+    CHECK(negotiate("gzip ; q=0.8 , deflate;q=0.799") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("gzip;q=0, deflate;q=0") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("gzip;q=0") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("*") == HTTP_CONTENT_CODING_GZIP);
+    CHECK(negotiate("gzip;q=0, *") == HTTP_CONTENT_CODING_DEFLATE);
+    CHECK(negotiate("*;q=0") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("gzip;q=1.000") == HTTP_CONTENT_CODING_GZIP);
+
+    // malformed q-values make the coding unacceptable
+    CHECK(negotiate("gzip;q=2") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("gzip;q=0.5555") == HTTP_CONTENT_CODING_IDENTITY);
+    CHECK(negotiate("gzip;q=abc, deflate") == HTTP_CONTENT_CODING_DEFLATE);
+}
+
+static void test_content_types(void)
+{
+    CHECK(is_compressible("text/html; charset=utf-8"));
+    CHECK(is_compressible("text/plain"));
+    CHECK(is_compressible("Application/JSON"));
+    CHECK(is_compressible("application/problem+json"));
+    CHECK(is_compressible("application/atom+xml; charset=utf-8"));
+    CHECK(is_compressible("image/svg+xml"));
+    CHECK(!is_compressible("image/png"));
+    CHECK(!is_compressible("application/octet-stream"));
+    CHECK(!is_compressible("font/woff2"));
+    CHECK(!is_compressible("text/"));
+    CHECK(!is_compressible(""));
+}
+
+static void test_round_trips(void)
+{
+    static char text[64 * 1024];
+    size_t text_len = 0;
+    while (text_len + 64 < sizeof(text)) {
+        text_len += (size_t) snprintf(text + text_len, sizeof(text) - text_len,
+                                      "line %zu: the quick brown fox jumps over the lazy dog\n", text_len % 97);
+    }
+
+    struct http_compressor compressor;
+    http_compressor_init(&compressor, 6);
+    CHECK(http_compressor_is_enabled(&compressor));
+
+    // every body goes through the same two streams
+    const size_t lengths[] = { 0, 1, HTTP_COMPRESSION_MIN_SIZE, text_len / 3, text_len };
+    for (size_t round = 0; round < 2; round++) {
+        for (size_t i = 0; i < ARRAY_SIZE(lengths); i++) {
+            const struct str_slice input = str_slice_from_buffer(text, lengths[i]);
+
+            void* data = NULL;
+            size_t len = 0;
+            CHECK(http_compressor_compress(&compressor, HTTP_CONTENT_CODING_GZIP, input, &data, &len) == RESULT_OK);
+            CHECK(inflates_to(data, len, text, lengths[i], true));
+            free(data);
+
+            CHECK(http_compressor_compress(&compressor, HTTP_CONTENT_CODING_DEFLATE, input, &data, &len) == RESULT_OK);
+            CHECK(inflates_to(data, len, text, lengths[i], false));
+            if (lengths[i] == text_len) {
+                CHECK(len < text_len / 4);
+            }
+            free(data);
+        }
+    }
+
+    http_compressor_free(&compressor);
+
+    http_compressor_init(&compressor, 0);
+    CHECK(!http_compressor_is_enabled(&compressor));
+    http_compressor_free(&compressor);
+}
+
+static void test_into_buffer(void)
+{
+    static char text[64 * 1024];
+    size_t text_len = 0;
+    while (text_len + 64 < sizeof(text)) {
+        text_len += (size_t) snprintf(text + text_len, sizeof(text) - text_len,
+                                      "line %zu: the quick brown fox jumps over the lazy dog\n", text_len % 97);
+    }
+
+    // incompressible past the first half
+    static char noise[8 * 1024];
+    uint32_t state = 1;
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        state = state * 1103515245 + 12345;
+        noise[i] = i < sizeof(noise) / 2 ? 'a' : (char) (state >> 16);
+    }
+
+    struct http_compressor compressor;
+    http_compressor_init(&compressor, 6);
+
+    static uint8_t output[4096];
+    size_t len = 0;
+    CHECK(http_compressor_compress_into(&compressor, HTTP_CONTENT_CODING_GZIP, str_slice_from_buffer(text, text_len),
+                                        output, sizeof(output), &len) == RESULT_OK);
+    CHECK(inflates_to(output, len, text, text_len, true));
+
+    // too big for the buffer, then a body that fits through the same stream
+    CHECK(http_compressor_compress_into(&compressor, HTTP_CONTENT_CODING_DEFLATE,
+                                        str_slice_from_buffer(noise, sizeof(noise)),
+                                        output, sizeof(output), &len) == RESULT_ERR);
+    CHECK(http_compressor_compress_into(&compressor, HTTP_CONTENT_CODING_DEFLATE,
+                                        str_slice_from_buffer(text, text_len / 3),
+                                        output, sizeof(output), &len) == RESULT_OK);
+    CHECK(inflates_to(output, len, text, text_len / 3, false));
+
+    CHECK(http_compressor_compress_into(&compressor, HTTP_CONTENT_CODING_DEFLATE, str_slice_from_buffer(text, 1),
+                                        output, 0, &len) == RESULT_ERR);
+
+    http_compressor_free(&compressor);
+}
+
+int main(void)
+{
+    test_negotiation();
+    test_content_types();
+    test_round_trips();
+    test_into_buffer();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all compression checks passed\n");
+    return 0;
+}
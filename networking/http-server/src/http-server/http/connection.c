@@ -0,0 +1,1255 @@
+#include "connection.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <http-server/commons.h>
+#include <http-server/io.h>
+#include <http-server/stopwatch.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/connection"
+
+static enum http_connection_state http_connection_read(struct http_connection* conn);
+static enum http_connection_state http_connection_process(struct http_connection* conn);
+static enum http_connection_state http_connection_flush(struct http_connection* conn);
+static bool http_connection_read_body(struct http_connection* conn);
+static void http_connection_fail_body(struct http_connection* conn, int status_code, const char* reason_phrase);
+static void http_connection_compact(struct http_connection* conn);
+static void http_connection_read_ahead(struct http_connection* conn);
+static enum result http_connection_acquire_buffers(struct http_connection* conn);
+static void http_connection_release_buffers(struct http_connection* conn);
+static void http_connection_advance_iov(struct http_connection* conn, size_t bytes_sent);
+static enum http_connection_state http_connection_send_file(struct http_connection* conn);
+static void http_connection_release_file(struct http_connection* conn);
+static bool http_connection_dispatch(struct http_connection* conn,
+                                     const struct http_request_head* request_head,
+                                     bool keep_alive);
+static bool http_connection_queue_handler_response(struct http_connection* conn,
+                                                   struct http_handler_context* ctx,
+                                                   bool head_only,
+                                                   bool keep_alive);
+static bool http_connection_queue_cached_response(struct http_connection* conn,
+                                                  struct http_cached_response* entry,
+                                                  bool head_only,
+                                                  bool keep_alive);
+static void http_connection_cache_response(struct http_connection* conn,
+                                           const struct http_handler_context* ctx,
+                                           const struct http_response_cache_key* key,
+                                           uint32_t ttl_ms);
+static void http_connection_release_cached(struct http_connection* conn);
+static void http_connection_compress_response(struct http_connection* conn,
+                                              struct http_handler_context* ctx,
+                                              enum http_content_coding coding);
+static const char* http_connection_format_allow(struct http_connection* conn, uint32_t allowed_methods);
+static bool http_connection_queue_response(struct http_connection* conn,
+                                           int status_code,
+                                           const char* reason_phrase,
+                                           const char* body,
+                                           bool keep_alive);
+static bool http_connection_queue_prepared_response(struct http_connection* conn, bool keep_alive);
+static bool http_connection_queue_parser_error(struct http_connection* conn, enum http_parser_error error);
+static bool http_connection_admit(struct http_connection* conn);
+static void http_connection_queue_rejection(struct http_connection* conn, int status_code, const char* reason_phrase);
+static void http_connection_leave_flight(struct http_connection* conn);
+
+void http_connection_resources_init(struct http_connection_resources* resources)
+{
+    assert(resources != NULL);
+
+    buffer_pool_init(&resources->connections, sizeof(struct http_connection), HTTP_CONNECTION_POOL_SLAB_SIZE);
+    buffer_pool_init(&resources->buffers, HTTP_CONNECTION_BUFFER_SIZE, HTTP_CONNECTION_POOL_SLAB_SIZE);
+    http_metrics_init(&resources->metrics);
+    resources->arena_high_water = 0;
+    http_response_init(&resources->response);
+    http_compressor_init(&resources->compressor, 0);
+    resources->router = NULL;
+    resources->files = NULL;
+    resources->response_cache = NULL;
+    resources->loop = NULL;
+    resources->rate_limiter = NULL;
+    resources->max_body_size = SIZE_MAX;
+    resources->requests_in_flight = 0;
+    resources->max_in_flight = SIZE_MAX;
+    resources->requests_shed = 0;
+    resources->requests_rate_limited = 0;
+    resources->draining = false;
+}
+
+void http_connection_resources_free(struct http_connection_resources* resources)
+{
+    assert(resources != NULL);
+
+    http_response_free(&resources->response);
+    http_compressor_free(&resources->compressor);
+    buffer_pool_free(&resources->buffers);
+    buffer_pool_free(&resources->connections);
+}
+
+struct http_connection* http_connection_create(struct http_connection_resources* resources,
+                                               int socket,
+                                               uint32_t client_address)
+{
+    assert(resources != NULL);
+    assert(socket >= 0);
+
+    struct http_connection* conn = buffer_pool_acquire(&resources->connections);
+    if (conn == NULL) {
+        LOG_ERROR("failed to allocate a new connection");
+        return NULL;
+    }
+
+    conn->socket = socket;
+    conn->state = HTTP_CONNECTION_STATE_READING;
+    conn->resources = resources;
+    conn->client_address = client_address;
+    conn->in_flight = false;
+    conn->request_admitted = false;
+    conn->keep_alive = true;
+    conn->responses_sent = 0;
+    conn->responses_queued = 0;
+    conn->bytes_sent = 0;
+    conn->body_bytes_received = 0;
+    timer_wheel_entry_init(&conn->timeout);
+    conn->prev = NULL;
+    conn->next = NULL;
+    conn->recv_buffer = NULL;
+    conn->recv_start = 0;
+    conn->recv_len = 0;
+    http_parser_init(&conn->parser);
+    http_body_decoder_init(&conn->body, false, 0);
+    conn->body_ctx = (struct http_handler_context) {0};
+    conn->body_head_only = false;
+    conn->body_coding = HTTP_CONTENT_CODING_IDENTITY;
+    conn->send_buffer = NULL;
+    conn->send_len = 0;
+    conn->send_iov_start = 0;
+    conn->send_iov_count = 0;
+    conn->send_file = NULL;
+    conn->send_file_offset = 0;
+    conn->send_file_remaining = 0;
+    conn->send_body_buffer = NULL;
+    conn->send_cached_count = 0;
+    conn->request_started_ns = 0;
+    conn->request_parse_ns = 0;
+    conn->send_started_ns = 0;
+
+    // buffers are acquired once there is something to read
+    return conn;
+}
+
+void http_connection_destroy(struct http_connection* conn)
+{
+    assert(conn != NULL);
+    assert(!timer_wheel_entry_is_armed(&conn->timeout));
+
+    LOG_DEBUG("client socket: closing...");
+    io_count_syscall();
+    close(conn->socket);
+    LOG_DEBUG("client socket: closed.");
+
+    // the body being streamed will never complete
+    if (conn->body_ctx.body_handler != NULL) {
+        conn->body_ctx.body_handler(&conn->body_ctx, str_slice_empty(), HTTP_BODY_STATUS_ERROR);
+    }
+
+    http_connection_leave_flight(conn);
+    http_connection_release_file(conn);
+    free(conn->send_body_buffer);
+    http_connection_release_cached(conn);
+    http_connection_release_buffers(conn);
+    buffer_pool_release(&conn->resources->connections, conn);
+}
+
+enum http_connection_state http_connection_on_events(struct http_connection* conn, uint32_t events)
+{
+    assert(conn != NULL);
+
+    if (events & EPOLLERR) {
+        LOG_WARN("client socket error");
+        conn->state = HTTP_CONNECTION_STATE_CLOSED;
+        return conn->state;
+    }
+
+    // Every finished keep-alive response may unblock pipelined requests already buffered (or still unread on the
+    // socket, since reading stops as soon as there is something to answer), so we keep going until the connection
+    // really has to wait for the socket.
+    bool progressed = true;
+    while (progressed) {
+        progressed = false;
+
+        if (conn->state == HTTP_CONNECTION_STATE_READING || conn->state == HTTP_CONNECTION_STATE_IDLE) {
+            conn->state = http_connection_read(conn);
+        }
+
+        // The socket is most likely writable already, so we try to flush right away instead of waiting for the
+        // next EPOLLOUT.
+        if (conn->state == HTTP_CONNECTION_STATE_WRITING) {
+            conn->state = http_connection_flush(conn);
+            progressed = conn->state == HTTP_CONNECTION_STATE_READING || conn->state == HTTP_CONNECTION_STATE_IDLE;
+        }
+    }
+
+    // nothing is buffered in either direction, so idle keep-alive connections don't hold on to any buffer (nor
+    // count as in flight)
+    if (conn->state == HTTP_CONNECTION_STATE_IDLE) {
+        http_connection_leave_flight(conn);
+        http_connection_release_buffers(conn);
+    }
+
+    return conn->state;
+}
+
+static enum http_connection_state http_connection_read(struct http_connection* conn)
+{
+    if (http_connection_acquire_buffers(conn) != RESULT_OK) {
+        return HTTP_CONNECTION_STATE_CLOSED;
+    }
+
+    while (true) {
+        // a draining worker only closes after the last request received: the ones the client already sent are
+        // all buffered first, so that none of them is taken for the last one
+        if (conn->resources->draining) {
+            http_connection_read_ahead(conn);
+        }
+
+        enum http_connection_state next_state = http_connection_process(conn);
+        if (next_state == HTTP_CONNECTION_STATE_WRITING || next_state == HTTP_CONNECTION_STATE_CLOSED) {
+            return next_state;
+        }
+
+        http_connection_compact(conn);
+
+        // keep room for the trailing '\0'
+        const size_t available = HTTP_CONNECTION_RECV_BUFFER_SIZE - 1 - conn->recv_len;
+        if (available == 0) {
+            LOG_WARN("request headers do not fit in the receive buffer");
+            http_connection_queue_response(conn, 431, "Request Header Fields Too Large", "", false);
+            conn->keep_alive = false;
+            return HTTP_CONNECTION_STATE_WRITING;
+        }
+
+        //NOTE this returns the raw unsafe data read from the client socket
+        //     so it can contain `\0` and other bad bytes...
+        size_t bytes_read = 0;
+        enum io_status status = event_loop_recv(conn->resources->loop, conn->socket,
+                                                conn->recv_buffer + conn->recv_len, available, &bytes_read);
+        switch (status) {
+            case IO_STATUS_OK:
+                break;
+            case IO_STATUS_WOULD_BLOCK:
+                return next_state;
+            case IO_STATUS_EOF:
+                if (next_state == HTTP_CONNECTION_STATE_READING
+                    && (conn->recv_start < conn->recv_len || !http_body_decoder_is_done(&conn->body)))
+                {
+                    LOG_WARN("client disconnected in the middle of a request");
+                } else {
+                    LOG_DEBUG("client closed the connection");
+                }
+                return HTTP_CONNECTION_STATE_CLOSED;
+            case IO_STATUS_ERR:
+                LOG_ERROR("failed to read from the client connection");
+                return HTTP_CONNECTION_STATE_CLOSED;
+        }
+
+        conn->recv_len += bytes_read;
+
+        // the first bytes of a new request
+        if (conn->request_started_ns == 0) {
+            conn->request_started_ns = clock_monotonic_ns();
+        }
+        conn->recv_buffer[conn->recv_len] = '\0';
+
+        LOG_DEBUGF("%zu bytes read", bytes_read);
+    }
+}
+
+/**
+ * @brief answers, in order, every complete request already in the receive buffer.
+ */
+static enum http_connection_state http_connection_process(struct http_connection* conn)
+{
+    // a file (or big body) response must be sent before anything queued after it
+    while (conn->send_file == NULL && conn->send_body_buffer == NULL) {
+        // the body of the previous request comes first (even an empty one, when a handler waits for it), whether the
+        // connection persists after it or not
+        if (!http_body_decoder_is_done(&conn->body) || conn->body_ctx.body_handler != NULL) {
+            if (!http_connection_read_body(conn)) {
+                // the responses to the requests before it are still sent
+                return conn->responses_queued > 0 ? HTTP_CONNECTION_STATE_WRITING : HTTP_CONNECTION_STATE_CLOSED;
+            }
+            if (!http_body_decoder_is_done(&conn->body) || conn->body_ctx.body_handler != NULL) {
+                break;
+            }
+            continue;
+        }
+
+        if (!conn->keep_alive || conn->recv_start == conn->recv_len) {
+            break;
+        }
+
+        // refused requests are not even parsed: shedding them costs next to nothing
+        if (!conn->request_admitted) {
+            if (!http_connection_admit(conn)) {
+                break;
+            }
+            conn->request_admitted = true;
+        }
+
+        //NOTE the receive buffer holds raw unsafe data. The parser validates every byte as it goes
+        //     (no '\0' or any other control char is accepted) and only resumes from where it stopped.
+        const char* request = (const char*) conn->recv_buffer + conn->recv_start;
+        const size_t request_buffer_len = conn->recv_len - conn->recv_start;
+
+        const uint64_t parse_started_ns = clock_monotonic_ns();
+        enum http_parser_status status = http_parser_execute(&conn->parser, request, request_buffer_len);
+        const uint64_t parsed_ns = clock_monotonic_ns();
+        conn->request_parse_ns += parsed_ns - parse_started_ns;
+
+        if (status == HTTP_PARSER_STATUS_INCOMPLETE) {
+            break;
+        }
+
+        if (status == HTTP_PARSER_STATUS_ERROR) {
+            LOG_WARNF("bad request head: error=%d offset=%zu", (int) conn->parser.error, conn->parser.offset);
+            if (http_connection_queue_parser_error(conn, conn->parser.error)) {
+                conn->keep_alive = false;
+            }
+            break;
+        }
+
+        // A handler streaming the body only queues its response once the body is complete, so the responses
+        // queued so far are sent first: it always gets an empty send buffer.
+        const bool has_body = conn->parser.chunked || conn->parser.content_length > 0;
+        if (has_body && conn->responses_queued > 0) {
+            break;
+        }
+
+        if (conn->parser.content_length > conn->resources->max_body_size) {
+            LOG_WARNF("request body too large: %zu bytes", conn->parser.content_length);
+            http_connection_queue_response(conn, 413, "Content Too Large", "", false);
+            conn->keep_alive = false;
+            break;
+        }
+
+        // after parsing, the request head is trusted which means it contains no invalid byte.
+        struct http_request_head* request_head = &conn->resources->request_head;
+        http_parser_request_head(&conn->parser, request, request_head);
+
+        // a draining worker answers the requests already sent, but no more: the last one buffered gets
+        // "Connection: close" (as does a request with a body, since what follows it is not known before it is read)
+        bool keep_alive = request_head->keep_alive;
+        if (conn->resources->draining) {
+            const bool more_buffered = conn->recv_start + conn->parser.offset < conn->recv_len
+                                       || conn->recv_len == HTTP_CONNECTION_RECV_BUFFER_SIZE - 1;
+            keep_alive = keep_alive && !has_body && more_buffered;
+        }
+
+        // when the send buffer is full, this request stays buffered and is answered after the flush
+        const size_t arena_mark = conn->arena.used;
+        const bool was_sending = conn->responses_queued > 0;
+        if (!http_connection_dispatch(conn, request_head, keep_alive)) {
+            arena_rewind(&conn->arena, arena_mark);
+            if (conn->responses_queued > 0) {
+                break;
+            }
+
+            // it would not fit in an empty send buffer either
+            LOG_ERROR("response head too large for the send buffer");
+            http_connection_queue_response(conn, 500, "Internal Server Error", "", false);
+            conn->keep_alive = false;
+            break;
+        }
+
+        const uint64_t handled_ns = clock_monotonic_ns();
+        struct http_metrics* metrics = &conn->resources->metrics;
+        if (conn->request_started_ns != 0) {
+            http_metrics_record(metrics, HTTP_METRICS_STAGE_READ, parsed_ns - conn->request_started_ns);
+        }
+        http_metrics_record(metrics, HTTP_METRICS_STAGE_PARSE, conn->request_parse_ns);
+        http_metrics_record(metrics, HTTP_METRICS_STAGE_HANDLE, handled_ns - parsed_ns);
+        if (!was_sending) {
+            conn->send_started_ns = handled_ns;
+        }
+
+        LOG_DEBUGF("request: %s %.*s (%zu header bytes)",
+                   http_method_cstr(request_head->method),
+                   (int) request_head->start_line.path.len,
+                   request_head->start_line.path.ptr,
+                   conn->parser.offset);
+
+        conn->recv_start += conn->parser.offset;
+        http_body_decoder_init(&conn->body, request_head->chunked, request_head->content_length);
+        conn->keep_alive = keep_alive;
+        conn->request_admitted = false;
+        http_parser_init(&conn->parser);
+
+        // a pipelined request already buffered starts now
+        conn->request_started_ns = conn->recv_start < conn->recv_len ? handled_ns : 0;
+        conn->request_parse_ns = 0;
+
+        // the bodies queued so far may live in the arena: once it is half full, the next requests wait for them
+        // to be sent (and the arena to be reset)
+        if (conn->arena.used > HTTP_CONNECTION_ARENA_SIZE / 2) {
+            break;
+        }
+    }
+
+    if (conn->responses_queued > 0) {
+        return HTTP_CONNECTION_STATE_WRITING;
+    }
+
+    if (conn->recv_start < conn->recv_len || !http_body_decoder_is_done(&conn->body)) {
+        return HTTP_CONNECTION_STATE_READING;
+    }
+
+    return conn->state;
+}
+
+static enum http_connection_state http_connection_flush(struct http_connection* conn)
+{
+    while (conn->send_iov_start < conn->send_iov_count) {
+        size_t bytes_sent = 0;
+        enum io_status status = send_iov_nonblocking(conn->socket,
+                                                     conn->send_iov + conn->send_iov_start,
+                                                     conn->send_iov_count - conn->send_iov_start,
+                                                     &bytes_sent);
+        switch (status) {
+            case IO_STATUS_OK:
+                http_connection_advance_iov(conn, bytes_sent);
+                conn->bytes_sent += bytes_sent;
+                break;
+            case IO_STATUS_WOULD_BLOCK:
+                // resumed on the next EPOLLOUT
+                LOG_DEBUGF("partial send: %zu/%zu buffers sent", conn->send_iov_start, conn->send_iov_count);
+                return HTTP_CONNECTION_STATE_WRITING;
+            case IO_STATUS_EOF:
+            case IO_STATUS_ERR:
+                LOG_ERRORF("failed to send %zu queued responses: %zu/%zu buffers sent",
+                           conn->responses_queued,
+                           conn->send_iov_start,
+                           conn->send_iov_count);
+                return HTTP_CONNECTION_STATE_CLOSED;
+        }
+    }
+
+    conn->send_len = 0;
+    conn->send_iov_start = 0;
+    conn->send_iov_count = 0;
+
+    if (conn->send_file != NULL) {
+        enum http_connection_state state = http_connection_send_file(conn);
+        if (state != HTTP_CONNECTION_STATE_READING) {
+            return state;
+        }
+    }
+
+    // every queued response is sent: nothing allocated for them is needed anymore (a handler streaming a body only
+    // starts once they are, so it has nothing there yet)
+    conn->resources->arena_high_water = MAX(conn->resources->arena_high_water, conn->arena.used);
+    arena_reset(&conn->arena);
+
+    free(conn->send_body_buffer);
+    conn->send_body_buffer = NULL;
+    http_connection_release_cached(conn);
+
+    if (conn->send_started_ns != 0) {
+        http_metrics_record_n(&conn->resources->metrics,
+                              HTTP_METRICS_STAGE_WRITE,
+                              clock_monotonic_ns() - conn->send_started_ns,
+                              conn->responses_queued);
+        conn->send_started_ns = 0;
+    }
+
+    conn->responses_sent += conn->responses_queued;
+    conn->responses_queued = 0;
+
+    if (!conn->keep_alive) {
+        return HTTP_CONNECTION_STATE_CLOSED;
+    }
+
+    // pipelined requests (or the rest of a request body) already buffered
+    if (conn->recv_start < conn->recv_len || !http_body_decoder_is_done(&conn->body)) {
+        return HTTP_CONNECTION_STATE_READING;
+    }
+
+    return HTTP_CONNECTION_STATE_IDLE;
+}
+
+/**
+ * @brief moves the start of the send queue past the |bytes_sent| first bytes.
+ */
+static void http_connection_advance_iov(struct http_connection* conn, size_t bytes_sent)
+{
+    while (bytes_sent > 0) {
+        struct iovec* iov = &conn->send_iov[conn->send_iov_start];
+        if (bytes_sent < iov->iov_len) {
+            iov->iov_base = (uint8_t*) iov->iov_base + bytes_sent;
+            iov->iov_len -= bytes_sent;
+            return;
+        }
+        bytes_sent -= iov->iov_len;
+        conn->send_iov_start++;
+    }
+}
+
+/**
+ * @brief sends the pending file body straight from the page cache to the socket.
+ *
+ * @return HTTP_CONNECTION_STATE_READING once the file is fully sent (and released).
+ */
+static enum http_connection_state http_connection_send_file(struct http_connection* conn)
+{
+    while (conn->send_file_remaining > 0) {
+        size_t bytes_sent = 0;
+        enum io_status status = sendfile_nonblocking(conn->socket,
+                                                     conn->send_file->fd,
+                                                     &conn->send_file_offset,
+                                                     conn->send_file_remaining,
+                                                     &bytes_sent);
+        switch (status) {
+            case IO_STATUS_OK:
+                conn->send_file_remaining -= bytes_sent;
+                conn->bytes_sent += bytes_sent;
+                break;
+            case IO_STATUS_WOULD_BLOCK:
+                LOG_DEBUGF("partial sendfile: %zu bytes left", conn->send_file_remaining);
+                return HTTP_CONNECTION_STATE_WRITING;
+            case IO_STATUS_EOF:
+                // the Content-Length is already sent: the response can only be cut short
+                LOG_WARNF("\"%s\" was truncated while being sent", conn->send_file->path);
+                return HTTP_CONNECTION_STATE_CLOSED;
+            case IO_STATUS_ERR:
+                LOG_ERRORF("failed to send \"%s\": %zu bytes left", conn->send_file->path, conn->send_file_remaining);
+                return HTTP_CONNECTION_STATE_CLOSED;
+        }
+    }
+
+    http_connection_release_file(conn);
+    return HTTP_CONNECTION_STATE_READING;
+}
+
+static void http_connection_release_cached(struct http_connection* conn)
+{
+    for (size_t i = 0; i < conn->send_cached_count; i++) {
+        http_response_cache_release(conn->send_cached[i]);
+    }
+    conn->send_cached_count = 0;
+}
+
+static void http_connection_release_file(struct http_connection* conn)
+{
+    if (conn->send_file == NULL) {
+        return;
+    }
+
+    http_file_cache_release(conn->resources->files, conn->send_file);
+    conn->send_file = NULL;
+    conn->send_file_offset = 0;
+    conn->send_file_remaining = 0;
+}
+
+/**
+ * @brief decodes the request body already buffered and hands it to the handler streaming it (if any), which gets
+ *        its response queued once the body is complete.
+ *
+ * @return false when the body is malformed or too large. The connection must be closed then.
+ */
+static bool http_connection_read_body(struct http_connection* conn)
+{
+    struct http_handler_context* ctx = &conn->body_ctx;
+
+    while (true) {
+        const char* input = (const char*) conn->recv_buffer + conn->recv_start;
+        const size_t input_len = conn->recv_len - conn->recv_start;
+
+        size_t consumed = 0;
+        struct str_slice data;
+        const uint64_t received = conn->body.received;
+        enum http_body_status status = http_body_decoder_execute(&conn->body, input, input_len, &consumed, &data);
+        conn->recv_start += consumed;
+        conn->body_bytes_received += conn->body.received - received;
+
+        if (status == HTTP_BODY_STATUS_ERROR) {
+            LOG_WARN("bad chunked request body");
+            http_connection_fail_body(conn, 400, "Bad Request");
+            return false;
+        }
+
+        // only chunked bodies get here, Content-Length is checked along with the request head
+        if (conn->body.received > conn->resources->max_body_size) {
+            LOG_WARNF("request body too large: more than %zu bytes", conn->resources->max_body_size);
+            http_connection_fail_body(conn, 413, "Content Too Large");
+            return false;
+        }
+
+        if (ctx->body_handler == NULL) {
+            // discarded
+            if (status == HTTP_BODY_STATUS_DONE || consumed == 0) {
+                return true;
+            }
+            continue;
+        }
+
+        if (status == HTTP_BODY_STATUS_DONE) {
+            http_response_reset(ctx->response, 200, "OK");
+            ctx->body_handler(ctx, data, HTTP_BODY_STATUS_DONE);
+            ctx->body_handler = NULL;
+            http_connection_compress_response(conn, ctx, conn->body_coding);
+
+            conn->send_started_ns = clock_monotonic_ns();
+            if (!http_connection_queue_handler_response(conn, ctx, conn->body_head_only, conn->keep_alive)) {
+                // the send buffer was empty
+                LOG_ERROR("response head too large for the send buffer");
+                http_connection_queue_response(conn, 500, "Internal Server Error", "", false);
+                conn->keep_alive = false;
+            }
+            return true;
+        }
+
+        if (data.len > 0) {
+            ctx->body_handler(ctx, data, HTTP_BODY_STATUS_INCOMPLETE);
+        }
+
+        if (consumed == 0) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief gives up on a malformed (or too large) request body. The connection is closed since the next request can't
+ *        be found. A handler streaming the body is told so, and its response replaced by an error response.
+ */
+static void http_connection_fail_body(struct http_connection* conn, int status_code, const char* reason_phrase)
+{
+    struct http_handler_context* ctx = &conn->body_ctx;
+    if (ctx->body_handler != NULL) {
+        ctx->body_handler(ctx, str_slice_empty(), HTTP_BODY_STATUS_ERROR);
+        ctx->body_handler = NULL;
+        http_connection_queue_response(conn, status_code, reason_phrase, "", false);
+    }
+
+    // otherwise the request was answered already, and its response is the last one
+    conn->keep_alive = false;
+}
+
+/**
+ * @brief makes room at the end of the receive buffer by moving the unconsumed bytes to its beginning.
+ */
+static void http_connection_compact(struct http_connection* conn)
+{
+    if (conn->recv_start == 0) {
+        return;
+    }
+
+    const size_t unconsumed = conn->recv_len - conn->recv_start;
+
+    // only pay for the copy when the buffer is actually running out of space
+    if (unconsumed > 0 && conn->recv_len < HTTP_CONNECTION_RECV_BUFFER_SIZE - 1) {
+        return;
+    }
+
+    // the parser state is relative to the request start, so it survives the move
+    memmove(conn->recv_buffer, conn->recv_buffer + conn->recv_start, unconsumed);
+    conn->recv_start = 0;
+    conn->recv_len = unconsumed;
+    conn->recv_buffer[conn->recv_len] = '\0';
+}
+
+/**
+ * @brief appends whatever is already on the socket to the receive buffer, until it is full. The end of the stream
+ *        (or a failure) is left for the next read to find.
+ */
+static void http_connection_read_ahead(struct http_connection* conn)
+{
+    http_connection_compact(conn);
+
+    size_t available = HTTP_CONNECTION_RECV_BUFFER_SIZE - 1 - conn->recv_len;
+    while (available > 0) {
+        size_t bytes_read = 0;
+        enum io_status status = event_loop_recv(conn->resources->loop, conn->socket,
+                                                conn->recv_buffer + conn->recv_len, available, &bytes_read);
+        if (status != IO_STATUS_OK) {
+            return;
+        }
+
+        conn->recv_len += bytes_read;
+        available -= bytes_read;
+        if (conn->request_started_ns == 0) {
+            conn->request_started_ns = clock_monotonic_ns();
+        }
+        conn->recv_buffer[conn->recv_len] = '\0';
+    }
+}
+
+/**
+ * @brief takes the receive buffer, the send buffer and the request arena from the pool (if not held already).
+ */
+static enum result http_connection_acquire_buffers(struct http_connection* conn)
+{
+    if (conn->recv_buffer != NULL) {
+        return RESULT_OK;
+    }
+
+    struct buffer_pool* buffers = &conn->resources->buffers;
+
+    uint8_t* recv_buffer = buffer_pool_acquire(buffers);
+    uint8_t* send_buffer = buffer_pool_acquire(buffers);
+    void* arena_data = buffer_pool_acquire(buffers);
+    if (recv_buffer == NULL || send_buffer == NULL || arena_data == NULL) {
+        LOG_ERROR("failed to allocate the connection buffers");
+        if (recv_buffer != NULL) {
+            buffer_pool_release(buffers, recv_buffer);
+        }
+        if (send_buffer != NULL) {
+            buffer_pool_release(buffers, send_buffer);
+        }
+        if (arena_data != NULL) {
+            buffer_pool_release(buffers, arena_data);
+        }
+        return RESULT_ERR;
+    }
+
+    // NOTE buffers are not zero-filled on purpose. recv_len/send_len track what is actually in use.
+    conn->recv_buffer = recv_buffer;
+    conn->recv_buffer[0] = '\0';
+    conn->send_buffer = send_buffer;
+    arena_init(&conn->arena, arena_data, HTTP_CONNECTION_ARENA_SIZE);
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief gives the buffers back to the pool. Only valid when nothing is buffered (or the connection is closing).
+ */
+static void http_connection_release_buffers(struct http_connection* conn)
+{
+    if (conn->recv_buffer == NULL) {
+        return;
+    }
+
+    struct buffer_pool* buffers = &conn->resources->buffers;
+    buffer_pool_release(buffers, conn->recv_buffer);
+    buffer_pool_release(buffers, conn->send_buffer);
+    buffer_pool_release(buffers, conn->arena.data);
+
+    conn->recv_buffer = NULL;
+    conn->recv_start = 0;
+    conn->recv_len = 0;
+    conn->send_buffer = NULL;
+    conn->send_len = 0;
+    conn->send_iov_start = 0;
+    conn->send_iov_count = 0;
+}
+
+/**
+ * @brief routes the request to its handler and queues the response it built.
+ *
+ * @return false when the response does not fit in the send buffer. Nothing is queued in that case.
+ */
+static bool http_connection_dispatch(struct http_connection* conn,
+                                     const struct http_request_head* request_head,
+                                     bool keep_alive)
+{
+    struct http_connection_resources* resources = conn->resources;
+    struct http_response* resp = &resources->response;
+
+    struct str_slice path = request_head->start_line.path;
+    const char* query = memchr(path.ptr, '?', path.len);
+    if (query != NULL) {
+        path.len = (size_t) (query - path.ptr);
+    }
+
+    struct http_router_match match;
+    enum http_router_match_status status = HTTP_ROUTER_MATCH_NOT_FOUND;
+    if (resources->router != NULL) {
+        status = http_router_match(resources->router, request_head->method, path, &match);
+    }
+
+    switch (status) {
+        case HTTP_ROUTER_MATCH_FOUND:
+            break;
+
+        case HTTP_ROUTER_MATCH_NOT_FOUND:
+            return http_connection_queue_response(conn, 404, "Not Found", "Not Found\n", keep_alive);
+
+        case HTTP_ROUTER_MATCH_METHOD_NOT_ALLOWED: {
+            const char* allow = http_connection_format_allow(conn, match.allowed_methods);
+            http_response_reset(resp, 405, "Method Not Allowed");
+            resp->body = str_slice_from_cstr_trusted("Method Not Allowed\n");
+            const bool headers_added =
+                http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                               str_slice_from_cstr_trusted("text/plain; charset=utf-8")) == RESULT_OK
+                && http_response_add_header(resp, str_slice_from_cstr_trusted("Allow"),
+                                                  str_slice_from_cstr_trusted(allow)) == RESULT_OK;
+            return headers_added && http_connection_queue_prepared_response(conn, keep_alive);
+        }
+    }
+
+    // a fresh cached response is sent as is, without calling the handler
+    const bool head_only = request_head->method == HTTP_METHOD_HEAD;
+    const uint32_t cache_ttl_ms = resources->response_cache != NULL ? match.route->cache_ttl_ms : 0;
+    struct http_response_cache_key cache_key;
+    const bool cacheable = cache_ttl_ms > 0 && http_response_cache_key_init(&cache_key, request_head);
+    if (cacheable) {
+        struct http_cached_response* entry =
+            http_response_cache_lookup(resources->response_cache, &cache_key, clock_monotonic_ms());
+        if (entry != NULL) {
+            if (http_connection_queue_cached_response(conn, entry, head_only, keep_alive)) {
+                return true;
+            }
+            http_response_cache_release(entry);
+            return false;
+        }
+    }
+
+    http_response_reset(resp, 200, "OK");
+
+    struct http_handler_context ctx = {
+        .request_head = request_head,
+        .params = &match.params,
+        .resources = resources,
+        .arena = &conn->arena,
+        .response = resp,
+        .file = NULL,
+        .send_file = false,
+        .body_buffer = NULL,
+        .body_handler = NULL,
+        .body_state = NULL,
+        .cacheable = cacheable,
+        .user_data = match.route->user_data,
+    };
+    match.route->handler(&ctx);
+
+    // answered once the body is complete (see http_connection_read_body)
+    const enum http_content_coding coding = http_compressor_is_enabled(&resources->compressor)
+                                            ? http_content_coding_negotiate(request_head)
+                                            : HTTP_CONTENT_CODING_IDENTITY;
+    if (ctx.body_handler != NULL) {
+        ctx.request_head = NULL;
+        ctx.params = NULL;
+        conn->body_ctx = ctx;
+        conn->body_head_only = head_only;
+        conn->body_coding = coding;
+        return true;
+    }
+
+    // compressed before being cached, so the cached copy is compressed once for all the requests it answers
+    http_connection_compress_response(conn, &ctx, coding);
+
+    // a HEAD is answered from the GET entries, but doesn't make one
+    if (ctx.cacheable && !head_only) {
+        http_connection_cache_response(conn, &ctx, &cache_key, cache_ttl_ms);
+    }
+
+    return http_connection_queue_handler_response(conn, &ctx, head_only, keep_alive);
+}
+
+/**
+ * @brief compresses the body of the 200 a handler just built with |coding|, when its type is worth it. Bodies sent
+ *        from a file (compressed by the handler itself if at all) or already encoded are left alone.
+ *
+ * The compressed body goes to the request arena, unless the handler malloc'ed its body (or the arena is too small):
+ * it then takes the place of the handler body buffer. The response is sent as it is on any failure.
+ */
+static void http_connection_compress_response(struct http_connection* conn,
+                                              struct http_handler_context* ctx,
+                                              enum http_content_coding coding)
+{
+    struct http_compressor* compressor = &conn->resources->compressor;
+    struct http_response* resp = ctx->response;
+    if (!http_compressor_is_enabled(compressor)
+        || resp->status_code != 200
+        || resp->has_content_length
+        || ctx->file != NULL
+        || resp->body.len < HTTP_COMPRESSION_MIN_SIZE)
+    {
+        return;
+    }
+
+    struct str_slice value;
+    if (!http_response_find_header(resp, "Content-Type", &value)
+        || !http_content_type_is_compressible(value)
+        || http_response_find_header(resp, "Content-Encoding", &value))
+    {
+        return;
+    }
+
+    // whether it is compressed or not depends on the request from now on
+    if (http_response_add_header(resp, str_slice_from_cstr_trusted("Vary"),
+                                       str_slice_from_cstr_trusted("Accept-Encoding")) != RESULT_OK
+        || coding == HTTP_CONTENT_CODING_IDENTITY)
+    {
+        return;
+    }
+
+    // a body that is no smaller compressed is sent as it is, which also bounds what the arena is asked for
+    struct arena* arena = &conn->arena;
+    const size_t arena_mark = arena->used;
+    const size_t capacity = MIN(arena_available(arena), resp->body.len - 1);
+
+    void* data = NULL;
+    size_t len = 0;
+    bool in_arena = false;
+    if (ctx->body_buffer == NULL && capacity > 0) {
+        void* output = arena_alloc(arena, capacity);
+        if (http_compressor_compress_into(compressor, coding, resp->body, output, capacity, &len) == RESULT_OK) {
+            // only what it took is kept
+            arena_rewind(arena, arena_mark);
+            data = arena_alloc(arena, len);
+            in_arena = true;
+        } else {
+            arena_rewind(arena, arena_mark);
+            if (capacity == resp->body.len - 1) {
+                // not smaller compressed: the malloc'ed attempt would fail the same way
+                return;
+            }
+        }
+    }
+    if (!in_arena && http_compressor_compress(compressor, coding, resp->body, &data, &len) != RESULT_OK) {
+        return;
+    }
+
+    if (len >= resp->body.len
+        || http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Encoding"),
+                                          str_slice_from_cstr_trusted(http_content_coding_cstr(coding))) != RESULT_OK)
+    {
+        if (in_arena) {
+            arena_rewind(arena, arena_mark);
+        } else {
+            free(data);
+        }
+        return;
+    }
+
+    LOG_DEBUGF("response body compressed with %s: %zu -> %zu bytes", http_content_coding_cstr(coding), resp->body.len, len);
+
+    if (!in_arena) {
+        free(ctx->body_buffer);
+        ctx->body_buffer = data;
+    }
+    resp->body = str_slice_from_buffer(data, len);
+}
+
+/**
+ * @brief queues a cached response with the connection level headers of this request. The connection holds |entry|
+ *        until it is sent.
+ *
+ * @return false when it does not fit. Nothing is queued in that case (and |entry| is still the caller's).
+ */
+static bool http_connection_queue_cached_response(struct http_connection* conn,
+                                                  struct http_cached_response* entry,
+                                                  bool head_only,
+                                                  bool keep_alive)
+{
+    const size_t body_len = head_only ? 0 : entry->body_len;
+    const size_t iov_needed = body_len > 0 ? 3 : 2;
+    if (conn->send_cached_count == HTTP_CONNECTION_SEND_CACHED_MAX
+        || conn->send_iov_count + iov_needed > HTTP_CONNECTION_SEND_IOV_MAX)
+    {
+        return false;
+    }
+
+    uint8_t* tail = conn->send_buffer + conn->send_len;
+    const int tail_len = snprintf((char*) tail,
+                                  HTTP_CONNECTION_SEND_BUFFER_SIZE - conn->send_len,
+                                  "Server: http-server/0.0.0\r\nConnection: %s\r\n\r\n",
+                                  keep_alive ? "keep-alive" : "close");
+    if (tail_len < 0 || (size_t) tail_len >= HTTP_CONNECTION_SEND_BUFFER_SIZE - conn->send_len) {
+        return false;
+    }
+
+    LOG_DEBUGF("response: cached, %zu head bytes, %zu body bytes", entry->head_len + (size_t) tail_len, body_len);
+
+    conn->send_iov[conn->send_iov_count++] = (struct iovec) {
+        .iov_base = (void*) http_cached_response_head(entry),
+        .iov_len = entry->head_len,
+    };
+    conn->send_iov[conn->send_iov_count++] = (struct iovec) { .iov_base = tail, .iov_len = (size_t) tail_len };
+    conn->send_len += (size_t) tail_len;
+
+    if (body_len > 0) {
+        conn->send_iov[conn->send_iov_count++] = (struct iovec) {
+            .iov_base = (void*) http_cached_response_body(entry),
+            .iov_len = body_len,
+        };
+    }
+
+    conn->send_cached[conn->send_cached_count++] = entry;
+    conn->responses_queued++;
+
+    return true;
+}
+
+/**
+ * @brief caches the 200 a handler just built (before the connection level headers are added). Responses sent from
+ *        a file or streamed are not, nor the ones whose head doesn't fit in the free part of the send buffer (used as
+ *        scratch).
+ */
+static void http_connection_cache_response(struct http_connection* conn,
+                                           const struct http_handler_context* ctx,
+                                           const struct http_response_cache_key* key,
+                                           uint32_t ttl_ms)
+{
+    const struct http_response* resp = ctx->response;
+    if (resp->status_code != 200 || resp->has_content_length || ctx->file != NULL || ctx->body_handler != NULL) {
+        return;
+    }
+
+    uint8_t* head = conn->send_buffer + conn->send_len;
+    size_t head_len = 0;
+    if (http_response_serialize_head(resp, head, HTTP_CONNECTION_SEND_BUFFER_SIZE - conn->send_len, &head_len) != RESULT_OK) {
+        return;
+    }
+
+    // the connection level headers and the empty line are added to every response sent from it
+    http_response_cache_insert(conn->resources->response_cache,
+                               key,
+                               (const char*) head,
+                               head_len - 2,
+                               resp->body,
+                               ttl_ms,
+                               clock_monotonic_ms());
+}
+
+/**
+ * @brief queues the response a handler built, with the file or body buffer it holds.
+ *
+ * @return false when the response does not fit in the send buffer. Nothing is queued in that case (and what the
+ *         handler held is released).
+ */
+static bool http_connection_queue_handler_response(struct http_connection* conn,
+                                                   struct http_handler_context* ctx,
+                                                   bool head_only,
+                                                   bool keep_alive)
+{
+    struct http_connection_resources* resources = conn->resources;
+    struct http_response* resp = ctx->response;
+
+    // HEAD gets the head a GET would get, whatever the handler did
+    if (head_only) {
+        if (!resp->has_content_length) {
+            http_response_set_content_length(resp, resp->body.len);
+        }
+        resp->body = str_slice_empty();
+        ctx->send_file = false;
+    }
+
+    const bool queued = http_connection_queue_prepared_response(conn, keep_alive);
+
+    // the body may point into the file (its compressed copy): it is held until sent then, like a file sent as is
+    if (ctx->file != NULL) {
+        if (queued && (ctx->send_file || resp->body.len > 0)) {
+            conn->send_file = ctx->file;
+            conn->send_file_offset = 0;
+            conn->send_file_remaining = ctx->send_file ? (size_t) ctx->file->size : 0;
+        } else {
+            http_file_cache_release(resources->files, ctx->file);
+        }
+    }
+
+    if (ctx->body_buffer != NULL) {
+        if (queued) {
+            conn->send_body_buffer = ctx->body_buffer;
+        } else {
+            free(ctx->body_buffer);
+        }
+    }
+
+    return queued;
+}
+
+/**
+ * @brief the Allow header value of a 405, allocated from the request arena.
+ */
+static const char* http_connection_format_allow(struct http_connection* conn, uint32_t allowed_methods)
+{
+    // a GET route answers HEAD requests too
+    if (allowed_methods & (UINT32_C(1) << HTTP_METHOD_GET)) {
+        allowed_methods |= UINT32_C(1) << HTTP_METHOD_HEAD;
+    }
+
+    // every method name is shorter than 8 chars, plus ", "
+    char* allow = arena_alloc(&conn->arena, HTTP_METHOD_COUNT * 10);
+    if (allow == NULL) {
+        return "";
+    }
+
+    size_t len = 0;
+    for (size_t m = 0; m < HTTP_METHOD_COUNT; m++) {
+        if (allowed_methods & (UINT32_C(1) << m)) {
+            len += (size_t) sprintf(allow + len, "%s%s", len > 0 ? ", " : "", http_method_cstr((enum http_method) m));
+        }
+    }
+    allow[len] = '\0';
+
+    return allow;
+}
+
+/**
+ * @brief appends a plain text response to the send buffer.
+ *
+ * @return false when it does not fit. Nothing is queued in that case.
+ */
+static bool http_connection_queue_response(struct http_connection* conn,
+                                           int status_code,
+                                           const char* reason_phrase,
+                                           const char* body,
+                                           bool keep_alive)
+{
+    struct http_response* resp = &conn->resources->response;
+
+    http_response_reset(resp, status_code, reason_phrase);
+    resp->body = str_slice_from_cstr_trusted(body);
+
+    if (http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                       str_slice_from_cstr_trusted("text/plain; charset=utf-8")) != RESULT_OK)
+    {
+        return false;
+    }
+
+    return http_connection_queue_prepared_response(conn, keep_alive);
+}
+
+/**
+ * @brief adds the connection level headers to the response built in the connection resources and appends it to
+ *        the send buffer.
+ *
+ * @return false when it does not fit. Nothing is queued in that case.
+ */
+static bool http_connection_queue_prepared_response(struct http_connection* conn, bool keep_alive)
+{
+    struct http_response* resp = &conn->resources->response;
+
+    const bool headers_added =
+        http_response_add_header(resp, str_slice_from_cstr_trusted("Server"),
+                                       str_slice_from_cstr_trusted("http-server/0.0.0")) == RESULT_OK
+        && http_response_add_header(resp, str_slice_from_cstr_trusted("Connection"),
+                                          str_slice_from_cstr_trusted(keep_alive ? "keep-alive" : "close")) == RESULT_OK;
+    if (!headers_added) {
+        return false;
+    }
+
+    const size_t iov_needed = resp->body.len > 0 ? 2 : 1;
+    if (conn->send_iov_count + iov_needed > HTTP_CONNECTION_SEND_IOV_MAX) {
+        return false;
+    }
+
+    uint8_t* head = conn->send_buffer + conn->send_len;
+    size_t head_len = 0;
+    if (http_response_serialize_head(resp, head, HTTP_CONNECTION_SEND_BUFFER_SIZE - conn->send_len, &head_len) != RESULT_OK) {
+        return false;
+    }
+
+    LOG_DEBUGF("response: %d, %zu head bytes, %zu body bytes", resp->status_code, head_len, resp->body.len);
+
+    // heads queued back to back (no body in between) are contiguous in the send buffer: a single buffer to send
+    struct iovec* last = conn->send_iov_count > 0 ? &conn->send_iov[conn->send_iov_count - 1] : NULL;
+    if (conn->send_len > 0 && last != NULL && (uint8_t*) last->iov_base + last->iov_len == head) {
+        last->iov_len += head_len;
+    } else {
+        conn->send_iov[conn->send_iov_count++] = (struct iovec) { .iov_base = head, .iov_len = head_len };
+    }
+    conn->send_len += head_len;
+
+    if (resp->body.len > 0) {
+        conn->send_iov[conn->send_iov_count++] = (struct iovec) {
+            .iov_base = (void*) resp->body.ptr,
+            .iov_len = resp->body.len,
+        };
+    }
+
+    conn->responses_queued++;
+
+    return true;
+}
+
+/**
+ * @brief answers a malformed request head. The connection is closed afterwards since the request can't be framed.
+ */
+static bool http_connection_queue_parser_error(struct http_connection* conn, enum http_parser_error error)
+{
+    switch (error) {
+        case HTTP_PARSER_ERROR_TOO_MANY_HEADERS:
+            return http_connection_queue_response(conn, 431, "Request Header Fields Too Large", "", false);
+        case HTTP_PARSER_ERROR_METHOD_NOT_IMPLEMENTED:
+            return http_connection_queue_response(conn, 501, "Not Implemented", "", false);
+        case HTTP_PARSER_ERROR_VERSION_NOT_SUPPORTED:
+            return http_connection_queue_response(conn, 505, "HTTP Version Not Supported", "", false);
+        case HTTP_PARSER_ERROR_NONE:
+        case HTTP_PARSER_ERROR_BAD_REQUEST:
+            break;
+    }
+    return http_connection_queue_response(conn, 400, "Bad Request", "", false);
+}
+
+/**
+ * @brief admission control of the request starting at recv_start, before it is parsed: it is shed when the worker
+ *        already has too many requests in flight, and refused when its client is over its rate.
+ *
+ * @return false when the request is refused. A rejection is queued and the connection is closed afterwards.
+ */
+static bool http_connection_admit(struct http_connection* conn)
+{
+    struct http_connection_resources* resources = conn->resources;
+
+    // the pipelined requests of a connection in flight already are part of the work admitted
+    if (!conn->in_flight) {
+        if (resources->requests_in_flight >= resources->max_in_flight) {
+            LOG_DEBUGF("too many requests in flight (%zu): shedding", resources->requests_in_flight);
+            resources->requests_shed++;
+            http_connection_queue_rejection(conn, 503, "Service Unavailable");
+            return false;
+        }
+        conn->in_flight = true;
+        resources->requests_in_flight++;
+    }
+
+    if (resources->rate_limiter != NULL
+        && !http_rate_limiter_take(resources->rate_limiter, conn->client_address, clock_monotonic_ms()))
+    {
+        LOG_DEBUG("client over its rate limit");
+        resources->requests_rate_limited++;
+        http_connection_queue_rejection(conn, 429, "Too Many Requests");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief queues a refusal asking the client to come back later, and closes the connection afterwards (the request
+ *        was not parsed, so it can't be skipped). When the send buffer is too full for it, the connection is closed
+ *        after the responses already queued anyway.
+ */
+static void http_connection_queue_rejection(struct http_connection* conn, int status_code, const char* reason_phrase)
+{
+    struct http_response* resp = &conn->resources->response;
+
+    http_response_reset(resp, status_code, reason_phrase);
+    const bool headers_added =
+        http_response_add_header(resp, str_slice_from_cstr_trusted("Retry-After"),
+                                       str_slice_from_cstr_trusted("1")) == RESULT_OK
+        && http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                          str_slice_from_cstr_trusted("text/plain; charset=utf-8")) == RESULT_OK;
+    if (!headers_added || !http_connection_queue_prepared_response(conn, false)) {
+        LOG_WARNF("no room left to answer %d: closing the connection", status_code);
+    }
+
+    conn->keep_alive = false;
+}
+
+static void http_connection_leave_flight(struct http_connection* conn)
+{
+    if (conn->in_flight) {
+        assert(conn->resources->requests_in_flight > 0);
+        conn->in_flight = false;
+        conn->resources->requests_in_flight--;
+    }
+}
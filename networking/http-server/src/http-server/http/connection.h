@@ -0,0 +1,337 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <sys/uio.h>
+
+#include <http-server/error.h>
+#include <http-server/arena.h>
+#include <http-server/buffer-pool.h>
+#include <http-server/timer-wheel.h>
+#include <http-server/event-loop.h>
+#include "parser.h"
+#include "body.h"
+#include "response.h"
+#include "router.h"
+#include "file-cache.h"
+#include "response-cache.h"
+#include "compression.h"
+#include "rate-limiter.h"
+#include "metrics.h"
+
+/**
+ * Receive buffers, send buffers and request arenas all come from the same pool of HTTP_CONNECTION_BUFFER_SIZE
+ * bytes buffers.
+ */
+#define HTTP_CONNECTION_BUFFER_SIZE 4096
+#define HTTP_CONNECTION_RECV_BUFFER_SIZE HTTP_CONNECTION_BUFFER_SIZE
+#define HTTP_CONNECTION_SEND_BUFFER_SIZE HTTP_CONNECTION_BUFFER_SIZE
+#define HTTP_CONNECTION_ARENA_SIZE HTTP_CONNECTION_BUFFER_SIZE
+
+/**
+ * @brief max number of buffers (a head and a body per response) queued for a single gathering send. A connection
+ *        stops answering pipelined requests until they are sent once it is reached.
+ */
+#define HTTP_CONNECTION_SEND_IOV_MAX 32
+
+/**
+ * @brief max number of cached responses queued at once (each one is referenced until it is sent)
+ */
+#define HTTP_CONNECTION_SEND_CACHED_MAX 8
+
+/**
+ * @brief number of connections (or buffers) allocated at once when a pool runs dry
+ */
+#define HTTP_CONNECTION_POOL_SLAB_SIZE 64
+
+enum http_connection_state {
+    /**
+     * Waiting for (the rest of) a request.
+     */
+    HTTP_CONNECTION_STATE_READING = 0,
+
+    /**
+     * Responses are queued on the send buffer and waiting for the socket to become writable.
+     */
+    HTTP_CONNECTION_STATE_WRITING,
+
+    /**
+     * A persistent (keep-alive) connection with every response sent and nothing buffered. Waiting for the next
+     * request.
+     */
+    HTTP_CONNECTION_STATE_IDLE,
+
+    /**
+     * Done (or failed). The owner should close and destroy the connection.
+     */
+    HTTP_CONNECTION_STATE_CLOSED,
+};
+
+/**
+ * @brief what every connection of a worker shares: the memory they are carved from and the scratch state of the
+ *        request being handled, so that steady-state request handling never calls malloc/free.
+ */
+struct http_connection_resources {
+    /**
+     * @brief struct http_connection objects
+     */
+    struct buffer_pool connections;
+
+    /**
+     * @brief receive/send buffers and request arenas (HTTP_CONNECTION_BUFFER_SIZE bytes each)
+     */
+    struct buffer_pool buffers;
+
+    /**
+     * @brief the peak of bytes used by a single request arena
+     */
+    size_t arena_high_water;
+
+    /**
+     * @brief the request being answered and the response being built. A worker handles one request at a time, so
+     *        its connections share them (and the response keeps its header list capacity from one response to the
+     *        next).
+     */
+    struct http_request_head request_head;
+    struct http_response response;
+
+    /**
+     * @brief the routes shared by every worker (read-only). Every request gets a 404 without one.
+     */
+    const struct http_router* router;
+
+    /**
+     * @brief the open files of the document root (owned by the worker). NULL when static files are not served.
+     */
+    struct http_file_cache* files;
+
+    /**
+     * @brief the responses of cacheable routes, shared by every worker. NULL when responses are not cached.
+     */
+    struct http_response_cache* response_cache;
+
+    /**
+     * @brief the event loop of the worker (owned by it), which the connections read their socket from (see
+     *        event_loop_recv)
+     */
+    struct event_loop* loop;
+
+    /**
+     * @brief the request rate of every client address, shared by every worker. NULL when requests are not rate
+     *        limited.
+     */
+    struct http_rate_limiter* rate_limiter;
+
+    /**
+     * @brief requests with a bigger body get a 413 (see struct config). SIZE_MAX when unlimited.
+     */
+    size_t max_body_size;
+
+    /**
+     * @brief connections of the worker with a request in flight (see struct http_connection), and how many of them
+     *        it takes for new requests to be shed with a 503. SIZE_MAX when unlimited.
+     */
+    size_t requests_in_flight;
+    size_t max_in_flight;
+
+    /**
+     * @brief requests refused by admission control: shed (503) or over the rate of their client (429)
+     */
+    size_t requests_shed;
+    size_t requests_rate_limited;
+
+    /**
+     * @brief set once the worker drains (see http_worker_drain): from then on, the last request a connection received
+     *        is answered with "Connection: close".
+     */
+    bool draining;
+
+    /**
+     * @brief compresses the response bodies of the worker (see http_connection_compress_response). Disabled unless
+     *        the worker enables it.
+     */
+    struct http_compressor compressor;
+
+    /**
+     * @brief the latencies of every request of the worker
+     */
+    struct http_metrics metrics;
+};
+
+/**
+ * @brief a client connection and its per-connection state machine.
+ *
+ * The socket is non-blocking and registered edge-triggered, so every event handler drains it until EAGAIN.
+ * Pipelined requests are answered in order from what is already buffered before reading the socket again.
+ */
+struct http_connection {
+    int socket;
+    enum http_connection_state state;
+
+    struct http_connection_resources* resources;
+
+    /**
+     * @brief the client IPv4 address (network byte order), for rate limiting
+     */
+    uint32_t client_address;
+
+    /**
+     * @brief whether the connection counts among the requests in flight of its worker: from the first bytes of an
+     *        admitted request until it becomes idle (or is closed), pipelined requests included.
+     */
+    bool in_flight;
+
+    /**
+     * @brief whether the request being read went through admission control already
+     */
+    bool request_admitted;
+
+    /**
+     * @brief whether the connection persists after the responses already queued. Cleared once a response is
+     *        sent with "Connection: close".
+     */
+    bool keep_alive;
+
+    /**
+     * @brief number of responses fully sent. The owner uses it to re-arm the read timeout for the next request.
+     */
+    size_t responses_sent;
+
+    /**
+     * @brief number of responses currently in the send buffer
+     */
+    size_t responses_queued;
+
+    /**
+     * @brief total bytes written to the socket. The owner uses it to tell a slow client still reading a big
+     *        response from a stalled one.
+     */
+    uint64_t bytes_sent;
+
+    /**
+     * @brief total request body bytes decoded. The owner uses it to tell a client still uploading a big body from a
+     *        stalled one.
+     */
+    uint64_t body_bytes_received;
+
+    /**
+     * @brief the deadline (CLOCK_MONOTONIC ms) in the worker timer wheel: the connection is dropped when it is
+     *        reached. Armed for as long as the connection is open.
+     */
+    struct timer_wheel_entry timeout;
+
+    /**
+     * @brief links of the owner list of open connections (the ones to go through when draining)
+     */
+    struct http_connection* prev;
+    struct http_connection* next;
+
+    /**
+     * @brief the raw unsafe data read from the client socket.
+     *
+     * Bytes in [recv_start, recv_len) are not consumed yet (the current request or pipelined ones).
+     * It is always kept null-terminated, so at most HTTP_CONNECTION_RECV_BUFFER_SIZE - 1 bytes are used.
+     *
+     * The receive buffer, the send buffer and the arena are only held while there is a request in flight: they
+     * go back to the pool as soon as the connection becomes idle (NULL then).
+     */
+    uint8_t* recv_buffer;
+    size_t recv_start;
+    size_t recv_len;
+
+    /**
+     * @brief the incremental parser of the request starting at recv_start. It resumes where it stopped on every
+     *        chunk, so a slow client is never rescanned.
+     */
+    struct http_parser parser;
+
+    /**
+     * @brief the body of the last request, decoded as it arrives and consumed right away (so any body size fits in
+     *        the receive buffer). Done when there is none left: the next pipelined request starts then.
+     */
+    struct http_body_decoder body;
+
+    /**
+     * @brief the context of the handler streaming the body (see http_body_fn), kept until the body is complete and
+     *        its response queued. body_ctx.body_handler is NULL when the body is discarded instead.
+     */
+    struct http_handler_context body_ctx;
+    bool body_head_only;
+    enum http_content_coding body_coding;
+
+    /**
+     * @brief the responses waiting to be sent, in order, as a single gathering send (writev).
+     *
+     * Response heads are serialized to the send buffer ([0, send_len) is in use) while bodies are sent from where
+     * they are, without any copy. Partially sent buffers are advanced in place, so a short send just resumes on
+     * the next EPOLLOUT.
+     */
+    uint8_t* send_buffer;
+    size_t send_len;
+    struct iovec send_iov[HTTP_CONNECTION_SEND_IOV_MAX];
+    size_t send_iov_start;
+    size_t send_iov_count;
+
+    /**
+     * @brief the body of the last queued response, sent with sendfile right after the send buffer is drained.
+     *        Later pipelined requests are not answered before it is fully sent.
+     */
+    struct http_file* send_file;
+    off_t send_file_offset;
+    size_t send_file_remaining;
+
+    /**
+     * @brief the malloc'ed body buffer of a queued response (see struct http_handler_context), freed once sent.
+     *        Later pipelined requests are not answered before it is.
+     */
+    void* send_body_buffer;
+
+    /**
+     * @brief the cached responses queued (their heads and bodies are sent from the cache entries), released once
+     *        sent
+     */
+    struct http_cached_response* send_cached[HTTP_CONNECTION_SEND_CACHED_MAX];
+    size_t send_cached_count;
+
+    /**
+     * @brief CLOCK_MONOTONIC timestamps (ns) of the request being read and of the first queued response, and the
+     *        time spent parsing the request so far (see enum http_metrics_stage). 0 when there is none.
+     */
+    uint64_t request_started_ns;
+    uint64_t request_parse_ns;
+    uint64_t send_started_ns;
+
+    /**
+     * @brief scratch memory of the requests being answered. Response bodies may live there, so it is only reset
+     *        once every queued response is sent.
+     */
+    struct arena arena;
+};
+
+void http_connection_resources_init(struct http_connection_resources* resources);
+void http_connection_resources_free(struct http_connection_resources* resources);
+
+/**
+ * @brief creates a new connection for an already accepted non-blocking |socket| of a client at |client_address|
+ *        (IPv4, network byte order).
+ *
+ * @return NULL on allocation failure. The socket ownership is only transferred on success.
+ */
+struct http_connection* http_connection_create(struct http_connection_resources* resources,
+                                               int socket,
+                                               uint32_t client_address);
+
+/**
+ * @brief closes the socket and gives the connection back to its pools (see struct http_connection_resources).
+ */
+void http_connection_destroy(struct http_connection* conn);
+
+/**
+ * @brief drives the connection state machine with the epoll |events| that are ready for it.
+ *
+ * @return the new connection state.
+ */
+enum http_connection_state http_connection_on_events(struct http_connection* conn, uint32_t events);
+
@@ -0,0 +1,392 @@
+#include "file-cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <http-server/commons.h>
+#include <http-server/stopwatch.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/file-cache"
+
+static uint64_t http_file_path_hash(const char* path, size_t path_len);
+static const char* http_file_content_type(const char* path, size_t path_len);
+static struct http_file* http_file_cache_find(struct http_file_cache* cache, const char* path, size_t path_len, uint64_t hash);
+static struct http_file* http_file_cache_take_entry(struct http_file_cache* cache);
+static void http_file_cache_detach(struct http_file_cache* cache, struct http_file* file);
+static void http_file_cache_recycle(struct http_file_cache* cache, struct http_file* file);
+static void http_file_cache_lru_remove(struct http_file_cache* cache, struct http_file* file);
+static void http_file_cache_lru_push_front(struct http_file_cache* cache, struct http_file* file);
+static bool http_file_is_unchanged(const struct http_file* file, const struct stat* st);
+
+enum result http_file_cache_init(struct http_file_cache* cache, const char* document_root, size_t capacity)
+{
+    assert(cache != NULL);
+    assert(document_root != NULL);
+    assert(capacity > 0);
+
+    *cache = (struct http_file_cache) { .root_fd = -1 };
+
+    cache->root_fd = open(document_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cache->root_fd < 0) {
+        int error_code = errno;
+        LOG_ERRORF("failed to open the document root \"%s\": %s", document_root, strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    // a power of two, so the bucket is just the lowest bits of the hash
+    cache->bucket_count = 16;
+    while (cache->bucket_count < capacity * 2) {
+        cache->bucket_count *= 2;
+    }
+
+    cache->files = calloc(capacity, sizeof(struct http_file));
+    cache->buckets = calloc(cache->bucket_count, sizeof(struct http_file*));
+    if (cache->files == NULL || cache->buckets == NULL) {
+        LOG_ERRORF("failed to allocate the file cache (%zu entries)", capacity);
+        http_file_cache_free(cache);
+        return RESULT_ERR;
+    }
+    cache->capacity = capacity;
+
+    for (size_t i = capacity; i > 0; i--) {
+        struct http_file* file = &cache->files[i - 1];
+        file->fd = -1;
+        file->hash_next = cache->free_list;
+        cache->free_list = file;
+    }
+
+    return RESULT_OK;
+}
+
+void http_file_cache_free(struct http_file_cache* cache)
+{
+    assert(cache != NULL);
+
+    if (cache->files != NULL) {
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->files[i].fd >= 0) {
+                close(cache->files[i].fd);
+            }
+            for (size_t j = 0; j < HTTP_CONTENT_CODING_COUNT; j++) {
+                free(cache->files[i].encodings[j].data);
+            }
+        }
+    }
+
+    if (cache->root_fd >= 0) {
+        close(cache->root_fd);
+    }
+
+    free(cache->files);
+    free(cache->buckets);
+    *cache = (struct http_file_cache) { .root_fd = -1 };
+}
+
+enum http_file_cache_status http_file_cache_acquire(struct http_file_cache* cache,
+                                                    const char* path,
+                                                    size_t path_len,
+                                                    struct http_file** out_file)
+{
+    assert(cache != NULL);
+    assert(path != NULL);
+    assert(out_file != NULL);
+
+    if (path_len == 0 || path_len >= HTTP_FILE_PATH_MAX_SIZE || memchr(path, '\0', path_len) != NULL) {
+        return HTTP_FILE_CACHE_NOT_FOUND;
+    }
+
+    // the syscalls below need it null-terminated
+    char cpath[HTTP_FILE_PATH_MAX_SIZE];
+    memcpy(cpath, path, path_len);
+    cpath[path_len] = '\0';
+
+    const uint64_t hash = http_file_path_hash(path, path_len);
+    const uint64_t now_ms = clock_monotonic_ms();
+
+    struct http_file* file = http_file_cache_find(cache, path, path_len, hash);
+    if (file != NULL && now_ms - file->validated_ms >= HTTP_FILE_CACHE_REVALIDATE_MS) {
+        cache->stats.revalidations++;
+
+        struct stat st;
+        if (fstatat(cache->root_fd, cpath, &st, 0) == 0 && http_file_is_unchanged(file, &st)) {
+            file->validated_ms = now_ms;
+        } else {
+            // deleted or replaced: the next lookup opens whatever is there now
+            http_file_cache_detach(cache, file);
+            file = NULL;
+        }
+    }
+
+    if (file != NULL) {
+        cache->stats.hits++;
+        http_file_cache_lru_remove(cache, file);
+        http_file_cache_lru_push_front(cache, file);
+        file->refs++;
+        *out_file = file;
+        return HTTP_FILE_CACHE_OK;
+    }
+
+    cache->stats.misses++;
+
+    // O_NONBLOCK so opening a fifo can't block the worker (it is rejected right after anyway)
+    int fd = openat(cache->root_fd, cpath, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        int error_code = errno;
+        if (error_code == ENOENT || error_code == ENOTDIR || error_code == EACCES || error_code == ELOOP
+            || error_code == ENAMETOOLONG || error_code == EISDIR)
+        {
+            return HTTP_FILE_CACHE_NOT_FOUND;
+        }
+        LOG_WARNF("failed to open \"%s\": %s", cpath, strerror(error_code));
+        return HTTP_FILE_CACHE_ERR;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error_code = errno;
+        LOG_WARNF("failed to stat \"%s\": %s", cpath, strerror(error_code));
+        close(fd);
+        return HTTP_FILE_CACHE_ERR;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return HTTP_FILE_CACHE_NOT_FOUND;
+    }
+
+    file = http_file_cache_take_entry(cache);
+    if (file == NULL) {
+        LOG_WARNF("every file cache entry is in use (%zu)", cache->capacity);
+        close(fd);
+        return HTTP_FILE_CACHE_ERR;
+    }
+
+    memcpy(file->path, path, path_len);
+    file->path[path_len] = '\0';
+    file->path_len = path_len;
+    file->path_hash = hash;
+    file->fd = fd;
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+    file->content_type = http_file_content_type(path, path_len);
+    file->validated_ms = now_ms;
+    file->refs = 1;
+    file->cached = true;
+
+    // changes on every write (or replacement), without hashing the content
+    snprintf(file->etag, sizeof(file->etag), "\"%llx-%llx\"",
+             (unsigned long long) st.st_size,
+             (unsigned long long) st.st_mtim.tv_sec * 1000000000ULL + (unsigned long long) st.st_mtim.tv_nsec);
+
+    struct tm mtime_tm;
+    gmtime_r(&st.st_mtim.tv_sec, &mtime_tm);
+    strftime(file->last_modified, sizeof(file->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &mtime_tm);
+
+    struct http_file** bucket = &cache->buckets[hash & (cache->bucket_count - 1)];
+    file->hash_next = *bucket;
+    *bucket = file;
+    http_file_cache_lru_push_front(cache, file);
+
+    *out_file = file;
+    return HTTP_FILE_CACHE_OK;
+}
+
+void http_file_cache_release(struct http_file_cache* cache, struct http_file* file)
+{
+    assert(cache != NULL);
+    assert(file != NULL);
+    assert(file->refs > 0);
+
+    file->refs--;
+    if (file->refs == 0 && !file->cached) {
+        http_file_cache_recycle(cache, file);
+    }
+}
+
+/**
+ * @brief FNV-1a
+ */
+static uint64_t http_file_path_hash(const char* path, size_t path_len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < path_len; i++) {
+        hash ^= (uint8_t) path[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static const char* http_file_content_type(const char* path, size_t path_len)
+{
+    static const struct {
+        const char* extension;
+        const char* content_type;
+    } content_types[] = {
+        { "html",  "text/html; charset=utf-8" },
+        { "htm",   "text/html; charset=utf-8" },
+        { "css",   "text/css; charset=utf-8" },
+        { "js",    "text/javascript; charset=utf-8" },
+        { "mjs",   "text/javascript; charset=utf-8" },
+        { "json",  "application/json" },
+        { "txt",   "text/plain; charset=utf-8" },
+        { "md",    "text/markdown; charset=utf-8" },
+        { "xml",   "application/xml" },
+        { "svg",   "image/svg+xml" },
+        { "png",   "image/png" },
+        { "jpg",   "image/jpeg" },
+        { "jpeg",  "image/jpeg" },
+        { "gif",   "image/gif" },
+        { "webp",  "image/webp" },
+        { "ico",   "image/x-icon" },
+        { "wasm",  "application/wasm" },
+        { "woff2", "font/woff2" },
+        { "pdf",   "application/pdf" },
+    };
+
+    const char* dot = NULL;
+    for (size_t i = path_len; i > 0; i--) {
+        if (path[i - 1] == '/') {
+            break;
+        }
+        if (path[i - 1] == '.') {
+            dot = &path[i - 1];
+            break;
+        }
+    }
+
+    if (dot != NULL) {
+        const char* extension = dot + 1;
+        const size_t extension_len = (size_t) (path + path_len - extension);
+        for (size_t i = 0; i < ARRAY_SIZE(content_types); i++) {
+            if (strlen(content_types[i].extension) == extension_len
+                && strncasecmp(content_types[i].extension, extension, extension_len) == 0)
+            {
+                return content_types[i].content_type;
+            }
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+static struct http_file* http_file_cache_find(struct http_file_cache* cache, const char* path, size_t path_len, uint64_t hash)
+{
+    struct http_file* file = cache->buckets[hash & (cache->bucket_count - 1)];
+    while (file != NULL) {
+        if (file->path_hash == hash && file->path_len == path_len && memcmp(file->path, path, path_len) == 0) {
+            return file;
+        }
+        file = file->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief an unused entry, evicting the least recently used file nobody is sending when there is none left.
+ */
+static struct http_file* http_file_cache_take_entry(struct http_file_cache* cache)
+{
+    if (cache->free_list == NULL) {
+        struct http_file* victim = cache->lru_tail;
+        while (victim != NULL && victim->refs > 0) {
+            victim = victim->lru_prev;
+        }
+        if (victim == NULL) {
+            return NULL;
+        }
+
+        cache->stats.evictions++;
+        http_file_cache_detach(cache, victim);
+    }
+
+    struct http_file* file = cache->free_list;
+    if (file != NULL) {
+        cache->free_list = file->hash_next;
+        file->hash_next = NULL;
+    }
+    return file;
+}
+
+/**
+ * @brief makes |file| unreachable by path. It is closed right away unless it is still referenced.
+ */
+static void http_file_cache_detach(struct http_file_cache* cache, struct http_file* file)
+{
+    assert(file->cached);
+
+    struct http_file** link = &cache->buckets[file->path_hash & (cache->bucket_count - 1)];
+    while (*link != file) {
+        link = &(*link)->hash_next;
+    }
+    *link = file->hash_next;
+    file->hash_next = NULL;
+
+    http_file_cache_lru_remove(cache, file);
+    file->cached = false;
+
+    if (file->refs == 0) {
+        http_file_cache_recycle(cache, file);
+    }
+}
+
+static void http_file_cache_recycle(struct http_file_cache* cache, struct http_file* file)
+{
+    close(file->fd);
+    file->fd = -1;
+    for (size_t i = 0; i < HTTP_CONTENT_CODING_COUNT; i++) {
+        free(file->encodings[i].data);
+        file->encodings[i] = (struct http_file_encoding) {0};
+    }
+    file->hash_next = cache->free_list;
+    cache->free_list = file;
+}
+
+static void http_file_cache_lru_remove(struct http_file_cache* cache, struct http_file* file)
+{
+    if (file->lru_prev != NULL) {
+        file->lru_prev->lru_next = file->lru_next;
+    } else {
+        cache->lru_head = file->lru_next;
+    }
+
+    if (file->lru_next != NULL) {
+        file->lru_next->lru_prev = file->lru_prev;
+    } else {
+        cache->lru_tail = file->lru_prev;
+    }
+
+    file->lru_prev = NULL;
+    file->lru_next = NULL;
+}
+
+static void http_file_cache_lru_push_front(struct http_file_cache* cache, struct http_file* file)
+{
+    file->lru_prev = NULL;
+    file->lru_next = cache->lru_head;
+
+    if (cache->lru_head != NULL) {
+        cache->lru_head->lru_prev = file;
+    } else {
+        cache->lru_tail = file;
+    }
+    cache->lru_head = file;
+}
+
+static bool http_file_is_unchanged(const struct http_file* file, const struct stat* st)
+{
+    return S_ISREG(st->st_mode)
+        && st->st_dev == file->dev
+        && st->st_ino == file->ino
+        && st->st_size == file->size
+        && st->st_mtim.tv_sec == file->mtime.tv_sec
+        && st->st_mtim.tv_nsec == file->mtime.tv_nsec;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include <http-server/error.h>
+#include "compression.h"
+
+/**
+ * @brief relative paths (from the document root) longer than this are never served
+ */
+#define HTTP_FILE_PATH_MAX_SIZE 256
+
+/**
+ * @brief cached metadata is trusted for this long before the file is stat'ed again. Within that window a
+ *        conditional request is answered without any syscall.
+ */
+#define HTTP_FILE_CACHE_REVALIDATE_MS 1000
+
+/**
+ * @brief the content of a file compressed with a content coding, computed once on the first request accepting it.
+ */
+struct http_file_encoding {
+    /**
+     * @brief malloc'ed, NULL when the file doesn't compress well (or failed to)
+     */
+    void* data;
+    size_t len;
+    bool tried;
+
+    /**
+     * @brief the file etag with the coding appended, since it is a different representation
+     */
+    char etag[64];
+};
+
+/**
+ * @brief an open file under the document root and everything needed to answer for it.
+ */
+struct http_file {
+    char path[HTTP_FILE_PATH_MAX_SIZE];
+    size_t path_len;
+    uint64_t path_hash;
+
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+
+    /**
+     * @brief the validators, formatted once when the file is opened
+     */
+    char etag[48];
+    char last_modified[32];
+    const char* content_type;
+
+    /**
+     * @brief precompressed copies of the content, indexed by coding (identity is unused). Freed with the entry.
+     */
+    struct http_file_encoding encodings[HTTP_CONTENT_CODING_COUNT];
+
+    /**
+     * @brief CLOCK_MONOTONIC ms of the last time the metadata was checked against the file system
+     */
+    uint64_t validated_ms;
+
+    /**
+     * @brief responses currently using the fd. A referenced file is never closed (nor evicted).
+     */
+    size_t refs;
+
+    /**
+     * @brief whether the file can be found by path (it is in the hash table and in the LRU list). Files replaced
+     *        on disk while referenced are detached and closed once released.
+     */
+    bool cached;
+
+    struct http_file* hash_next;
+    struct http_file* lru_prev;
+    struct http_file* lru_next;
+};
+
+struct http_file_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t revalidations;
+};
+
+/**
+ * @brief a fixed-capacity LRU cache of open files keyed by path, owned by a single worker (not thread-safe).
+ *
+ * Every entry is allocated up front, so looking up, opening or evicting files never allocates.
+ */
+struct http_file_cache {
+    int root_fd;
+
+    struct http_file* files;
+    size_t capacity;
+
+    struct http_file** buckets;
+    size_t bucket_count;
+
+    /**
+     * @brief most recently used first
+     */
+    struct http_file* lru_head;
+    struct http_file* lru_tail;
+
+    /**
+     * @brief unused entries (linked by hash_next)
+     */
+    struct http_file* free_list;
+
+    struct http_file_cache_stats stats;
+};
+
+enum http_file_cache_status {
+    HTTP_FILE_CACHE_OK = 0,
+
+    /**
+     * Missing, not readable or not a regular file.
+     */
+    HTTP_FILE_CACHE_NOT_FOUND,
+
+    /**
+     * Every entry is in use (or any other unexpected failure).
+     */
+    HTTP_FILE_CACHE_ERR,
+};
+
+/**
+ * @brief opens |document_root| and allocates |capacity| entries.
+ */
+enum result http_file_cache_init(struct http_file_cache* cache, const char* document_root, size_t capacity);
+void http_file_cache_free(struct http_file_cache* cache);
+
+/**
+ * @brief finds (or opens) the regular file at |path|, relative to the document root.
+ *
+ * |path| must already be normalized: no leading '/', no "." or ".." segment.
+ * On success, the returned file is referenced and must be given back with http_file_cache_release.
+ */
+enum http_file_cache_status http_file_cache_acquire(struct http_file_cache* cache,
+                                                    const char* path,
+                                                    size_t path_len,
+                                                    struct http_file** out_file);
+
+void http_file_cache_release(struct http_file_cache* cache, struct http_file* file);
@@ -1,6 +1,7 @@
 #include "method.h"
 
 #include <assert.h>
+#include <string.h>
 
 static const char *const http_method_to_cstr_map[HTTP_METHOD_COUNT] = {
     [HTTP_METHOD_GET] = "GET",
@@ -19,3 +20,34 @@ const char* http_method_cstr(enum http_method method)
     return http_method_to_cstr_map[method];
 }
 
+enum result http_method_from_slice(struct str_slice token, enum http_method* out)
+{
+    assert(token.ptr != NULL);
+    assert(out != NULL);
+
+    // a switch on the length first, so at most two memcmp calls are needed
+    switch (token.len) {
+        case 3:
+            if (memcmp(token.ptr, "GET", 3) == 0) { *out = HTTP_METHOD_GET; return RESULT_OK; }
+            if (memcmp(token.ptr, "PUT", 3) == 0) { *out = HTTP_METHOD_PUT; return RESULT_OK; }
+            break;
+        case 4:
+            if (memcmp(token.ptr, "POST", 4) == 0) { *out = HTTP_METHOD_POST; return RESULT_OK; }
+            if (memcmp(token.ptr, "HEAD", 4) == 0) { *out = HTTP_METHOD_HEAD; return RESULT_OK; }
+            break;
+        case 5:
+            if (memcmp(token.ptr, "TRACE", 5) == 0) { *out = HTTP_METHOD_TRACE; return RESULT_OK; }
+            break;
+        case 6:
+            if (memcmp(token.ptr, "DELETE", 6) == 0) { *out = HTTP_METHOD_DELETE; return RESULT_OK; }
+            break;
+        case 7:
+            if (memcmp(token.ptr, "CONNECT", 7) == 0) { *out = HTTP_METHOD_CONNECT; return RESULT_OK; }
+            if (memcmp(token.ptr, "OPTIONS", 7) == 0) { *out = HTTP_METHOD_OPTIONS; return RESULT_OK; }
+            break;
+        default:
+            break;
+    }
+
+    return RESULT_ERR;
+}
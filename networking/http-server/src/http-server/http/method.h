@@ -1,5 +1,8 @@
 #pragma once
 
+#include <http-server/str.h>
+#include <http-server/error.h>
+
 enum http_method {
     HTTP_METHOD_GET = 0,
     HTTP_METHOD_PUT,
@@ -14,3 +17,7 @@ enum http_method {
 
 const char* http_method_cstr(enum http_method method);
 
+/**
+ * @brief maps a method token (case-sensitive, as per RFC 9110) to its enum value.
+ */
+enum result http_method_from_slice(struct str_slice token, enum http_method* out);
@@ -0,0 +1,322 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <http-server/commons.h>
+#include <http-server/dynamic-array.h>
+#include <http-server/log.h>
+#include "router.h"
+#include "server.h"
+#define LOG_NAME "http/metrics"
+
+/**
+ * @brief the Prometheus text exposition format, see https://prometheus.io/docs/instrumenting/exposition_formats/
+ */
+#define HTTP_METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+DYNAMIC_ARRAY_DEFINE(http_metrics_text, char)
+
+static const char* const http_metrics_stage_names[HTTP_METRICS_STAGE_COUNT] = {
+    [HTTP_METRICS_STAGE_ACCEPT] = "accept",
+    [HTTP_METRICS_STAGE_READ] = "read",
+    [HTTP_METRICS_STAGE_PARSE] = "parse",
+    [HTTP_METRICS_STAGE_HANDLE] = "handle",
+    [HTTP_METRICS_STAGE_WRITE] = "write",
+};
+
+static const double http_metrics_quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+
+static bool http_metrics_text_printf(struct http_metrics_text* text, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+static bool http_metrics_write_stages(struct http_metrics_text* text, const struct http_server* server);
+static bool http_metrics_write_gauge(struct http_metrics_text* text,
+                                     const struct http_server* server,
+                                     const char* name,
+                                     const char* type,
+                                     const char* help,
+                                     size_t field_offset);
+static bool http_metrics_write_response_cache(struct http_metrics_text* text, const struct http_response_cache* cache);
+static bool http_metrics_write_rate_limiter(struct http_metrics_text* text, const struct http_rate_limiter* limiter);
+
+void http_metrics_init(struct http_metrics* metrics)
+{
+    assert(metrics != NULL);
+
+    for (size_t i = 0; i < HTTP_METRICS_STAGE_COUNT; i++) {
+        histogram_init(&metrics->stages[i]);
+    }
+    atomic_init(&metrics->connections_open, 0);
+    atomic_init(&metrics->connection_pool_capacity, 0);
+    atomic_init(&metrics->buffer_pool_in_use, 0);
+    atomic_init(&metrics->buffer_pool_capacity, 0);
+    atomic_init(&metrics->arena_high_water, 0);
+    atomic_init(&metrics->requests_in_flight, 0);
+    atomic_init(&metrics->requests_shed, 0);
+    atomic_init(&metrics->requests_rate_limited, 0);
+    atomic_init(&metrics->connections_rejected, 0);
+    atomic_init(&metrics->io_syscalls, 0);
+    atomic_init(&metrics->file_cache_hits, 0);
+    atomic_init(&metrics->file_cache_misses, 0);
+    atomic_init(&metrics->file_cache_evictions, 0);
+}
+
+void http_metrics_handler(struct http_handler_context* ctx)
+{
+    assert(ctx != NULL);
+    assert(ctx->user_data != NULL);
+
+    const struct http_server* server = ctx->user_data;
+    struct http_response* resp = ctx->response;
+
+    // way bigger than the request arena, so it gets its own buffer, freed once sent
+    struct http_metrics_text text;
+    http_metrics_text_init(&text);
+
+    const bool written =
+        http_metrics_write_stages(&text, server)
+        && http_metrics_write_gauge(&text, server, "http_connections_open", "gauge",
+                                    "Client connections currently open.",
+                                    offsetof(struct http_metrics, connections_open))
+        && http_metrics_write_gauge(&text, server, "http_connection_pool_capacity", "gauge",
+                                    "Connection objects owned by the pool (in use or free).",
+                                    offsetof(struct http_metrics, connection_pool_capacity))
+        && http_metrics_write_gauge(&text, server, "http_buffer_pool_in_use", "gauge",
+                                    "Connection buffers currently in use.",
+                                    offsetof(struct http_metrics, buffer_pool_in_use))
+        && http_metrics_write_gauge(&text, server, "http_buffer_pool_capacity", "gauge",
+                                    "Connection buffers owned by the pool (in use or free).",
+                                    offsetof(struct http_metrics, buffer_pool_capacity))
+        && http_metrics_write_gauge(&text, server, "http_arena_high_water_bytes", "gauge",
+                                    "Peak bytes used by a single request arena.",
+                                    offsetof(struct http_metrics, arena_high_water))
+        && http_metrics_write_gauge(&text, server, "http_requests_in_flight", "gauge",
+                                    "Connections with a request admitted and not answered yet.",
+                                    offsetof(struct http_metrics, requests_in_flight))
+        && http_metrics_write_gauge(&text, server, "http_requests_shed_total", "counter",
+                                    "Requests refused with a 503 because too many were in flight.",
+                                    offsetof(struct http_metrics, requests_shed))
+        && http_metrics_write_gauge(&text, server, "http_requests_rate_limited_total", "counter",
+                                    "Requests refused with a 429 because their client was over its rate.",
+                                    offsetof(struct http_metrics, requests_rate_limited))
+        && http_metrics_write_gauge(&text, server, "http_connections_rejected_total", "counter",
+                                    "Connections refused with a 503 because too many were open.",
+                                    offsetof(struct http_metrics, connections_rejected))
+        && http_metrics_write_gauge(&text, server, "http_io_syscalls_total", "counter",
+                                    "I/O syscalls of the workers: waits, registrations, accepts, reads, writes, closes.",
+                                    offsetof(struct http_metrics, io_syscalls))
+        && http_metrics_write_gauge(&text, server, "http_file_cache_hits_total", "counter",
+                                    "Static file lookups served by the open file cache.",
+                                    offsetof(struct http_metrics, file_cache_hits))
+        && http_metrics_write_gauge(&text, server, "http_file_cache_misses_total", "counter",
+                                    "Static file lookups that had to open the file.",
+                                    offsetof(struct http_metrics, file_cache_misses))
+        && http_metrics_write_gauge(&text, server, "http_file_cache_evictions_total", "counter",
+                                    "Open files closed to make room for others.",
+                                    offsetof(struct http_metrics, file_cache_evictions))
+        && (server->response_cache == NULL || http_metrics_write_response_cache(&text, server->response_cache))
+        && (server->rate_limiter == NULL || http_metrics_write_rate_limiter(&text, server->rate_limiter))
+        && http_metrics_text_printf(&text,
+                                    "# HELP log_dropped_records_total Log records dropped because a ring buffer was full.\n"
+                                    "# TYPE log_dropped_records_total counter\n"
+                                    "log_dropped_records_total %llu\n",
+                                    (unsigned long long) log_dropped_records());
+    if (!written) {
+        LOG_ERROR("failed to allocate the metrics");
+        http_metrics_text_free(&text);
+        http_response_reset(resp, 503, "Service Unavailable");
+        resp->body = str_slice_from_cstr_trusted("Service Unavailable\n");
+        return;
+    }
+
+    http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                   str_slice_from_cstr_trusted(HTTP_METRICS_CONTENT_TYPE));
+    http_response_add_header(resp, str_slice_from_cstr_trusted("Cache-Control"), str_slice_from_cstr_trusted("no-store"));
+    resp->body = str_slice_from_buffer(text.items, text.length);
+    ctx->body_buffer = text.items;
+}
+
+/**
+ * @brief appends to |text|, '\0' excluded.
+ *
+ * @return false on allocation failure.
+ */
+static bool http_metrics_text_printf(struct http_metrics_text* text, const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) {
+        return false;
+    }
+
+    // room for the '\0' vsnprintf always writes
+    if (http_metrics_text_grow(text, (size_t) len + 1) != 0) {
+        return false;
+    }
+
+    va_start(args, format);
+    vsnprintf(text->items + text->length, (size_t) len + 1, format, args);
+    va_end(args);
+    text->length += (size_t) len;
+
+    return true;
+}
+
+/**
+ * @brief the stage latencies of every worker merged into one summary per stage.
+ */
+static bool http_metrics_write_stages(struct http_metrics_text* text, const struct http_server* server)
+{
+    if (!http_metrics_text_printf(text,
+                                  "# HELP http_request_stage_duration_seconds Time spent in each stage of the requests.\n"
+                                  "# TYPE http_request_stage_duration_seconds summary\n"))
+    {
+        return false;
+    }
+
+    // merged one stage at a time, so it stays small enough for the stack
+    struct histogram merged;
+    for (size_t stage = 0; stage < HTTP_METRICS_STAGE_COUNT; stage++) {
+        histogram_init(&merged);
+        for (size_t i = 0; i < server->worker_count; i++) {
+            histogram_merge(&merged, &server->workers[i].resources.metrics.stages[stage]);
+        }
+
+        const char* stage_name = http_metrics_stage_names[stage];
+        for (size_t q = 0; q < ARRAY_SIZE(http_metrics_quantiles); q++) {
+            const uint64_t ns = histogram_value_at_quantile(&merged, http_metrics_quantiles[q]);
+            if (!http_metrics_text_printf(text,
+                                          "http_request_stage_duration_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                                          stage_name,
+                                          http_metrics_quantiles[q],
+                                          (double) ns / 1e9))
+            {
+                return false;
+            }
+        }
+
+        if (!http_metrics_text_printf(text,
+                                      "http_request_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n"
+                                      "http_request_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+                                      stage_name,
+                                      (double) atomic_load_explicit(&merged.sum, memory_order_relaxed) / 1e9,
+                                      stage_name,
+                                      (unsigned long long) atomic_load_explicit(&merged.count, memory_order_relaxed)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief the counters of the response cache, shared by every worker (so a single sample each).
+ */
+static bool http_metrics_write_response_cache(struct http_metrics_text* text, const struct http_response_cache* cache)
+{
+    const struct {
+        const char* name;
+        const char* type;
+        const char* help;
+        const _Atomic uint64_t* value;
+    } counters[] = {
+        { "http_response_cache_hits_total", "counter", "Requests answered from the response cache.",
+          &cache->stats.hits },
+        { "http_response_cache_misses_total", "counter", "Requests of cached routes that had to call the handler.",
+          &cache->stats.misses },
+        { "http_response_cache_insertions_total", "counter", "Responses stored in the response cache.",
+          &cache->stats.insertions },
+        { "http_response_cache_evictions_total", "counter", "Cached responses dropped to make room for others.",
+          &cache->stats.evictions },
+        { "http_response_cache_expirations_total", "counter", "Cached responses dropped once expired.",
+          &cache->stats.expirations },
+        { "http_response_cache_entries", "gauge", "Responses currently cached.", &cache->stats.entries },
+        { "http_response_cache_bytes", "gauge", "Bytes currently used by the cached responses.", &cache->stats.bytes },
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+        if (!http_metrics_text_printf(text,
+                                      "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+                                      counters[i].name,
+                                      counters[i].help,
+                                      counters[i].name,
+                                      counters[i].type,
+                                      counters[i].name,
+                                      (unsigned long long) atomic_load_explicit(counters[i].value, memory_order_relaxed)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief the counters of the rate limiter, shared by every worker (so a single sample each).
+ */
+static bool http_metrics_write_rate_limiter(struct http_metrics_text* text, const struct http_rate_limiter* limiter)
+{
+    const struct {
+        const char* name;
+        const char* help;
+        const _Atomic uint64_t* value;
+    } counters[] = {
+        { "http_rate_limiter_allowed_total", "Requests within the rate of their client.", &limiter->stats.allowed },
+        { "http_rate_limiter_limited_total", "Requests over the rate of their client.", &limiter->stats.limited },
+        { "http_rate_limiter_forgotten_total", "Client rates dropped to make room for others.",
+          &limiter->stats.forgotten },
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+        if (!http_metrics_text_printf(text,
+                                      "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                                      counters[i].name,
+                                      counters[i].help,
+                                      counters[i].name,
+                                      counters[i].name,
+                                      (unsigned long long) atomic_load_explicit(counters[i].value, memory_order_relaxed)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief one sample per worker of the struct http_metrics counter at |field_offset|.
+ */
+static bool http_metrics_write_gauge(struct http_metrics_text* text,
+                                     const struct http_server* server,
+                                     const char* name,
+                                     const char* type,
+                                     const char* help,
+                                     size_t field_offset)
+{
+    if (!http_metrics_text_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < server->worker_count; i++) {
+        const struct http_metrics* metrics = &server->workers[i].resources.metrics;
+        const _Atomic uint64_t* value = (const _Atomic uint64_t*) ((const char*) metrics + field_offset);
+        if (!http_metrics_text_printf(text,
+                                      "%s{worker=\"%zu\"} %llu\n",
+                                      name,
+                                      i,
+                                      (unsigned long long) atomic_load_explicit(value, memory_order_relaxed)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <http-server/histogram.h>
+
+struct http_handler_context;
+
+/**
+ * @brief the stages of the life of a request, timed separately.
+ */
+enum http_metrics_stage {
+    /**
+     * accept4 and the connection setup (pool, epoll registration)
+     */
+    HTTP_METRICS_STAGE_ACCEPT = 0,
+
+    /**
+     * from the first bytes of a request (or the end of the previous pipelined one) to its head being complete, so
+     * mostly waiting for the client. It includes the parse stage.
+     */
+    HTTP_METRICS_STAGE_READ,
+
+    /**
+     * the parser runs over the request head, summed over every incremental call
+     */
+    HTTP_METRICS_STAGE_PARSE,
+
+    /**
+     * routing, the handler and the response head serialization
+     */
+    HTTP_METRICS_STAGE_HANDLE,
+
+    /**
+     * from the first response of a batch being queued to the whole batch (files included) being sent. Every
+     * response of the batch gets the same sample.
+     */
+    HTTP_METRICS_STAGE_WRITE,
+
+    HTTP_METRICS_STAGE_COUNT,
+};
+
+/**
+ * @brief the metrics of a worker. Only the worker thread writes them, any thread can read them at any time.
+ */
+struct http_metrics {
+    /**
+     * @brief latencies in ns
+     */
+    struct histogram stages[HTTP_METRICS_STAGE_COUNT];
+
+    /**
+     * @brief snapshots of the (single-threaded) worker counters, published by the worker after every event loop
+     *        iteration
+     */
+    _Atomic uint64_t connections_open;
+    _Atomic uint64_t connection_pool_capacity;
+    _Atomic uint64_t buffer_pool_in_use;
+    _Atomic uint64_t buffer_pool_capacity;
+    _Atomic uint64_t arena_high_water;
+    _Atomic uint64_t requests_in_flight;
+    _Atomic uint64_t requests_shed;
+    _Atomic uint64_t requests_rate_limited;
+    _Atomic uint64_t connections_rejected;
+    _Atomic uint64_t io_syscalls;
+    _Atomic uint64_t file_cache_hits;
+    _Atomic uint64_t file_cache_misses;
+    _Atomic uint64_t file_cache_evictions;
+};
+
+void http_metrics_init(struct http_metrics* metrics);
+
+static inline void http_metrics_record(struct http_metrics* metrics, enum http_metrics_stage stage, uint64_t ns)
+{
+    histogram_record(&metrics->stages[stage], ns);
+}
+
+static inline void http_metrics_record_n(struct http_metrics* metrics,
+                                         enum http_metrics_stage stage,
+                                         uint64_t ns,
+                                         uint64_t n)
+{
+    histogram_record_n(&metrics->stages[stage], ns, n);
+}
+
+static inline void http_metrics_publish(_Atomic uint64_t* gauge, uint64_t value)
+{
+    atomic_store_explicit(gauge, value, memory_order_relaxed);
+}
+
+/**
+ * @brief a GET route handler answering with the metrics of every worker, merged, in the Prometheus text format.
+ *
+ * The route user data must be the const struct http_server* serving it.
+ */
+void http_metrics_handler(struct http_handler_context* ctx);
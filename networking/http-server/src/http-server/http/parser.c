@@ -1,67 +1,400 @@
 #include "parser.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #include <http-server/commons.h>
-#include <http-server/scanner.h>
 
-void http_parser_init(struct http_parser* parser, struct str_slice input)
+#include "scan.h"
+
+#define CHAR_CLASS_TCHAR  1 // token chars (method and header names)
+#define CHAR_CLASS_TARGET 2 // request-target chars (any visible char)
+#define CHAR_CLASS_VALUE  4 // header field value chars (visible chars, SP and HTAB)
+
+/**
+ * @brief character classes of every possible byte. See RFC 9110 (5.6.2 Tokens and 5.5 Field Values).
+ *
+ * obs-text (0x80-0xFF) is accepted in targets and values, but no control char is accepted anywhere except HTAB
+ * in values. \r and \n are only accepted as line terminators.
+ *
+ * Long runs of target and value chars are matched by http_scan() instead (see scan.h), they must stay in sync.
+ */
+static const uint8_t char_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 7, 6, 7, 7, 7, 7, 7, 6, 6, 7, 7, 6, 7, 7, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 6, 6, 6,
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 7, 6, 7, 0,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+};
+
+#define IS_CHAR_CLASS(C, CLASS) ((char_classes[(uint8_t) (C)] & (CLASS)) != 0)
+
+/**
+ * @brief below this many buffered bytes (e.g. slow clients) the char class table is cheaper than a run scan call.
+ */
+#define SCAN_RUN_MIN_LEN 16
+
+static enum http_parser_status http_parser_fail(struct http_parser* parser, enum http_parser_error error);
+static enum http_parser_status http_parser_on_request_line(struct http_parser* parser, const char* request);
+static enum http_parser_status http_parser_on_header(struct http_parser* parser, const char* request);
+static void http_parser_connection_inspect(struct http_parser* parser, struct str_slice value);
+static enum result http_content_length_parse(struct str_slice value, size_t* out);
+static struct str_slice http_parser_span_slice(const char* request, struct http_parser_span span);
+
+void http_parser_init(struct http_parser* parser)
 {
     assert(parser != NULL);
-    assert(input.ptr != NULL);
-    parser->input = input;
-    parser->cursor = input;
-    regex_must_compile(&parser->method_pattern, "^GET|PUT|POST|HEAD|TRACE|DELETE|CONNECT|OPTIONS", REG_EXTENDED);
+
+    // NOTE the headers array is not cleared on purpose. header_count tracks what is actually in use.
+    parser->state = HTTP_PARSER_STATE_METHOD;
+    parser->error = HTTP_PARSER_ERROR_NONE;
+    parser->offset = 0;
+    parser->token_offset = 0;
+    parser->token_end = 0;
+    parser->method_span = (struct http_parser_span) {0};
+    parser->target = (struct http_parser_span) {0};
+    parser->version = (struct http_parser_span) {0};
+    parser->method = HTTP_METHOD_GET;
+    parser->header_count = 0;
+    parser->keep_alive = false;
+    parser->chunked = false;
+    parser->has_content_length = false;
+    parser->content_length = 0;
 }
 
-void http_parser_free(struct http_parser* parser)
+enum http_parser_status http_parser_execute(struct http_parser* parser, const char* request, size_t request_len)
 {
     assert(parser != NULL);
-    regfree(&parser->method_pattern);
+    assert(request != NULL);
+    assert(request_len >= parser->offset);
+
+    if (parser->state == HTTP_PARSER_STATE_DONE) {
+        return HTTP_PARSER_STATUS_DONE;
+    }
+    if (parser->error != HTTP_PARSER_ERROR_NONE) {
+        return HTTP_PARSER_STATUS_ERROR;
+    }
+
+    const struct http_scan_impl* scan = http_scan();
+
+    size_t i = parser->offset;
+    enum http_parser_state state = parser->state;
+
+    for (; i < request_len; i++) {
+        const char c = request[i];
+
+        switch (state) {
+            case HTTP_PARSER_STATE_METHOD:
+                if (c == ' ' && i > parser->token_offset) {
+                    parser->method_span = (struct http_parser_span) { .offset = parser->token_offset, .len = i - parser->token_offset };
+                    parser->token_offset = i + 1;
+                    state = HTTP_PARSER_STATE_TARGET;
+                } else if (!IS_CHAR_CLASS(c, CHAR_CLASS_TCHAR)) {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+
+            case HTTP_PARSER_STATE_TARGET: {
+                // targets can be long (query strings), skip the whole run of target chars at once
+                const size_t run_len = request_len - i >= SCAN_RUN_MIN_LEN ? scan->target_run(request + i, request_len - i) : 0;
+                if (run_len > 0) {
+                    i += run_len - 1;
+                    break;
+                }
+
+                if (c == ' ' && i > parser->token_offset) {
+                    parser->target = (struct http_parser_span) { .offset = parser->token_offset, .len = i - parser->token_offset };
+                    parser->token_offset = i + 1;
+                    state = HTTP_PARSER_STATE_VERSION;
+                } else if (!IS_CHAR_CLASS(c, CHAR_CLASS_TARGET)) {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+            }
+
+            case HTTP_PARSER_STATE_VERSION:
+                if (c == '\r') {
+                    parser->version = (struct http_parser_span) { .offset = parser->token_offset, .len = i - parser->token_offset };
+                    state = HTTP_PARSER_STATE_REQUEST_LINE_LF;
+                } else if (!IS_CHAR_CLASS(c, CHAR_CLASS_TCHAR) && c != '/') {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+
+            case HTTP_PARSER_STATE_REQUEST_LINE_LF:
+                if (c != '\n') {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                if (http_parser_on_request_line(parser, request) != HTTP_PARSER_STATUS_INCOMPLETE) {
+                    parser->offset = i;
+                    return HTTP_PARSER_STATUS_ERROR;
+                }
+                state = HTTP_PARSER_STATE_HEADER_LINE_START;
+                break;
+
+            case HTTP_PARSER_STATE_HEADER_LINE_START:
+                if (c == '\r') {
+                    state = HTTP_PARSER_STATE_HEADERS_END_LF;
+                } else if (IS_CHAR_CLASS(c, CHAR_CLASS_TCHAR)) {
+                    if (parser->header_count == HTTP_REQUEST_HEADERS_BUFFER_SIZE) {
+                        parser->offset = i;
+                        return http_parser_fail(parser, HTTP_PARSER_ERROR_TOO_MANY_HEADERS);
+                    }
+                    parser->token_offset = i;
+                    state = HTTP_PARSER_STATE_HEADER_NAME;
+                } else {
+                    // this also rejects obsolete line folding (a header line starting with whitespace)
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+
+            case HTTP_PARSER_STATE_HEADER_NAME:
+                if (c == ':') {
+                    parser->headers[parser->header_count].name = (struct http_parser_span) {
+                        .offset = parser->token_offset,
+                        .len = i - parser->token_offset,
+                    };
+                    state = HTTP_PARSER_STATE_HEADER_VALUE_OWS;
+                } else if (!IS_CHAR_CLASS(c, CHAR_CLASS_TCHAR)) {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+
+            case HTTP_PARSER_STATE_HEADER_VALUE_OWS:
+                if (c == ' ' || c == '\t') {
+                    break;
+                }
+                parser->token_offset = i;
+                parser->token_end = i;
+                state = HTTP_PARSER_STATE_HEADER_VALUE;
+                // fallthrough
+            case HTTP_PARSER_STATE_HEADER_VALUE: {
+                const size_t run_len = request_len - i >= SCAN_RUN_MIN_LEN ? scan->field_value_run(request + i, request_len - i) : 0;
+                if (run_len > 0) {
+                    // trailing whitespace is not part of the value
+                    size_t value_end = i + run_len;
+                    while (value_end > i && (request[value_end - 1] == ' ' || request[value_end - 1] == '\t')) {
+                        value_end--;
+                    }
+                    if (value_end > i) {
+                        parser->token_end = value_end;
+                    }
+
+                    i += run_len - 1;
+                    break;
+                }
+
+                if (c == '\r') {
+                    parser->headers[parser->header_count].value = (struct http_parser_span) {
+                        .offset = parser->token_offset,
+                        .len = parser->token_end - parser->token_offset,
+                    };
+                    state = HTTP_PARSER_STATE_HEADER_LINE_LF;
+                } else if (!IS_CHAR_CLASS(c, CHAR_CLASS_VALUE)) {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                } else if (c != ' ' && c != '\t') {
+                    // trailing whitespace is not part of the value
+                    parser->token_end = i + 1;
+                }
+                break;
+            }
+
+            case HTTP_PARSER_STATE_HEADER_LINE_LF:
+                if (c != '\n') {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                if (http_parser_on_header(parser, request) != HTTP_PARSER_STATUS_INCOMPLETE) {
+                    parser->offset = i;
+                    return HTTP_PARSER_STATUS_ERROR;
+                }
+                state = HTTP_PARSER_STATE_HEADER_LINE_START;
+                break;
+
+            case HTTP_PARSER_STATE_HEADERS_END_LF:
+                if (c != '\n') {
+                    parser->offset = i;
+                    return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+                }
+                parser->offset = i + 1;
+                parser->state = HTTP_PARSER_STATE_DONE;
+                return HTTP_PARSER_STATUS_DONE;
+
+            case HTTP_PARSER_STATE_DONE:
+                assert(false && "unreachable");
+                break;
+        }
+    }
+
+    parser->offset = i;
+    parser->state = state;
+    return HTTP_PARSER_STATUS_INCOMPLETE;
 }
 
-enum result http_parser_method_parse(struct http_parser* parser, enum http_method* out)
+void http_parser_request_head(const struct http_parser* parser, const char* request, struct http_request_head* out)
 {
     assert(parser != NULL);
-    assert(parser->cursor.ptr != NULL);
+    assert(parser->state == HTTP_PARSER_STATE_DONE);
+    assert(request != NULL);
     assert(out != NULL);
-    return RESULT_ERR;
+
+    out->start_line = (struct http_request_start_line) {
+        .method = http_parser_span_slice(request, parser->method_span),
+        .path = http_parser_span_slice(request, parser->target),
+        .version = http_parser_span_slice(request, parser->version),
+    };
+    out->method = parser->method;
+
+    for (size_t i = 0; i < parser->header_count; i++) {
+        out->headers[i] = (struct http_header) {
+            .key = http_parser_span_slice(request, parser->headers[i].name),
+            .value = http_parser_span_slice(request, parser->headers[i].value),
+        };
+    }
+    out->header_count = parser->header_count;
+
+    out->keep_alive = parser->keep_alive;
+    out->content_length = parser->content_length;
+    out->chunked = parser->chunked;
 }
 
-/*
-enum result http_parser_method_parse(struct http_parser* parser, struct str_slice* out)
+static enum http_parser_status http_parser_fail(struct http_parser* parser, enum http_parser_error error)
 {
-    assert(parser != NULL);
-    assert(parser->cursor.ptr != NULL);
+    parser->error = error;
+    return HTTP_PARSER_STATUS_ERROR;
+}
+
+static enum http_parser_status http_parser_on_request_line(struct http_parser* parser, const char* request)
+{
+    const struct str_slice method = http_parser_span_slice(request, parser->method_span);
+    if (http_method_from_slice(method, &parser->method) != RESULT_OK) {
+        return http_parser_fail(parser, HTTP_PARSER_ERROR_METHOD_NOT_IMPLEMENTED);
+    }
+
+    // HTTP/1.1 connections are persistent by default. HTTP/1.0 ones have to ask for it.
+    const struct str_slice version = http_parser_span_slice(request, parser->version);
+    if (version.len != sizeof("HTTP/1.1") - 1 || memcmp(version.ptr, "HTTP/1.", sizeof("HTTP/1.") - 1) != 0) {
+        return http_parser_fail(parser, HTTP_PARSER_ERROR_VERSION_NOT_SUPPORTED);
+    }
+    switch (version.ptr[version.len - 1]) {
+        case '1':
+            parser->keep_alive = true;
+            break;
+        case '0':
+            parser->keep_alive = false;
+            break;
+        default:
+            return http_parser_fail(parser, HTTP_PARSER_ERROR_VERSION_NOT_SUPPORTED);
+    }
 
-    if (parser->cursor.len < 3 || parser->cursor.len > 8) {
+    return HTTP_PARSER_STATUS_INCOMPLETE;
+}
+
+/**
+ * @brief called once a header line is complete. Only the headers needed to frame the request are interpreted here.
+ */
+static enum http_parser_status http_parser_on_header(struct http_parser* parser, const char* request)
+{
+    const struct http_parser_header* header = &parser->headers[parser->header_count];
+    parser->header_count++;
+
+    const struct str_slice name = http_parser_span_slice(request, header->name);
+    const struct str_slice value = http_parser_span_slice(request, header->value);
+
+    if (str_slice_eq_ignore_case(name, str_slice_from_cstr_trusted("Connection"))) {
+        http_parser_connection_inspect(parser, value);
+    } else if (str_slice_eq_ignore_case(name, str_slice_from_cstr_trusted("Content-Length"))) {
+        size_t content_length = 0;
+        if (http_content_length_parse(value, &content_length) != RESULT_OK) {
+            return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+        }
+        // conflicting lengths are a classic request smuggling vector
+        if (parser->has_content_length && parser->content_length != content_length) {
+            return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+        }
+        parser->has_content_length = true;
+        parser->content_length = content_length;
+    } else if (str_slice_eq_ignore_case(name, str_slice_from_cstr_trusted("Transfer-Encoding"))) {
+        // chunked is the only coding we can decode, and it frames the body on its own
+        if (!str_slice_eq_ignore_case(str_slice_trim(value), str_slice_from_cstr_trusted("chunked"))) {
+            return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+        }
+        parser->chunked = true;
+    }
+
+    // a body framed both ways is the other classic request smuggling vector
+    if (parser->chunked && parser->has_content_length) {
+        return http_parser_fail(parser, HTTP_PARSER_ERROR_BAD_REQUEST);
+    }
+
+    return HTTP_PARSER_STATUS_INCOMPLETE;
+}
+
+/**
+ * @brief Connection is a comma separated list of options. We only care about "close" and "keep-alive".
+ */
+static void http_parser_connection_inspect(struct http_parser* parser, struct str_slice value)
+{
+    while (value.len > 0) {
+        const char* comma = memchr(value.ptr, ',', value.len);
+        const size_t option_len = (comma != NULL) ? (size_t) (comma - value.ptr) : value.len;
+
+        struct str_slice option = str_slice_trim(str_slice_from_buffer(value.ptr, option_len));
+        if (str_slice_eq_ignore_case(option, str_slice_from_cstr_trusted("close"))) {
+            parser->keep_alive = false;
+        } else if (str_slice_eq_ignore_case(option, str_slice_from_cstr_trusted("keep-alive"))) {
+            parser->keep_alive = true;
+        }
+
+        const size_t skip = MIN(value.len, option_len + 1);
+        value.ptr += skip;
+        value.len -= skip;
+    }
+}
+
+static enum result http_content_length_parse(struct str_slice value, size_t* out)
+{
+    if (str_slice_is_empty(value)) {
         return RESULT_ERR;
     }
 
-#define RETURN_IF_MATCHES(M) \
-    do { \
-        const char* ptr = memmem(parser->cursor.ptr, parser->cursor.len, M, sizeof(M) - 1); \
-        if (ptr != NULL) { \
-            *out = (struct str_slice) { \
-                .ptr = parser->cursor.ptr, \
-                .len = ptr - parser->cursor.ptr, \
-            }; \
-            return RESULT_OK; \
-        } \
-    } while (false)
-
-    RETURN_IF_MATCHES("GET");
-    RETURN_IF_MATCHES("PUT");
-    RETURN_IF_MATCHES("POST");
-    RETURN_IF_MATCHES("HEAD");
-    RETURN_IF_MATCHES("TRACE");
-    RETURN_IF_MATCHES("DELETE");
-    RETURN_IF_MATCHES("CONNECT");
-    RETURN_IF_MATCHES("OPTIONS");
-
-#undef RETURN_IF_METHOD_MATCHES
-
-    return RESULT_ERR;
+    size_t content_length = 0;
+    for (size_t i = 0; i < value.len; i++) {
+        if (value.ptr[i] < '0' || value.ptr[i] > '9') {
+            return RESULT_ERR;
+        }
+        size_t digit = (size_t) (value.ptr[i] - '0');
+        if (content_length > (SIZE_MAX - digit) / 10) {
+            return RESULT_ERR;
+        }
+        content_length = content_length * 10 + digit;
+    }
+
+    *out = content_length;
+    return RESULT_OK;
+}
+
+static struct str_slice http_parser_span_slice(const char* request, struct http_parser_span span)
+{
+    return str_slice_from_buffer(request + span.offset, span.len);
 }
-*/
@@ -1,20 +1,117 @@
 #pragma once
 
-#include <regex.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #include <http-server/str.h>
 #include <http-server/error.h>
+#include <http-server/http.h>
 #include "method.h"
 
+enum http_parser_status {
+    /**
+     * Every byte given so far was consumed. Call http_parser_execute again once more data arrives.
+     */
+    HTTP_PARSER_STATUS_INCOMPLETE = 0,
+
+    /**
+     * The request head is complete. http_parser_request_head can be called now.
+     */
+    HTTP_PARSER_STATUS_DONE,
+
+    /**
+     * The request head is malformed. See http_parser.error.
+     */
+    HTTP_PARSER_STATUS_ERROR,
+};
+
+enum http_parser_error {
+    HTTP_PARSER_ERROR_NONE = 0,
+    HTTP_PARSER_ERROR_BAD_REQUEST,
+    HTTP_PARSER_ERROR_TOO_MANY_HEADERS,
+    HTTP_PARSER_ERROR_METHOD_NOT_IMPLEMENTED,
+    HTTP_PARSER_ERROR_VERSION_NOT_SUPPORTED,
+};
+
+enum http_parser_state {
+    HTTP_PARSER_STATE_METHOD = 0,
+    HTTP_PARSER_STATE_TARGET,
+    HTTP_PARSER_STATE_VERSION,
+    HTTP_PARSER_STATE_REQUEST_LINE_LF,
+    HTTP_PARSER_STATE_HEADER_LINE_START,
+    HTTP_PARSER_STATE_HEADER_NAME,
+    HTTP_PARSER_STATE_HEADER_VALUE_OWS,
+    HTTP_PARSER_STATE_HEADER_VALUE,
+    HTTP_PARSER_STATE_HEADER_LINE_LF,
+    HTTP_PARSER_STATE_HEADERS_END_LF,
+    HTTP_PARSER_STATE_DONE,
+};
+
+/**
+ * @brief a region of the request, relative to its first byte.
+ *
+ * Offsets (instead of pointers) keep the parser state valid when the connection moves the unconsumed bytes
+ * around its receive buffer between two calls.
+ */
+struct http_parser_span {
+    size_t offset;
+    size_t len;
+};
+
+struct http_parser_header {
+    struct http_parser_span name;
+    struct http_parser_span value;
+};
+
+/**
+ * @brief a resumable, byte-at-a-time http/1.x request head parser.
+ *
+ * Each call to http_parser_execute resumes exactly where the previous one stopped, so a byte is never looked at
+ * twice no matter how the request is split across reads. Nothing is copied: the parsed head is a set of spans
+ * into the caller buffer.
+ */
 struct http_parser {
-    struct str_slice input;
-    struct str_slice cursor;
+    enum http_parser_state state;
+    enum http_parser_error error;
+
+    /**
+     * @brief number of bytes consumed so far. Once done, the size of the request head (including the empty line).
+     */
+    size_t offset;
 
-    regex_t method_pattern;
+    /**
+     * @brief where the token being parsed starts and, for header values, where it ends without trailing whitespace.
+     */
+    size_t token_offset;
+    size_t token_end;
+
+    struct http_parser_span method_span;
+    struct http_parser_span target;
+    struct http_parser_span version;
+    enum http_method method;
+
+    struct http_parser_header headers[HTTP_REQUEST_HEADERS_BUFFER_SIZE];
+    size_t header_count;
+
+    bool keep_alive;
+    bool chunked;
+    bool has_content_length;
+    size_t content_length;
 };
 
-void http_parser_init(struct http_parser* parser, struct str_slice input);
-void http_parser_free(struct http_parser* parser);
+void http_parser_init(struct http_parser* parser);
+
+/**
+ * @brief feeds the parser with the request bytes received so far.
+ *
+ * @param request the first byte of the request. It may move between calls, but the bytes already given must stay
+ *                the same.
+ * @param request_len the total number of bytes available from |request| (not just the new ones).
+ */
+enum http_parser_status http_parser_execute(struct http_parser* parser, const char* request, size_t request_len);
 
-enum result http_parser_method_parse(struct http_parser* parser, enum http_method* out);
+/**
+ * @brief builds the parsed request head as views into |request|. Only valid after HTTP_PARSER_STATUS_DONE.
+ */
+void http_parser_request_head(const struct http_parser* parser, const char* request, struct http_request_head* out);
 
@@ -0,0 +1,138 @@
+#include "rate-limiter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <http-server/commons.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/rate-limiter"
+
+static uint64_t http_rate_limiter_hash(uint32_t address);
+static void http_rate_limiter_refill(const struct http_rate_limiter* limiter,
+                                     struct http_rate_limiter_bucket* bucket,
+                                     uint64_t now_ms);
+
+enum result http_rate_limiter_init(struct http_rate_limiter* limiter, uint32_t rate, uint32_t burst, size_t max_clients)
+{
+    assert(limiter != NULL);
+    assert(rate > 0);
+    assert(burst > 0);
+
+    limiter->rate = rate;
+    limiter->burst = (uint64_t) burst * HTTP_RATE_LIMITER_TOKEN;
+
+    limiter->shard_capacity = HTTP_RATE_LIMITER_PROBES;
+    while (limiter->shard_capacity * HTTP_RATE_LIMITER_SHARDS < max_clients) {
+        limiter->shard_capacity *= 2;
+    }
+
+    for (size_t i = 0; i < HTTP_RATE_LIMITER_SHARDS; i++) {
+        struct http_rate_limiter_shard* shard = &limiter->shards[i];
+        shard->buckets = calloc(limiter->shard_capacity, sizeof(struct http_rate_limiter_bucket));
+        if (shard->buckets == NULL || pthread_mutex_init(&shard->lock, NULL) != 0) {
+            LOG_ERROR("failed to initialize a rate limiter shard");
+            free(shard->buckets);
+            for (size_t j = 0; j < i; j++) {
+                pthread_mutex_destroy(&limiter->shards[j].lock);
+                free(limiter->shards[j].buckets);
+            }
+            return RESULT_ERR;
+        }
+    }
+
+    atomic_init(&limiter->stats.allowed, 0);
+    atomic_init(&limiter->stats.limited, 0);
+    atomic_init(&limiter->stats.forgotten, 0);
+
+    return RESULT_OK;
+}
+
+void http_rate_limiter_free(struct http_rate_limiter* limiter)
+{
+    assert(limiter != NULL);
+
+    for (size_t i = 0; i < HTTP_RATE_LIMITER_SHARDS; i++) {
+        pthread_mutex_destroy(&limiter->shards[i].lock);
+        free(limiter->shards[i].buckets);
+        limiter->shards[i].buckets = NULL;
+    }
+}
+
+bool http_rate_limiter_take(struct http_rate_limiter* limiter, uint32_t address, uint64_t now_ms)
+{
+    assert(limiter != NULL);
+
+    // shards take the lowest bits of the hash and slots the next ones, so they are independent
+    const uint64_t hash = http_rate_limiter_hash(address);
+    struct http_rate_limiter_shard* shard = &limiter->shards[hash & (HTTP_RATE_LIMITER_SHARDS - 1)];
+    const size_t mask = limiter->shard_capacity - 1;
+    const size_t first = (size_t) (hash / HTTP_RATE_LIMITER_SHARDS) & mask;
+
+    pthread_mutex_lock(&shard->lock);
+
+    struct http_rate_limiter_bucket* bucket = NULL;
+    struct http_rate_limiter_bucket* victim = NULL;
+    for (size_t i = 0; i < HTTP_RATE_LIMITER_PROBES; i++) {
+        struct http_rate_limiter_bucket* slot = &shard->buckets[(first + i) & mask];
+        if (slot->used && slot->address == address) {
+            bucket = slot;
+            break;
+        }
+        if (victim == NULL || (victim->used && (!slot->used || slot->updated_ms < victim->updated_ms))) {
+            victim = slot;
+        }
+    }
+
+    if (bucket == NULL) {
+        if (victim->used) {
+            atomic_fetch_add_explicit(&limiter->stats.forgotten, 1, memory_order_relaxed);
+        }
+        bucket = victim;
+        bucket->address = address;
+        bucket->used = true;
+        bucket->tokens = limiter->burst;
+        bucket->updated_ms = now_ms;
+    } else {
+        http_rate_limiter_refill(limiter, bucket, now_ms);
+    }
+
+    const bool allowed = bucket->tokens >= HTTP_RATE_LIMITER_TOKEN;
+    if (allowed) {
+        bucket->tokens -= HTTP_RATE_LIMITER_TOKEN;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    atomic_fetch_add_explicit(allowed ? &limiter->stats.allowed : &limiter->stats.limited, 1, memory_order_relaxed);
+    return allowed;
+}
+
+/**
+ * @brief a 32 bits finalizer (murmur3 fmix32): consecutive addresses end up far apart.
+ */
+static uint64_t http_rate_limiter_hash(uint32_t address)
+{
+    uint32_t hash = address;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void http_rate_limiter_refill(const struct http_rate_limiter* limiter,
+                                     struct http_rate_limiter_bucket* bucket,
+                                     uint64_t now_ms)
+{
+    // workers read the clock at different times: it may look like it went backwards a little
+    if (now_ms <= bucket->updated_ms) {
+        return;
+    }
+
+    // bounded by the time an empty bucket takes to fill up, so that it never overflows
+    const uint64_t elapsed_ms = MIN(now_ms - bucket->updated_ms, limiter->burst / limiter->rate + 1);
+    bucket->tokens = MIN(bucket->tokens + elapsed_ms * limiter->rate, limiter->burst);
+    bucket->updated_ms = now_ms;
+}
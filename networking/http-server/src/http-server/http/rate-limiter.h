@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <http-server/error.h>
+
+/**
+ * @brief number of independently locked parts of the limiter (a power of two). Workers only contend when they take
+ *        tokens of clients of the same shard at the same time.
+ */
+#define HTTP_RATE_LIMITER_SHARDS 16
+
+/**
+ * @brief slots looked at for a client address, from the one it hashes to
+ */
+#define HTTP_RATE_LIMITER_PROBES 8
+
+/**
+ * @brief tokens are counted in thousandths, so that refilling at a few tokens per second still adds some every ms
+ */
+#define HTTP_RATE_LIMITER_TOKEN 1000
+
+/**
+ * @brief the token bucket of a client address
+ */
+struct http_rate_limiter_bucket {
+    /**
+     * @brief IPv4 address (network byte order)
+     */
+    uint32_t address;
+    bool used;
+
+    /**
+     * @brief in thousandths of a token (see HTTP_RATE_LIMITER_TOKEN), as of updated_ms
+     */
+    uint64_t tokens;
+    uint64_t updated_ms;
+};
+
+struct http_rate_limiter_shard {
+    pthread_mutex_t lock;
+    struct http_rate_limiter_bucket* buckets;
+};
+
+/**
+ * @brief a token bucket per client address, shared by every worker: a client gets |burst| requests right away, then
+ *        |rate| per second.
+ *
+ * Buckets live in fixed-size open addressing tables, so the memory used is bounded whatever the number of clients.
+ * When every slot a client may use is taken, the least recently seen client of them is forgotten: it starts over
+ * with a full bucket next time, which only ever lets more requests in.
+ */
+struct http_rate_limiter {
+    struct http_rate_limiter_shard shards[HTTP_RATE_LIMITER_SHARDS];
+
+    /**
+     * @brief slots per shard (a power of two)
+     */
+    size_t shard_capacity;
+
+    /**
+     * @brief tokens added per second, which is also the thousandths of a token added per ms
+     */
+    uint64_t rate;
+
+    /**
+     * @brief the bucket size, in thousandths of a token
+     */
+    uint64_t burst;
+
+    struct {
+        _Atomic uint64_t allowed;
+        _Atomic uint64_t limited;
+        _Atomic uint64_t forgotten;
+    } stats;
+};
+
+/**
+ * @brief |max_clients| is rounded up so that every shard gets a power of two of slots.
+ */
+enum result http_rate_limiter_init(struct http_rate_limiter* limiter, uint32_t rate, uint32_t burst, size_t max_clients);
+void http_rate_limiter_free(struct http_rate_limiter* limiter);
+
+/**
+ * @brief takes a token from the bucket of |address| (IPv4, network byte order), refilled up to |now_ms|.
+ *
+ * @return false when the bucket is empty: the request should be refused.
+ */
+bool http_rate_limiter_take(struct http_rate_limiter* limiter, uint32_t address, uint64_t now_ms);
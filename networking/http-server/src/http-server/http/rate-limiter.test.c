@@ -0,0 +1,102 @@
+/**
+ * Tests of the http/rate-limiter.h token buckets: the burst, the refill rate (fractions of a token included), clients
+ * being independent, a clock going backwards and clients forgotten once more of them share the same slots.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/rate-limiter.h>
+#include <http-server/test.h>
+
+#define CLIENT_A 0x0100007fu
+#define CLIENT_B 0x0200007fu
+
+/**
+ * @return how many requests of |address| are allowed in a row at |now_ms|
+ */
+static size_t take_all(struct http_rate_limiter* limiter, uint32_t address, uint64_t now_ms)
+{
+    size_t allowed = 0;
+    while (allowed < 1000 && http_rate_limiter_take(limiter, address, now_ms)) {
+        allowed++;
+    }
+    return allowed;
+}
+
+static void test_burst_and_refill(void)
+{
+    struct http_rate_limiter limiter;
+    CHECK(http_rate_limiter_init(&limiter, 10, 5, 1024) == RESULT_OK);
+
+    CHECK(take_all(&limiter, CLIENT_A, 1000) == 5);
+
+    // 10 per second: one every 100ms, and the thousandths add up
+    CHECK(take_all(&limiter, CLIENT_A, 1050) == 0);
+    CHECK(take_all(&limiter, CLIENT_A, 1100) == 1);
+    for (uint64_t now_ms = 1101; now_ms < 1200; now_ms++) {
+        CHECK(!http_rate_limiter_take(&limiter, CLIENT_A, now_ms));
+    }
+    CHECK(take_all(&limiter, CLIENT_A, 1200) == 1);
+    CHECK(take_all(&limiter, CLIENT_A, 1500) == 3);
+
+    // never more than the burst, however long it waited
+    CHECK(take_all(&limiter, CLIENT_A, UINT64_C(1) << 40) == 5);
+
+    // another client has its own bucket
+    CHECK(take_all(&limiter, CLIENT_B, 1000) == 5);
+
+    CHECK(atomic_load(&limiter.stats.allowed) == 5 + 1 + 1 + 3 + 5 + 5);
+    CHECK(atomic_load(&limiter.stats.limited) > 0);
+
+    http_rate_limiter_free(&limiter);
+}
+
+static void test_clock_going_backwards(void)
+{
+    struct http_rate_limiter limiter;
+    CHECK(http_rate_limiter_init(&limiter, 1, 1, 1024) == RESULT_OK);
+
+    CHECK(http_rate_limiter_take(&limiter, CLIENT_A, 5000));
+    CHECK(!http_rate_limiter_take(&limiter, CLIENT_A, 4000));
+    CHECK(!http_rate_limiter_take(&limiter, CLIENT_A, 5999));
+    CHECK(http_rate_limiter_take(&limiter, CLIENT_A, 6000));
+
+    http_rate_limiter_free(&limiter);
+}
+
+static void test_forgotten_clients(void)
+{
+    // as small as it gets: HTTP_RATE_LIMITER_PROBES slots per shard
+    struct http_rate_limiter limiter;
+    CHECK(http_rate_limiter_init(&limiter, 1, 1, 1) == RESULT_OK);
+    CHECK(limiter.shard_capacity == HTTP_RATE_LIMITER_PROBES);
+
+    const size_t client_count = HTTP_RATE_LIMITER_SHARDS * HTTP_RATE_LIMITER_PROBES * 4;
+    for (uint32_t i = 0; i < client_count; i++) {
+        CHECK(http_rate_limiter_take(&limiter, i, i));
+    }
+    CHECK(atomic_load(&limiter.stats.forgotten) >= client_count - HTTP_RATE_LIMITER_SHARDS * HTTP_RATE_LIMITER_PROBES);
+
+    // the most recent client of a shard is remembered, the oldest one starts over
+    CHECK(!http_rate_limiter_take(&limiter, (uint32_t) client_count - 1, client_count));
+    CHECK(http_rate_limiter_take(&limiter, 0, client_count));
+
+    http_rate_limiter_free(&limiter);
+}
+
+int main(void)
+{
+    test_burst_and_refill();
+    test_clock_going_backwards();
+    test_forgotten_clients();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all rate limiter checks passed\n");
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include "response-cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <http-server/commons.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/response-cache"
+
+/**
+ * @brief the request headers responses may vary on, so they are part of the key
+ */
+static const char* const http_response_cache_key_headers[] = {
+    "Accept",
+    "Accept-Encoding",
+};
+
+static bool http_response_cache_key_append(struct http_response_cache_key* key, struct str_slice s);
+static uint64_t http_response_cache_hash(const char* data, size_t len);
+static struct http_response_cache_shard* http_response_cache_shard_of(struct http_response_cache* cache, uint64_t hash);
+static struct http_cached_response** http_response_cache_bucket_of(struct http_response_cache_shard* shard, uint64_t hash);
+static void http_response_cache_unlink(struct http_response_cache* cache,
+                                       struct http_response_cache_shard* shard,
+                                       struct http_cached_response* entry);
+static void http_response_cache_lru_push_front(struct http_response_cache_shard* shard, struct http_cached_response* entry);
+static void http_response_cache_lru_remove(struct http_response_cache_shard* shard, struct http_cached_response* entry);
+
+enum result http_response_cache_init(struct http_response_cache* cache, size_t max_bytes)
+{
+    assert(cache != NULL);
+    assert(max_bytes > 0);
+
+    cache->shard_max_bytes = MAX(max_bytes / HTTP_RESPONSE_CACHE_SHARDS, (size_t) 1);
+
+    for (size_t i = 0; i < HTTP_RESPONSE_CACHE_SHARDS; i++) {
+        struct http_response_cache_shard* shard = &cache->shards[i];
+        if (pthread_mutex_init(&shard->lock, NULL) != 0) {
+            LOG_ERROR("failed to initialize a response cache lock");
+            for (size_t j = 0; j < i; j++) {
+                pthread_mutex_destroy(&cache->shards[j].lock);
+            }
+            return RESULT_ERR;
+        }
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->lru_head = NULL;
+        shard->lru_tail = NULL;
+        shard->bytes = 0;
+    }
+
+    atomic_init(&cache->stats.hits, 0);
+    atomic_init(&cache->stats.misses, 0);
+    atomic_init(&cache->stats.insertions, 0);
+    atomic_init(&cache->stats.evictions, 0);
+    atomic_init(&cache->stats.expirations, 0);
+    atomic_init(&cache->stats.bytes, 0);
+    atomic_init(&cache->stats.entries, 0);
+
+    return RESULT_OK;
+}
+
+void http_response_cache_free(struct http_response_cache* cache)
+{
+    assert(cache != NULL);
+
+    // every worker is gone, so nothing is being sent anymore
+    for (size_t i = 0; i < HTTP_RESPONSE_CACHE_SHARDS; i++) {
+        struct http_response_cache_shard* shard = &cache->shards[i];
+        while (shard->lru_head != NULL) {
+            http_response_cache_unlink(cache, shard, shard->lru_head);
+        }
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+bool http_response_cache_key_init(struct http_response_cache_key* key, const struct http_request_head* request_head)
+{
+    assert(key != NULL);
+    assert(request_head != NULL);
+
+    // the responses would depend on who is asking
+    struct str_slice value;
+    if (http_request_head_find_header(request_head, "Authorization", &value)) {
+        return false;
+    }
+
+    // a HEAD is answered with the head of the GET response
+    const enum http_method method = request_head->method == HTTP_METHOD_HEAD ? HTTP_METHOD_GET : request_head->method;
+
+    // nothing in a request head can be a '\n', so it separates the parts unambiguously
+    key->len = 0;
+    bool fits = http_response_cache_key_append(key, str_slice_from_cstr_trusted(http_method_cstr(method)))
+                && http_response_cache_key_append(key, str_slice_from_cstr_trusted("\n"))
+                && http_response_cache_key_append(key, request_head->start_line.path);
+
+    for (size_t i = 0; fits && i < ARRAY_SIZE(http_response_cache_key_headers); i++) {
+        if (!http_request_head_find_header(request_head, http_response_cache_key_headers[i], &value)) {
+            value = str_slice_empty();
+        }
+        fits = http_response_cache_key_append(key, str_slice_from_cstr_trusted("\n"))
+               && http_response_cache_key_append(key, value);
+    }
+
+    if (!fits) {
+        return false;
+    }
+
+    key->hash = http_response_cache_hash(key->data, key->len);
+    return true;
+}
+
+struct http_cached_response* http_response_cache_lookup(struct http_response_cache* cache,
+                                                        const struct http_response_cache_key* key,
+                                                        uint64_t now_ms)
+{
+    assert(cache != NULL);
+    assert(key != NULL);
+
+    struct http_response_cache_shard* shard = http_response_cache_shard_of(cache, key->hash);
+    struct http_cached_response* found = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+
+    for (struct http_cached_response* entry = *http_response_cache_bucket_of(shard, key->hash);
+         entry != NULL;
+         entry = entry->hash_next)
+    {
+        if (entry->key_hash != key->hash || entry->key_len != key->len || memcmp(entry->data, key->data, key->len) != 0) {
+            continue;
+        }
+
+        if (entry->expires_ms <= now_ms) {
+            http_response_cache_unlink(cache, shard, entry);
+            atomic_fetch_add_explicit(&cache->stats.expirations, 1, memory_order_relaxed);
+            break;
+        }
+
+        http_response_cache_lru_remove(shard, entry);
+        http_response_cache_lru_push_front(shard, entry);
+        atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+        found = entry;
+        break;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    atomic_fetch_add_explicit(found != NULL ? &cache->stats.hits : &cache->stats.misses, 1, memory_order_relaxed);
+    return found;
+}
+
+enum result http_response_cache_insert(struct http_response_cache* cache,
+                                       const struct http_response_cache_key* key,
+                                       const char* head,
+                                       size_t head_len,
+                                       struct str_slice body,
+                                       uint64_t ttl_ms,
+                                       uint64_t now_ms)
+{
+    assert(cache != NULL);
+    assert(key != NULL);
+    assert(head != NULL);
+
+    const size_t size = sizeof(struct http_cached_response) + key->len + head_len + body.len;
+    if (size > cache->shard_max_bytes) {
+        return RESULT_ERR;
+    }
+
+    // built outside the lock
+    struct http_cached_response* entry = malloc(size);
+    if (entry == NULL) {
+        LOG_ERROR("failed to allocate a response cache entry");
+        return RESULT_ERR;
+    }
+
+    entry->key_hash = key->hash;
+    entry->key_len = key->len;
+    entry->expires_ms = now_ms + ttl_ms;
+    entry->head_len = head_len;
+    entry->body_len = body.len;
+    entry->size = size;
+    atomic_init(&entry->refs, 1);
+    memcpy(entry->data, key->data, key->len);
+    memcpy(entry->data + key->len, head, head_len);
+    if (body.len > 0) {
+        memcpy(entry->data + key->len + head_len, body.ptr, body.len);
+    }
+
+    struct http_response_cache_shard* shard = http_response_cache_shard_of(cache, key->hash);
+    pthread_mutex_lock(&shard->lock);
+
+    struct http_cached_response** bucket = http_response_cache_bucket_of(shard, key->hash);
+    for (struct http_cached_response* old = *bucket; old != NULL; old = old->hash_next) {
+        if (old->key_hash == key->hash && old->key_len == key->len && memcmp(old->data, key->data, key->len) == 0) {
+            http_response_cache_unlink(cache, shard, old);
+            break;
+        }
+    }
+
+    while (shard->bytes + size > cache->shard_max_bytes && shard->lru_tail != NULL) {
+        http_response_cache_unlink(cache, shard, shard->lru_tail);
+        atomic_fetch_add_explicit(&cache->stats.evictions, 1, memory_order_relaxed);
+    }
+
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    http_response_cache_lru_push_front(shard, entry);
+    shard->bytes += size;
+
+    pthread_mutex_unlock(&shard->lock);
+
+    atomic_fetch_add_explicit(&cache->stats.insertions, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cache->stats.entries, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cache->stats.bytes, size, memory_order_relaxed);
+
+    return RESULT_OK;
+}
+
+void http_response_cache_release(struct http_cached_response* entry)
+{
+    assert(entry != NULL);
+
+    // the last reference: the entry is out of the cache already
+    if (atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) == 1) {
+        free(entry);
+    }
+}
+
+static bool http_response_cache_key_append(struct http_response_cache_key* key, struct str_slice s)
+{
+    if (s.len > HTTP_RESPONSE_CACHE_KEY_MAX_SIZE - key->len) {
+        return false;
+    }
+    if (s.len > 0) {
+        memcpy(key->data + key->len, s.ptr, s.len);
+        key->len += s.len;
+    }
+    return true;
+}
+
+static uint64_t http_response_cache_hash(const char* data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief shards take the lowest bits of the hash and buckets the next ones, so they are independent.
+ */
+static struct http_response_cache_shard* http_response_cache_shard_of(struct http_response_cache* cache, uint64_t hash)
+{
+    return &cache->shards[hash & (HTTP_RESPONSE_CACHE_SHARDS - 1)];
+}
+
+static struct http_cached_response** http_response_cache_bucket_of(struct http_response_cache_shard* shard, uint64_t hash)
+{
+    return &shard->buckets[(hash / HTTP_RESPONSE_CACHE_SHARDS) & (HTTP_RESPONSE_CACHE_SHARD_BUCKETS - 1)];
+}
+
+/**
+ * @brief takes |entry| out of the cache and drops the cache reference. The shard lock must be held.
+ */
+static void http_response_cache_unlink(struct http_response_cache* cache,
+                                       struct http_response_cache_shard* shard,
+                                       struct http_cached_response* entry)
+{
+    struct http_cached_response** link = http_response_cache_bucket_of(shard, entry->key_hash);
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    http_response_cache_lru_remove(shard, entry);
+    shard->bytes -= entry->size;
+
+    atomic_fetch_sub_explicit(&cache->stats.entries, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&cache->stats.bytes, entry->size, memory_order_relaxed);
+
+    http_response_cache_release(entry);
+}
+
+static void http_response_cache_lru_push_front(struct http_response_cache_shard* shard, struct http_cached_response* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head != NULL) {
+        shard->lru_head->lru_prev = entry;
+    } else {
+        shard->lru_tail = entry;
+    }
+    shard->lru_head = entry;
+}
+
+static void http_response_cache_lru_remove(struct http_response_cache_shard* shard, struct http_cached_response* entry)
+{
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        shard->lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        shard->lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
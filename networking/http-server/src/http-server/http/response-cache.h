@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <http-server/error.h>
+#include <http-server/str.h>
+#include <http-server/http.h>
+
+/**
+ * @brief number of independently locked parts of the cache (a power of two). Workers only contend when they look
+ *        up keys of the same shard at the same time.
+ */
+#define HTTP_RESPONSE_CACHE_SHARDS 16
+#define HTTP_RESPONSE_CACHE_SHARD_BUCKETS 256
+
+/**
+ * @brief requests whose key (method, target and key headers) is longer than this are never cached
+ */
+#define HTTP_RESPONSE_CACHE_KEY_MAX_SIZE 512
+
+/**
+ * @brief a cached response, serialized once and sent as is (without any copy) to every request it answers.
+ *
+ * It is immutable once cached and reference counted: an entry evicted (or replaced) while being sent is only freed
+ * once every connection sending it released it.
+ */
+struct http_cached_response {
+    uint64_t key_hash;
+    size_t key_len;
+
+    /**
+     * @brief CLOCK_MONOTONIC ms past which it is not served anymore
+     */
+    uint64_t expires_ms;
+
+    /**
+     * @brief the status line and the headers, Content-Length included, but neither the connection level headers
+     *        nor the empty line ending the head (see http_response_cache_insert)
+     */
+    size_t head_len;
+    size_t body_len;
+
+    /**
+     * @brief the bytes accounted for the entry in its shard
+     */
+    size_t size;
+
+    /**
+     * @brief one for the cache while the entry is in it, plus one per response being sent from it
+     */
+    _Atomic size_t refs;
+
+    struct http_cached_response* hash_next;
+    struct http_cached_response* lru_prev;
+    struct http_cached_response* lru_next;
+
+    /**
+     * @brief the key, then the head, then the body
+     */
+    char data[];
+};
+
+static inline const char* http_cached_response_head(const struct http_cached_response* entry)
+{
+    return entry->data + entry->key_len;
+}
+
+static inline const char* http_cached_response_body(const struct http_cached_response* entry)
+{
+    return entry->data + entry->key_len + entry->head_len;
+}
+
+struct http_response_cache_shard {
+    pthread_mutex_t lock;
+    struct http_cached_response* buckets[HTTP_RESPONSE_CACHE_SHARD_BUCKETS];
+
+    /**
+     * @brief most recently used first
+     */
+    struct http_cached_response* lru_head;
+    struct http_cached_response* lru_tail;
+
+    size_t bytes;
+};
+
+/**
+ * @brief counters of the whole cache, readable from any thread at any time
+ */
+struct http_response_cache_stats {
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    _Atomic uint64_t insertions;
+    _Atomic uint64_t evictions;
+    _Atomic uint64_t expirations;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t entries;
+};
+
+/**
+ * @brief responses of cacheable routes (see http_router_add_cached), shared by every worker.
+ *
+ * The key is the method (HEAD shares the GET entries), the request target (query included) and the values of a few
+ * request headers the responses may depend on (Accept and Accept-Encoding). Every shard is a hash table plus an LRU
+ * list within a byte budget: the least recently used entries are evicted to make room, and expired entries are
+ * dropped when they are found.
+ */
+struct http_response_cache {
+    struct http_response_cache_shard shards[HTTP_RESPONSE_CACHE_SHARDS];
+
+    /**
+     * @brief byte budget of every shard (the total one split evenly)
+     */
+    size_t shard_max_bytes;
+
+    struct http_response_cache_stats stats;
+};
+
+/**
+ * @brief a request key, built once and used both for the lookup and (on a miss) the insertion.
+ */
+struct http_response_cache_key {
+    char data[HTTP_RESPONSE_CACHE_KEY_MAX_SIZE];
+    size_t len;
+    uint64_t hash;
+};
+
+enum result http_response_cache_init(struct http_response_cache* cache, size_t max_bytes);
+void http_response_cache_free(struct http_response_cache* cache);
+
+/**
+ * @brief builds the cache key of |request_head|.
+ *
+ * @return false when the request can't be cached (key too long, or an Authorization header).
+ */
+bool http_response_cache_key_init(struct http_response_cache_key* key, const struct http_request_head* request_head);
+
+/**
+ * @brief finds the fresh entry of |key|.
+ *
+ * @return a referenced entry (to be given back with http_response_cache_release) or NULL on a miss.
+ */
+struct http_cached_response* http_response_cache_lookup(struct http_response_cache* cache,
+                                                        const struct http_response_cache_key* key,
+                                                        uint64_t now_ms);
+
+/**
+ * @brief caches the response |head| (as http_response_serialize_head writes it, without the final empty line) and
+ *        |body| for |ttl_ms|, replacing any entry of the same key. Both are copied.
+ *
+ * @return RESULT_ERR when it is bigger than a shard or on allocation failure. Nothing is cached then.
+ */
+enum result http_response_cache_insert(struct http_response_cache* cache,
+                                       const struct http_response_cache_key* key,
+                                       const char* head,
+                                       size_t head_len,
+                                       struct str_slice body,
+                                       uint64_t ttl_ms,
+                                       uint64_t now_ms);
+
+void http_response_cache_release(struct http_cached_response* entry);
@@ -0,0 +1,184 @@
+/**
+ * Tests of the http/response-cache.h entries: keys (HEAD shares GET, Accept varies, Authorization is never cached),
+ * hits and misses, expiration, replacement, LRU eviction within the byte budget and entries outliving their
+ * eviction while referenced.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/response-cache.h>
+#include <http-server/test.h>
+
+#define HEAD "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n"
+#define BODY "hello"
+
+static void request_init(struct http_request_head* request,
+                         enum http_method method,
+                         const char* target,
+                         const char* header_name,
+                         const char* header_value)
+{
+    memset(request, 0, sizeof(*request));
+    request->method = method;
+    request->start_line.method = str_slice_from_cstr_trusted(http_method_cstr(method));
+    request->start_line.path = str_slice_from_cstr_trusted(target);
+    if (header_name != NULL) {
+        request->headers[0].key = str_slice_from_cstr_trusted(header_name);
+        request->headers[0].value = str_slice_from_cstr_trusted(header_value);
+        request->header_count = 1;
+    }
+}
+
+static bool key_init(struct http_response_cache_key* key,
+                     enum http_method method,
+                     const char* target,
+                     const char* header_name,
+                     const char* header_value)
+{
+    struct http_request_head request;
+    request_init(&request, method, target, header_name, header_value);
+    return http_response_cache_key_init(key, &request);
+}
+
+static enum result insert(struct http_response_cache* cache, const struct http_response_cache_key* key, uint64_t now_ms)
+{
+    return http_response_cache_insert(cache, key, HEAD, strlen(HEAD), str_slice_from_cstr_trusted(BODY), 100, now_ms);
+}
+
+static void test_keys(void)
+{
+    struct http_response_cache_key get, head, query, accept, other;
+    CHECK(key_init(&get, HTTP_METHOD_GET, "/a", NULL, NULL));
+    CHECK(key_init(&head, HTTP_METHOD_HEAD, "/a", NULL, NULL));
+    CHECK(key_init(&query, HTTP_METHOD_GET, "/a?x=1", NULL, NULL));
+    CHECK(key_init(&accept, HTTP_METHOD_GET, "/a", "accept", "text/html"));
+    CHECK(key_init(&other, HTTP_METHOD_GET, "/a", "X-Other", "1"));
+
+    CHECK(get.len == head.len && memcmp(get.data, head.data, get.len) == 0);
+    CHECK(get.len != query.len || memcmp(get.data, query.data, get.len) != 0);
+    CHECK(get.len != accept.len || memcmp(get.data, accept.data, get.len) != 0);
+    CHECK(get.len == other.len && memcmp(get.data, other.data, get.len) == 0);
+
+    struct http_response_cache_key key;
+    CHECK(!key_init(&key, HTTP_METHOD_GET, "/a", "Authorization", "Bearer x"));
+
+    static char long_target[HTTP_RESPONSE_CACHE_KEY_MAX_SIZE + 1];
+    memset(long_target, 'a', sizeof(long_target) - 1);
+    long_target[0] = '/';
+    CHECK(!key_init(&key, HTTP_METHOD_GET, long_target, NULL, NULL));
+}
+
+static void test_hit_miss_expire(void)
+{
+    struct http_response_cache cache;
+    CHECK(http_response_cache_init(&cache, 1024 * 1024) == RESULT_OK);
+
+    struct http_response_cache_key key;
+    CHECK(key_init(&key, HTTP_METHOD_GET, "/a", NULL, NULL));
+
+    CHECK(http_response_cache_lookup(&cache, &key, 0) == NULL);
+    CHECK(insert(&cache, &key, 0) == RESULT_OK);
+
+    struct http_cached_response* entry = http_response_cache_lookup(&cache, &key, 99);
+    CHECK(entry != NULL);
+    if (entry != NULL) {
+        CHECK(entry->head_len == strlen(HEAD) && memcmp(http_cached_response_head(entry), HEAD, entry->head_len) == 0);
+        CHECK(entry->body_len == strlen(BODY) && memcmp(http_cached_response_body(entry), BODY, entry->body_len) == 0);
+        http_response_cache_release(entry);
+    }
+
+    // replaced, not duplicated
+    CHECK(insert(&cache, &key, 50) == RESULT_OK);
+    CHECK(atomic_load(&cache.stats.entries) == 1);
+
+    CHECK(http_response_cache_lookup(&cache, &key, 150) == NULL);
+    CHECK(atomic_load(&cache.stats.expirations) == 1);
+    CHECK(atomic_load(&cache.stats.entries) == 0);
+    CHECK(atomic_load(&cache.stats.bytes) == 0);
+
+    CHECK(atomic_load(&cache.stats.hits) == 1);
+    CHECK(atomic_load(&cache.stats.misses) == 2);
+
+    http_response_cache_free(&cache);
+}
+
+static void test_lru_eviction(void)
+{
+    struct http_response_cache_key keys[64];
+    char targets[64][16];
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        snprintf(targets[i], sizeof(targets[i]), "/%zu", i);
+        CHECK(key_init(&keys[i], HTTP_METHOD_GET, targets[i], NULL, NULL));
+    }
+
+    // room for two or three entries per shard (keys are 2 or 3 bytes long)
+    const size_t entry_size = sizeof(struct http_cached_response) + keys[63].len + strlen(HEAD) + strlen(BODY);
+    struct http_response_cache cache;
+    CHECK(http_response_cache_init(&cache, HTTP_RESPONSE_CACHE_SHARDS * (entry_size * 2 + 1)) == RESULT_OK);
+
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        CHECK(insert(&cache, &keys[i], 0) == RESULT_OK);
+
+        // the first one stays the most recently used
+        struct http_cached_response* first = http_response_cache_lookup(&cache, &keys[0], 0);
+        CHECK(first != NULL);
+        if (first != NULL) {
+            http_response_cache_release(first);
+        }
+    }
+
+    CHECK(atomic_load(&cache.stats.evictions) > 0);
+    CHECK(atomic_load(&cache.stats.entries) == ARRAY_SIZE(keys) - atomic_load(&cache.stats.evictions));
+    for (size_t i = 0; i < HTTP_RESPONSE_CACHE_SHARDS; i++) {
+        CHECK(cache.shards[i].bytes <= cache.shard_max_bytes);
+    }
+
+    // bigger than a shard
+    static char big_body[4096];
+    CHECK(http_response_cache_insert(&cache, &keys[1], HEAD, strlen(HEAD),
+                                     str_slice_from_buffer(big_body, sizeof(big_body)), 100, 0) == RESULT_ERR);
+
+    http_response_cache_free(&cache);
+}
+
+static void test_referenced_entry_outlives_eviction(void)
+{
+    struct http_response_cache cache;
+    CHECK(http_response_cache_init(&cache, 1024 * 1024) == RESULT_OK);
+
+    struct http_response_cache_key key;
+    CHECK(key_init(&key, HTTP_METHOD_GET, "/a", NULL, NULL));
+    CHECK(insert(&cache, &key, 0) == RESULT_OK);
+
+    struct http_cached_response* entry = http_response_cache_lookup(&cache, &key, 0);
+    CHECK(entry != NULL);
+
+    // replaced while still being sent, then the cache goes away entirely
+    CHECK(insert(&cache, &key, 0) == RESULT_OK);
+    http_response_cache_free(&cache);
+
+    // the sanitizers report a use after free (or a leak) otherwise
+    if (entry != NULL) {
+        CHECK(memcmp(http_cached_response_body(entry), BODY, entry->body_len) == 0);
+        http_response_cache_release(entry);
+    }
+}
+
+int main(void)
+{
+    test_keys();
+    test_hit_miss_expire();
+    test_lru_eviction();
+    test_referenced_entry_outlives_eviction();
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all response cache checks passed\n");
+    return 0;
+}
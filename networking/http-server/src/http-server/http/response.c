@@ -0,0 +1,154 @@
+#include "response.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <http-server/log.h>
+#define LOG_NAME "http/response"
+
+/**
+ * @brief appends to a fixed-size buffer and remembers if anything did not fit.
+ */
+struct response_writer {
+    uint8_t* buffer;
+    size_t size;
+    size_t len;
+    bool overflow;
+};
+
+static void response_writer_write(struct response_writer* w, const void* data, size_t data_len)
+{
+    if (data_len == 0) {
+        return;
+    }
+    if (w->overflow || data_len > w->size - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buffer + w->len, data, data_len);
+    w->len += data_len;
+}
+
+static void response_writer_write_slice(struct response_writer* w, struct str_slice s)
+{
+    response_writer_write(w, s.ptr, s.len);
+}
+
+static void response_writer_write_cstr(struct response_writer* w, const char* cstr)
+{
+    response_writer_write(w, cstr, strlen(cstr));
+}
+
+static void response_writer_write_size(struct response_writer* w, size_t value)
+{
+    char digits[24];
+    int len = snprintf(digits, sizeof(digits), "%zu", value);
+    assert(len > 0 && (size_t) len < sizeof(digits));
+    response_writer_write(w, digits, (size_t) len);
+}
+
+void http_response_init(struct http_response* resp)
+{
+    assert(resp != NULL);
+
+    http_header_list_init(&resp->headers);
+    http_response_reset(resp, 200, "OK");
+}
+
+void http_response_free(struct http_response* resp)
+{
+    assert(resp != NULL);
+
+    http_header_list_free(&resp->headers);
+}
+
+void http_response_reset(struct http_response* resp, int status_code, const char* reason_phrase)
+{
+    assert(resp != NULL);
+    assert(status_code >= 100 && status_code <= 999);
+    assert(reason_phrase != NULL);
+
+    resp->status_code = status_code;
+    resp->reason_phrase = reason_phrase;
+    http_header_list_clear(&resp->headers);
+    resp->body = str_slice_empty();
+    resp->has_content_length = false;
+    resp->content_length = 0;
+}
+
+void http_response_set_content_length(struct http_response* resp, size_t content_length)
+{
+    assert(resp != NULL);
+
+    resp->has_content_length = true;
+    resp->content_length = content_length;
+}
+
+enum result http_response_add_header(struct http_response* resp, struct str_slice name, struct str_slice value)
+{
+    assert(resp != NULL);
+
+    const struct http_header header = { .key = name, .value = value };
+    if (http_header_list_push_back(&resp->headers, header) != 0) {
+        LOG_ERROR("failed to grow the response header list");
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+bool http_response_find_header(const struct http_response* resp, const char* name, struct str_slice* out_value)
+{
+    assert(resp != NULL);
+    assert(name != NULL);
+    assert(out_value != NULL);
+
+    const struct str_slice key = str_slice_from_cstr_trusted(name);
+    for (size_t i = 0; i < resp->headers.length; i++) {
+        if (str_slice_eq_ignore_case(resp->headers.items[i].key, key)) {
+            *out_value = resp->headers.items[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+enum result http_response_serialize_head(const struct http_response* resp,
+                                         uint8_t* buffer,
+                                         size_t buffer_size,
+                                         size_t* out_len)
+{
+    assert(resp != NULL);
+    assert(buffer != NULL);
+    assert(out_len != NULL);
+
+    struct response_writer w = { .buffer = buffer, .size = buffer_size, .len = 0, .overflow = false };
+
+    response_writer_write_cstr(&w, "HTTP/1.1 ");
+    response_writer_write_size(&w, (size_t) resp->status_code);
+    response_writer_write_cstr(&w, " ");
+    response_writer_write_cstr(&w, resp->reason_phrase);
+    response_writer_write_cstr(&w, "\r\n");
+
+    for (size_t i = 0; i < resp->headers.length; i++) {
+        const struct http_header* header = &resp->headers.items[i];
+        response_writer_write_slice(&w, header->key);
+        response_writer_write_cstr(&w, ": ");
+        response_writer_write_slice(&w, header->value);
+        response_writer_write_cstr(&w, "\r\n");
+    }
+
+    response_writer_write_cstr(&w, "Content-Length: ");
+    response_writer_write_size(&w, resp->has_content_length ? resp->content_length : resp->body.len);
+    response_writer_write_cstr(&w, "\r\n\r\n");
+
+    if (w.overflow) {
+        return RESULT_ERR;
+    }
+
+    *out_len = w.len;
+    return RESULT_OK;
+}
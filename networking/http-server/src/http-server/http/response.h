@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <http-server/error.h>
+#include <http-server/str.h>
+#include <http-server/http.h>
+#include <http-server/dynamic-array.h>
+
+DYNAMIC_ARRAY_DEFINE(http_header_list, struct http_header)
+
+/**
+ * @brief a response being built, before it is serialized to a connection send buffer.
+ *
+ * Meant to be reused: http_response_reset keeps the header list capacity, so once it has grown to the biggest
+ * response, building responses doesn't allocate anymore.
+ */
+struct http_response {
+    int status_code;
+    const char* reason_phrase;
+
+    /**
+     * @brief every header but Content-Length, which is derived from the body when serializing.
+     */
+    struct http_header_list headers;
+
+    /**
+     * @brief never copied: it is sent straight from where it is (its own iovec) so it must stay valid until the
+     *        response is sent. Static data and the request arena (see struct http_connection) are both fine.
+     */
+    struct str_slice body;
+
+    /**
+     * @brief the announced Content-Length when it is not the body length: the body is sent separately (a file)
+     *        or not at all (HEAD, 304). Only meaningful when has_content_length.
+     */
+    bool has_content_length;
+    size_t content_length;
+};
+
+void http_response_init(struct http_response* resp);
+void http_response_free(struct http_response* resp);
+
+/**
+ * @brief starts a new (empty body, no headers) response.
+ */
+void http_response_reset(struct http_response* resp, int status_code, const char* reason_phrase);
+
+/**
+ * @brief announces |content_length| bytes instead of the body length.
+ */
+void http_response_set_content_length(struct http_response* resp, size_t content_length);
+
+/**
+ * @brief |name| and |value| are not copied, they must outlive the response serialization.
+ */
+enum result http_response_add_header(struct http_response* resp, struct str_slice name, struct str_slice value);
+
+/**
+ * @brief finds the first header named |name| (case-insensitive).
+ *
+ * @return false when the response has no such header.
+ */
+bool http_response_find_header(const struct http_response* resp, const char* name, struct str_slice* out_value);
+
+/**
+ * @brief writes the response head (the status line, the headers and the Content-Length, up to the empty line) to
+ *        |buffer|. The body is left out, to be sent from where it is.
+ *
+ * @return RESULT_ERR when it does not fit in |buffer_size| bytes. |out_len| is left untouched then.
+ */
+enum result http_response_serialize_head(const struct http_response* resp,
+                                         uint8_t* buffer,
+                                         size_t buffer_size,
+                                         size_t* out_len);
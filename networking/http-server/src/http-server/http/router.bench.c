@@ -0,0 +1,202 @@
+/**
+ * Microbenchmark: http_router_match (radix trie) vs. trying every route pattern in turn.
+ *
+ * The routes look like the ones of a big REST API (static, single and double parameter, catch-all), and every
+ * lookup path matches exactly one of them, so both strategies must agree on every lookup.
+ *
+ * Usage: http-router-bench [routes] [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/stopwatch.h>
+#include <http-server/http/router.h>
+
+#define DEFAULT_ROUTES 10000
+#define DEFAULT_ITERATIONS 2000000
+#define PATTERN_BUFFER_SIZE 96
+
+struct bench_route {
+    char pattern[PATTERN_BUFFER_SIZE];
+    char path[PATTERN_BUFFER_SIZE];
+};
+
+static void noop_handler(struct http_handler_context* ctx)
+{
+    (void) ctx;
+}
+
+/**
+ * @brief the route |i| and a path only it matches.
+ */
+static void bench_route_make(size_t i, struct bench_route* out)
+{
+    const size_t version = i % 7;
+    const size_t service = i / 4;
+
+    switch (i % 4) {
+        case 0:
+            snprintf(out->pattern, sizeof(out->pattern), "/api/v%zu/service%zu/items", version, service);
+            snprintf(out->path, sizeof(out->path), "/api/v%zu/service%zu/items", version, service);
+            break;
+        case 1:
+            snprintf(out->pattern, sizeof(out->pattern), "/api/v%zu/service%zu/items/:id", version, service);
+            snprintf(out->path, sizeof(out->path), "/api/v%zu/service%zu/items/8f14e45f", version, service);
+            break;
+        case 2:
+            snprintf(out->pattern, sizeof(out->pattern), "/api/v%zu/service%zu/items/:id/tags/:tag", version, service);
+            snprintf(out->path, sizeof(out->path), "/api/v%zu/service%zu/items/8f14e45f/tags/blue", version, service);
+            break;
+        default:
+            snprintf(out->pattern, sizeof(out->pattern), "/assets%zu/*path", service);
+            snprintf(out->path, sizeof(out->path), "/assets%zu/css/site.3f9c2d1e.css", service);
+            break;
+    }
+}
+
+/**
+ * @brief matches |path| against a single pattern, segment by segment.
+ */
+static bool linear_pattern_matches(const char* pattern, const char* path)
+{
+    while (*pattern != '\0') {
+        if (pattern[-1] == '/' && *pattern == '*') {
+            return true;
+        }
+
+        if (pattern[-1] == '/' && *pattern == ':') {
+            const size_t segment_len = strcspn(path, "/");
+            if (segment_len == 0) {
+                return false;
+            }
+            pattern += strcspn(pattern, "/");
+            path += segment_len;
+            continue;
+        }
+
+        if (*pattern != *path) {
+            return false;
+        }
+        pattern++;
+        path++;
+    }
+
+    return *path == '\0';
+}
+
+static size_t linear_match(const struct bench_route* routes, size_t route_count, const char* path)
+{
+    for (size_t i = 0; i < route_count; i++) {
+        // every pattern starts with '/', so pattern[-1] is never read before it
+        if (routes[i].pattern[0] == *path && linear_pattern_matches(routes[i].pattern + 1, path + 1)) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static size_t trie_match(const struct http_router* router, const char* path)
+{
+    struct http_router_match match;
+    if (http_router_match(router, HTTP_METHOD_GET, str_slice_from_cstr_trusted(path), &match) != HTTP_ROUTER_MATCH_FOUND) {
+        return SIZE_MAX;
+    }
+    return (size_t) (uintptr_t) match.route->user_data;
+}
+
+static void report(const char* name, size_t route_count, size_t iterations, struct stopwatch* sw, size_t checksum)
+{
+    const double elapsed_ns = (double) stopwatch_get_ns(sw);
+    printf("%-8s routes=%-7zu %10.1f ns/lookup %12.0f lookups/s (checksum=%zu)\n",
+           name,
+           route_count,
+           elapsed_ns / (double) iterations,
+           (double) iterations / (elapsed_ns / 1e9),
+           checksum);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t route_count = DEFAULT_ROUTES;
+    size_t iterations = DEFAULT_ITERATIONS;
+
+    for (int i = 1; i < argc && i <= 2; i++) {
+        unsigned long long value;
+        if (parse_ull(argv[i], &value) != RESULT_OK || value == 0) {
+            fprintf(stderr, "usage: %s [routes] [iterations]\n", argv[0]);
+            return 1;
+        }
+        if (i == 1) {
+            route_count = (size_t) value;
+        } else {
+            iterations = (size_t) value;
+        }
+    }
+
+    struct bench_route* routes = calloc(route_count, sizeof(struct bench_route));
+    if (routes == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    struct http_router router;
+    if (http_router_init(&router) != RESULT_OK) {
+        free(routes);
+        return 1;
+    }
+
+    for (size_t i = 0; i < route_count; i++) {
+        bench_route_make(i, &routes[i]);
+        if (http_router_add(&router, HTTP_METHOD_GET, routes[i].pattern, noop_handler, (void*) (uintptr_t) i) != RESULT_OK) {
+            fprintf(stderr, "error: failed to add route \"%s\"\n", routes[i].pattern);
+            return 1;
+        }
+    }
+
+    // sanity check: both strategies find the route every path was made for
+    for (size_t i = 0; i < route_count; i++) {
+        const size_t trie_route = trie_match(&router, routes[i].path);
+        const size_t linear_route = linear_match(routes, route_count, routes[i].path);
+        if (trie_route != i || linear_route != i) {
+            fprintf(stderr, "error: \"%s\": expected route %zu, trie=%zu linear=%zu\n",
+                    routes[i].path, i, trie_route, linear_route);
+            return 1;
+        }
+    }
+    if (trie_match(&router, "/api/v1/service0/nope") != SIZE_MAX) {
+        fprintf(stderr, "error: unexpected match\n");
+        return 1;
+    }
+
+    printf("routes=%zu trie_nodes=%zu iterations=%zu\n", route_count, router.nodes.length, iterations);
+
+    // a stride co-prime with most route counts, so consecutive lookups don't hit neighbouring routes
+    const size_t stride = 7919;
+
+    struct stopwatch sw;
+    size_t checksum = 0;
+    stopwatch_start(&sw);
+    for (size_t i = 0; i < iterations; i++) {
+        checksum += trie_match(&router, routes[(i * stride) % route_count].path);
+    }
+    stopwatch_stop(&sw);
+    report("trie", route_count, iterations, &sw, checksum);
+
+    // a full scan is orders of magnitude slower
+    const size_t linear_iterations = MAX(iterations / 1000, (size_t) 1);
+    checksum = 0;
+    stopwatch_start(&sw);
+    for (size_t i = 0; i < linear_iterations; i++) {
+        checksum += linear_match(routes, route_count, routes[(i * stride) % route_count].path);
+    }
+    stopwatch_stop(&sw);
+    report("linear", route_count, linear_iterations, &sw, checksum);
+
+    http_router_free(&router);
+    free(routes);
+    return 0;
+}
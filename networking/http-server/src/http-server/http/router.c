@@ -0,0 +1,459 @@
+#include "router.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include <http-server/log.h>
+#define LOG_NAME "http/router"
+
+static uint32_t http_router_add_node(struct http_router* router, int kind, const char* label, size_t label_len);
+static uint32_t http_router_insert_static(struct http_router* router, uint32_t parent, const char* run, size_t run_len);
+static uint32_t http_router_insert_param(struct http_router* router,
+                                         uint32_t parent,
+                                         int kind,
+                                         const char* name,
+                                         size_t name_len);
+static enum result http_router_split(struct http_router* router, uint32_t node, uint32_t prefix_len);
+static uint32_t http_router_find_static_child(const struct http_router* router, uint32_t parent, char first_byte);
+static uint32_t http_router_node_route(const struct http_router_node* node, enum http_method method);
+static uint32_t http_router_match_node(const struct http_router* router,
+                                       uint32_t node_index,
+                                       enum http_method method,
+                                       struct str_slice path,
+                                       size_t pos,
+                                       struct http_route_params* params,
+                                       uint32_t* out_path_match);
+static bool http_router_is_param_start(const char* pattern, size_t i);
+
+bool http_route_params_get(const struct http_route_params* params, const char* name, struct str_slice* out_value)
+{
+    assert(params != NULL);
+    assert(name != NULL);
+    assert(out_value != NULL);
+
+    const size_t name_len = strlen(name);
+    for (size_t i = 0; i < params->count; i++) {
+        if (params->names[i].len == name_len && memcmp(params->names[i].ptr, name, name_len) == 0) {
+            *out_value = params->values[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+enum result http_router_init(struct http_router* router)
+{
+    assert(router != NULL);
+
+    http_router_node_list_init(&router->nodes);
+    http_route_list_init(&router->routes);
+    http_router_label_pool_init(&router->labels);
+
+    // the root: an empty static label every path goes through
+    if (http_router_add_node(router, HTTP_ROUTER_NODE_STATIC, "", 0) == HTTP_ROUTER_NO_NODE) {
+        http_router_free(router);
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+void http_router_free(struct http_router* router)
+{
+    assert(router != NULL);
+
+    http_router_node_list_free(&router->nodes);
+    http_route_list_free(&router->routes);
+    http_router_label_pool_free(&router->labels);
+}
+
+enum result http_router_add(struct http_router* router,
+                            enum http_method method,
+                            const char* pattern,
+                            http_handler_fn handler,
+                            void* user_data)
+{
+    return http_router_add_cached(router, method, pattern, handler, user_data, 0);
+}
+
+enum result http_router_add_cached(struct http_router* router,
+                                   enum http_method method,
+                                   const char* pattern,
+                                   http_handler_fn handler,
+                                   void* user_data,
+                                   uint32_t cache_ttl_ms)
+{
+    assert(router != NULL);
+    assert(pattern != NULL);
+    assert(handler != NULL);
+    assert((size_t) method < HTTP_METHOD_COUNT);
+
+    const size_t pattern_len = strlen(pattern);
+    if (pattern_len == 0 || pattern[0] != '/') {
+        LOG_ERRORF("route \"%s\": patterns must start with '/'", pattern);
+        return RESULT_ERR;
+    }
+
+    uint32_t node = 0;
+    size_t param_count = 0;
+    size_t i = 0;
+
+    while (i < pattern_len && node != HTTP_ROUTER_NO_NODE) {
+        if (!http_router_is_param_start(pattern, i)) {
+            // the longest literal run, up to the next parameter
+            size_t run_end = i + 1;
+            while (run_end < pattern_len && !http_router_is_param_start(pattern, run_end)) {
+                run_end++;
+            }
+            node = http_router_insert_static(router, node, pattern + i, run_end - i);
+            i = run_end;
+            continue;
+        }
+
+        const bool catch_all = pattern[i] == '*';
+        const char* name = pattern + i + 1;
+        const char* name_end = memchr(name, '/', pattern_len - (i + 1));
+        const size_t name_len = name_end != NULL ? (size_t) (name_end - name) : pattern_len - (i + 1);
+
+        if (name_len == 0 || memchr(name, ':', name_len) != NULL || memchr(name, '*', name_len) != NULL) {
+            LOG_ERRORF("route \"%s\": bad parameter name at offset %zu", pattern, i);
+            return RESULT_ERR;
+        }
+        if (catch_all && name_end != NULL) {
+            LOG_ERRORF("route \"%s\": a catch-all parameter must be the last segment", pattern);
+            return RESULT_ERR;
+        }
+        if (++param_count > HTTP_ROUTER_MAX_PARAMS) {
+            LOG_ERRORF("route \"%s\": more than %d parameters", pattern, HTTP_ROUTER_MAX_PARAMS);
+            return RESULT_ERR;
+        }
+
+        node = http_router_insert_param(router,
+                                        node,
+                                        catch_all ? HTTP_ROUTER_NODE_CATCH_ALL : HTTP_ROUTER_NODE_PARAM,
+                                        name,
+                                        name_len);
+        if (node == HTTP_ROUTER_NO_NODE) {
+            LOG_ERRORF("route \"%s\": conflicts with the parameter of an existing route", pattern);
+        }
+        i += 1 + name_len;
+    }
+
+    if (node == HTTP_ROUTER_NO_NODE) {
+        return RESULT_ERR;
+    }
+
+    if (router->nodes.items[node].routes[method] != HTTP_ROUTER_NO_ROUTE) {
+        LOG_ERRORF("route %s \"%s\": already registered", http_method_cstr(method), pattern);
+        return RESULT_ERR;
+    }
+
+    const struct http_route route = {
+        .method = method,
+        .handler = handler,
+        .user_data = user_data,
+        .cache_ttl_ms = cache_ttl_ms,
+    };
+    if (http_route_list_push_back(&router->routes, route) != 0) {
+        LOG_ERROR("failed to grow the route list");
+        return RESULT_ERR;
+    }
+    router->nodes.items[node].routes[method] = (uint32_t) (router->routes.length - 1);
+
+    return RESULT_OK;
+}
+
+enum http_router_match_status http_router_match(const struct http_router* router,
+                                                enum http_method method,
+                                                struct str_slice path,
+                                                struct http_router_match* out_match)
+{
+    assert(router != NULL);
+    assert(out_match != NULL);
+
+    out_match->route = NULL;
+    out_match->params.count = 0;
+    out_match->allowed_methods = 0;
+
+    uint32_t path_match = HTTP_ROUTER_NO_NODE;
+    uint32_t route = http_router_match_node(router, 0, method, path, 0, &out_match->params, &path_match);
+    if (route != HTTP_ROUTER_NO_ROUTE) {
+        out_match->route = &router->routes.items[route];
+        return HTTP_ROUTER_MATCH_FOUND;
+    }
+
+    out_match->params.count = 0;
+    if (path_match == HTTP_ROUTER_NO_NODE) {
+        return HTTP_ROUTER_MATCH_NOT_FOUND;
+    }
+
+    const struct http_router_node* node = &router->nodes.items[path_match];
+    for (size_t m = 0; m < HTTP_METHOD_COUNT; m++) {
+        if (node->routes[m] != HTTP_ROUTER_NO_ROUTE) {
+            out_match->allowed_methods |= UINT32_C(1) << m;
+        }
+    }
+    return HTTP_ROUTER_MATCH_METHOD_NOT_ALLOWED;
+}
+
+/**
+ * @brief ':' and '*' only start a parameter at the beginning of a segment.
+ */
+static bool http_router_is_param_start(const char* pattern, size_t i)
+{
+    return i > 0 && pattern[i - 1] == '/' && (pattern[i] == ':' || pattern[i] == '*');
+}
+
+/**
+ * @return the index of the new node, or HTTP_ROUTER_NO_NODE on allocation failure.
+ */
+static uint32_t http_router_add_node(struct http_router* router, int kind, const char* label, size_t label_len)
+{
+    const size_t label_offset = router->labels.length;
+    if (http_router_label_pool_append(&router->labels, label, label_len) != 0) {
+        LOG_ERROR("failed to grow the route label pool");
+        return HTTP_ROUTER_NO_NODE;
+    }
+
+    struct http_router_node node = {
+        .kind = kind,
+        .label_offset = (uint32_t) label_offset,
+        .label_len = (uint32_t) label_len,
+        .first_child = HTTP_ROUTER_NO_NODE,
+        .next_sibling = HTTP_ROUTER_NO_NODE,
+        .param_child = HTTP_ROUTER_NO_NODE,
+        .catch_all_child = HTTP_ROUTER_NO_NODE,
+    };
+    for (size_t m = 0; m < HTTP_METHOD_COUNT; m++) {
+        node.routes[m] = HTTP_ROUTER_NO_ROUTE;
+    }
+
+    if (http_router_node_list_push_back(&router->nodes, node) != 0) {
+        LOG_ERROR("failed to grow the route trie");
+        return HTTP_ROUTER_NO_NODE;
+    }
+
+    return (uint32_t) (router->nodes.length - 1);
+}
+
+/**
+ * @brief walks down (splitting edges as needed) the static path |run| from |parent|.
+ *
+ * @return the node where |run| ends, or HTTP_ROUTER_NO_NODE on allocation failure.
+ */
+static uint32_t http_router_insert_static(struct http_router* router, uint32_t parent, const char* run, size_t run_len)
+{
+    while (run_len > 0) {
+        uint32_t child = http_router_find_static_child(router, parent, run[0]);
+        if (child == HTTP_ROUTER_NO_NODE) {
+            child = http_router_add_node(router, HTTP_ROUTER_NODE_STATIC, run, run_len);
+            if (child == HTTP_ROUTER_NO_NODE) {
+                return HTTP_ROUTER_NO_NODE;
+            }
+            router->nodes.items[child].next_sibling = router->nodes.items[parent].first_child;
+            router->nodes.items[parent].first_child = child;
+            return child;
+        }
+
+        const struct http_router_node* node = &router->nodes.items[child];
+        const char* label = &router->labels.items[node->label_offset];
+        uint32_t common_len = 0;
+        while (common_len < node->label_len && common_len < run_len && label[common_len] == run[common_len]) {
+            common_len++;
+        }
+
+        if (common_len < node->label_len && http_router_split(router, child, common_len) != RESULT_OK) {
+            return HTTP_ROUTER_NO_NODE;
+        }
+
+        parent = child;
+        run += common_len;
+        run_len -= common_len;
+    }
+
+    return parent;
+}
+
+/**
+ * @brief cuts the label of |node| after |prefix_len| bytes. The rest of the label (and everything hanging from the
+ *        node) moves to a new single child.
+ */
+static enum result http_router_split(struct http_router* router, uint32_t node, uint32_t prefix_len)
+{
+    // no new label: the suffix is already in the pool, right after the prefix
+    struct http_router_node suffix = router->nodes.items[node];
+    suffix.label_offset += prefix_len;
+    suffix.label_len -= prefix_len;
+    suffix.next_sibling = HTTP_ROUTER_NO_NODE;
+
+    if (http_router_node_list_push_back(&router->nodes, suffix) != 0) {
+        LOG_ERROR("failed to grow the route trie");
+        return RESULT_ERR;
+    }
+
+    struct http_router_node* prefix = &router->nodes.items[node];
+    prefix->label_len = prefix_len;
+    prefix->first_child = (uint32_t) (router->nodes.length - 1);
+    prefix->param_child = HTTP_ROUTER_NO_NODE;
+    prefix->catch_all_child = HTTP_ROUTER_NO_NODE;
+    for (size_t m = 0; m < HTTP_METHOD_COUNT; m++) {
+        prefix->routes[m] = HTTP_ROUTER_NO_ROUTE;
+    }
+
+    return RESULT_OK;
+}
+
+/**
+ * @return the parameter child of |parent| named |name|, created if needed. HTTP_ROUTER_NO_NODE when |parent| already
+ *         has one named differently (or on allocation failure).
+ */
+static uint32_t http_router_insert_param(struct http_router* router,
+                                         uint32_t parent,
+                                         int kind,
+                                         const char* name,
+                                         size_t name_len)
+{
+    const uint32_t existing = kind == HTTP_ROUTER_NODE_PARAM
+                            ? router->nodes.items[parent].param_child
+                            : router->nodes.items[parent].catch_all_child;
+    if (existing != HTTP_ROUTER_NO_NODE) {
+        const struct http_router_node* node = &router->nodes.items[existing];
+        if (node->label_len != name_len || memcmp(&router->labels.items[node->label_offset], name, name_len) != 0) {
+            return HTTP_ROUTER_NO_NODE;
+        }
+        return existing;
+    }
+
+    const uint32_t child = http_router_add_node(router, kind, name, name_len);
+    if (child == HTTP_ROUTER_NO_NODE) {
+        return HTTP_ROUTER_NO_NODE;
+    }
+
+    if (kind == HTTP_ROUTER_NODE_PARAM) {
+        router->nodes.items[parent].param_child = child;
+    } else {
+        router->nodes.items[parent].catch_all_child = child;
+    }
+    return child;
+}
+
+static uint32_t http_router_find_static_child(const struct http_router* router, uint32_t parent, char first_byte)
+{
+    uint32_t child = router->nodes.items[parent].first_child;
+    while (child != HTTP_ROUTER_NO_NODE) {
+        const struct http_router_node* node = &router->nodes.items[child];
+        if (router->labels.items[node->label_offset] == first_byte) {
+            return child;
+        }
+        child = node->next_sibling;
+    }
+    return HTTP_ROUTER_NO_NODE;
+}
+
+static uint32_t http_router_node_route(const struct http_router_node* node, enum http_method method)
+{
+    if (method == HTTP_METHOD_HEAD && node->routes[HTTP_METHOD_HEAD] == HTTP_ROUTER_NO_ROUTE) {
+        return node->routes[HTTP_METHOD_GET];
+    }
+    return node->routes[method];
+}
+
+/**
+ * @brief matches the rest of |path| (from |pos|) against the subtree of |node_index|.
+ *
+ * A parameter always extends to the end of its segment, so every node is entered at a single position of the path
+ * and is visited at most once: backtracking is bounded by the size of the trie, never exponential.
+ *
+ * @return the matched route, or HTTP_ROUTER_NO_ROUTE. |out_path_match| gets the first node matching the whole path
+ *         without a route for |method| (to answer 405 instead of 404).
+ */
+static uint32_t http_router_match_node(const struct http_router* router,
+                                       uint32_t node_index,
+                                       enum http_method method,
+                                       struct str_slice path,
+                                       size_t pos,
+                                       struct http_route_params* params,
+                                       uint32_t* out_path_match)
+{
+    const struct http_router_node* node = &router->nodes.items[node_index];
+    const char* label = &router->labels.items[node->label_offset];
+    const size_t params_count = params->count;
+
+    switch (node->kind) {
+        case HTTP_ROUTER_NODE_STATIC:
+            if (node->label_len > path.len - pos || memcmp(path.ptr + pos, label, node->label_len) != 0) {
+                return HTTP_ROUTER_NO_ROUTE;
+            }
+            pos += node->label_len;
+            break;
+
+        case HTTP_ROUTER_NODE_PARAM: {
+            const char* segment_end = memchr(path.ptr + pos, '/', path.len - pos);
+            const size_t end = segment_end != NULL ? (size_t) (segment_end - path.ptr) : path.len;
+            if (end == pos) {
+                return HTTP_ROUTER_NO_ROUTE;
+            }
+            params->names[params->count] = str_slice_from_buffer(label, node->label_len);
+            params->values[params->count] = str_slice_from_buffer(path.ptr + pos, end - pos);
+            params->count++;
+            pos = end;
+            break;
+        }
+
+        case HTTP_ROUTER_NODE_CATCH_ALL:
+            params->names[params->count] = str_slice_from_buffer(label, node->label_len);
+            params->values[params->count] = str_slice_from_buffer(path.ptr + pos, path.len - pos);
+            params->count++;
+            pos = path.len;
+            break;
+    }
+
+    if (pos == path.len) {
+        const uint32_t route = http_router_node_route(node, method);
+        if (route != HTTP_ROUTER_NO_ROUTE) {
+            return route;
+        }
+
+        if (*out_path_match == HTTP_ROUTER_NO_NODE) {
+            for (size_t m = 0; m < HTTP_METHOD_COUNT; m++) {
+                if (node->routes[m] != HTTP_ROUTER_NO_ROUTE) {
+                    *out_path_match = node_index;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (node->kind != HTTP_ROUTER_NODE_CATCH_ALL) {
+        if (pos < path.len) {
+            const uint32_t child = http_router_find_static_child(router, node_index, path.ptr[pos]);
+            if (child != HTTP_ROUTER_NO_NODE) {
+                const uint32_t route = http_router_match_node(router, child, method, path, pos, params, out_path_match);
+                if (route != HTTP_ROUTER_NO_ROUTE) {
+                    return route;
+                }
+            }
+        }
+
+        if (node->param_child != HTTP_ROUTER_NO_NODE && pos < path.len) {
+            const uint32_t route =
+                http_router_match_node(router, node->param_child, method, path, pos, params, out_path_match);
+            if (route != HTTP_ROUTER_NO_ROUTE) {
+                return route;
+            }
+        }
+
+        // a catch-all also matches an empty rest: "/files/*path" matches "/files/"
+        if (node->catch_all_child != HTTP_ROUTER_NO_NODE) {
+            const uint32_t route =
+                http_router_match_node(router, node->catch_all_child, method, path, pos, params, out_path_match);
+            if (route != HTTP_ROUTER_NO_ROUTE) {
+                return route;
+            }
+        }
+    }
+
+    params->count = params_count;
+    return HTTP_ROUTER_NO_ROUTE;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <http-server/error.h>
+#include <http-server/str.h>
+#include <http-server/arena.h>
+#include <http-server/http.h>
+#include <http-server/dynamic-array.h>
+#include "method.h"
+#include "response.h"
+#include "body.h"
+
+/**
+ * @brief max number of parameters (":name" and "*name") a single route pattern can have
+ */
+#define HTTP_ROUTER_MAX_PARAMS 8
+
+#define HTTP_ROUTER_NO_NODE UINT32_MAX
+#define HTTP_ROUTER_NO_ROUTE UINT32_MAX
+
+struct http_connection_resources;
+struct http_file;
+
+/**
+ * @brief the values captured by the parameters of the matched route pattern, in pattern order.
+ *
+ * Values are views into the request path (not percent-decoded), names are views into the router.
+ */
+struct http_route_params {
+    struct str_slice names[HTTP_ROUTER_MAX_PARAMS];
+    struct str_slice values[HTTP_ROUTER_MAX_PARAMS];
+    size_t count;
+};
+
+/**
+ * @brief the value of the parameter named |name|.
+ *
+ * @return false when the route pattern has no such parameter.
+ */
+bool http_route_params_get(const struct http_route_params* params, const char* name, struct str_slice* out_value);
+
+struct http_handler_context;
+
+/**
+ * @brief gets the request body, in order, one run of data at a time as it arrives (views into the receive buffer,
+ *        never bigger than it, only valid during the call).
+ *
+ * |status| is HTTP_BODY_STATUS_INCOMPLETE while more is to come. The last call gets HTTP_BODY_STATUS_DONE (with the
+ * last data, maybe empty): the response is reset to an empty 200 right before it and must be filled then. On
+ * HTTP_BODY_STATUS_ERROR (malformed or too large body, connection lost) the response is not sent: the handler only
+ * frees what it holds. Either way there is no call after the last one.
+ *
+ * |request_head| and |params| are NULL by then: what the handler needs from them must be copied to the arena
+ * (or |body_state|) by the handler itself.
+ */
+typedef void (*http_body_fn)(struct http_handler_context* ctx, struct str_slice data, enum http_body_status status);
+
+/**
+ * @brief everything a handler gets to answer a request, and what it can answer with.
+ */
+struct http_handler_context {
+    const struct http_request_head* request_head;
+    const struct http_route_params* params;
+
+    /**
+     * @brief the worker shared state (pools, file cache...) of the connection
+     */
+    struct http_connection_resources* resources;
+
+    /**
+     * @brief scratch memory reset once the request is answered. Response headers can point into it.
+     */
+    struct arena* arena;
+
+    /**
+     * @brief the response to fill. It is reset to an empty 200 before the handler is called.
+     */
+    struct http_response* response;
+
+    /**
+     * @brief a referenced file (see http_file_cache_acquire) the response headers point into. Its content is sent
+     *        as the response body when |send_file| is set, then the connection releases it either way.
+     */
+    struct http_file* file;
+    bool send_file;
+
+    /**
+     * @brief a malloc'ed buffer the response body points into, for bodies too big for the arena. The connection
+     *        frees it once the response is sent (or right away when it is not sent at all).
+     */
+    void* body_buffer;
+
+    /**
+     * @brief set by the handler to stream the request body (see http_body_fn). The response is then only sent
+     *        once the body is complete. Without one, the body is discarded.
+     */
+    http_body_fn body_handler;
+
+    /**
+     * @brief the handler state from one body call to the next (the arena lives until the response is sent)
+     */
+    void* body_state;
+
+    /**
+     * @brief whether the response can be cached, for routes added with http_router_add_cached. It is set before the
+     *        handler is called, which clears it for the responses that must not be (only 200s without a file nor a
+     *        streamed body are cached anyway).
+     */
+    bool cacheable;
+
+    /**
+     * @brief as given to http_router_add
+     */
+    void* user_data;
+};
+
+typedef void (*http_handler_fn)(struct http_handler_context* ctx);
+
+struct http_route {
+    enum http_method method;
+    http_handler_fn handler;
+    void* user_data;
+
+    /**
+     * @brief how long its responses are cached (0 when they are not)
+     */
+    uint32_t cache_ttl_ms;
+};
+
+/**
+ * @brief a node of the radix trie. Nodes refer to each other by index, so the trie is a few flat arrays.
+ */
+struct http_router_node {
+    enum {
+        HTTP_ROUTER_NODE_STATIC = 0,
+        HTTP_ROUTER_NODE_PARAM,
+        HTTP_ROUTER_NODE_CATCH_ALL,
+    } kind;
+
+    /**
+     * @brief the compressed edge (STATIC) or the parameter name (PARAM, CATCH_ALL), in the label pool
+     */
+    uint32_t label_offset;
+    uint32_t label_len;
+
+    /**
+     * @brief STATIC children, whose labels all start with a different byte
+     */
+    uint32_t first_child;
+    uint32_t next_sibling;
+
+    /**
+     * @brief at most one parameter child and one catch-all child, only tried when no static child matches
+     */
+    uint32_t param_child;
+    uint32_t catch_all_child;
+
+    /**
+     * @brief index of the route registered for every method on the path ending here (or HTTP_ROUTER_NO_ROUTE)
+     */
+    uint32_t routes[HTTP_METHOD_COUNT];
+};
+
+DYNAMIC_ARRAY_DEFINE(http_router_node_list, struct http_router_node)
+DYNAMIC_ARRAY_DEFINE(http_route_list, struct http_route)
+DYNAMIC_ARRAY_DEFINE(http_router_label_pool, char)
+
+/**
+ * @brief maps (method, path) pairs to handlers.
+ *
+ * Patterns are made of static segments, ":name" segments matching a single non-empty segment and a final "*name"
+ * matching the rest of the path (possibly empty). They are compiled into a radix trie as they are added, so matching
+ * is a single walk down the path, only backtracking when a static branch dead-ends. Static segments take precedence
+ * over parameters, which take precedence over catch-alls.
+ *
+ * Routes are registered at startup. Once complete, the router is only read: it is shared by every worker without
+ * any lock, and matching never allocates.
+ */
+struct http_router {
+    struct http_router_node_list nodes;
+    struct http_route_list routes;
+
+    /**
+     * @brief every label and parameter name, copied from the patterns
+     */
+    struct http_router_label_pool labels;
+};
+
+enum http_router_match_status {
+    HTTP_ROUTER_MATCH_FOUND = 0,
+    HTTP_ROUTER_MATCH_NOT_FOUND,
+
+    /**
+     * The path matched, but not with this method. The methods it matches are in |allowed_methods|.
+     */
+    HTTP_ROUTER_MATCH_METHOD_NOT_ALLOWED,
+};
+
+struct http_router_match {
+    const struct http_route* route;
+    struct http_route_params params;
+
+    /**
+     * @brief bit (1 << method) for every method registered on the matched path
+     */
+    uint32_t allowed_methods;
+};
+
+enum result http_router_init(struct http_router* router);
+void http_router_free(struct http_router* router);
+
+/**
+ * @brief registers |handler| for |method| requests whose path matches |pattern| (which must start with '/').
+ *
+ * @return RESULT_ERR on a malformed pattern, a parameter named differently than an already registered one at the
+ *         same position, a (method, pattern) pair already registered or an allocation failure.
+ */
+enum result http_router_add(struct http_router* router,
+                            enum http_method method,
+                            const char* pattern,
+                            http_handler_fn handler,
+                            void* user_data);
+
+/**
+ * @brief like http_router_add, but the responses are served from the response cache (when the server has one) for
+ *        |cache_ttl_ms| once computed (see struct http_response_cache). The handler must answer the same to the same
+ *        key: its response can only depend on the method, the request target, Accept and Accept-Encoding.
+ */
+enum result http_router_add_cached(struct http_router* router,
+                                   enum http_method method,
+                                   const char* pattern,
+                                   http_handler_fn handler,
+                                   void* user_data,
+                                   uint32_t cache_ttl_ms);
+
+/**
+ * @brief finds the route of |method| matching |path| (the request target without its query).
+ *
+ * HEAD requests fall back to the GET route of the path when there is no HEAD route. |path| must outlive |out_match|.
+ */
+enum http_router_match_status http_router_match(const struct http_router* router,
+                                                enum http_method method,
+                                                struct str_slice path,
+                                                struct http_router_match* out_match);
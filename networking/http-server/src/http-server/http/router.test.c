@@ -0,0 +1,156 @@
+/**
+ * Tests of the http/router.h matching rules: precedence (static, then parameter, then catch-all), backtracking out
+ * of dead-end static branches, parameter captures, the HEAD to GET fallback and 405 vs 404.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/router.h>
+#include <http-server/test.h>
+
+static void noop_handler(struct http_handler_context* ctx)
+{
+    (void) ctx;
+}
+
+static const struct {
+    enum http_method method;
+    const char* pattern;
+} routes[] = {
+    { HTTP_METHOD_GET,    "/" },
+    { HTTP_METHOD_GET,    "/users" },
+    { HTTP_METHOD_POST,   "/users" },
+    { HTTP_METHOD_GET,    "/users/me" },
+    { HTTP_METHOD_GET,    "/users/:id" },
+    { HTTP_METHOD_DELETE, "/users/:id" },
+    { HTTP_METHOD_GET,    "/users/:id/posts/:post" },
+    { HTTP_METHOD_GET,    "/users/mentions/recent" },
+    { HTTP_METHOD_HEAD,   "/health" },
+    { HTTP_METHOD_GET,    "/health" },
+    { HTTP_METHOD_GET,    "/static/*path" },
+    { HTTP_METHOD_GET,    "/search" },
+    { HTTP_METHOD_GET,    "/searching/:term" },
+};
+
+/**
+ * @return the index (in |routes|) of the matched route, or -1 (404) or -2 (405)
+ */
+static int match(const struct http_router* router,
+                 enum http_method method,
+                 const char* path,
+                 struct http_router_match* out_match)
+{
+    switch (http_router_match(router, method, str_slice_from_cstr_trusted(path), out_match)) {
+        case HTTP_ROUTER_MATCH_FOUND:
+            return (int) (intptr_t) out_match->route->user_data;
+        case HTTP_ROUTER_MATCH_NOT_FOUND:
+            return -1;
+        case HTTP_ROUTER_MATCH_METHOD_NOT_ALLOWED:
+            return -2;
+    }
+    return -3;
+}
+
+static bool param_is(const struct http_router_match* m, const char* name, const char* expected)
+{
+    struct str_slice value;
+    return http_route_params_get(&m->params, name, &value)
+        && value.len == strlen(expected)
+        && memcmp(value.ptr, expected, value.len) == 0;
+}
+
+static void test_matching(const struct http_router* router)
+{
+    struct http_router_match m;
+
+    CHECK(match(router, HTTP_METHOD_GET, "/", &m) == 0);
+    CHECK(match(router, HTTP_METHOD_GET, "/users", &m) == 1);
+    CHECK(match(router, HTTP_METHOD_POST, "/users", &m) == 2);
+
+    // static wins over the parameter, which still gets everything else
+    CHECK(match(router, HTTP_METHOD_GET, "/users/me", &m) == 3 && m.params.count == 0);
+    CHECK(match(router, HTTP_METHOD_GET, "/users/42", &m) == 4 && param_is(&m, "id", "42"));
+    CHECK(match(router, HTTP_METHOD_DELETE, "/users/42", &m) == 5 && param_is(&m, "id", "42"));
+
+    // "me" and "mentions/recent" share a prefix with these: the static branch dead-ends and the parameter matches
+    CHECK(match(router, HTTP_METHOD_GET, "/users/mel", &m) == 4 && param_is(&m, "id", "mel"));
+    CHECK(match(router, HTTP_METHOD_GET, "/users/mentions", &m) == 4 && param_is(&m, "id", "mentions"));
+    CHECK(match(router, HTTP_METHOD_GET, "/users/mentions/recent", &m) == 7);
+
+    CHECK(match(router, HTTP_METHOD_GET, "/users/42/posts/7", &m) == 6 && m.params.count == 2
+          && param_is(&m, "id", "42") && param_is(&m, "post", "7"));
+    CHECK(match(router, HTTP_METHOD_GET, "/users/42/posts/", &m) == -1);
+    CHECK(match(router, HTTP_METHOD_GET, "/users/42/posts", &m) == -1);
+
+    // a route with its own HEAD, a GET only one falling back for HEAD
+    CHECK(match(router, HTTP_METHOD_HEAD, "/health", &m) == 8);
+    CHECK(match(router, HTTP_METHOD_HEAD, "/users/me", &m) == 3);
+
+    CHECK(match(router, HTTP_METHOD_GET, "/static/css/site.css", &m) == 10 && param_is(&m, "path", "css/site.css"));
+    CHECK(match(router, HTTP_METHOD_GET, "/static/", &m) == 10 && param_is(&m, "path", ""));
+    CHECK(match(router, HTTP_METHOD_GET, "/static", &m) == -1);
+
+    CHECK(match(router, HTTP_METHOD_GET, "/search", &m) == 11);
+    CHECK(match(router, HTTP_METHOD_GET, "/searching/cats", &m) == 12 && param_is(&m, "term", "cats"));
+    CHECK(match(router, HTTP_METHOD_GET, "/searc", &m) == -1);
+    CHECK(match(router, HTTP_METHOD_GET, "/searchin", &m) == -1);
+    CHECK(match(router, HTTP_METHOD_GET, "/nope", &m) == -1);
+    CHECK(match(router, HTTP_METHOD_GET, "", &m) == -1);
+
+    // 405 with the methods of the path
+    CHECK(match(router, HTTP_METHOD_PUT, "/users", &m) == -2
+          && m.allowed_methods == ((UINT32_C(1) << HTTP_METHOD_GET) | (UINT32_C(1) << HTTP_METHOD_POST)));
+    CHECK(match(router, HTTP_METHOD_PUT, "/users/42", &m) == -2
+          && m.allowed_methods == ((UINT32_C(1) << HTTP_METHOD_GET) | (UINT32_C(1) << HTTP_METHOD_DELETE)));
+
+    // DELETE only exists on the parameter: "/users/me" matches it instead of being a 405 of the static route
+    CHECK(match(router, HTTP_METHOD_DELETE, "/users/me", &m) == 5 && param_is(&m, "id", "me"));
+}
+
+static void test_bad_patterns(struct http_router* router)
+{
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "users", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/users/:", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/files/*path/more", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/users/:user_id/likes", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/users/me", noop_handler, NULL) == RESULT_ERR);
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/:a/:b/:c/:d/:e/:f/:g/:h/:i", noop_handler, NULL) == RESULT_ERR);
+
+    // ':' and '*' are plain bytes in the middle of a segment
+    CHECK(http_router_add(router, HTTP_METHOD_GET, "/time/12:30", noop_handler, (void*) (intptr_t) 100) == RESULT_OK);
+    struct http_router_match m;
+    CHECK(match(router, HTTP_METHOD_GET, "/time/12:30", &m) == 100);
+}
+
+int main(void)
+{
+    struct http_router router;
+    if (http_router_init(&router) != RESULT_OK) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(routes); i++) {
+        if (http_router_add(&router, routes[i].method, routes[i].pattern, noop_handler, (void*) (intptr_t) i) != RESULT_OK) {
+            fprintf(stderr, "error: failed to add route \"%s\"\n", routes[i].pattern);
+            return 1;
+        }
+    }
+
+    test_matching(&router);
+    test_bad_patterns(&router);
+
+    const size_t node_count = router.nodes.length;
+    http_router_free(&router);
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all router checks passed (%zu routes, %zu nodes)\n", ARRAY_SIZE(routes), node_count);
+    return 0;
+}
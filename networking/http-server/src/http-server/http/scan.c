@@ -0,0 +1,475 @@
+#include "scan.h"
+
+#include <stdbool.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/////////////////////
+// Scalar (fallback) //
+/////////////////////
+
+/**
+ * @brief only 2 ascii control chars are permitted in request headers: \r and \n
+ */
+static bool is_allowed_header_byte(uint8_t byte)
+{
+    return (byte >= 0x20 && byte != 0x7f) || byte == '\r' || byte == '\n';
+}
+
+static bool is_field_value_byte(uint8_t byte)
+{
+    return (byte >= 0x20 && byte != 0x7f) || byte == '\t';
+}
+
+static bool is_target_byte(uint8_t byte)
+{
+    return byte > 0x20 && byte != 0x7f;
+}
+
+static bool is_crlf(uint8_t byte)
+{
+    return byte == '\r' || byte == '\n';
+}
+
+/**
+ * @brief the end of headers automaton: 0 -> \r -> 1 -> \n -> 2 -> \r -> 3 -> \n -> accept.
+ *
+ * A \r in state 1 keeps it there. Any other unexpected byte goes back to 0, which means that the state after a byte
+ * that is neither \r nor \n is always 0. The SIMD implementations rely on that to restart the automaton anywhere.
+ *
+ * @return the next state or 4 on accept.
+ */
+static ALWAYS_INLINE int end_of_headers_step(int state, uint8_t byte)
+{
+    if (state == 0 && byte == '\r') {
+        return 1;
+    }
+    if (state == 1 && byte == '\r') {
+        return 1;
+    }
+    if (state == 1 && byte == '\n') {
+        return 2;
+    }
+    if (state == 2 && byte == '\r') {
+        return 3;
+    }
+    if (state == 3 && byte == '\n') {
+        return 4;
+    }
+    return 0;
+}
+
+/**
+ * @brief runs the automaton (and the byte validation) over [*position, end).
+ *
+ * @return true if a result was reached (complete or bad byte)
+ */
+static ALWAYS_INLINE bool headers_scan_scalar_range(const uint8_t* buffer,
+                                                    size_t* position,
+                                                    size_t end,
+                                                    int* state,
+                                                    struct http_headers_scan_result* out)
+{
+    for (size_t i = *position; i < end; i++) {
+        const uint8_t byte = buffer[i];
+
+        if (!is_allowed_header_byte(byte)) {
+            *out = (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_BAD_BYTE, .offset = i };
+            return true;
+        }
+
+        *state = end_of_headers_step(*state, byte);
+        if (*state == 4) {
+            // remove the trailing \r\n which just separates headers from body.
+            *out = (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_COMPLETE, .offset = i - 2 };
+            return true;
+        }
+    }
+
+    *position = end;
+    return false;
+}
+
+static struct http_headers_scan_result headers_scan_scalar(const uint8_t* buffer, size_t buffer_size)
+{
+    struct http_headers_scan_result result = { .status = HTTP_HEADERS_SCAN_INCOMPLETE, .offset = 0 };
+    size_t position = 0;
+    int state = 0;
+    headers_scan_scalar_range(buffer, &position, buffer_size, &state, &result);
+    return result;
+}
+
+static size_t field_value_run_scalar(const char* data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && is_field_value_byte((uint8_t) data[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t target_run_scalar(const char* data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && is_target_byte((uint8_t) data[i])) {
+        i++;
+    }
+    return i;
+}
+
+/////////////////////////////////
+// SIMD (block at a time) driver //
+/////////////////////////////////
+
+#ifdef HTTP_SCAN_X86
+
+/**
+ * @brief bit i of each mask refers to the byte at block[i].
+ */
+struct block_masks {
+    /**
+     * @brief \r\n\r\n starts at byte i
+     */
+    uint32_t terminators;
+
+    /**
+     * @brief byte i is not allowed in request headers
+     */
+    uint32_t forbidden;
+};
+
+typedef struct block_masks (*block_masks_fn)(const uint8_t* block);
+typedef uint32_t (*run_mask_fn)(const uint8_t* block);
+
+/**
+ * @brief restarts the automaton at the beginning of the \r/\n run that contains |target|, unless the scalar pass
+ *        already went past that point. Every byte is walked back at most once, so the whole scan stays linear.
+ */
+static ALWAYS_INLINE void headers_scan_resync(const uint8_t* buffer, size_t target, size_t* position, int* state)
+{
+    if (*position >= target) {
+        return;
+    }
+
+    size_t run_start = target;
+    while (run_start > *position && is_crlf(buffer[run_start - 1])) {
+        run_start--;
+    }
+
+    if (run_start > *position) {
+        // buffer[run_start - 1] is neither \r nor \n, so the automaton is in state 0 here
+        *position = run_start;
+        *state = 0;
+    }
+}
+
+/**
+ * @brief block at a time version of headers_scan_scalar.
+ *
+ * Blocks with no forbidden byte and no \r\n\r\n are skipped at once. The exact automaton only runs around the
+ * terminator candidates (it may reject one, e.g. "\r\n\r\r\n\r\n"), so the results are always the scalar ones.
+ */
+static ALWAYS_INLINE struct http_headers_scan_result headers_scan_blocks(const uint8_t* buffer,
+                                                                        size_t buffer_size,
+                                                                        size_t width,
+                                                                        block_masks_fn block_masks)
+{
+    struct http_headers_scan_result result = { .status = HTTP_HEADERS_SCAN_INCOMPLETE, .offset = 0 };
+
+    // the automaton went through [0, position) and it's in |state| there
+    size_t position = 0;
+    int state = 0;
+
+    size_t i = 0;
+
+    // the terminator mask reads 3 bytes past the block
+    for (; i + width + 3 <= buffer_size; i += width) {
+        const struct block_masks masks = block_masks(buffer + i);
+        if ((masks.terminators | masks.forbidden) == 0) {
+            continue;
+        }
+
+        const size_t first_forbidden = (masks.forbidden != 0)
+                                     ? i + (size_t) __builtin_ctz(masks.forbidden)
+                                     : SIZE_MAX;
+
+        uint32_t terminators = masks.terminators;
+        while (terminators != 0) {
+            const size_t start = i + (size_t) __builtin_ctz(terminators);
+            terminators &= terminators - 1;
+
+            // terminator bytes are allowed ones, so a forbidden byte before it is reported first
+            if (first_forbidden < start) {
+                break;
+            }
+
+            headers_scan_resync(buffer, start, &position, &state);
+            if (headers_scan_scalar_range(buffer, &position, start + 4, &state, &result)) {
+                return result;
+            }
+        }
+
+        if (first_forbidden != SIZE_MAX) {
+            return (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_BAD_BYTE, .offset = first_forbidden };
+        }
+    }
+
+    headers_scan_resync(buffer, i, &position, &state);
+    headers_scan_scalar_range(buffer, &position, buffer_size, &state, &result);
+    return result;
+}
+
+static ALWAYS_INLINE size_t run_blocks(const uint8_t* data,
+                                       size_t len,
+                                       size_t width,
+                                       run_mask_fn run_mask,
+                                       bool (*is_run_byte)(uint8_t))
+{
+    size_t i = 0;
+    for (; i + width <= len; i += width) {
+        const uint32_t mask = run_mask(data + i);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+
+    while (i < len && is_run_byte(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+//////////
+// SSE2 //
+//////////
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE __m128i sse2_load(const uint8_t* p)
+{
+    return _mm_loadu_si128((const __m128i*) p);
+}
+
+/**
+ * @brief unsigned "byte <= max" for every byte (there is no unsigned byte compare in SSE2)
+ */
+__attribute__((target("sse2")))
+static ALWAYS_INLINE __m128i sse2_le_u8(__m128i v, uint8_t max)
+{
+    return _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8((char) max)), v);
+}
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE struct block_masks sse2_block_masks(const uint8_t* block)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    const __m128i b0 = sse2_load(block);
+    const __m128i b1 = sse2_load(block + 1);
+    const __m128i b2 = sse2_load(block + 2);
+    const __m128i b3 = sse2_load(block + 3);
+
+    const __m128i terminators = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, cr), _mm_cmpeq_epi8(b1, lf)),
+                                              _mm_and_si128(_mm_cmpeq_epi8(b2, cr), _mm_cmpeq_epi8(b3, lf)));
+
+    const __m128i control = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(b0, cr), _mm_cmpeq_epi8(b0, lf)),
+                                             sse2_le_u8(b0, 0x1f));
+    const __m128i forbidden = _mm_or_si128(control, _mm_cmpeq_epi8(b0, _mm_set1_epi8(0x7f)));
+
+    return (struct block_masks) {
+        .terminators = (uint32_t) _mm_movemask_epi8(terminators),
+        .forbidden = (uint32_t) _mm_movemask_epi8(forbidden),
+    };
+}
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE uint32_t sse2_field_value_mask(const uint8_t* block)
+{
+    const __m128i b = sse2_load(block);
+    const __m128i control = _mm_andnot_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\t')), sse2_le_u8(b, 0x1f));
+    return (uint32_t) _mm_movemask_epi8(_mm_or_si128(control, _mm_cmpeq_epi8(b, _mm_set1_epi8(0x7f))));
+}
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE uint32_t sse2_target_mask(const uint8_t* block)
+{
+    const __m128i b = sse2_load(block);
+    return (uint32_t) _mm_movemask_epi8(_mm_or_si128(sse2_le_u8(b, 0x20), _mm_cmpeq_epi8(b, _mm_set1_epi8(0x7f))));
+}
+
+__attribute__((target("sse2")))
+static struct http_headers_scan_result headers_scan_sse2(const uint8_t* buffer, size_t buffer_size)
+{
+    return headers_scan_blocks(buffer, buffer_size, 16, sse2_block_masks);
+}
+
+__attribute__((target("sse2")))
+static size_t field_value_run_sse2(const char* data, size_t len)
+{
+    return run_blocks((const uint8_t*) data, len, 16, sse2_field_value_mask, is_field_value_byte);
+}
+
+__attribute__((target("sse2")))
+static size_t target_run_sse2(const char* data, size_t len)
+{
+    return run_blocks((const uint8_t*) data, len, 16, sse2_target_mask, is_target_byte);
+}
+
+//////////
+// AVX2 //
+//////////
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE __m256i avx2_load(const uint8_t* p)
+{
+    return _mm256_loadu_si256((const __m256i*) p);
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE __m256i avx2_le_u8(__m256i v, uint8_t max)
+{
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8((char) max)), v);
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE struct block_masks avx2_block_masks(const uint8_t* block)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    const __m256i b0 = avx2_load(block);
+    const __m256i b1 = avx2_load(block + 1);
+    const __m256i b2 = avx2_load(block + 2);
+    const __m256i b3 = avx2_load(block + 3);
+
+    const __m256i terminators = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, cr), _mm256_cmpeq_epi8(b1, lf)),
+                                                 _mm256_and_si256(_mm256_cmpeq_epi8(b2, cr), _mm256_cmpeq_epi8(b3, lf)));
+
+    const __m256i control = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi8(b0, cr), _mm256_cmpeq_epi8(b0, lf)),
+                                                avx2_le_u8(b0, 0x1f));
+    const __m256i forbidden = _mm256_or_si256(control, _mm256_cmpeq_epi8(b0, _mm256_set1_epi8(0x7f)));
+
+    return (struct block_masks) {
+        .terminators = (uint32_t) _mm256_movemask_epi8(terminators),
+        .forbidden = (uint32_t) _mm256_movemask_epi8(forbidden),
+    };
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE uint32_t avx2_field_value_mask(const uint8_t* block)
+{
+    const __m256i b = avx2_load(block);
+    const __m256i control = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\t')), avx2_le_u8(b, 0x1f));
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(b, _mm256_set1_epi8(0x7f))));
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE uint32_t avx2_target_mask(const uint8_t* block)
+{
+    const __m256i b = avx2_load(block);
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(avx2_le_u8(b, 0x20), _mm256_cmpeq_epi8(b, _mm256_set1_epi8(0x7f))));
+}
+
+__attribute__((target("avx2")))
+static struct http_headers_scan_result headers_scan_avx2(const uint8_t* buffer, size_t buffer_size)
+{
+    return headers_scan_blocks(buffer, buffer_size, 32, avx2_block_masks);
+}
+
+__attribute__((target("avx2")))
+static size_t field_value_run_avx2(const char* data, size_t len)
+{
+    return run_blocks((const uint8_t*) data, len, 32, avx2_field_value_mask, is_field_value_byte);
+}
+
+__attribute__((target("avx2")))
+static size_t target_run_avx2(const char* data, size_t len)
+{
+    return run_blocks((const uint8_t*) data, len, 32, avx2_target_mask, is_target_byte);
+}
+
+#endif // HTTP_SCAN_X86
+
+////////////////////////
+// Runtime selection //
+////////////////////////
+
+static const struct http_scan_impl impls[HTTP_SCAN_ISA_COUNT] = {
+    [HTTP_SCAN_ISA_SCALAR] = {
+        .isa = HTTP_SCAN_ISA_SCALAR,
+        .name = "scalar",
+        .headers = headers_scan_scalar,
+        .field_value_run = field_value_run_scalar,
+        .target_run = target_run_scalar,
+    },
+#ifdef HTTP_SCAN_X86
+    [HTTP_SCAN_ISA_SSE2] = {
+        .isa = HTTP_SCAN_ISA_SSE2,
+        .name = "sse2",
+        .headers = headers_scan_sse2,
+        .field_value_run = field_value_run_sse2,
+        .target_run = target_run_sse2,
+    },
+    [HTTP_SCAN_ISA_AVX2] = {
+        .isa = HTTP_SCAN_ISA_AVX2,
+        .name = "avx2",
+        .headers = headers_scan_avx2,
+        .field_value_run = field_value_run_avx2,
+        .target_run = target_run_avx2,
+    },
+#endif
+};
+
+static const struct http_scan_impl* selected_impl = &impls[HTTP_SCAN_ISA_SCALAR];
+static pthread_once_t selected_impl_once = PTHREAD_ONCE_INIT;
+
+static void http_scan_select(void)
+{
+    for (int isa = HTTP_SCAN_ISA_COUNT - 1; isa > HTTP_SCAN_ISA_SCALAR; isa--) {
+        const struct http_scan_impl* impl = http_scan_impl_get((enum http_scan_isa) isa);
+        if (impl != NULL) {
+            selected_impl = impl;
+            return;
+        }
+    }
+}
+
+const struct http_scan_impl* http_scan(void)
+{
+    pthread_once(&selected_impl_once, http_scan_select);
+    return selected_impl;
+}
+
+const struct http_scan_impl* http_scan_impl_get(enum http_scan_isa isa)
+{
+    assert(isa < HTTP_SCAN_ISA_COUNT);
+
+    switch (isa) {
+        case HTTP_SCAN_ISA_SCALAR:
+            return &impls[isa];
+        case HTTP_SCAN_ISA_SSE2:
+#ifdef HTTP_SCAN_X86
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2") ? &impls[isa] : NULL;
+#else
+            return NULL;
+#endif
+        case HTTP_SCAN_ISA_AVX2:
+#ifdef HTTP_SCAN_X86
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &impls[isa] : NULL;
+#else
+            return NULL;
+#endif
+    }
+
+    return NULL;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Byte scanning primitives of the request head hot paths, with SIMD implementations selected at runtime.
+ *
+ * Every implementation gives exactly the same results as the scalar one. Only the speed differs.
+ */
+
+enum http_scan_isa {
+    HTTP_SCAN_ISA_SCALAR = 0,
+    HTTP_SCAN_ISA_SSE2,
+    HTTP_SCAN_ISA_AVX2,
+};
+#define HTTP_SCAN_ISA_COUNT 3
+
+enum http_headers_scan_status {
+    /**
+     * The end of the headers was found before any forbidden byte.
+     */
+    HTTP_HEADERS_SCAN_COMPLETE = 0,
+
+    /**
+     * A forbidden byte ('\0' or any control char but \r and \n) was found before the end of the headers.
+     */
+    HTTP_HEADERS_SCAN_BAD_BYTE,
+
+    /**
+     * Every byte is allowed but the end of the headers was not found.
+     */
+    HTTP_HEADERS_SCAN_INCOMPLETE,
+};
+
+struct http_headers_scan_result {
+    enum http_headers_scan_status status;
+
+    /**
+     * @brief COMPLETE: the end of headers offset (as reported by http_headers_validate).
+     *        BAD_BYTE: the offset of the forbidden byte.
+     */
+    size_t offset;
+};
+
+struct http_scan_impl {
+    enum http_scan_isa isa;
+    const char* name;
+
+    /**
+     * @brief looks for forbidden bytes and for the \r\n\r\n terminator. See http_headers_validate.
+     */
+    struct http_headers_scan_result (*headers)(const uint8_t* buffer, size_t buffer_size);
+
+    /**
+     * @return the length of the longest prefix made of header field value bytes (visible chars, obs-text, SP, HTAB).
+     */
+    size_t (*field_value_run)(const char* data, size_t len);
+
+    /**
+     * @return the length of the longest prefix made of request-target bytes (visible chars and obs-text).
+     */
+    size_t (*target_run)(const char* data, size_t len);
+};
+
+/**
+ * @brief the fastest implementation supported by this cpu. It is selected once, on the first call.
+ */
+const struct http_scan_impl* http_scan(void);
+
+/**
+ * @return a specific implementation or NULL when this build/cpu does not support it.
+ */
+const struct http_scan_impl* http_scan_impl_get(enum http_scan_isa isa);
@@ -0,0 +1,286 @@
+/**
+ * Property tests of the http/scan.h implementations.
+ *
+ * Every implementation supported by this cpu must give the same results as the reference below, which is the
+ * byte at a time http_headers_validate loop that was used before the SIMD ones. The inputs are a corpus of edge
+ * cases plus random buffers made mostly of \r, \n and a few forbidden bytes, where the automaton is the most stressed.
+ *
+ * Usage: http-scan-test [iterations] [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include <http-server/commons.h>
+#include <http-server/http/scan.h>
+#include <http-server/test.h>
+
+#define DEFAULT_ITERATIONS 200000
+#define DEFAULT_SEED 0x9e3779b97f4a7c15ULL
+#define MAX_BUFFER_SIZE 160
+
+/////////////////
+// Reference //
+/////////////////
+
+static bool reference_is_valid_byte(uint8_t unsafe_byte)
+{
+    if (unsafe_byte == '\0') {
+        return false;
+    }
+
+    // only 2 ascii control chars are permitted in request headers: \r and \n
+    if (iscntrl((int) unsafe_byte) && unsafe_byte != '\r' && unsafe_byte != '\n') {
+        return false;
+    }
+
+    return true;
+}
+
+static struct http_headers_scan_result reference_headers(const uint8_t* buffer, size_t buffer_size)
+{
+    int state = 0;
+    for (size_t i = 0; i < buffer_size; i++) {
+        uint8_t unsafe_byte = buffer[i];
+
+        if (!reference_is_valid_byte(unsafe_byte)) {
+            return (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_BAD_BYTE, .offset = i };
+        }
+
+        if (state == 0 && unsafe_byte == '\r') {
+            state = 1;
+            continue;
+        }
+
+        if (state == 1 && unsafe_byte == '\r') {
+            continue;
+        }
+
+        if (state == 1 && unsafe_byte == '\n') {
+            state = 2;
+            continue;
+        }
+
+        if (state == 2 && unsafe_byte == '\r') {
+            state = 3;
+            continue;
+        }
+
+        if (state == 3 && unsafe_byte == '\n') {
+            return (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_COMPLETE, .offset = i - 2 };
+        }
+
+        state = 0;
+    }
+
+    return (struct http_headers_scan_result) { .status = HTTP_HEADERS_SCAN_INCOMPLETE, .offset = 0 };
+}
+
+static size_t reference_field_value_run(const char* data, size_t len)
+{
+    size_t i = 0;
+    for (; i < len; i++) {
+        const uint8_t byte = (uint8_t) data[i];
+        if ((byte < 0x20 && byte != '\t') || byte == 0x7f) {
+            break;
+        }
+    }
+    return i;
+}
+
+static size_t reference_target_run(const char* data, size_t len)
+{
+    size_t i = 0;
+    for (; i < len; i++) {
+        const uint8_t byte = (uint8_t) data[i];
+        if (byte <= 0x20 || byte == 0x7f) {
+            break;
+        }
+    }
+    return i;
+}
+
+//////////////
+// Checking //
+//////////////
+
+static void dump_buffer(const uint8_t* buffer, size_t buffer_size)
+{
+    fputs("  buffer:", stderr);
+    for (size_t i = 0; i < buffer_size; i++) {
+        fprintf(stderr, " %02X", (int) buffer[i]);
+    }
+    fputs("\n", stderr);
+}
+
+static void check_buffer(const struct http_scan_impl* impl, const uint8_t* buffer, size_t buffer_size)
+{
+    const struct http_headers_scan_result expected = reference_headers(buffer, buffer_size);
+    const struct http_headers_scan_result actual = impl->headers(buffer, buffer_size);
+    if (expected.status != actual.status || expected.offset != actual.offset) {
+        fprintf(stderr, "%s: headers: expected (status=%d, offset=%zu) got (status=%d, offset=%zu)\n",
+                impl->name, (int) expected.status, expected.offset, (int) actual.status, actual.offset);
+        dump_buffer(buffer, buffer_size);
+        test_failures++;
+    }
+
+    const size_t expected_value_run = reference_field_value_run((const char*) buffer, buffer_size);
+    const size_t actual_value_run = impl->field_value_run((const char*) buffer, buffer_size);
+    if (expected_value_run != actual_value_run) {
+        fprintf(stderr, "%s: field_value_run: expected %zu got %zu\n", impl->name, expected_value_run, actual_value_run);
+        dump_buffer(buffer, buffer_size);
+        test_failures++;
+    }
+
+    const size_t expected_target_run = reference_target_run((const char*) buffer, buffer_size);
+    const size_t actual_target_run = impl->target_run((const char*) buffer, buffer_size);
+    if (expected_target_run != actual_target_run) {
+        fprintf(stderr, "%s: target_run: expected %zu got %zu\n", impl->name, expected_target_run, actual_target_run);
+        dump_buffer(buffer, buffer_size);
+        test_failures++;
+    }
+}
+
+/**
+ * @brief checks the buffer as is and with a prefix shifting it around the 16/32 bytes block boundaries.
+ */
+static void check_buffer_shifted(const struct http_scan_impl* impl, const char* input, size_t input_len)
+{
+    uint8_t buffer[MAX_BUFFER_SIZE + 64];
+    for (size_t shift = 0; shift <= 33 && shift + input_len <= sizeof(buffer); shift++) {
+        memset(buffer, 'a', shift);
+        memcpy(buffer + shift, input, input_len);
+        check_buffer(impl, buffer, shift + input_len);
+    }
+}
+
+static const char* const corpus[] = {
+    "",
+    "\r\n\r\n",
+    "\r\n\r",
+    "\r\r\n\r\n",
+    "\n\r\n\r\n",
+    "A\r\n\r\r\n\r\n",
+    "A\r\n\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost: x\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost: x\r\n\r\nbody\x01",
+    "GET / HTTP/1.1\r\nHost: x\r\n\r",
+    "GET / HTTP/1.1\r\nHost: x\x01\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost:\tx\r\n\r\n",
+    "GET /\x7f HTTP/1.1\r\n\r\n",
+    "GET /\x80\xff HTTP/1.1\r\nX: \xc3\xa9\r\n\r\n",
+    "\x1f",
+    "\x7f\r\n\r\n",
+    "0123456789abcdef0123456789abcdef0123456789abcdef\r\n\r\n",
+    "0123456789abcdef0123456789abcdef0123456789abcdef\r\n\r",
+    "0123456789abcdef0123456789abcdef0123456789abcdef\r\r\r\r\r\r\r\r\r\r\r\r\r\r\r\r\r\r\n\r\n",
+    "0123456789abcdef0123456789abcdef0123456789abcdef\r\n\r\r\n\r\r\n\r\r\n\r\r\n\r\r\n\r\r\n\r\r\n\r\n",
+    "0123456789abcdef0123456789abcdef0123456789abcdef value with spaces   \t\t",
+};
+
+static void check_corpus(const struct http_scan_impl* impl)
+{
+    fprintf(stderr, "%s:%s:%s\n", __FILE__, __func__, impl->name);
+
+    for (size_t i = 0; i < ARRAY_SIZE(corpus); i++) {
+        check_buffer_shifted(impl, corpus[i], strlen(corpus[i]));
+    }
+
+    // a \0 is a forbidden byte too (the corpus can't hold it)
+    static const char with_nul[] = "GET / HTTP/1.1\r\nX: a\0b\r\n\r\n";
+    check_buffer_shifted(impl, with_nul, sizeof(with_nul) - 1);
+}
+
+/**
+ * @brief xorshift64*, so a failing seed can be replayed.
+ */
+static uint64_t next_random(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static uint8_t random_byte(uint64_t* state)
+{
+    static const uint8_t alphabet[] = { '\r', '\n', '\r', '\n', '\r', '\n', 'a', ' ', '\t', ':', 0x00, 0x01, 0x1f, 0x7f, 0x80, 0xff };
+
+    const uint64_t r = next_random(state);
+    // mostly printable bytes, so the terminator and the forbidden bytes may show up far away from the start
+    if ((r & 3) == 0) {
+        return alphabet[(r >> 8) % ARRAY_SIZE(alphabet)];
+    }
+    if ((r & 0xff) == 1) {
+        return (uint8_t) (r >> 16);
+    }
+    return (uint8_t) (0x20 + ((r >> 16) % 0x5f));
+}
+
+static void check_random(const struct http_scan_impl* impl, size_t iterations, uint64_t seed)
+{
+    fprintf(stderr, "%s:%s:%s (iterations=%zu, seed=%llu)\n", __FILE__, __func__, impl->name, iterations, (unsigned long long) seed);
+
+    uint64_t state = seed;
+    uint8_t buffer[MAX_BUFFER_SIZE];
+
+    for (size_t i = 0; i < iterations && test_failures < 16; i++) {
+        const size_t buffer_size = (size_t) (next_random(&state) % (MAX_BUFFER_SIZE + 1));
+        const uint64_t density = next_random(&state) % 4;
+        for (size_t j = 0; j < buffer_size; j++) {
+            // some buffers are only made of the automaton bytes
+            buffer[j] = density == 0 ? (uint8_t) "\r\n\r\na"[next_random(&state) % 5] : random_byte(&state);
+        }
+        check_buffer(impl, buffer, buffer_size);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t iterations = DEFAULT_ITERATIONS;
+    uint64_t seed = DEFAULT_SEED;
+
+    if (argc > 1) {
+        unsigned long long value;
+        if (parse_ull(argv[1], &value) != RESULT_OK) {
+            fprintf(stderr, "usage: %s [iterations] [seed]\n", argv[0]);
+            return 1;
+        }
+        iterations = (size_t) value;
+    }
+    if (argc > 2) {
+        unsigned long long value;
+        if (parse_ull(argv[2], &value) != RESULT_OK || value == 0) {
+            fprintf(stderr, "usage: %s [iterations] [seed]\n", argv[0]);
+            return 1;
+        }
+        seed = (uint64_t) value;
+    }
+
+    size_t tested = 0;
+    for (int isa = 0; isa < HTTP_SCAN_ISA_COUNT; isa++) {
+        const struct http_scan_impl* impl = http_scan_impl_get((enum http_scan_isa) isa);
+        if (impl == NULL) {
+            fprintf(stderr, "skipping isa %d: not supported\n", isa);
+            continue;
+        }
+
+        check_corpus(impl);
+        check_random(impl, iterations, seed);
+        tested++;
+    }
+
+    fprintf(stderr, "selected implementation: %s\n", http_scan()->name);
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    fprintf(stderr, "OK: %zu implementations\n", tested);
+    return 0;
+}
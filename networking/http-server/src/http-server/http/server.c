@@ -1,90 +1,512 @@
 #include "server.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 
+#include <sched.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
+#include <http-server/commons.h>
 #include <http-server/config.h>
 #include <http-server/net.h>
+#include <http-server/stopwatch.h>
 #include <http-server/log.h>
 #define LOG_NAME "http/server"
 
-static enum result http_server_bind(struct http_server* server);
-static enum result http_server_listen(struct http_server* server);
+/**
+ * The listening sockets (a comma separated list of fds) and the end of the pipe to write to once ready, as handed
+ * down to a successor.
+ */
+#define HTTP_SERVER_LISTEN_FDS_ENV "HTTP_SERVER_LISTEN_FDS"
+#define HTTP_SERVER_READY_FD_ENV "HTTP_SERVER_READY_FD"
 
-enum result http_server_init(struct http_server* server, const struct config* config)
+/**
+ * @brief how long a successor gets to initialize and start its workers
+ */
+#define HTTP_SERVER_SUCCESSOR_READY_TIMEOUT_MS 10000
+
+static int* http_server_inherited_sockets(const struct config* config, size_t* out_count);
+static bool http_server_socket_is_reusable(int fd, const struct config* config);
+static int http_server_inherited_ready_fd(void);
+static char** http_server_successor_env(const struct http_server* server, int ready_fd);
+static void* http_server_worker_main(void* arg);
+static int http_server_worker_cpu(size_t worker_id, const cpu_set_t* allowed_cpus);
+
+enum result http_server_init(struct http_server* server,
+                             const struct config* config,
+                             const struct http_router* router)
 {
     assert(server != NULL);
     assert(config != NULL);
+    assert(config->workers > 0);
 
     server->config = config;
-    server->socket = tcp_socket_or_exit();
+    server->worker_count = 0;
+    server->workers = calloc(config->workers, sizeof(struct http_worker));
+    server->threads = calloc(config->workers, sizeof(pthread_t));
+    server->thread_count = 0;
+    server->response_cache = NULL;
+    server->rate_limiter = NULL;
+    server->ready_fd = http_server_inherited_ready_fd();
 
-    int opt = 1;
-    if (setsockopt(server->socket, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
-        int error_code = errno;
-        LOG_ERRORF("failed to set socket options: %s", strerror(error_code));
+    size_t inherited_count = 0;
+    int* inherited = http_server_inherited_sockets(config, &inherited_count);
+
+    if (server->workers == NULL || server->threads == NULL) {
+        LOG_ERROR("failed to allocate workers");
         goto err;
     }
 
-    if (http_server_bind(server) != RESULT_OK) {
-        goto err;
+    if (config->response_cache_size > 0) {
+        struct http_response_cache* cache = malloc(sizeof(*cache));
+        if (cache == NULL || http_response_cache_init(cache, config->response_cache_size) != RESULT_OK) {
+            LOG_ERROR("failed to create the response cache");
+            free(cache);
+            goto err;
+        }
+        server->response_cache = cache;
     }
 
-    if (http_server_listen(server) != RESULT_OK) {
-        goto err;
+    if (config->rate_limit > 0) {
+        struct http_rate_limiter* limiter = malloc(sizeof(*limiter));
+        if (limiter == NULL
+            || http_rate_limiter_init(limiter, config->rate_limit, config->rate_limit_burst,
+                                      config->rate_limit_clients) != RESULT_OK)
+        {
+            LOG_ERROR("failed to create the rate limiter");
+            free(limiter);
+            goto err;
+        }
+        server->rate_limiter = limiter;
+    }
+
+    for (size_t i = 0; i < config->workers; i++) {
+        // the worker owns the socket from now on, even when it fails
+        const int listen_socket = i < inherited_count ? inherited[i] : -1;
+        if (i < inherited_count) {
+            inherited[i] = -1;
+        }
+
+        if (http_worker_init(&server->workers[i], i, config, router, listen_socket) != RESULT_OK) {
+            LOG_ERRORF("worker %zu: initialization failed", i);
+            goto err;
+        }
+        server->workers[i].resources.response_cache = server->response_cache;
+        server->workers[i].resources.rate_limiter = server->rate_limiter;
+        server->worker_count++;
     }
-   
+
+    // NOTE with fewer workers than before, the connections waiting in the backlog of the sockets left are reset once
+    //      the predecessor closes them too
+    for (size_t i = config->workers; i < inherited_count; i++) {
+        LOG_WARNF("listening socket %d is not needed anymore with %zu worker(s). closing it", inherited[i],
+                  config->workers);
+        close(inherited[i]);
+    }
+    free(inherited);
+
     return RESULT_OK;
 
 err:
-    LOG_DEBUG("socket: closing...");
-    close(server->socket);
-    LOG_DEBUG("socket: closed.");
+    for (size_t i = 0; i < inherited_count; i++) {
+        if (inherited[i] >= 0) {
+            close(inherited[i]);
+        }
+    }
+    free(inherited);
 
+    http_server_free(server);
     return RESULT_ERR;
 }
 
-enum result http_server_bind(struct http_server* server)
+void http_server_free(struct http_server* server)
 {
     assert(server != NULL);
-    struct sockaddr_in server_address = ipv4_address_create(server->config->server_host, server->config->server_port);
 
-    LOG_DEBUGF("binding socket to address... addr=\"%s:%hu\"", server->config->server_host, server->config->server_port);
+    for (size_t i = 0; i < server->worker_count; i++) {
+        http_worker_free(&server->workers[i]);
+    }
+    server->worker_count = 0;
 
-    if (bind(server->socket, (struct sockaddr*) &server_address, sizeof(server_address)) != 0) {
-        int error_code = errno;
-        LOG_ERRORF("socket binding failed: %s", strerror(error_code));
-        return RESULT_ERR;
+    free(server->workers);
+    server->workers = NULL;
+
+    free(server->threads);
+    server->threads = NULL;
+
+    if (server->response_cache != NULL) {
+        http_response_cache_free(server->response_cache);
+        free(server->response_cache);
+        server->response_cache = NULL;
+    }
+
+    if (server->rate_limiter != NULL) {
+        http_rate_limiter_free(server->rate_limiter);
+        free(server->rate_limiter);
+        server->rate_limiter = NULL;
+    }
+
+    if (server->ready_fd >= 0) {
+        close(server->ready_fd);
+        server->ready_fd = -1;
+    }
+}
+
+enum result http_server_start(struct http_server* server)
+{
+    assert(server != NULL);
+    assert(server->worker_count > 0);
+
+    cpu_set_t allowed_cpus;
+    CPU_ZERO(&allowed_cpus);
+    bool pinning = sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) == 0;
+    if (!pinning) {
+        LOG_WARN("failed to get the process cpu affinity. workers will not be pinned");
+    }
+
+    for (size_t i = 0; i < server->worker_count; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+
+        if (pinning) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            int cpu = http_server_worker_cpu(i, &allowed_cpus);
+            CPU_SET(cpu, &cpu_set);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+            LOG_DEBUGF("worker %zu: pinned to cpu %d", i, cpu);
+        }
+
+        int rc = pthread_create(&server->threads[i], &attr, http_server_worker_main, &server->workers[i]);
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            LOG_ERRORF("worker %zu: failed to start thread: %s", i, strerror(rc));
+            http_server_drain(server, 0);
+            http_server_wait(server);
+            return RESULT_ERR;
+        }
+        server->thread_count++;
     }
 
     return RESULT_OK;
 }
 
-enum result http_server_listen(struct http_server* server)
+enum result http_server_wait(struct http_server* server)
 {
     assert(server != NULL);
 
-    LOG_DEBUGF("listening... tcp_backlog=%d", (int)server->config->tcp_backlog);
+    enum result result = RESULT_OK;
 
-    if (listen(server->socket, (int) server->config->tcp_backlog) != 0) {
+    for (size_t i = 0; i < server->thread_count; i++) {
+        void* worker_result = NULL;
+        pthread_join(server->threads[i], &worker_result);
+        if ((enum result) (intptr_t) worker_result != RESULT_OK) {
+            result = RESULT_ERR;
+        }
+    }
+    server->thread_count = 0;
+
+    return result;
+}
+
+void http_server_drain(struct http_server* server, size_t timeout_ms)
+{
+    assert(server != NULL);
+
+    const uint64_t deadline_ms = clock_monotonic_ms() + timeout_ms;
+    LOG_INFOF("draining... timeout=%zums", timeout_ms);
+
+    for (size_t i = 0; i < server->worker_count; i++) {
+        http_worker_drain(&server->workers[i], deadline_ms);
+    }
+}
+
+void http_server_notify_ready(struct http_server* server)
+{
+    assert(server != NULL);
+
+    if (server->ready_fd < 0) {
+        return;
+    }
+
+    const char ready = 1;
+    if (write(server->ready_fd, &ready, sizeof(ready)) != (ssize_t) sizeof(ready)) {
         int error_code = errno;
-        LOG_ERRORF("socket listening failed: %s", strerror(error_code));
+        LOG_ERRORF("failed to notify the previous process: %s", strerror(error_code));
+    }
+
+    close(server->ready_fd);
+    server->ready_fd = -1;
+}
+
+enum result http_server_spawn_successor(struct http_server* server, char* const argv[])
+{
+    assert(server != NULL);
+    assert(argv != NULL && argv[0] != NULL);
+
+    // the listening sockets are not close-on-exec: the write end of the pipe is the only other fd inherited
+    int ready_pipe[2];
+    if (pipe2(ready_pipe, O_CLOEXEC) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("successor: pipe failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+    if (fcntl(ready_pipe[1], F_SETFD, 0) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("successor: fcntl failed: %s", strerror(error_code));
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
         return RESULT_ERR;
     }
 
-    return RESULT_OK;
+    char** env = http_server_successor_env(server, ready_pipe[1]);
+    if (env == NULL) {
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
+        return RESULT_ERR;
+    }
+
+    // our signals are blocked (so that only the main thread gets them with sigwait), the successor's must not be
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], NULL, &attr, argv, env);
+
+    posix_spawnattr_destroy(&attr);
+    for (size_t i = 0; env[i] != NULL; i++) {
+        if (strncmp(env[i], HTTP_SERVER_LISTEN_FDS_ENV "=", strlen(HTTP_SERVER_LISTEN_FDS_ENV "=")) == 0
+            || strncmp(env[i], HTTP_SERVER_READY_FD_ENV "=", strlen(HTTP_SERVER_READY_FD_ENV "=")) == 0)
+        {
+            free(env[i]);
+        }
+    }
+    free(env);
+    close(ready_pipe[1]);
+
+    if (rc != 0) {
+        LOG_ERRORF("successor: failed to start \"%s\": %s", argv[0], strerror(rc));
+        close(ready_pipe[0]);
+        return RESULT_ERR;
+    }
+
+    LOG_INFOF("successor: started. pid=%d", (int) pid);
+
+    // it writes a byte once serving, and the pipe is closed without any if it exits first
+    struct pollfd pollfd = { .fd = ready_pipe[0], .events = POLLIN };
+    char ready = 0;
+    rc = poll(&pollfd, 1, HTTP_SERVER_SUCCESSOR_READY_TIMEOUT_MS);
+    const bool is_ready = rc == 1 && read(ready_pipe[0], &ready, sizeof(ready)) == (ssize_t) sizeof(ready);
+    close(ready_pipe[0]);
+
+    if (is_ready) {
+        LOG_INFOF("successor: serving. pid=%d", (int) pid);
+        return RESULT_OK;
+    }
+
+    if (rc == 0) {
+        LOG_ERRORF("successor: not ready within %d ms. killing it", HTTP_SERVER_SUCCESSOR_READY_TIMEOUT_MS);
+    }
+    kill(pid, SIGKILL);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(status)) {
+        LOG_ERRORF("successor: exited before serving. status=%d", WEXITSTATUS(status));
+    }
+
+    return RESULT_ERR;
 }
 
-void http_server_free(struct http_server* server)
+/**
+ * @brief the listening sockets handed down by the predecessor (see http_server_spawn_successor) that are still bound
+ *        to the configured address, in the order of their workers. The other ones are closed.
+ *
+ * @return a malloc'ed array, NULL when there is none
+ */
+static int* http_server_inherited_sockets(const struct config* config, size_t* out_count)
+{
+    *out_count = 0;
+
+    const char* value = getenv(HTTP_SERVER_LISTEN_FDS_ENV);
+    if (value == NULL || value[0] == '\0') {
+        return NULL;
+    }
+
+    size_t capacity = 1;
+    for (const char* c = value; *c != '\0'; c++) {
+        capacity += *c == ',';
+    }
+
+    int* sockets = calloc(capacity, sizeof(int));
+    if (sockets == NULL) {
+        LOG_ERROR("failed to allocate the inherited sockets");
+        return NULL;
+    }
+
+    size_t count = 0;
+    const char* cursor = value;
+    while (*cursor != '\0') {
+        char* end = NULL;
+        errno = 0;
+        const unsigned long fd = strtoul(cursor, &end, 10);
+        if (errno != 0 || end == cursor || fd > INT_MAX || (*end != ',' && *end != '\0')) {
+            LOG_ERRORF("%s: bad value: \"%s\"", HTTP_SERVER_LISTEN_FDS_ENV, value);
+            break;
+        }
+
+        if (http_server_socket_is_reusable((int) fd, config)) {
+            sockets[count++] = (int) fd;
+        } else {
+            LOG_INFOF("inherited socket %lu is not listening on the configured address anymore. closing it", fd);
+            close((int) fd);
+        }
+
+        cursor = *end == ',' ? end + 1 : end;
+    }
+
+    *out_count = count;
+    return sockets;
+}
+
+static bool http_server_socket_is_reusable(int fd, const struct config* config)
+{
+    int accepting = 0;
+    socklen_t accepting_len = sizeof(accepting);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &accepting_len) != 0 || !accepting) {
+        return false;
+    }
+
+    struct sockaddr_in address = {0};
+    socklen_t address_len = sizeof(address);
+    if (getsockname(fd, (struct sockaddr*) &address, &address_len) != 0 || address.sin_family != AF_INET) {
+        return false;
+    }
+
+    const struct sockaddr_in expected = ipv4_address_create(config->server_host, config->server_port);
+    return address.sin_addr.s_addr == expected.sin_addr.s_addr && address.sin_port == expected.sin_port;
+}
+
+static int http_server_inherited_ready_fd(void)
+{
+    const char* value = getenv(HTTP_SERVER_READY_FD_ENV);
+    if (value == NULL) {
+        return -1;
+    }
+
+    unsigned long long fd;
+    if (parse_ull(value, &fd) != RESULT_OK || fd > INT_MAX) {
+        LOG_ERRORF("%s: bad value: Not a fd", HTTP_SERVER_READY_FD_ENV);
+        return -1;
+    }
+
+    // not to be inherited any further
+    fcntl((int) fd, F_SETFD, FD_CLOEXEC);
+    return (int) fd;
+}
+
+/**
+ * @brief the environment of the successor: the one we were started with (without what the env file set, which it
+ *        loads again), with the listening sockets and |ready_fd| in place of the ones we got (if any). Only the two
+ *        variables added are malloc'ed, besides the array itself.
+ */
+static char** http_server_successor_env(const struct http_server* server, int ready_fd)
+{
+    char* const* original_env = config_original_env();
+    size_t env_count = 0;
+    while (original_env[env_count] != NULL) {
+        env_count++;
+    }
+
+    // "fd," is at most 11 chars per socket
+    const size_t listen_fds_size = sizeof(HTTP_SERVER_LISTEN_FDS_ENV "=") + server->worker_count * 12;
+    const size_t ready_fd_size = sizeof(HTTP_SERVER_READY_FD_ENV "=") + 12;
+
+    char** env = calloc(env_count + 3, sizeof(char*));
+    char* listen_fds = malloc(listen_fds_size);
+    char* ready = malloc(ready_fd_size);
+    if (env == NULL || listen_fds == NULL || ready == NULL) {
+        LOG_ERROR("successor: failed to allocate its environment");
+        free(env);
+        free(listen_fds);
+        free(ready);
+        return NULL;
+    }
+
+    size_t len = (size_t) snprintf(listen_fds, listen_fds_size, "%s=", HTTP_SERVER_LISTEN_FDS_ENV);
+    for (size_t i = 0; i < server->worker_count; i++) {
+        len += (size_t) snprintf(listen_fds + len, listen_fds_size - len, i == 0 ? "%d" : ",%d",
+                                 server->workers[i].socket);
+    }
+    snprintf(ready, ready_fd_size, "%s=%d", HTTP_SERVER_READY_FD_ENV, ready_fd);
+
+    size_t count = 0;
+    for (size_t i = 0; i < env_count; i++) {
+        if (strncmp(original_env[i], HTTP_SERVER_LISTEN_FDS_ENV "=", strlen(HTTP_SERVER_LISTEN_FDS_ENV "=")) == 0
+            || strncmp(original_env[i], HTTP_SERVER_READY_FD_ENV "=", strlen(HTTP_SERVER_READY_FD_ENV "=")) == 0)
+        {
+            continue;
+        }
+        env[count++] = original_env[i];
+    }
+    env[count++] = listen_fds;
+    env[count++] = ready;
+    env[count] = NULL;
+
+    return env;
+}
+
+static void* http_server_worker_main(void* arg)
 {
-    LOG_DEBUG("socket: closing...");
+    struct http_worker* worker = arg;
+
+    enum result result = http_worker_run(worker);
+    if (result != RESULT_OK) {
+        LOG_ERRORF("worker %zu: event loop failed", worker->id);
 
-    close(server->socket);
+        // the main thread (waiting for signals) shuts the other workers down
+        kill(getpid(), SIGTERM);
+    }
 
-    LOG_DEBUG("socket: closed.");
+    return (void*) (intptr_t) result;
 }
 
+/**
+ * @brief picks the (worker_id % N)-th cpu among the N cpus this process is allowed to run on.
+ */
+static int http_server_worker_cpu(size_t worker_id, const cpu_set_t* allowed_cpus)
+{
+    const size_t allowed_count = (size_t) CPU_COUNT(allowed_cpus);
+    assert(allowed_count > 0);
+
+    size_t nth = worker_id % allowed_count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, allowed_cpus)) {
+            continue;
+        }
+        if (nth == 0) {
+            return cpu;
+        }
+        nth--;
+    }
+
+    return 0;
+}
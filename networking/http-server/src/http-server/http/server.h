@@ -1,17 +1,87 @@
 #pragma once
 
-#include <sys/types.h>
-#include <arpa/inet.h>
+#include <stddef.h>
+
+#include <pthread.h>
 
 #include <http-server/error.h>
+#include "worker.h"
+#include "response-cache.h"
+#include "rate-limiter.h"
 
 struct config;
+struct http_router;
 
+/**
+ * @brief the http server: a set of independent workers, each one running on its own thread pinned to a core.
+ */
 struct http_server {
     const struct config* config;
-    int socket;
+
+    size_t worker_count;
+    struct http_worker* workers;
+    pthread_t* threads;
+    size_t thread_count;
+
+    /**
+     * @brief shared by every worker. NULL when disabled (see struct config).
+     */
+    struct http_response_cache* response_cache;
+
+    /**
+     * @brief the request rate of every client address, shared by every worker. NULL when disabled (see struct config).
+     */
+    struct http_rate_limiter* rate_limiter;
+
+    /**
+     * @brief where to tell the process this one replaces that it is serving (see http_server_spawn_successor). -1
+     *        when there is none.
+     */
+    int ready_fd;
 };
 
-enum result http_server_init(struct http_server* server, const struct config* config);
+/**
+ * @brief creates every worker (and its listening socket) up front, so bind/listen failures are reported
+ *        before the server is announced as ready. Every worker dispatches requests with |router|, which must
+ *        outlive the server.
+ *
+ * A server spawned by http_server_spawn_successor takes over the listening sockets of its predecessor (the ones
+ * still bound to the configured address) instead of creating new ones.
+ */
+enum result http_server_init(struct http_server* server,
+                             const struct config* config,
+                             const struct http_router* router);
 void http_server_free(struct http_server* server);
 
+/**
+ * @brief starts one thread per worker. Every signal should be blocked by then, so that the threads inherit the mask
+ *        and only the caller gets them.
+ */
+enum result http_server_start(struct http_server* server);
+
+/**
+ * @brief waits for every worker, which only return once drained (or on failure).
+ */
+enum result http_server_wait(struct http_server* server);
+
+/**
+ * @brief asks every worker to drain (see http_worker_drain), giving the requests in flight |timeout_ms| to complete.
+ */
+void http_server_drain(struct http_server* server, size_t timeout_ms);
+
+/**
+ * @brief tells the process this one replaces that it is serving, so that it can drain. Does nothing without one.
+ */
+void http_server_notify_ready(struct http_server* server);
+
+/**
+ * @brief starts a new instance of the program (|argv|, looked up in PATH as execvp does) sharing the listening
+ *        sockets, and waits for it to serve. Both accept from the same sockets in the meantime, so none is ever
+ *        closed: the caller only has to drain this server afterwards for the new process (and its configuration)
+ *        to take over without refusing a connection.
+ *
+ * @return RESULT_ERR when the new process fails to start, exits or does not get ready in time. It is gone then, and
+ *         this server carries on.
+ */
+enum result http_server_spawn_successor(struct http_server* server, char* const argv[]);
+
@@ -0,0 +1,374 @@
+/**
+ * Tests of a reload (SIGHUP) and a shutdown (SIGTERM) of a running server under pipelined keep-alive traffic.
+ *
+ * The server binary is started on a free port, and every connection sends batches of pipelined requests over and
+ * over. A connection closed by the server must have answered every request sent on it, the last one with
+ * "Connection: close": it is then re-opened (the successor or the draining process answers), except after SIGTERM.
+ * Not a single request may be lost, and both processes must exit cleanly.
+ *
+ * Usage: http-server-test <http-server binary>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <http-server/commons.h>
+#include <http-server/stopwatch.h>
+#include <http-server/test.h>
+
+#define CONNECTION_COUNT 16
+#define PIPELINE_DEPTH 8
+
+/**
+ * @brief when the signals are sent, from the start of the traffic
+ */
+#define RELOAD_AFTER_MS 300
+#define SHUTDOWN_AFTER_MS 1500
+
+/**
+ * @brief any single step (connecting, a batch, the processes exiting) taking longer fails the test
+ */
+#define STEP_TIMEOUT_MS 10000
+
+#define RECEIVE_BUFFER_SIZE (64 * 1024)
+
+extern char** environ;
+
+static const char request[] = "GET /drain-test HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+struct client_connection {
+    int socket;
+    bool done;
+
+    char buffer[RECEIVE_BUFFER_SIZE];
+    size_t len;
+};
+
+struct traffic_stats {
+    uint64_t requests_sent;
+    uint64_t responses;
+    uint64_t responses_after_reload;
+    uint64_t closed_by_server;
+    uint64_t lost;
+};
+
+static uint16_t free_port(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t address_len = sizeof(address);
+    if (fd < 0
+        || bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || getsockname(fd, (struct sockaddr*) &address, &address_len) != 0)
+    {
+        perror("free port");
+        exit(1);
+    }
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+static int connect_to(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct timeval timeout = { .tv_sec = STEP_TIMEOUT_MS / 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief starts the server in a process group of its own, which its successor joins: both are signaled at once.
+ */
+static pid_t start_server(const char* path, uint16_t port)
+{
+    char port_value[8];
+    snprintf(port_value, sizeof(port_value), "%hu", port);
+    setenv("HTTP_SERVER_HOST", "127.0.0.1", 1);
+    setenv("HTTP_SERVER_PORT", port_value, 1);
+    setenv("HTTP_SERVER_WORKERS", "2", 1);
+    setenv("HTTP_SERVER_SHUTDOWN_TIMEOUT_MS", "5000", 1);
+    setenv("HTTP_SERVER_LOG_LEVEL", "warn", 1);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+
+    pid_t pid;
+    char* argv[] = { (char*) path, NULL };
+    int rc = posix_spawn(&pid, path, NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        fprintf(stderr, "error: failed to start \"%s\": %s\n", path, strerror(rc));
+        exit(1);
+    }
+
+    const uint64_t deadline_ms = clock_monotonic_ms() + STEP_TIMEOUT_MS;
+    while (clock_monotonic_ms() < deadline_ms) {
+        int fd = connect_to(port);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        usleep(10 * 1000);
+    }
+
+    fprintf(stderr, "error: the server did not start listening\n");
+    kill(-pid, SIGKILL);
+    exit(1);
+}
+
+/**
+ * @brief reads a whole response (head and Content-Length body) from the connection.
+ *
+ * @return false when the connection is closed (or fails) first
+ */
+static bool read_response(struct client_connection* conn, bool* out_close)
+{
+    while (true) {
+        char* head_end = memmem(conn->buffer, conn->len, "\r\n\r\n", 4);
+        if (head_end != NULL) {
+            const size_t head_len = (size_t) (head_end - conn->buffer) + 4;
+            head_end[2] = '\0';
+
+            size_t body_len = 0;
+            const char* content_length = strstr(conn->buffer, "Content-Length: ");
+            if (content_length != NULL) {
+                body_len = strtoul(content_length + strlen("Content-Length: "), NULL, 10);
+            }
+
+            if (conn->len >= head_len + body_len) {
+                *out_close = strstr(conn->buffer, "Connection: close\r\n") != NULL;
+                memmove(conn->buffer, conn->buffer + head_len + body_len, conn->len - head_len - body_len);
+                conn->len -= head_len + body_len;
+                return true;
+            }
+            head_end[2] = '\r';
+        }
+
+        if (conn->len == sizeof(conn->buffer)) {
+            return false;
+        }
+
+        ssize_t rc = recv(conn->socket, conn->buffer + conn->len, sizeof(conn->buffer) - conn->len, 0);
+        if (rc <= 0) {
+            return false;
+        }
+        conn->len += (size_t) rc;
+    }
+}
+
+/**
+ * @brief sends a batch of pipelined requests and reads their responses. A connection the server closes is re-opened,
+ *        unless |reconnect| is false (it is done then).
+ */
+static void run_batch(struct client_connection* conn, uint16_t port, bool reconnect, bool reloaded,
+                      struct traffic_stats* stats)
+{
+    char batch[sizeof(request) * PIPELINE_DEPTH];
+    size_t batch_len = 0;
+    for (size_t i = 0; i < PIPELINE_DEPTH; i++) {
+        memcpy(batch + batch_len, request, sizeof(request) - 1);
+        batch_len += sizeof(request) - 1;
+    }
+
+    size_t answered = 0;
+    bool closed = false;
+    if (send(conn->socket, batch, batch_len, MSG_NOSIGNAL) == (ssize_t) batch_len) {
+        stats->requests_sent += PIPELINE_DEPTH;
+        while (answered < PIPELINE_DEPTH) {
+            bool close_after = false;
+            if (!read_response(conn, &close_after)) {
+                closed = true;
+                break;
+            }
+            answered++;
+            stats->responses++;
+            stats->responses_after_reload += reloaded ? 1 : 0;
+            if (close_after) {
+                closed = true;
+                break;
+            }
+        }
+        if (closed) {
+            // every request of the batch had to be answered before the server closed
+            stats->lost += PIPELINE_DEPTH - answered;
+        }
+    } else {
+        closed = true;
+    }
+
+    if (!closed) {
+        return;
+    }
+
+    stats->closed_by_server++;
+    close(conn->socket);
+    conn->socket = -1;
+    conn->len = 0;
+
+    if (!reconnect) {
+        conn->done = true;
+        return;
+    }
+
+    conn->socket = connect_to(port);
+    if (conn->socket < 0) {
+        fprintf(stderr, "failed to reconnect: %s\n", strerror(errno));
+        test_failures++;
+        conn->done = true;
+    }
+}
+
+/**
+ * @brief reaps the server and its successor (which became our child when the server exited)
+ */
+static void wait_for_servers(pid_t group)
+{
+    const uint64_t deadline_ms = clock_monotonic_ms() + STEP_TIMEOUT_MS;
+    size_t exited = 0;
+    while (true) {
+        int status = 0;
+        pid_t pid = waitpid(-group, &status, WNOHANG);
+        if (pid < 0) {
+            break;
+        }
+        if (pid == 0) {
+            if (clock_monotonic_ms() >= deadline_ms) {
+                fprintf(stderr, "error: the servers did not exit in time\n");
+                test_failures++;
+                kill(-group, SIGKILL);
+                while (waitpid(-group, &status, 0) > 0) {
+                }
+                return;
+            }
+            usleep(10 * 1000);
+            continue;
+        }
+
+        exited++;
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    // the one started and the one that took over
+    CHECK(exited == 2);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <http-server binary>\n", argv[0]);
+        return 1;
+    }
+
+    // the successor outlives the server that started it: it is reparented to us, to be reaped here
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        perror("prctl");
+        return 1;
+    }
+
+    const uint16_t port = free_port();
+    const pid_t group = start_server(argv[1], port);
+
+    static struct client_connection connections[CONNECTION_COUNT];
+    for (size_t i = 0; i < CONNECTION_COUNT; i++) {
+        connections[i].socket = connect_to(port);
+        connections[i].done = connections[i].socket < 0;
+        connections[i].len = 0;
+        CHECK(connections[i].socket >= 0);
+    }
+
+    struct traffic_stats stats = {0};
+    bool reloaded = false;
+    bool terminated = false;
+    uint64_t closed_before_shutdown = 0;
+
+    const uint64_t started_ms = clock_monotonic_ms();
+    while (true) {
+        const uint64_t elapsed_ms = clock_monotonic_ms() - started_ms;
+        if (!reloaded && elapsed_ms >= RELOAD_AFTER_MS) {
+            kill(-group, SIGHUP);
+            reloaded = true;
+        }
+
+        // once the successor served the connections the reload closed
+        if (reloaded && !terminated && elapsed_ms >= SHUTDOWN_AFTER_MS && stats.responses_after_reload > 0) {
+            closed_before_shutdown = stats.closed_by_server;
+            kill(-group, SIGTERM);
+            terminated = true;
+        }
+
+        if (elapsed_ms >= SHUTDOWN_AFTER_MS + STEP_TIMEOUT_MS) {
+            fprintf(stderr, "error: the traffic did not stop in time\n");
+            test_failures++;
+            break;
+        }
+
+        size_t active = 0;
+        for (size_t i = 0; i < CONNECTION_COUNT; i++) {
+            if (!connections[i].done) {
+                run_batch(&connections[i], port, !terminated, reloaded, &stats);
+                active++;
+            }
+        }
+        if (active == 0) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < CONNECTION_COUNT; i++) {
+        if (connections[i].socket >= 0) {
+            close(connections[i].socket);
+        }
+    }
+
+    wait_for_servers(group);
+
+    printf("requests: %" PRIu64 " sent, %" PRIu64 " answered (%" PRIu64 " after the reload), %" PRIu64 " lost, "
+           "%" PRIu64 " connections closed by the server\n",
+           stats.requests_sent, stats.responses, stats.responses_after_reload, stats.lost, stats.closed_by_server);
+
+    CHECK(terminated);
+    CHECK(stats.lost == 0);
+    CHECK(stats.responses == stats.requests_sent);
+
+    // the reload closed every connection once (and the new ones were served), the shutdown closed them all again
+    CHECK(closed_before_shutdown >= CONNECTION_COUNT);
+    CHECK(stats.closed_by_server >= closed_before_shutdown + CONNECTION_COUNT);
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all server drain checks passed\n");
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include "static-files.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include <http-server/log.h>
+#include "connection.h"
+#include "file-cache.h"
+#include "compression.h"
+#define LOG_NAME "http/static-files"
+
+#define HTTP_STATIC_FILES_INDEX "index.html"
+
+/**
+ * @brief bigger files are always sent as they are (with sendfile): their compressed copies would take too much memory
+ */
+#define HTTP_STATIC_FILES_COMPRESS_MAX_SIZE (1024 * 1024)
+
+enum http_static_files_path_status {
+    HTTP_STATIC_FILES_PATH_OK = 0,
+    HTTP_STATIC_FILES_PATH_BAD_REQUEST,
+    HTTP_STATIC_FILES_PATH_NOT_FOUND,
+};
+
+static enum http_static_files_path_status http_static_files_normalize_path(struct str_slice target,
+                                                                           char* out_path,
+                                                                           size_t* out_path_len);
+static int http_static_files_hex_value(char c);
+static const struct http_file_encoding* http_static_files_encode(struct http_compressor* compressor,
+                                                                 struct http_file* file,
+                                                                 enum http_content_coding coding);
+static bool http_static_files_is_not_modified(const struct http_request_head* request_head,
+                                              const struct http_file* file,
+                                              const char* etag);
+static bool http_static_files_etag_matches(struct str_slice if_none_match, const char* etag);
+static bool http_static_files_parse_http_date(struct str_slice value, time_t* out_time);
+static void http_static_files_error(struct http_response* resp, int status_code, const char* reason_phrase);
+
+void http_static_files_handler(struct http_handler_context* ctx)
+{
+    assert(ctx != NULL);
+
+    struct http_file_cache* files = ctx->resources->files;
+    struct http_response* resp = ctx->response;
+    const struct http_request_head* request_head = ctx->request_head;
+
+    if (files == NULL) {
+        http_static_files_error(resp, 404, "Not Found");
+        return;
+    }
+
+    struct str_slice target = request_head->start_line.path;
+    if (ctx->params->count > 0) {
+        target = ctx->params->values[ctx->params->count - 1];
+    }
+
+    char path[HTTP_FILE_PATH_MAX_SIZE];
+    size_t path_len = 0;
+    switch (http_static_files_normalize_path(target, path, &path_len)) {
+        case HTTP_STATIC_FILES_PATH_OK:
+            break;
+        case HTTP_STATIC_FILES_PATH_BAD_REQUEST:
+            http_static_files_error(resp, 400, "Bad Request");
+            return;
+        case HTTP_STATIC_FILES_PATH_NOT_FOUND:
+            http_static_files_error(resp, 404, "Not Found");
+            return;
+    }
+
+    struct http_file* file = NULL;
+    switch (http_file_cache_acquire(files, path, path_len, &file)) {
+        case HTTP_FILE_CACHE_OK:
+            break;
+        case HTTP_FILE_CACHE_NOT_FOUND:
+            http_static_files_error(resp, 404, "Not Found");
+            return;
+        case HTTP_FILE_CACHE_ERR:
+            http_static_files_error(resp, 503, "Service Unavailable");
+            return;
+    }
+
+    // text files are sent from their compressed copy to the clients accepting it
+    struct http_compressor* compressor = &ctx->resources->compressor;
+    const bool compressible = http_compressor_is_enabled(compressor)
+                              && file->size >= HTTP_COMPRESSION_MIN_SIZE
+                              && file->size <= HTTP_STATIC_FILES_COMPRESS_MAX_SIZE
+                              && http_content_type_is_compressible(str_slice_from_cstr_trusted(file->content_type));
+    const enum http_content_coding coding = compressible
+                                            ? http_content_coding_negotiate(request_head)
+                                            : HTTP_CONTENT_CODING_IDENTITY;
+    const struct http_file_encoding* encoding = coding != HTTP_CONTENT_CODING_IDENTITY
+                                                ? http_static_files_encode(compressor, file, coding)
+                                                : NULL;
+    const char* etag = encoding != NULL ? encoding->etag : file->etag;
+
+    const bool not_modified = http_static_files_is_not_modified(request_head, file, etag);
+    if (not_modified) {
+        http_response_reset(resp, 304, "Not Modified");
+    } else {
+        http_response_reset(resp, 200, "OK");
+        http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                       str_slice_from_cstr_trusted(file->content_type));
+    }
+    http_response_add_header(resp, str_slice_from_cstr_trusted("ETag"), str_slice_from_cstr_trusted(etag));
+    http_response_add_header(resp, str_slice_from_cstr_trusted("Last-Modified"),
+                                   str_slice_from_cstr_trusted(file->last_modified));
+    if (compressible) {
+        http_response_add_header(resp, str_slice_from_cstr_trusted("Vary"),
+                                       str_slice_from_cstr_trusted("Accept-Encoding"));
+    }
+
+    ctx->file = file;
+
+    if (encoding != NULL) {
+        http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Encoding"),
+                                       str_slice_from_cstr_trusted(http_content_coding_cstr(coding)));
+
+        // the copy belongs to the file, which stays referenced until the response is sent
+        http_response_set_content_length(resp, encoding->len);
+        if (!not_modified) {
+            resp->body = str_slice_from_buffer(encoding->data, encoding->len);
+        }
+        ctx->send_file = false;
+        return;
+    }
+
+    // HEAD and 304 announce the length a GET would get, without any body
+    http_response_set_content_length(resp, (size_t) file->size);
+    ctx->send_file = !not_modified && file->size > 0;
+}
+
+/**
+ * @brief the copy of |file| compressed with |coding|, read and compressed on the first call. Reading blocks the
+ *        worker, but only once per file and worker.
+ *
+ * @return NULL when it is not smaller than the file itself (or on failure): the file is sent as it is then.
+ */
+static const struct http_file_encoding* http_static_files_encode(struct http_compressor* compressor,
+                                                                 struct http_file* file,
+                                                                 enum http_content_coding coding)
+{
+    struct http_file_encoding* encoding = &file->encodings[coding];
+    if (encoding->tried) {
+        return encoding->data != NULL ? encoding : NULL;
+    }
+    encoding->tried = true;
+
+    const size_t size = (size_t) file->size;
+    char* content = malloc(size);
+    if (content == NULL) {
+        LOG_ERRORF("failed to allocate %zu bytes to compress \"%s\"", size, file->path);
+        return NULL;
+    }
+
+    size_t len = 0;
+    while (len < size) {
+        const ssize_t bytes_read = pread(file->fd, content + len, size - len, (off_t) len);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            // truncated since it was opened: the next revalidation replaces it
+            LOG_WARNF("failed to read \"%s\" to compress it", file->path);
+            free(content);
+            return NULL;
+        }
+        len += (size_t) bytes_read;
+    }
+
+    void* data = NULL;
+    size_t data_len = 0;
+    enum result result = http_compressor_compress(compressor, coding, str_slice_from_buffer(content, size), &data, &data_len);
+    free(content);
+    if (result != RESULT_OK) {
+        return NULL;
+    }
+    if (data_len >= size) {
+        free(data);
+        return NULL;
+    }
+
+    // "size-mtime" becomes "size-mtime-gzip"
+    snprintf(encoding->etag, sizeof(encoding->etag), "%.*s-%s\"",
+             (int) (strlen(file->etag) - 1), file->etag, http_content_coding_cstr(coding));
+    encoding->data = data;
+    encoding->len = data_len;
+
+    LOG_DEBUGF("\"%s\" compressed with %s: %zu -> %zu bytes", file->path, http_content_coding_cstr(coding), size, data_len);
+    return encoding;
+}
+
+/**
+ * @brief maps a request path (without its query) to a path relative to the document root.
+ *
+ * Percent-encoded bytes are decoded, empty and "." segments are skipped and a directory maps
+ * to its index. Anything trying to escape the document root ("..") or that could not be a file name ('\0') is
+ * never found.
+ */
+static enum http_static_files_path_status http_static_files_normalize_path(struct str_slice target,
+                                                                           char* out_path,
+                                                                           size_t* out_path_len)
+{
+    size_t len = 0;
+    size_t segment_start = 0;
+    bool is_directory = true;
+
+    // leading (and repeated) '/' are just empty segments
+    for (size_t i = 0; i <= target.len; i++) {
+        if (i == target.len || target.ptr[i] == '/') {
+            const char* segment = out_path + segment_start;
+            const size_t segment_len = len - segment_start;
+
+            if (segment_len == 0 || (segment_len == 1 && segment[0] == '.')) {
+                len = segment_start;
+                is_directory = true;
+            } else if (segment_len == 2 && segment[0] == '.' && segment[1] == '.') {
+                return HTTP_STATIC_FILES_PATH_NOT_FOUND;
+            } else {
+                is_directory = false;
+                if (i < target.len) {
+                    if (len + 1 >= HTTP_FILE_PATH_MAX_SIZE) {
+                        return HTTP_STATIC_FILES_PATH_NOT_FOUND;
+                    }
+                    out_path[len++] = '/';
+                }
+            }
+            segment_start = len;
+            continue;
+        }
+
+        char c = target.ptr[i];
+        if (c == '%') {
+            if (i + 2 >= target.len) {
+                return HTTP_STATIC_FILES_PATH_BAD_REQUEST;
+            }
+            const int high = http_static_files_hex_value(target.ptr[i + 1]);
+            const int low = http_static_files_hex_value(target.ptr[i + 2]);
+            if (high < 0 || low < 0) {
+                return HTTP_STATIC_FILES_PATH_BAD_REQUEST;
+            }
+            c = (char) (high * 16 + low);
+            i += 2;
+
+            // an encoded '/' would let a single segment span directories (and hide a "..")
+            if (c == '\0' || c == '/') {
+                return HTTP_STATIC_FILES_PATH_NOT_FOUND;
+            }
+        }
+
+        if (len + 1 >= HTTP_FILE_PATH_MAX_SIZE) {
+            return HTTP_STATIC_FILES_PATH_NOT_FOUND;
+        }
+        out_path[len++] = c;
+    }
+
+    // "/", "/docs/" or "/docs/.": the path ends with '/' (or is empty) and maps to the directory index
+    if (is_directory) {
+        if (len + sizeof(HTTP_STATIC_FILES_INDEX) > HTTP_FILE_PATH_MAX_SIZE) {
+            return HTTP_STATIC_FILES_PATH_NOT_FOUND;
+        }
+        memcpy(out_path + len, HTTP_STATIC_FILES_INDEX, sizeof(HTTP_STATIC_FILES_INDEX) - 1);
+        len += sizeof(HTTP_STATIC_FILES_INDEX) - 1;
+    }
+
+    out_path[len] = '\0';
+    *out_path_len = len;
+    return HTTP_STATIC_FILES_PATH_OK;
+}
+
+static int http_static_files_hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief RFC 9110 13.2.2: If-None-Match takes precedence, If-Modified-Since is only looked at without it.
+ */
+static bool http_static_files_is_not_modified(const struct http_request_head* request_head,
+                                              const struct http_file* file,
+                                              const char* etag)
+{
+    struct str_slice value;
+    if (http_request_head_find_header(request_head, "If-None-Match", &value)) {
+        return http_static_files_etag_matches(value, etag);
+    }
+
+    if (http_request_head_find_header(request_head, "If-Modified-Since", &value)) {
+        time_t since;
+        return http_static_files_parse_http_date(value, &since) && file->mtime.tv_sec <= since;
+    }
+
+    return false;
+}
+
+/**
+ * @brief weak comparison against every entity-tag of the list (or "*").
+ */
+static bool http_static_files_etag_matches(struct str_slice if_none_match, const char* etag)
+{
+    const struct str_slice expected = str_slice_from_cstr_trusted(etag);
+
+    while (if_none_match.len > 0) {
+        const char* comma = memchr(if_none_match.ptr, ',', if_none_match.len);
+        const size_t item_len = comma != NULL ? (size_t) (comma - if_none_match.ptr) : if_none_match.len;
+        struct str_slice item = str_slice_trim(str_slice_from_buffer(if_none_match.ptr, item_len));
+
+        if (item.len == 1 && item.ptr[0] == '*') {
+            return true;
+        }
+        if (item.len > 2 && item.ptr[0] == 'W' && item.ptr[1] == '/') {
+            item.ptr += 2;
+            item.len -= 2;
+        }
+        if (item.len == expected.len && memcmp(item.ptr, expected.ptr, item.len) == 0) {
+            return true;
+        }
+
+        if (comma == NULL) {
+            break;
+        }
+        if_none_match.ptr = comma + 1;
+        if_none_match.len -= item_len + 1;
+    }
+
+    return false;
+}
+
+/**
+ * @brief only the IMF-fixdate format (the one every client sends back from Last-Modified).
+ */
+static bool http_static_files_parse_http_date(struct str_slice value, time_t* out_time)
+{
+    char date[64];
+    if (value.len >= sizeof(date)) {
+        return false;
+    }
+    memcpy(date, value.ptr, value.len);
+    date[value.len] = '\0';
+
+    struct tm tm = {0};
+    const char* end = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+        return false;
+    }
+
+    *out_time = timegm(&tm);
+    return *out_time != (time_t) -1;
+}
+
+static void http_static_files_error(struct http_response* resp, int status_code, const char* reason_phrase)
+{
+    http_response_reset(resp, status_code, reason_phrase);
+    http_response_add_header(resp, str_slice_from_cstr_trusted("Content-Type"),
+                                   str_slice_from_cstr_trusted("text/plain; charset=utf-8"));
+    resp->body = str_slice_from_cstr_trusted(reason_phrase);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "router.h"
+
+/**
+ * @brief a GET route handler serving the files under the document root (see struct http_connection_resources).
+ *
+ * The file is the one at the value of the route last parameter (e.g. the "*path" catch-all of a "/static/" route),
+ * or at the request path when the route has none. Its content is never copied to the response body: it is sent
+ * right after the response head with sendfile, unless the client accepts a compressed text file: the copy compressed
+ * once (per worker) and kept along with the open file is sent then. Conditional requests (If-None-Match, If-Modified-Since) matching the cached validators are
+ * answered with a 304 without touching the disk.
+ */
+void http_static_files_handler(struct http_handler_context* ctx);
@@ -0,0 +1,73 @@
+#include "upload.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <http-server/log.h>
+#define LOG_NAME "http/upload"
+
+#define FNV1A_64_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define FNV1A_64_PRIME UINT64_C(0x100000001b3)
+
+struct http_upload {
+    uint64_t size;
+    uint64_t hash;
+};
+
+static void http_upload_on_body(struct http_handler_context* ctx, struct str_slice data, enum http_body_status status);
+
+void http_upload_handler(struct http_handler_context* ctx)
+{
+    assert(ctx != NULL);
+
+    struct http_upload* upload = arena_alloc(ctx->arena, sizeof(*upload));
+    if (upload == NULL) {
+        http_response_reset(ctx->response, 503, "Service Unavailable");
+        ctx->response->body = str_slice_from_cstr_trusted("Service Unavailable\n");
+        return;
+    }
+
+    upload->size = 0;
+    upload->hash = FNV1A_64_OFFSET_BASIS;
+
+    ctx->body_state = upload;
+    ctx->body_handler = http_upload_on_body;
+}
+
+static void http_upload_on_body(struct http_handler_context* ctx, struct str_slice data, enum http_body_status status)
+{
+    struct http_upload* upload = ctx->body_state;
+
+    for (size_t i = 0; i < data.len; i++) {
+        upload->hash = (upload->hash ^ (uint8_t) data.ptr[i]) * FNV1A_64_PRIME;
+    }
+    upload->size += data.len;
+
+    switch (status) {
+        case HTTP_BODY_STATUS_INCOMPLETE:
+            return;
+        case HTTP_BODY_STATUS_ERROR:
+            // nothing to free: the state lives in the arena
+            LOG_DEBUGF("upload aborted after %" PRIu64 " bytes", upload->size);
+            return;
+        case HTTP_BODY_STATUS_DONE:
+            break;
+    }
+
+    // "size=<20 digits> fnv1a64=<16 digits>\n"
+    enum { UPLOAD_SUMMARY_SIZE = 64 };
+    char* summary = arena_alloc(ctx->arena, UPLOAD_SUMMARY_SIZE);
+    if (summary == NULL) {
+        http_response_reset(ctx->response, 503, "Service Unavailable");
+        ctx->response->body = str_slice_from_cstr_trusted("Service Unavailable\n");
+        return;
+    }
+
+    const int len = snprintf(summary, UPLOAD_SUMMARY_SIZE, "size=%" PRIu64 " fnv1a64=%016" PRIx64 "\n",
+                             upload->size, upload->hash);
+
+    http_response_add_header(ctx->response, str_slice_from_cstr_trusted("Content-Type"),
+                                            str_slice_from_cstr_trusted("text/plain; charset=utf-8"));
+    ctx->response->body = str_slice_from_buffer(summary, (size_t) len);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "router.h"
+
+/**
+ * @brief a POST route handler taking request bodies of any size (up to the max body size) in constant memory.
+ *
+ * The body is streamed (see http_body_fn): it is hashed as it arrives and never stored. The response is its size and
+ * FNV-1a 64 hash, so a client can check what the server got.
+ */
+void http_upload_handler(struct http_handler_context* ctx);
@@ -0,0 +1,604 @@
+#include "worker.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <http-server/commons.h>
+#include <http-server/config.h>
+#include <http-server/net.h>
+#include <http-server/stopwatch.h>
+#include <http-server/log.h>
+#define LOG_NAME "http/worker"
+
+static enum result http_worker_bind(struct http_worker* worker);
+static enum result http_worker_listen(struct http_worker* worker);
+static void http_worker_accept_all(struct http_worker* worker);
+static void http_worker_reject(struct http_worker* worker, int client_socket);
+static size_t http_worker_share(size_t total, size_t worker_count);
+static void http_worker_start_draining(struct http_worker* worker);
+static void http_worker_on_connection_events(struct http_worker* worker,
+                                             struct http_connection* conn,
+                                             uint32_t events);
+static void http_worker_close_connection(struct http_worker* worker, struct http_connection* conn);
+static bool http_worker_close_idle_connection(struct http_worker* worker, struct http_connection* conn);
+static void http_worker_expire_timeouts(struct http_worker* worker);
+static int http_worker_next_timeout_ms(const struct http_worker* worker);
+static void http_worker_rearm_timeout(struct http_worker* worker, struct http_connection* conn);
+static void http_worker_publish_metrics(struct http_worker* worker);
+
+enum result http_worker_init(struct http_worker* worker,
+                             size_t id,
+                             const struct config* config,
+                             const struct http_router* router,
+                             int listen_socket)
+{
+    assert(worker != NULL);
+    assert(config != NULL);
+
+    worker->id = id;
+    worker->config = config;
+    worker->socket = listen_socket >= 0 ? listen_socket : tcp_socket_or_exit();
+    worker->loop = (struct event_loop) { .epoll_fd = -1, .ring.fd = -1 };
+    worker->wakeup_fd = -1;
+    atomic_init(&worker->drain_deadline_ms, 0);
+    worker->draining = false;
+    timer_wheel_init(&worker->timeouts, clock_monotonic_ms());
+    worker->connection_count = 0;
+    worker->max_connections = http_worker_share(config->max_connections, config->workers);
+    worker->connections_rejected = 0;
+    worker->connections = NULL;
+    http_connection_resources_init(&worker->resources);
+    worker->resources.router = router;
+    worker->resources.max_body_size = config->max_body_size;
+    worker->resources.max_in_flight = http_worker_share(config->max_in_flight, config->workers);
+    http_compressor_init(&worker->resources.compressor, config->compression_level);
+    worker->file_cache = (struct http_file_cache) { .root_fd = -1 };
+
+    // an inherited socket is bound (with the options below) and listening already: the connections waiting in its
+    // backlog are accepted here from now on, so a reload never refuses any
+    if (listen_socket < 0) {
+        // NOTE these are option names, not flags. They can't be OR'ed together in a single setsockopt call.
+        int opt = 1;
+        if (setsockopt(worker->socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0) {
+            int error_code = errno;
+            LOG_ERRORF("failed to set socket option SO_REUSEADDR: %s", strerror(error_code));
+            goto err;
+        }
+
+        // every worker binds its own socket to the same address and the kernel load balances accepts among them
+        if (setsockopt(worker->socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+            int error_code = errno;
+            LOG_ERRORF("failed to set socket option SO_REUSEPORT: %s", strerror(error_code));
+            goto err;
+        }
+
+        // inherited by the accepted sockets. Responses are already written in one go (writev), but a head followed by
+        // a sendfile body would otherwise wait for the client delayed ack (~40ms)
+        if (setsockopt(worker->socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) != 0) {
+            int error_code = errno;
+            LOG_ERRORF("failed to set socket option TCP_NODELAY: %s", strerror(error_code));
+            goto err;
+        }
+
+        if (http_worker_bind(worker) != RESULT_OK) {
+            goto err;
+        }
+    } else {
+        LOG_INFOF("worker %zu: took over the listening socket. fd=%d", worker->id, worker->socket);
+    }
+
+    if (http_worker_listen(worker) != RESULT_OK) {
+        goto err;
+    }
+
+    // the listening socket is edge-triggered too, so accept must never block once the backlog is drained
+    if (socket_set_nonblocking(worker->socket) != RESULT_OK) {
+        goto err;
+    }
+
+    // the connections over the limit are rejected without ever being registered
+    const size_t max_streams = config->max_connections > 0 ? worker->max_connections : 0;
+    if (event_loop_init(&worker->loop, config->io_backend, max_streams) != RESULT_OK) {
+        if (config->io_backend == EVENT_LOOP_BACKEND_IO_URING) {
+            LOG_ERROR("the io_uring backend is not available here: HTTP_SERVER_IO_BACKEND=epoll works on any kernel");
+        }
+        goto err;
+    }
+
+    worker->resources.loop = &worker->loop;
+
+    if (event_loop_add_listener(&worker->loop, worker->socket, worker) != RESULT_OK) {
+        goto err;
+    }
+
+    worker->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->wakeup_fd < 0) {
+        int error_code = errno;
+        LOG_ERRORF("eventfd failed: %s", strerror(error_code));
+        goto err;
+    }
+
+    if (event_loop_add(&worker->loop, worker->wakeup_fd, EPOLLIN | EPOLLET, &worker->wakeup_fd) != RESULT_OK) {
+        goto err;
+    }
+
+    if (config->document_root != NULL) {
+        if (http_file_cache_init(&worker->file_cache, config->document_root, config->file_cache_entries) != RESULT_OK) {
+            goto err;
+        }
+        worker->resources.files = &worker->file_cache;
+    }
+
+    return RESULT_OK;
+
+err:
+    event_loop_free(&worker->loop);
+    if (worker->wakeup_fd >= 0) {
+        close(worker->wakeup_fd);
+    }
+
+    LOG_DEBUG("socket: closing...");
+    close(worker->socket);
+    LOG_DEBUG("socket: closed.");
+
+    return RESULT_ERR;
+}
+
+enum result http_worker_bind(struct http_worker* worker)
+{
+    assert(worker != NULL);
+    struct sockaddr_in server_address = ipv4_address_create(worker->config->server_host, worker->config->server_port);
+
+    LOG_DEBUGF("worker %zu: binding socket to address... addr=\"%s:%hu\"",
+               worker->id,
+               worker->config->server_host,
+               worker->config->server_port);
+
+    if (bind(worker->socket, (struct sockaddr*) &server_address, sizeof(server_address)) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("socket binding failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+enum result http_worker_listen(struct http_worker* worker)
+{
+    assert(worker != NULL);
+
+    LOG_DEBUGF("listening... tcp_backlog=%d", (int)worker->config->tcp_backlog);
+
+    if (listen(worker->socket, (int) worker->config->tcp_backlog) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("socket listening failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+void http_worker_free(struct http_worker* worker)
+{
+    // every open connection is armed: expiring them all at once closes them
+    struct timer_wheel_entry* entry;
+    while ((entry = timer_wheel_pop_expired(&worker->timeouts, UINT64_MAX - 1)) != NULL) {
+        http_worker_close_connection(worker, CONTAINER_OF(entry, struct http_connection, timeout));
+    }
+
+    http_worker_log_pool_stats(worker);
+    http_connection_resources_free(&worker->resources);
+    if (worker->resources.files != NULL) {
+        http_file_cache_free(&worker->file_cache);
+    }
+
+    event_loop_free(&worker->loop);
+    close(worker->wakeup_fd);
+
+    if (worker->socket >= 0) {
+        LOG_DEBUG("socket: closing...");
+
+        close(worker->socket);
+
+        LOG_DEBUG("socket: closed.");
+    }
+}
+
+void http_worker_log_pool_stats(const struct http_worker* worker)
+{
+    assert(worker != NULL);
+
+    const struct buffer_pool_stats* connections = &worker->resources.connections.stats;
+    const struct buffer_pool_stats* buffers = &worker->resources.buffers.stats;
+
+    LOG_INFOF("worker %zu: connection pool: hits=%zu misses=%zu in_use=%zu high_water=%zu capacity=%zu",
+              worker->id, connections->hits, connections->misses, connections->in_use, connections->high_water,
+              connections->capacity);
+    LOG_INFOF("worker %zu: buffer pool: hits=%zu misses=%zu in_use=%zu high_water=%zu capacity=%zu "
+              "arena_high_water=%zu bytes",
+              worker->id, buffers->hits, buffers->misses, buffers->in_use, buffers->high_water, buffers->capacity,
+              worker->resources.arena_high_water);
+
+    if (worker->resources.files != NULL) {
+        const struct http_file_cache_stats* files = &worker->file_cache.stats;
+        LOG_INFOF("worker %zu: file cache: hits=%zu misses=%zu evictions=%zu revalidations=%zu capacity=%zu",
+                  worker->id, files->hits, files->misses, files->evictions, files->revalidations,
+                  worker->file_cache.capacity);
+    }
+}
+
+enum result http_worker_run(struct http_worker* worker)
+{
+    assert(worker != NULL);
+
+    struct epoll_event events[HTTP_WORKER_MAX_EVENTS];
+
+    while (!worker->draining || worker->connection_count > 0) {
+        int timeout_ms = http_worker_next_timeout_ms(worker);
+
+        int ready_count = event_loop_wait(&worker->loop, events, HTTP_WORKER_MAX_EVENTS, timeout_ms);
+        if (ready_count < 0) {
+            return RESULT_ERR;
+        }
+
+        bool drain_requested = false;
+        for (int i = 0; i < ready_count; i++) {
+            if (events[i].data.ptr == worker) {
+                // the listening socket is gone once draining
+                if (!worker->draining) {
+                    http_worker_accept_all(worker);
+                }
+                continue;
+            }
+
+            // draining closes connections other than the one of the event at hand, which may still come up later in
+            // this batch: it waits for the batch to be handled
+            if (events[i].data.ptr == &worker->wakeup_fd) {
+                drain_requested = true;
+                continue;
+            }
+
+            // NOTE the event loop reports each fd at most once per wait, so a connection closed by its own event
+            //      can't leave a dangling pointer behind for the following ones.
+            http_worker_on_connection_events(worker, events[i].data.ptr, events[i].events);
+        }
+
+        if (drain_requested) {
+            http_worker_start_draining(worker);
+        }
+
+        http_worker_expire_timeouts(worker);
+        http_worker_publish_metrics(worker);
+
+        // http_worker_free closes the connections left
+        if (worker->draining && clock_monotonic_ms() >= atomic_load(&worker->drain_deadline_ms)) {
+            LOG_WARNF("worker %zu: drain deadline reached. closing %zu connection(s) with requests in flight",
+                      worker->id, worker->connection_count);
+            break;
+        }
+    }
+
+    LOG_DEBUGF("worker %zu: stopped", worker->id);
+    return RESULT_OK;
+}
+
+void http_worker_drain(struct http_worker* worker, uint64_t deadline_ms)
+{
+    assert(worker != NULL);
+    assert(deadline_ms > 0);
+
+    atomic_store(&worker->drain_deadline_ms, deadline_ms);
+
+    const uint64_t one = 1;
+    if (write(worker->wakeup_fd, &one, sizeof(one)) != (ssize_t) sizeof(one)) {
+        int error_code = errno;
+        LOG_ERRORF("worker %zu: failed to wake up: %s", worker->id, strerror(error_code));
+    }
+}
+
+/**
+ * @brief stops accepting. Every connection is closed after the response to the last request it received (see struct
+ *        http_connection_resources): the idle ones are only given HTTP_WORKER_DRAIN_IDLE_TIMEOUT_MS to send one.
+ */
+static void http_worker_start_draining(struct http_worker* worker)
+{
+    uint64_t count;
+    while (read(worker->wakeup_fd, &count, sizeof(count)) > 0) {
+    }
+
+    if (worker->draining) {
+        return;
+    }
+
+    worker->draining = true;
+    worker->resources.draining = true;
+
+    // a successor holding the same socket keeps it in our interest list, even once closed here. Removed first, so
+    // that io_uring stops accepting on it: the connections it accepted already are still taken below.
+    event_loop_remove(&worker->loop, worker->socket);
+
+    // what is already in the backlog is served. The socket itself lives on when a successor shares it, but it is
+    // destroyed with its backlog otherwise: the clients connecting past this point are refused (or reset).
+    http_worker_accept_all(worker);
+
+    close(worker->socket);
+    worker->socket = -1;
+
+    // a client may be sending its next request right now: closing under it would lose the request
+    struct http_connection* next;
+    for (struct http_connection* conn = worker->connections; conn != NULL; conn = next) {
+        next = conn->next;
+        if (conn->state != HTTP_CONNECTION_STATE_IDLE) {
+            continue;
+        }
+
+        // what it sent already is answered with "Connection: close"
+        if (http_connection_on_events(conn, EPOLLIN) == HTTP_CONNECTION_STATE_CLOSED) {
+            http_worker_close_connection(worker, conn);
+        } else {
+            http_worker_rearm_timeout(worker, conn);
+        }
+    }
+
+    LOG_INFOF("worker %zu: draining %zu connection(s)", worker->id, worker->connection_count);
+}
+
+static void http_worker_accept_all(struct http_worker* worker)
+{
+    // the address is only needed for rate limiting, and it costs a syscall of its own on io_uring
+    const bool needs_address = worker->resources.rate_limiter != NULL;
+
+    while (true) {
+        int client_socket = -1;
+        uint32_t client_address = 0;
+
+        const uint64_t accept_started_ns = clock_monotonic_ns();
+
+        const enum io_status status = event_loop_accept(&worker->loop,
+                                                        worker->socket,
+                                                        &client_socket,
+                                                        needs_address ? &client_address : NULL);
+        if (status != IO_STATUS_OK) {
+            return;
+        }
+
+        LOG_DEBUG("new client connected.");
+
+        // accepting goes on past the limit, so that the backlog is drained and the clients waiting there get an
+        // answer right away instead of timing out
+        if (worker->connection_count >= worker->max_connections) {
+            http_worker_reject(worker, client_socket);
+            continue;
+        }
+
+        struct http_connection* conn = http_connection_create(&worker->resources, client_socket, client_address);
+        if (conn == NULL) {
+            close(client_socket);
+            continue;
+        }
+
+        if (event_loop_add_stream(&worker->loop, client_socket, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, conn)
+            != RESULT_OK)
+        {
+            http_connection_destroy(conn);
+            continue;
+        }
+
+        http_worker_rearm_timeout(worker, conn);
+        worker->connection_count++;
+
+        conn->next = worker->connections;
+        if (worker->connections != NULL) {
+            worker->connections->prev = conn;
+        }
+        worker->connections = conn;
+
+        http_metrics_record(&worker->resources.metrics,
+                            HTTP_METRICS_STAGE_ACCEPT,
+                            clock_monotonic_ns() - accept_started_ns);
+    }
+}
+
+/**
+ * @brief answers a connection over max_connections with a 503 and closes it. The response is tiny, so it fits in
+ *        the socket buffer of a fresh connection: it is sent once and for all, without waiting for the request (on
+ *        io_uring, by a send and a close linked together).
+ */
+static void http_worker_reject(struct http_worker* worker, int client_socket)
+{
+    static const char response[] =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Server: http-server/0.0.0\r\n"
+        "Retry-After: 1\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+
+    LOG_DEBUGF("worker %zu: too many connections (%zu): rejecting a new one", worker->id, worker->connection_count);
+    worker->connections_rejected++;
+
+    event_loop_send_and_close(&worker->loop, client_socket, response, sizeof(response) - 1);
+}
+
+/**
+ * @brief the part of a server wide limit (0 when unlimited) that every worker gets, rounded up.
+ */
+static size_t http_worker_share(size_t total, size_t worker_count)
+{
+    if (total == 0) {
+        return SIZE_MAX;
+    }
+    return total / worker_count + (total % worker_count != 0);
+}
+
+static void http_worker_on_connection_events(struct http_worker* worker,
+                                             struct http_connection* conn,
+                                             uint32_t events)
+{
+    const enum http_connection_state previous_state = conn->state;
+    const size_t responses_sent = conn->responses_sent;
+    const uint64_t bytes_sent = conn->bytes_sent;
+    const uint64_t body_bytes_received = conn->body_bytes_received;
+
+    enum http_connection_state state = http_connection_on_events(conn, events);
+
+    // when draining, the connections that become idle (the responses queued before were keep-alive ones) wait for
+    // one more request like the others
+    if (state == HTTP_CONNECTION_STATE_CLOSED) {
+        http_worker_close_connection(worker, conn);
+        return;
+    }
+
+    // a new request started (either on an idle connection or right after a response), a response started or the
+    // connection just became idle: its deadline starts over. So does a (possibly big) response every time the
+    // client accepts more of it, and a (possibly big) request body every time more of it arrives, so that only a
+    // stalled client is timed out.
+    if (state != previous_state
+        || responses_sent != conn->responses_sent
+        || bytes_sent != conn->bytes_sent
+        || body_bytes_received != conn->body_bytes_received)
+    {
+        http_worker_rearm_timeout(worker, conn);
+    }
+}
+
+static void http_worker_close_connection(struct http_worker* worker, struct http_connection* conn)
+{
+    timer_wheel_cancel(&worker->timeouts, &conn->timeout);
+    worker->connection_count--;
+
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        worker->connections = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+
+    // closing the socket also removes it from the epoll interest list, but not from io_uring
+    event_loop_forget(&worker->loop, conn->socket);
+    http_connection_destroy(conn);
+}
+
+static void http_worker_expire_timeouts(struct http_worker* worker)
+{
+    const struct config* config = worker->config;
+    const uint64_t now_ms = clock_monotonic_ms();
+
+    struct timer_wheel_entry* entry;
+    while ((entry = timer_wheel_pop_expired(&worker->timeouts, now_ms)) != NULL) {
+        struct http_connection* conn = CONTAINER_OF(entry, struct http_connection, timeout);
+        switch (conn->state) {
+            case HTTP_CONNECTION_STATE_READING:
+                LOG_WARNF("client did not complete the request within read timeout (%zu ms)", config->read_timeout_ms);
+                break;
+            case HTTP_CONNECTION_STATE_WRITING:
+                LOG_WARNF("client did not accept more of the response within write timeout (%zu ms)",
+                          config->write_timeout_ms);
+                break;
+            case HTTP_CONNECTION_STATE_IDLE:
+            case HTTP_CONNECTION_STATE_CLOSED:
+                LOG_DEBUGF("idle keep-alive connection timed out (%zu ms)", config->connection_timeout_ms);
+                if (worker->draining) {
+                    http_worker_close_idle_connection(worker, conn);
+                    continue;
+                }
+                break;
+        }
+        http_worker_close_connection(worker, conn);
+    }
+}
+
+static int http_worker_next_timeout_ms(const struct http_worker* worker)
+{
+    uint64_t deadline_ms = timer_wheel_next_expiry(&worker->timeouts);
+    if (worker->draining) {
+        deadline_ms = MIN(deadline_ms, atomic_load(&worker->drain_deadline_ms));
+    }
+    if (deadline_ms == UINT64_MAX) {
+        return -1;
+    }
+
+    const uint64_t now_ms = clock_monotonic_ms();
+    if (deadline_ms <= now_ms) {
+        return 0;
+    }
+
+    return (int) MIN(deadline_ms - now_ms, (uint64_t) INT_MAX);
+}
+
+/**
+ * @brief closes an idle connection of a draining worker, after a last read: a request that arrived since the last
+ *        wait is still answered.
+ *
+ * @return false when the connection is kept open to answer a request (its deadline is re-armed then).
+ */
+static bool http_worker_close_idle_connection(struct http_worker* worker, struct http_connection* conn)
+{
+    const enum http_connection_state state = http_connection_on_events(conn, EPOLLIN);
+    if (state != HTTP_CONNECTION_STATE_IDLE && state != HTTP_CONNECTION_STATE_CLOSED) {
+        http_worker_rearm_timeout(worker, conn);
+        return false;
+    }
+
+    http_worker_close_connection(worker, conn);
+    return true;
+}
+
+/**
+ * @brief (re-)arms the deadline of |conn| from now, with the timeout of its state.
+ */
+static void http_worker_rearm_timeout(struct http_worker* worker, struct http_connection* conn)
+{
+    size_t timeout_ms = worker->config->read_timeout_ms;
+    if (conn->state == HTTP_CONNECTION_STATE_IDLE) {
+        timeout_ms = worker->config->connection_timeout_ms;
+        if (worker->draining) {
+            timeout_ms = MIN(timeout_ms, (size_t) HTTP_WORKER_DRAIN_IDLE_TIMEOUT_MS);
+        }
+    } else if (conn->state == HTTP_CONNECTION_STATE_WRITING) {
+        timeout_ms = worker->config->write_timeout_ms;
+    }
+
+    timer_wheel_arm(&worker->timeouts, &conn->timeout, clock_monotonic_ms() + timeout_ms);
+}
+
+/**
+ * @brief copies the counters of this worker to its metrics, where other threads can read them.
+ */
+static void http_worker_publish_metrics(struct http_worker* worker)
+{
+    struct http_metrics* metrics = &worker->resources.metrics;
+    const struct buffer_pool_stats* connections = &worker->resources.connections.stats;
+    const struct buffer_pool_stats* buffers = &worker->resources.buffers.stats;
+
+    http_metrics_publish(&metrics->connections_open, worker->connection_count);
+    http_metrics_publish(&metrics->connection_pool_capacity, connections->capacity);
+    http_metrics_publish(&metrics->buffer_pool_in_use, buffers->in_use);
+    http_metrics_publish(&metrics->buffer_pool_capacity, buffers->capacity);
+    http_metrics_publish(&metrics->arena_high_water, worker->resources.arena_high_water);
+    http_metrics_publish(&metrics->requests_in_flight, worker->resources.requests_in_flight);
+    http_metrics_publish(&metrics->requests_shed, worker->resources.requests_shed);
+    http_metrics_publish(&metrics->requests_rate_limited, worker->resources.requests_rate_limited);
+    http_metrics_publish(&metrics->connections_rejected, worker->connections_rejected);
+    http_metrics_publish(&metrics->io_syscalls, io_syscall_count());
+
+    if (worker->resources.files != NULL) {
+        const struct http_file_cache_stats* files = &worker->file_cache.stats;
+        http_metrics_publish(&metrics->file_cache_hits, files->hits);
+        http_metrics_publish(&metrics->file_cache_misses, files->misses);
+        http_metrics_publish(&metrics->file_cache_evictions, files->evictions);
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <http-server/error.h>
+#include <http-server/event-loop.h>
+#include <http-server/timer-wheel.h>
+#include "connection.h"
+#include "file-cache.h"
+
+#define HTTP_WORKER_MAX_EVENTS 256
+
+/**
+ * @brief how long an idle keep-alive connection of a draining worker is kept open for a client that may be sending
+ *        its next request already (answered with "Connection: close"), when connection_timeout_ms is longer
+ */
+#define HTTP_WORKER_DRAIN_IDLE_TIMEOUT_MS 1000
+
+struct config;
+struct http_router;
+
+/**
+ * @brief a single-threaded reactor: one listening socket plus one epoll event loop.
+ *
+ * Every worker binds its own listening socket to the same address with SO_REUSEPORT, so the kernel spreads
+ * incoming connections among them and workers never share any state (or lock) on the hot path.
+ */
+struct http_worker {
+    size_t id;
+    const struct config* config;
+
+    /**
+     * @brief the listening socket. -1 once closed, when draining.
+     */
+    int socket;
+
+    struct event_loop loop;
+
+    /**
+     * @brief an eventfd in the event loop, written to wake the worker up from another thread (see http_worker_drain)
+     */
+    int wakeup_fd;
+
+    /**
+     * @brief when the connections left are closed anyway (CLOCK_MONOTONIC ms), once asked to drain. 0 until then.
+     */
+    _Atomic uint64_t drain_deadline_ms;
+    bool draining;
+
+    /**
+     * @brief the deadline of every open connection, depending on its state: read_timeout_ms to receive a request,
+     *        write_timeout_ms for the client to accept more of a response and connection_timeout_ms to start the
+     *        next request on an idle keep-alive connection (HTTP_WORKER_DRAIN_IDLE_TIMEOUT_MS at most when draining).
+     */
+    struct timer_wheel timeouts;
+
+    size_t connection_count;
+
+    /**
+     * @brief the connections accepted beyond it get a 503 and are closed (see struct config). SIZE_MAX when
+     *        unlimited.
+     */
+    size_t max_connections;
+    size_t connections_rejected;
+
+    /**
+     * @brief every open connection (linked through their prev/next), most recently accepted first
+     */
+    struct http_connection* connections;
+
+    /**
+     * @brief every connection (and its buffers) of this worker comes from here, so no malloc/free happens per
+     *        request once its pools have grown to the peak load.
+     */
+    struct http_connection_resources resources;
+
+    /**
+     * @brief open files of the document root. Only initialized when config->document_root is set.
+     */
+    struct http_file_cache file_cache;
+};
+
+/**
+ * @brief |router| is shared by every worker and must outlive them.
+ *
+ * The worker takes over |listen_socket| when it is not -1: an already bound and listening socket inherited from the
+ * process this one replaces (see http_server_spawn_successor). A new socket is created otherwise.
+ */
+enum result http_worker_init(struct http_worker* worker,
+                             size_t id,
+                             const struct config* config,
+                             const struct http_router* router,
+                             int listen_socket);
+void http_worker_free(struct http_worker* worker);
+
+/**
+ * @brief runs the event loop: accepts new clients and progresses every connection as its socket becomes ready.
+ *        Returns once drained (see http_worker_drain).
+ */
+enum result http_worker_run(struct http_worker* worker);
+
+/**
+ * @brief asks the worker to stop: it closes its listening socket, answers the last request each connection received
+ *        with "Connection: close" (idle connections get HTTP_WORKER_DRAIN_IDLE_TIMEOUT_MS to send one) and returns
+ *        once every connection is closed, or at |deadline_ms| (CLOCK_MONOTONIC) at the latest. Thread-safe.
+ */
+void http_worker_drain(struct http_worker* worker, uint64_t deadline_ms);
+
+/**
+ * @brief logs the pool counters (hits, misses, high-water marks) of this worker.
+ */
+void http_worker_log_pool_stats(const struct http_worker* worker);
+
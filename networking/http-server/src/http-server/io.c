@@ -3,41 +3,150 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <poll.h>
-
+#include <sys/sendfile.h>
 
+#include "commons.h"
 #include "log.h"
 #define LOG_NAME "io"
 
-enum result recv_or_timeout(int fd, uint8_t* buffer, size_t buffer_size, size_t timeout_ms, ssize_t* out_bytes_read)
+static _Thread_local uint64_t io_syscalls = 0;
+
+uint64_t io_syscall_count(void)
+{
+    return io_syscalls;
+}
+
+void io_count_syscall(void)
+{
+    io_syscalls++;
+}
+
+enum io_status recv_nonblocking(int fd, uint8_t* buffer, size_t buffer_size, size_t* out_bytes_read)
 {
-    struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+    assert(buffer != NULL);
+    assert(buffer_size > 0);
+    assert(out_bytes_read != NULL);
+
+    *out_bytes_read = 0;
+
+    while (true) {
+        io_syscalls++;
+        ssize_t rc = recv(fd, buffer, buffer_size, 0);
+        if (rc > 0) {
+            *out_bytes_read = (size_t) rc;
+            return IO_STATUS_OK;
+        }
+        if (rc == 0) {
+            return IO_STATUS_EOF;
+        }
 
-    int poll_ready_count = poll(&pollfd, (nfds_t) 1, (int) timeout_ms);
-    if (poll_ready_count < 0) {
         int error_code = errno;
-        LOG_ERRORF("recv polling failed: %s", strerror(error_code));
-        return RESULT_ERR;
+        if (error_code == EINTR) {
+            continue;
+        }
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK) {
+            return IO_STATUS_WOULD_BLOCK;
+        }
+
+        LOG_WARNF("recv failed: fd=%d: %s", fd, strerror(error_code));
+        return IO_STATUS_ERR;
     }
+}
+
+enum io_status send_nonblocking(int fd, const uint8_t* buffer, size_t buffer_size, size_t* out_bytes_sent)
+{
+    assert(buffer != NULL);
+    assert(out_bytes_sent != NULL);
+
+    *out_bytes_sent = 0;
+
+    while (true) {
+        io_syscalls++;
+        ssize_t rc = send(fd, buffer, buffer_size, MSG_NOSIGNAL);
+        if (rc >= 0) {
+            *out_bytes_sent = (size_t) rc;
+            return IO_STATUS_OK;
+        }
 
-    if (poll_ready_count == 0) {
-        LOG_WARNF("read timeout triggered after %zu ms.", timeout_ms);
-        *out_bytes_read = 0;
-        return RESULT_OK;
+        int error_code = errno;
+        if (error_code == EINTR) {
+            continue;
+        }
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK) {
+            return IO_STATUS_WOULD_BLOCK;
+        }
+
+        LOG_WARNF("send failed: fd=%d: %s", fd, strerror(error_code));
+        return IO_STATUS_ERR;
     }
+}
+
+enum io_status send_iov_nonblocking(int fd, const struct iovec* iov, size_t iov_count, size_t* out_bytes_sent)
+{
+    assert(iov != NULL);
+    assert(out_bytes_sent != NULL);
+
+    *out_bytes_sent = 0;
 
-    // We are only checking POLLIN events here
-    assert(pollfd.revents & POLLIN);
+    // writev(2) has no flags: sendmsg is the same gathering write with MSG_NOSIGNAL
+    struct msghdr msg = {
+        .msg_iov = (struct iovec*) iov,
+        .msg_iovlen = MIN(iov_count, (size_t) IOV_MAX),
+    };
 
-    memset(buffer, '\0', buffer_size);
+    while (true) {
+        io_syscalls++;
+        ssize_t rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (rc >= 0) {
+            *out_bytes_sent = (size_t) rc;
+            return IO_STATUS_OK;
+        }
 
-    //NOTE -1 may not be necessary here but this makes it a null-terminated string for convenience
-    assert(buffer_size > 1);
-    *out_bytes_read = recv(fd, buffer, buffer_size - 1, MSG_DONTWAIT);
+        int error_code = errno;
+        if (error_code == EINTR) {
+            continue;
+        }
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK) {
+            return IO_STATUS_WOULD_BLOCK;
+        }
 
-    return RESULT_OK;
+        LOG_WARNF("sendmsg failed: fd=%d: %s", fd, strerror(error_code));
+        return IO_STATUS_ERR;
+    }
 }
 
+enum io_status sendfile_nonblocking(int out_fd, int in_fd, off_t* offset, size_t count, size_t* out_bytes_sent)
+{
+    assert(offset != NULL);
+    assert(out_bytes_sent != NULL);
+
+    *out_bytes_sent = 0;
+
+    while (true) {
+        io_syscalls++;
+        ssize_t rc = sendfile(out_fd, in_fd, offset, count);
+        if (rc > 0) {
+            *out_bytes_sent = (size_t) rc;
+            return IO_STATUS_OK;
+        }
+        if (rc == 0) {
+            return count == 0 ? IO_STATUS_OK : IO_STATUS_EOF;
+        }
+
+        int error_code = errno;
+        if (error_code == EINTR) {
+            continue;
+        }
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK) {
+            return IO_STATUS_WOULD_BLOCK;
+        }
+
+        LOG_WARNF("sendfile failed: out_fd=%d in_fd=%d: %s", out_fd, in_fd, strerror(error_code));
+        return IO_STATUS_ERR;
+    }
+}
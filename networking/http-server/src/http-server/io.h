@@ -4,7 +4,55 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #include "error.h"
 
-enum result recv_or_timeout(int fd, uint8_t* buffer, size_t buffer_size, size_t timeout_ms, ssize_t* out_bytes_read);
+/**
+ * Outcome of a single non-blocking I/O call.
+ */
+enum io_status {
+    IO_STATUS_OK = 0,
+    IO_STATUS_WOULD_BLOCK,
+    IO_STATUS_EOF,
+    IO_STATUS_ERR,
+};
+
+/**
+ * @brief a single recv on a non-blocking socket.
+ *
+ * @return IO_STATUS_WOULD_BLOCK when there is nothing left to be read and IO_STATUS_EOF when the peer closed its side.
+ */
+enum io_status recv_nonblocking(int fd, uint8_t* buffer, size_t buffer_size, size_t* out_bytes_read);
+
+/**
+ * @brief a single send on a non-blocking socket. It never raises SIGPIPE.
+ *
+ * @return IO_STATUS_WOULD_BLOCK when the socket send buffer is full. |out_bytes_sent| may be less than |buffer_size|.
+ */
+enum io_status send_nonblocking(int fd, const uint8_t* buffer, size_t buffer_size, size_t* out_bytes_sent);
+
+/**
+ * @brief a single gathering send (writev) of |iov_count| buffers on a non-blocking socket. It never raises SIGPIPE.
+ *
+ * @return IO_STATUS_WOULD_BLOCK when the socket send buffer is full. |out_bytes_sent| may stop in the middle of any
+ *         of the buffers.
+ */
+enum io_status send_iov_nonblocking(int fd, const struct iovec* iov, size_t iov_count, size_t* out_bytes_sent);
+
+/**
+ * @brief a single sendfile from |in_fd| (at |*offset|, which is advanced) to a non-blocking socket, so the file
+ *        content never goes through user space.
+ *
+ * @return IO_STATUS_WOULD_BLOCK when the socket send buffer is full and IO_STATUS_EOF when the file is shorter than
+ *         expected (it was truncated while being sent).
+ */
+enum io_status sendfile_nonblocking(int out_fd, int in_fd, off_t* offset, size_t count, size_t* out_bytes_sent);
 
+/**
+ * @brief the I/O syscalls the calling thread made so far: the ones of this file, of the event loop (waits,
+ *        registrations, accepts) and the ones reported with io_count_syscall. To compare the event loop backends.
+ */
+uint64_t io_syscall_count(void);
+void io_count_syscall(void);
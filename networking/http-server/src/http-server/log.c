@@ -0,0 +1,487 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ansi.h"
+#include "commons.h"
+
+static_assert((LOG_RING_CAPACITY & (LOG_RING_CAPACITY - 1)) == 0, "the ring capacity must be a power of 2");
+
+#define LOG_CACHE_LINE_SIZE 64
+
+/**
+ * @brief how long the writer sleeps when every ring is empty
+ */
+#define LOG_WRITER_IDLE_SLEEP_NS (5 * 1000 * 1000)
+
+#define LOG_OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief room left in the output buffer under which it is written out: a record never takes more (even escaped)
+ */
+#define LOG_OUTPUT_RECORD_MAX_SIZE (6 * LOG_MESSAGE_MAX_SIZE + 256)
+
+struct log_record {
+    struct timespec time;
+    const char* name;
+    pid_t thread_id;
+    uint16_t message_len;
+    uint8_t level;
+    char message[LOG_MESSAGE_MAX_SIZE];
+};
+
+/**
+ * @brief the records of a single thread. Only the owner thread moves |head| and only the writer moves |tail|.
+ */
+struct log_ring {
+    alignas(LOG_CACHE_LINE_SIZE) _Atomic size_t head;
+    alignas(LOG_CACHE_LINE_SIZE) _Atomic size_t tail;
+    alignas(LOG_CACHE_LINE_SIZE) _Atomic uint64_t dropped;
+    pid_t thread_id;
+    struct log_ring* next;
+    struct log_record records[LOG_RING_CAPACITY];
+};
+
+struct log_output {
+    char* data;
+    size_t size;
+    size_t len;
+};
+
+/**
+ * @brief the writer thread and everything it shares with the logging threads
+ */
+static struct {
+    _Atomic bool running;
+    _Atomic bool stopping;
+
+    /**
+     * @brief incremented by every log_start, so threads know their ring is from a previous run
+     */
+    _Atomic uint64_t generation;
+
+    /**
+     * @brief every ring ever registered since log_start (the rings of exited threads included)
+     */
+    _Atomic(struct log_ring*) rings;
+
+    enum log_format format;
+    int fd;
+    bool colors;
+    pthread_t thread;
+
+    uint64_t dropped_reported;
+
+    /**
+     * @brief the records dropped by the rings freed by log_stop
+     */
+    _Atomic uint64_t dropped_before;
+} log_state;
+
+static _Thread_local struct log_ring* log_thread_ring = NULL;
+static _Thread_local uint64_t log_thread_ring_generation = 0;
+
+_Atomic int log_runtime_level = LOG_LEVEL_INFO;
+
+static struct log_ring* log_ring_get(void);
+static void* log_writer_main(void* arg);
+static bool log_writer_drain(struct log_output* output);
+static void log_writer_report_dropped(struct log_output* output);
+static void log_record_init(struct log_record* record, enum log_level level, const char* name, pid_t thread_id);
+static void log_record_format(const struct log_record* record, enum log_format format, bool colors, struct log_output* output);
+static void log_output_append(struct log_output* output, const char* s, size_t len);
+static void log_output_append_json_string(struct log_output* output, const char* s, size_t len);
+static void log_output_flush(struct log_output* output, int fd);
+
+static const char* const log_level_names[] = {
+    [LOG_LEVEL_DEBUG] = "debug",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_OFF] = "off",
+};
+
+static const char* const log_level_colors[] = {
+    [LOG_LEVEL_DEBUG] = ANSI_HCYN,
+    [LOG_LEVEL_INFO] = ANSI_HGRN,
+    [LOG_LEVEL_WARN] = ANSI_HORA,
+    [LOG_LEVEL_ERROR] = ANSI_HRED,
+    [LOG_LEVEL_OFF] = "",
+};
+
+enum result log_start(enum log_level level, enum log_format format, int fd)
+{
+    assert(!atomic_load(&log_state.running));
+
+    log_state.format = format;
+    log_state.fd = fd;
+    log_state.colors = format == LOG_FORMAT_TEXT && isatty(fd);
+    log_state.dropped_reported = 0;
+    atomic_store(&log_state.rings, NULL);
+    atomic_store(&log_state.stopping, false);
+    atomic_fetch_add(&log_state.generation, 1);
+    log_set_level(level);
+
+    int rc = pthread_create(&log_state.thread, NULL, log_writer_main, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "log: failed to start the writer thread: %s\n", strerror(rc));
+        return RESULT_ERR;
+    }
+
+    atomic_store(&log_state.running, true);
+    return RESULT_OK;
+}
+
+void log_stop(void)
+{
+    if (!atomic_load(&log_state.running)) {
+        return;
+    }
+
+    atomic_store(&log_state.stopping, true);
+    pthread_join(log_state.thread, NULL);
+    atomic_store(&log_state.running, false);
+
+    // the writer drained everything before exiting
+    struct log_ring* ring = atomic_exchange(&log_state.rings, NULL);
+    while (ring != NULL) {
+        struct log_ring* next = ring->next;
+        atomic_fetch_add(&log_state.dropped_before, atomic_load(&ring->dropped));
+        free(ring);
+        ring = next;
+    }
+}
+
+void log_set_level(enum log_level level)
+{
+    atomic_store_explicit(&log_runtime_level, (int) level, memory_order_relaxed);
+}
+
+enum result log_level_parse(const char* value, enum log_level* out_level)
+{
+    assert(value != NULL);
+    assert(out_level != NULL);
+
+    for (size_t i = 0; i < ARRAY_SIZE(log_level_names); i++) {
+        if (strcmp(value, log_level_names[i]) == 0) {
+            *out_level = (enum log_level) i;
+            return RESULT_OK;
+        }
+    }
+    return RESULT_ERR;
+}
+
+enum result log_format_parse(const char* value, enum log_format* out_format)
+{
+    assert(value != NULL);
+    assert(out_format != NULL);
+
+    if (strcmp(value, "text") == 0) {
+        *out_format = LOG_FORMAT_TEXT;
+        return RESULT_OK;
+    }
+    if (strcmp(value, "json") == 0) {
+        *out_format = LOG_FORMAT_JSON;
+        return RESULT_OK;
+    }
+    return RESULT_ERR;
+}
+
+uint64_t log_dropped_records(void)
+{
+    uint64_t dropped = atomic_load(&log_state.dropped_before);
+    for (struct log_ring* ring = atomic_load(&log_state.rings); ring != NULL; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void log_write(enum log_level level, const char* name, const char* format, ...)
+{
+    va_list args;
+
+    struct log_ring* ring = atomic_load_explicit(&log_state.running, memory_order_acquire) ? log_ring_get() : NULL;
+    if (ring == NULL) {
+        // not started (or stopped): written right away, the old way
+        struct log_record record;
+        log_record_init(&record, level, name, gettid());
+
+        va_start(args, format);
+        int len = vsnprintf(record.message, sizeof(record.message), format, args);
+        va_end(args);
+        record.message_len = (uint16_t) MIN((size_t) MAX(len, 0), sizeof(record.message) - 1);
+
+        char buffer[LOG_OUTPUT_RECORD_MAX_SIZE];
+        struct log_output output = { .data = buffer, .size = sizeof(buffer), .len = 0 };
+        log_record_format(&record, LOG_FORMAT_TEXT, isatty(STDERR_FILENO), &output);
+        log_output_flush(&output, STDERR_FILENO);
+        return;
+    }
+
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == LOG_RING_CAPACITY) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct log_record* record = &ring->records[head & (LOG_RING_CAPACITY - 1)];
+    log_record_init(record, level, name, ring->thread_id);
+
+    va_start(args, format);
+    int len = vsnprintf(record->message, sizeof(record->message), format, args);
+    va_end(args);
+    record->message_len = (uint16_t) MIN((size_t) MAX(len, 0), sizeof(record->message) - 1);
+
+    // publishes the record to the writer
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief the ring of the calling thread, registered on its first record.
+ *
+ * @return NULL when it can't be allocated.
+ */
+static struct log_ring* log_ring_get(void)
+{
+    const uint64_t generation = atomic_load_explicit(&log_state.generation, memory_order_relaxed);
+    if (log_thread_ring != NULL && log_thread_ring_generation == generation) {
+        return log_thread_ring;
+    }
+
+    struct log_ring* ring = aligned_alloc(LOG_CACHE_LINE_SIZE, sizeof(struct log_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    ring->thread_id = gettid();
+
+    // lock-free push: the writer may be walking the list right now
+    ring->next = atomic_load(&log_state.rings);
+    while (!atomic_compare_exchange_weak(&log_state.rings, &ring->next, ring)) {
+    }
+
+    log_thread_ring = ring;
+    log_thread_ring_generation = generation;
+    return ring;
+}
+
+static void* log_writer_main(void* arg)
+{
+    (void) arg;
+
+    char* buffer = malloc(LOG_OUTPUT_BUFFER_SIZE);
+    if (buffer == NULL) {
+        fputs("log: failed to allocate the output buffer\n", stderr);
+        return NULL;
+    }
+    struct log_output output_buffer = { .data = buffer, .size = LOG_OUTPUT_BUFFER_SIZE, .len = 0 };
+    struct log_output* output = &output_buffer;
+
+    while (true) {
+        // read before draining, so the records logged before log_stop are all written
+        const bool stopping = atomic_load(&log_state.stopping);
+
+        const bool drained_any = log_writer_drain(output);
+        log_writer_report_dropped(output);
+        log_output_flush(output, log_state.fd);
+
+        if (stopping) {
+            break;
+        }
+
+        if (!drained_any) {
+            const struct timespec idle = { .tv_sec = 0, .tv_nsec = LOG_WRITER_IDLE_SLEEP_NS };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief formats every record buffered so far, writing the output whenever it is full.
+ *
+ * @return whether there was any record.
+ */
+static bool log_writer_drain(struct log_output* output)
+{
+    bool drained_any = false;
+
+    for (struct log_ring* ring = atomic_load(&log_state.rings); ring != NULL; ring = ring->next) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == head) {
+            continue;
+        }
+
+        drained_any = true;
+        for (; tail != head; tail++) {
+            if (output->size - output->len < LOG_OUTPUT_RECORD_MAX_SIZE) {
+                log_output_flush(output, log_state.fd);
+            }
+            log_record_format(&ring->records[tail & (LOG_RING_CAPACITY - 1)], log_state.format, log_state.colors, output);
+        }
+
+        // hands the slots back to the producer
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    return drained_any;
+}
+
+static void log_writer_report_dropped(struct log_output* output)
+{
+    uint64_t dropped = 0;
+    for (struct log_ring* ring = atomic_load(&log_state.rings); ring != NULL; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+
+    if (dropped == log_state.dropped_reported) {
+        return;
+    }
+
+    struct log_record record;
+    log_record_init(&record, LOG_LEVEL_WARN, "log", gettid());
+    int len = snprintf(record.message,
+                       sizeof(record.message),
+                       "%llu records dropped (ring buffer full), %llu so far",
+                       (unsigned long long) (dropped - log_state.dropped_reported),
+                       (unsigned long long) dropped);
+    record.message_len = (uint16_t) MIN((size_t) MAX(len, 0), sizeof(record.message) - 1);
+    log_state.dropped_reported = dropped;
+
+    if (output->size - output->len < LOG_OUTPUT_RECORD_MAX_SIZE) {
+        log_output_flush(output, log_state.fd);
+    }
+    log_record_format(&record, log_state.format, log_state.colors, output);
+}
+
+static void log_record_init(struct log_record* record, enum log_level level, const char* name, pid_t thread_id)
+{
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->name = name;
+    record->thread_id = thread_id;
+    record->level = (uint8_t) level;
+    record->message_len = 0;
+}
+
+static void log_record_format(const struct log_record* record, enum log_format format, bool colors, struct log_output* output)
+{
+    const char* level_name = log_level_names[record->level];
+
+    switch (format) {
+        case LOG_FORMAT_TEXT: {
+            if (!colors) {
+                output->len += (size_t) snprintf(output->data + output->len,
+                                                 output->size - output->len,
+                                                 "%s: %s: ",
+                                                 record->name,
+                                                 level_name);
+                log_output_append(output, record->message, record->message_len);
+                log_output_append(output, "\n", 1);
+                break;
+            }
+
+            const bool highlighted = record->level >= LOG_LEVEL_WARN;
+            output->len += (size_t) snprintf(output->data + output->len,
+                                             output->size - output->len,
+                                             ANSI_HYEL "%s" ANSI_RESET ": %s%s" ANSI_RESET ": %s",
+                                             record->name,
+                                             log_level_colors[record->level],
+                                             level_name,
+                                             highlighted ? ANSI_HWHT : "");
+            log_output_append(output, record->message, record->message_len);
+            if (highlighted) {
+                log_output_append(output, ANSI_RESET, sizeof(ANSI_RESET) - 1);
+            }
+            log_output_append(output, "\n", 1);
+            break;
+        }
+
+        case LOG_FORMAT_JSON: {
+            struct tm tm;
+            gmtime_r(&record->time.tv_sec, &tm);
+
+            output->len += (size_t) snprintf(output->data + output->len,
+                                             output->size - output->len,
+                                             "{\"ts\":\"%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ\",\"level\":\"%s\","
+                                             "\"logger\":\"%s\",\"thread\":%d,\"msg\":",
+                                             tm.tm_year + 1900,
+                                             tm.tm_mon + 1,
+                                             tm.tm_mday,
+                                             tm.tm_hour,
+                                             tm.tm_min,
+                                             tm.tm_sec,
+                                             record->time.tv_nsec / 1000,
+                                             level_name,
+                                             record->name,
+                                             (int) record->thread_id);
+            log_output_append_json_string(output, record->message, record->message_len);
+            log_output_append(output, "}\n", 2);
+            break;
+        }
+    }
+}
+
+static void log_output_append(struct log_output* output, const char* s, size_t len)
+{
+    assert(output->len + len <= output->size);
+
+    memcpy(output->data + output->len, s, len);
+    output->len += len;
+}
+
+static void log_output_append_json_string(struct log_output* output, const char* s, size_t len)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+
+    log_output_append(output, "\"", 1);
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char c = (unsigned char) s[i];
+        if (c == '"' || c == '\\') {
+            const char escaped[2] = { '\\', (char) c };
+            log_output_append(output, escaped, sizeof(escaped));
+        } else if (c < 0x20 || c == 0x7f) {
+            const char escaped[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf] };
+            log_output_append(output, escaped, sizeof(escaped));
+        } else {
+            output->data[output->len++] = (char) c;
+        }
+    }
+    log_output_append(output, "\"", 1);
+}
+
+/**
+ * @brief writes out the whole buffer. Errors are ignored: there is nowhere left to report them.
+ */
+static void log_output_flush(struct log_output* output, int fd)
+{
+    size_t written = 0;
+    while (written < output->len) {
+        ssize_t rc = write(fd, output->data + written, output->len - written);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += (size_t) rc;
+    }
+    output->len = 0;
+}
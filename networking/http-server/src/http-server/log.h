@@ -1,23 +1,116 @@
 #pragma once
 
-#include <stdio.h>
-#include "ansi.h"
+#include <stdint.h>
+#include <stdatomic.h>
 
-#define LOG_TAG       ANSI_HYEL LOG_NAME ANSI_RESET ": "
-#define LOG_TAG_DEBUG ANSI_HCYN "debug" ANSI_RESET ": "
-#define LOG_TAG_INFO  ANSI_HGRN "info" ANSI_RESET ": "
-#define LOG_TAG_WARN  ANSI_HORA "warn" ANSI_RESET ": "
-#define LOG_TAG_ERROR ANSI_HRED "error" ANSI_RESET ": "
+#include "error.h"
 
-#define LOG_DEBUGF(FMT, ...)   fprintf(stderr, LOG_TAG LOG_TAG_DEBUG FMT "\n", __VA_ARGS__)
-#define LOG_DEBUG(S)           fputs(LOG_TAG LOG_TAG_DEBUG S "\n", stderr)
+/**
+ * Asynchronous logging.
+ *
+ * Every thread formats its records into its own ring buffer (lock-free, single producer / single consumer) and a
+ * background writer thread drains all of them to the output. Logging never blocks on the output: when the ring of a
+ * thread is full, the record is dropped and counted.
+ *
+ * Levels are filtered twice, so a disabled record costs a single branch at most:
+ * - at compile time, calls below LOG_COMPILE_LEVEL (the LOG_LEVEL CMake cache variable) are compiled out.
+ * - at runtime, calls below log_runtime_level return before formatting anything.
+ *
+ * Until log_start (and after log_stop) records are written synchronously to stderr, so configuration errors are
+ * still reported.
+ */
 
-#define LOG_INFOF(FMT, ...)   fprintf(stderr, LOG_TAG LOG_TAG_INFO FMT "\n", __VA_ARGS__)
-#define LOG_INFO(S)           fputs(LOG_TAG LOG_TAG_INFO S "\n", stderr)
+enum log_level {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+};
 
-#define LOG_WARNF(FMT, ...)  fprintf(stderr, LOG_TAG LOG_TAG_WARN ANSI_HWHT FMT ANSI_RESET "\n", __VA_ARGS__)
-#define LOG_WARN(S)          fputs(LOG_TAG LOG_TAG_WARN ANSI_HWHT S ANSI_RESET "\n", stderr)
+enum log_format {
+    /**
+     * "name: level: message" lines, colored when the output is a terminal
+     */
+    LOG_FORMAT_TEXT = 0,
 
-#define LOG_ERRORF(FMT, ...)  fprintf(stderr, LOG_TAG LOG_TAG_ERROR ANSI_HWHT FMT ANSI_RESET "\n", __VA_ARGS__)
-#define LOG_ERROR(S)          fputs(LOG_TAG LOG_TAG_ERROR ANSI_HWHT S ANSI_RESET "\n", stderr)
+    /**
+     * one JSON object per line: {"ts":...,"level":...,"logger":...,"thread":...,"msg":...}
+     */
+    LOG_FORMAT_JSON,
+};
 
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief max size of a formatted message. Longer ones are truncated.
+ */
+#define LOG_MESSAGE_MAX_SIZE 224
+
+/**
+ * @brief records buffered per thread (a power of 2)
+ */
+#define LOG_RING_CAPACITY 1024
+
+/**
+ * @brief the lowest level written. Only read with relaxed loads: it can be changed at any time.
+ */
+extern _Atomic int log_runtime_level;
+
+/**
+ * @brief starts the writer thread, writing to |fd| (which is not closed by log_stop).
+ */
+enum result log_start(enum log_level level, enum log_format format, int fd);
+
+/**
+ * @brief writes every buffered record and stops the writer thread. Threads still logging afterwards fall back to
+ *        synchronous writes.
+ */
+void log_stop(void);
+
+void log_set_level(enum log_level level);
+
+/**
+ * @brief parses "debug", "info", "warn", "error" or "off".
+ */
+enum result log_level_parse(const char* value, enum log_level* out_level);
+
+/**
+ * @brief parses "text" or "json".
+ */
+enum result log_format_parse(const char* value, enum log_format* out_format);
+
+/**
+ * @brief records dropped so far because the ring of their thread was full.
+ */
+uint64_t log_dropped_records(void);
+
+/**
+ * @brief use the LOG_* macros instead, which skip disabled levels before evaluating any argument.
+ */
+void log_write(enum log_level level, const char* name, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define LOG_ENABLED(LEVEL) \
+    ((LEVEL) >= LOG_COMPILE_LEVEL && (int) (LEVEL) >= atomic_load_explicit(&log_runtime_level, memory_order_relaxed))
+
+#define LOG_AT(LEVEL, ...)                             \
+    do {                                               \
+        if (LOG_ENABLED(LEVEL)) {                      \
+            log_write((LEVEL), LOG_NAME, __VA_ARGS__); \
+        }                                              \
+    } while (0)
+
+#define LOG_DEBUGF(FMT, ...)  LOG_AT(LOG_LEVEL_DEBUG, FMT, __VA_ARGS__)
+#define LOG_DEBUG(S)          LOG_AT(LOG_LEVEL_DEBUG, "%s", S)
+
+#define LOG_INFOF(FMT, ...)   LOG_AT(LOG_LEVEL_INFO, FMT, __VA_ARGS__)
+#define LOG_INFO(S)           LOG_AT(LOG_LEVEL_INFO, "%s", S)
+
+#define LOG_WARNF(FMT, ...)   LOG_AT(LOG_LEVEL_WARN, FMT, __VA_ARGS__)
+#define LOG_WARN(S)           LOG_AT(LOG_LEVEL_WARN, "%s", S)
+
+#define LOG_ERRORF(FMT, ...)  LOG_AT(LOG_LEVEL_ERROR, FMT, __VA_ARGS__)
+#define LOG_ERROR(S)          LOG_AT(LOG_LEVEL_ERROR, "%s", S)
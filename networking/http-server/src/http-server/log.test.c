@@ -0,0 +1,138 @@
+/**
+ * Tests of the log.h asynchronous logger: every record of several threads logging at once is either written (in
+ * order, per thread) or counted as dropped, levels are filtered and JSON messages are escaped.
+ *
+ * Usage: log-test [records per thread]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#include <http-server/commons.h>
+#include <http-server/test.h>
+#include <http-server/log.h>
+#define LOG_NAME "log-test"
+
+#define THREAD_COUNT 4
+#define DEFAULT_RECORDS_PER_THREAD 100000
+#define LINE_MAX_SIZE 2048
+
+static size_t records_per_thread = DEFAULT_RECORDS_PER_THREAD;
+
+static void* producer_main(void* arg)
+{
+    const int thread_index = (int) (intptr_t) arg;
+    for (size_t i = 0; i < records_per_thread; i++) {
+        LOG_INFOF("producer=%d record=%zu", thread_index, i);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        unsigned long long value;
+        if (parse_ull(argv[1], &value) != RESULT_OK || value == 0) {
+            fprintf(stderr, "usage: %s [records per thread]\n", argv[0]);
+            return 1;
+        }
+        records_per_thread = (size_t) value;
+    }
+
+    FILE* output = tmpfile();
+    if (output == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    if (log_start(LOG_LEVEL_INFO, LOG_FORMAT_JSON, fileno(output)) != RESULT_OK) {
+        return 1;
+    }
+
+    LOG_DEBUG("filtered out at runtime");
+    LOG_WARNF("quote=\" backslash=\\ newline=\n tab=\t %s", "end");
+
+    char long_message[LOG_MESSAGE_MAX_SIZE * 2];
+    memset(long_message, 'x', sizeof(long_message) - 1);
+    long_message[sizeof(long_message) - 1] = '\0';
+    LOG_WARNF("%s", long_message);
+
+    pthread_t threads[THREAD_COUNT];
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        if (pthread_create(&threads[i], NULL, producer_main, (void*) (intptr_t) i) != 0) {
+            fprintf(stderr, "error: failed to start a producer\n");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    log_stop();
+
+    const uint64_t dropped = log_dropped_records();
+
+    rewind(output);
+
+    char line[LINE_MAX_SIZE];
+    size_t next_record[THREAD_COUNT] = {0};
+    size_t producer_records = 0;
+    size_t dropped_reports = 0;
+    bool found_escaped = false;
+    bool found_truncated = false;
+    bool found_debug = false;
+
+    while (fgets(line, sizeof(line), output) != NULL) {
+        const size_t len = strlen(line);
+        CHECK(len > 2 && line[0] == '{' && strcmp(line + len - 2, "}\n") == 0);
+
+        int producer = 0;
+        size_t record = 0;
+        const char* msg = strstr(line, "\"msg\":\"");
+        if (msg != NULL && sscanf(msg, "\"msg\":\"producer=%d record=%zu\"", &producer, &record) == 2) {
+            // records can be dropped, but the others are written in order
+            CHECK(producer >= 0 && producer < THREAD_COUNT);
+            if (producer >= 0 && producer < THREAD_COUNT) {
+                CHECK(record >= next_record[producer]);
+                next_record[producer] = record + 1;
+            }
+            producer_records++;
+            continue;
+        }
+
+        if (strstr(line, "records dropped") != NULL) {
+            CHECK(strstr(line, "\"level\":\"warn\"") != NULL);
+            dropped_reports++;
+        }
+        if (strstr(line, "quote=\\\" backslash=\\\\ newline=\\u000a tab=\\u0009 end") != NULL) {
+            found_escaped = true;
+        }
+        if (strstr(line, "xxxx") != NULL) {
+            CHECK(strlen(strstr(line, "xxxx")) == LOG_MESSAGE_MAX_SIZE - 1 + sizeof("\"}\n") - 1);
+            found_truncated = true;
+        }
+        if (strstr(line, "filtered out") != NULL) {
+            found_debug = true;
+        }
+    }
+    fclose(output);
+
+    CHECK(found_escaped);
+    CHECK(found_truncated);
+    CHECK(!found_debug);
+    CHECK(producer_records + dropped == THREAD_COUNT * records_per_thread);
+    CHECK((dropped > 0) == (dropped_reports > 0));
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all log checks passed (%zu records written, %llu dropped)\n",
+           producer_records,
+           (unsigned long long) dropped);
+    return 0;
+}
@@ -4,28 +4,88 @@
 
 #include <unistd.h>
 #include <signal.h>
-#include <poll.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 
-#define DYNAMIC_ARRAY_IMPLEMENTATION
-#include "dynamic-array.h"
-
 #include "commons.h"
 #include "error.h"
 #include "str.h"
-#include "io.h"
 #include "stopwatch.h"
 #include "net.h"
 #include "http.h"
 #include "config.h"
 #include "http/server.h"
+#include "http/router.h"
+#include "http/static-files.h"
+#include "http/metrics.h"
+#include "http/upload.h"
 
 #include "log.h"
 #define LOG_NAME "main"
 
-int main(void)
+/**
+ * @brief scrapes within the same second share a single rendering of the metrics
+ */
+#define METRICS_CACHE_TTL_MS 1000
+
+/**
+ * @brief registers every route of the application. |server| is only used once it runs.
+ */
+static enum result routes_init(struct http_router* router, const struct config* config, const struct http_server* server)
+{
+    if (config->metrics
+        && http_router_add_cached(router, HTTP_METHOD_GET, "/metrics", http_metrics_handler, (void*) server,
+                                  METRICS_CACHE_TTL_MS) != RESULT_OK)
+    {
+        return RESULT_ERR;
+    }
+
+    if (http_router_add(router, HTTP_METHOD_POST, "/upload", http_upload_handler, NULL) != RESULT_OK) {
+        return RESULT_ERR;
+    }
+
+    if (config->document_root != NULL) {
+        // the lowest priority route: any other route (even with parameters) wins over a file
+        if (http_router_add(router, HTTP_METHOD_GET, "/*path", http_static_files_handler, NULL) != RESULT_OK) {
+            return RESULT_ERR;
+        }
+    }
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief waits for a signal telling the server to stop: SIGTERM (or SIGINT), or SIGHUP once a successor took over
+ *        the listening sockets (see http_server_spawn_successor).
+ */
+static void wait_for_stop(struct http_server* server, const sigset_t* signals, char* argv[])
 {
+    while (true) {
+        int signal_number = 0;
+        if (sigwait(signals, &signal_number) != 0) {
+            LOG_ERROR("sigwait failed");
+            return;
+        }
+
+        if (signal_number != SIGHUP) {
+            LOG_INFOF("%s received", strsignal(signal_number));
+            return;
+        }
+
+        // the successor reads the configuration again, and keeps serving from the same sockets as we drain
+        LOG_INFO("reloading...");
+        if (http_server_spawn_successor(server, argv) == RESULT_OK) {
+            return;
+        }
+        LOG_ERROR("reload failed. still serving");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    (void) argc;
+
     struct stopwatch elapsed_time;
     stopwatch_start(&elapsed_time);
 
@@ -38,140 +98,88 @@ int main(void)
 
     const struct config* config = config_get();
 
+    // blocked before any thread starts (the logger's included), so that every thread inherits the mask and only
+    // sigwait gets them
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    // from now on, logging never blocks on stderr
+    if (log_start(config->log_level, config->log_format, STDERR_FILENO) != RESULT_OK) {
+        return 1;
+    }
+
+    // sendfile(2) has no MSG_NOSIGNAL equivalent, a client closing in the middle of a file must not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    struct http_router router;
+    if (http_router_init(&router) != RESULT_OK) {
+        LOG_ERROR("router initialization failed");
+        log_stop();
+        return 1;
+    }
+
     struct http_server server;
 
-    // this will among other things...
-    // 1. create the server socket
+    if (routes_init(&router, config, &server) != RESULT_OK) {
+        LOG_ERROR("bad routes");
+        http_router_free(&router);
+        log_stop();
+        return 1;
+    }
+
+    // this will among other things, for each configured worker...
+    // 1. create the worker listening socket (SO_REUSEPORT), or take over the one of the process we replace
     // 2. bind it to the configured address (host+port)
     // 3. listen using the configured tcp backlog
-    if (http_server_init(&server, config) != RESULT_OK) {
+    // 4. register it on a new epoll event loop
+    if (http_server_init(&server, config, &router) != RESULT_OK) {
         LOG_ERROR("server initialization failed");
+        http_router_free(&router);
+        log_stop();
         return 1;
     }
 
-    socklen_t client_address_len = sizeof(struct sockaddr_in);
-
     stopwatch_stop(&elapsed_time);
 
-    LOG_INFOF("server is ready. url=\"" ANSI_HWHT "http://%s:%hu" ANSI_RESET "\" elapsed_time=%zuus",
+    LOG_INFOF("server is ready. url=\"http://%s:%hu\" workers=%zu io_backend=%s elapsed_time=%zuus",
               config->server_host,
               config->server_port,
+              config->workers,
+              event_loop_backend_cstr(config->io_backend),
               stopwatch_get_us(&elapsed_time));
 
-    // the main server loop
-    while (true) {
-        struct sockaddr_in client_address = {0};
-
-        // 4. accept
-        int client_socket = accept(server.socket, (struct sockaddr*) &client_address, &client_address_len);
-        if (client_socket < 0) {
-            int error_code = errno;
-            LOG_ERRORF("socket accept failed: %s", strerror(error_code));
-            goto err;
-        }
-
-        LOG_DEBUG("new client connected.");
-
-        // Read all http headers with a single recv call... it's not enough (aka \r\n\r\n not found) then
-        // we respond BadRequest to it.
-
-        ssize_t bytes_read;
-        uint8_t unsafe_buffer[4096] = {0};
-        const size_t unsafe_buffer_size = ARRAY_SIZE(unsafe_buffer);
-        const size_t unsafe_buffer_max_size = unsafe_buffer_size - 1; // this will ensure it'll end up being a c-str
-
-        //NOTE this returns the raw unsafe data read from the client socket
-        //     so it can contain `\0` and other bad bytes...
-        if (recv_or_timeout(client_socket,
-                            unsafe_buffer, unsafe_buffer_max_size,
-                            config->read_timeout_ms,
-                            &bytes_read) != RESULT_OK)
-        {
-            LOG_ERROR("failed to poll/read from the client connection");
-            goto end_of_request;
-        }
-        if (bytes_read <= 0) {
-            LOG_WARN("client disconnected or did not send http headers within read timeout");
-            goto end_of_request;
-        }
-        assert((size_t) bytes_read <= unsafe_buffer_max_size);
-
-        LOG_DEBUGF("%ld bytes read", bytes_read);
-
-        // Validate/sanitize unsafe input date here...
+    // the main server loop(s). every worker runs its own event loop on its own thread, and every client
+    // connection progresses independently on its own state machine, so a slow client never stalls the others.
+    if (http_server_start(&server) != RESULT_OK) {
+        LOG_ERROR("failed to start the workers");
+        goto err;
+    }
+    http_server_notify_ready(&server);
 
-        // this validation ensures it does not contain invalid bytes like '\0' before |bytes_read| and \r\n\r\n
-        size_t end_of_headers_offset = 0;
-        if (http_headers_validate(unsafe_buffer, bytes_read, &end_of_headers_offset) != RESULT_OK) {
-            //TODO write back bad request maybe?
-            LOG_WARN("bad request headers");
-            goto end_of_request;
-        }
+    wait_for_stop(&server, &stop_signals, argv);
 
-        // after validation, unsafe_buffer is now trusted which means it contains no invalid byte.
-        // check validation function for more info.
-
-        //TODO implement http header parsing...
-
-        LOG_DEBUG("parsed request headers:");
-        fwrite(unsafe_buffer, sizeof(uint8_t), end_of_headers_offset, stdout);
-        fputc('\n', stdout);
-
-        // Route and dispatch (each handler will judge if it makes sense to do more socket reading or not)
-        
-        //TODO implement router/routing/handling
-        
-        // No route matched. 404 it here...
-        
-        //TODO encapsulate/abstract sending static strings...
-        const char response_body[] = "Server is under development... please be patient\n";
-        const size_t response_body_len = sizeof(response_body) - 1;
-
-        char response_buffer[4098] = {0};
-        int bytes_printed = snprintf(response_buffer, sizeof(response_buffer),
-                          "HTTP/1.1 %d Not Implemented\r\n"
-                          "Server: http-server/0.0.0\r\n"
-                          "Content-Length: %zu\r\n"
-                          "Content-Type: text/plain; charset=utf-8\r\n"
-                          "Connection: closed\r\n"
-                          "\r\n"
-                          "%s",
-                          501,
-                          response_body_len,
-                          response_body
-                          );
-        assert(bytes_printed > 0);
-
-        LOG_DEBUGF("sending %d bytes...", bytes_printed);
-        fwrite(response_buffer, sizeof(char), bytes_printed, stdout);
-
-        ssize_t bytes_sent = send(client_socket, response_buffer, bytes_printed, MSG_DONTWAIT);
-        if (bytes_sent < 0) {
-            int error_code = errno;
-            LOG_ERRORF("failed to send full response (%d bytes): %s", bytes_printed, strerror(error_code));
-            goto end_of_request;
-        }
-        if (bytes_sent < bytes_printed) {
-            int error_code = errno;
-            LOG_WARNF("failed to send full response (%d bytes): just sent %ld bytes: %s",
-                      bytes_printed,
-                      bytes_sent,
-                      strerror(error_code));
-            goto end_of_request;
-        }
+    // the requests in flight get their responses, but no new connection is accepted
+    http_server_drain(&server, config->shutdown_timeout_ms);
 
-end_of_request:
-        LOG_DEBUG("client socket: closing...");
-        close(client_socket);
-        LOG_DEBUG("client socket: closed.");
+    if (http_server_wait(&server) != RESULT_OK) {
+        LOG_ERROR("server event loop failed");
+        goto err;
     }
 
-    // Ensure socket close by using signals
     http_server_free(&server);
+    http_router_free(&router);
+    LOG_INFO("stopped");
+    log_stop();
     return 0;
 
 err:
     http_server_free(&server);
+    http_router_free(&router);
+    log_stop();
     return 1;
 }
 
@@ -4,6 +4,8 @@
 #include <string.h>
 #include <errno.h>
 
+#include <fcntl.h>
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -33,3 +35,14 @@ struct sockaddr_in ipv4_address_create(const char* ip, uint16_t port)
         .sin_port = htons(port),
     };
 }
+
+enum result socket_set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("failed to set socket as non-blocking: fd=%d: %s", fd, strerror(error_code));
+        return RESULT_ERR;
+    }
+    return RESULT_OK;
+}
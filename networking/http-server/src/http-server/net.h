@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+#include "error.h"
+
 /**
  * Creates a tcp socket or exit if it fails.
  *
@@ -17,3 +19,7 @@ int tcp_socket_or_exit(void);
  */
 struct sockaddr_in ipv4_address_create(const char* ip, uint16_t port);
 
+/**
+ * Sets the O_NONBLOCK flag on |fd|.
+ */
+enum result socket_set_nonblocking(int fd);
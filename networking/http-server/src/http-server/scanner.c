@@ -58,3 +58,13 @@ enum result scanner_next_until_end(struct scanner* s, struct str_slice* out)
     return RESULT_OK;
 }
 
+enum result scanner_skip_slice(struct scanner* s, struct str_slice pattern)
+{
+    if (s->input.len < pattern.len || memcmp(s->input.ptr, pattern.ptr, pattern.len) != 0) {
+        return RESULT_ERR;
+    }
+
+    s->input.ptr += pattern.len;
+    s->input.len -= pattern.len;
+    return RESULT_OK;
+}
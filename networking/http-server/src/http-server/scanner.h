@@ -11,3 +11,8 @@ enum result scanner_next_until_char(struct scanner* s, char c, struct str_slice*
 enum result scanner_next_until_slice(struct scanner* s, struct str_slice pattern, struct str_slice* out);
 enum result scanner_next_until_end(struct scanner* s, struct str_slice* out);
 
+/**
+ * @brief skips |pattern| if the input starts with it. Fails otherwise.
+ */
+enum result scanner_skip_slice(struct scanner* s, struct str_slice pattern);
+
@@ -34,3 +34,17 @@ size_t stopwatch_get_us(struct stopwatch* sw)
     size_t diff_ns = sw->end_ts.tv_nsec - sw->start_ts.tv_nsec;
     return (diff_s * 1000 * 1000) + (diff_ns / 1000);
 }
+
+uint64_t clock_monotonic_ms(void)
+{
+    struct timespec now;
+    assert_clock_gettime(&now);
+    return ((uint64_t) now.tv_sec * 1000) + ((uint64_t) now.tv_nsec / (1000 * 1000));
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    struct timespec now;
+    assert_clock_gettime(&now);
+    return ((uint64_t) now.tv_sec * 1000 * 1000 * 1000) + (uint64_t) now.tv_nsec;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <time.h>
+#include <stdint.h>
 
 struct stopwatch {
     struct timespec start_ts;
@@ -13,3 +14,13 @@ void stopwatch_reset(struct stopwatch* sw);
 
 size_t stopwatch_get_ns(struct stopwatch* sw);
 size_t stopwatch_get_us(struct stopwatch* sw);
+
+/**
+ * @brief current CLOCK_MONOTONIC time in milliseconds. Useful for deadlines.
+ */
+uint64_t clock_monotonic_ms(void);
+
+/**
+ * @brief current CLOCK_MONOTONIC time in nanoseconds. Useful for latency samples.
+ */
+uint64_t clock_monotonic_ns(void);
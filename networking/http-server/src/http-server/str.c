@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <assert.h>
+#include <strings.h>
 
 struct str_slice str_slice_empty(void)
 {
@@ -43,6 +44,23 @@ bool str_slice_is_empty(struct str_slice s)
     return s.ptr == NULL || s.len == 0;
 }
 
+bool str_slice_eq_ignore_case(struct str_slice a, struct str_slice b)
+{
+    return a.len == b.len && (a.len == 0 || strncasecmp(a.ptr, b.ptr, a.len) == 0);
+}
+
+struct str_slice str_slice_trim(struct str_slice s)
+{
+    while (s.len > 0 && (s.ptr[0] == ' ' || s.ptr[0] == '\t')) {
+        s.ptr++;
+        s.len--;
+    }
+    while (s.len > 0 && (s.ptr[s.len - 1] == ' ' || s.ptr[s.len - 1] == '\t')) {
+        s.len--;
+    }
+    return s;
+}
+
 void str_slice_print(struct str_slice s, FILE* file)
 {
     fwrite(s.ptr, 1, s.len, file);
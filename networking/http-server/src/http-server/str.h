@@ -18,6 +18,12 @@ struct str_slice str_slice_from_cstr_untrusted(const char* cstr, size_t max_size
 struct str_slice str_slice_from_buffer(const char* buf, size_t buf_len);
 
 bool str_slice_is_empty(struct str_slice s);
+bool str_slice_eq_ignore_case(struct str_slice a, struct str_slice b);
+
+/**
+ * @brief removes leading and trailing spaces and horizontal tabs (aka http optional whitespace)
+ */
+struct str_slice str_slice_trim(struct str_slice s);
 
 void str_slice_print(struct str_slice s, FILE* file);
 void str_slice_println(struct str_slice s, FILE* file);
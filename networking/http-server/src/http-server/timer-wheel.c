@@ -0,0 +1,274 @@
+#include "timer-wheel.h"
+
+#include <assert.h>
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOT_COUNT - 1)
+#define TIMER_WHEEL_SLOT_EXPIRED (TIMER_WHEEL_LEVEL_COUNT * TIMER_WHEEL_SLOT_COUNT)
+
+/**
+ * @brief the deadlines the last level can tell apart: [current, current + TIMER_WHEEL_RANGE)
+ */
+#define TIMER_WHEEL_RANGE (UINT64_C(1) << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVEL_COUNT))
+
+static void timer_wheel_list_init(struct timer_wheel_entry* head);
+static void timer_wheel_list_append(struct timer_wheel_entry* head, struct timer_wheel_entry* entry);
+static void timer_wheel_place(struct timer_wheel* wheel, struct timer_wheel_entry* entry);
+static void timer_wheel_unlink(struct timer_wheel* wheel, struct timer_wheel_entry* entry);
+static void timer_wheel_advance(struct timer_wheel* wheel, uint64_t now);
+static void timer_wheel_process_tick(struct timer_wheel* wheel);
+static unsigned timer_wheel_level_shift(unsigned level);
+static uint64_t rotate_right(uint64_t bits, unsigned count);
+
+void timer_wheel_init(struct timer_wheel* wheel, uint64_t now)
+{
+    assert(wheel != NULL);
+
+    wheel->current = now;
+    for (size_t i = 0; i < TIMER_WHEEL_LEVEL_COUNT * TIMER_WHEEL_SLOT_COUNT; i++) {
+        timer_wheel_list_init(&wheel->slots[i]);
+    }
+    for (size_t i = 0; i < TIMER_WHEEL_LEVEL_COUNT; i++) {
+        wheel->occupied[i] = 0;
+    }
+    timer_wheel_list_init(&wheel->expired);
+    wheel->count = 0;
+}
+
+void timer_wheel_entry_init(struct timer_wheel_entry* entry)
+{
+    assert(entry != NULL);
+
+    entry->prev = NULL;
+    entry->next = NULL;
+    entry->deadline = 0;
+    entry->slot = 0;
+}
+
+void timer_wheel_arm(struct timer_wheel* wheel, struct timer_wheel_entry* entry, uint64_t deadline)
+{
+    assert(wheel != NULL);
+    assert(entry != NULL);
+
+    if (timer_wheel_entry_is_armed(entry)) {
+        timer_wheel_unlink(wheel, entry);
+    } else {
+        wheel->count++;
+    }
+
+    entry->deadline = deadline;
+    timer_wheel_place(wheel, entry);
+}
+
+void timer_wheel_cancel(struct timer_wheel* wheel, struct timer_wheel_entry* entry)
+{
+    assert(wheel != NULL);
+    assert(entry != NULL);
+
+    if (!timer_wheel_entry_is_armed(entry)) {
+        return;
+    }
+
+    timer_wheel_unlink(wheel, entry);
+    wheel->count--;
+}
+
+struct timer_wheel_entry* timer_wheel_pop_expired(struct timer_wheel* wheel, uint64_t now)
+{
+    assert(wheel != NULL);
+
+    timer_wheel_advance(wheel, now);
+
+    struct timer_wheel_entry* entry = wheel->expired.next;
+    if (entry == &wheel->expired) {
+        return NULL;
+    }
+
+    timer_wheel_unlink(wheel, entry);
+    wheel->count--;
+    return entry;
+}
+
+uint64_t timer_wheel_next_expiry(const struct timer_wheel* wheel)
+{
+    assert(wheel != NULL);
+
+    // already due
+    if (wheel->expired.next != &wheel->expired) {
+        return 0;
+    }
+
+    uint64_t next_expiry = UINT64_MAX;
+    for (unsigned level = 0; level < TIMER_WHEEL_LEVEL_COUNT; level++) {
+        if (wheel->occupied[level] == 0) {
+            continue;
+        }
+
+        // the slots of a level are visited (expired or cascaded) in turn, every 2^shift ticks: find the first
+        // occupied one from the next visit on
+        const unsigned shift = timer_wheel_level_shift(level);
+        const uint64_t next_visit = (wheel->current + (UINT64_C(1) << shift) - 1) >> shift;
+        const uint64_t bits = rotate_right(wheel->occupied[level], (unsigned) (next_visit & TIMER_WHEEL_SLOT_MASK));
+        const uint64_t visit = (next_visit + (uint64_t) __builtin_ctzll(bits)) << shift;
+
+        if (visit < next_expiry) {
+            next_expiry = visit;
+        }
+    }
+
+    return next_expiry;
+}
+
+static void timer_wheel_list_init(struct timer_wheel_entry* head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static void timer_wheel_list_append(struct timer_wheel_entry* head, struct timer_wheel_entry* entry)
+{
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+/**
+ * @brief links an unlinked |entry| in the slot of the lowest level covering its deadline (or in the expired list).
+ */
+static void timer_wheel_place(struct timer_wheel* wheel, struct timer_wheel_entry* entry)
+{
+    if (entry->deadline < wheel->current) {
+        entry->slot = TIMER_WHEEL_SLOT_EXPIRED;
+        timer_wheel_list_append(&wheel->expired, entry);
+        return;
+    }
+
+    uint64_t deadline = entry->deadline;
+    const uint64_t delta = deadline - wheel->current;
+
+    unsigned level = 0;
+    while (level < TIMER_WHEEL_LEVEL_COUNT - 1 && delta >= UINT64_C(1) << timer_wheel_level_shift(level + 1)) {
+        level++;
+    }
+
+    // too far: parked as far as possible, it is placed again (with its real deadline) when cascaded
+    if (delta >= TIMER_WHEEL_RANGE) {
+        deadline = wheel->current + TIMER_WHEEL_RANGE - 1;
+    }
+
+    const unsigned index = (unsigned) (deadline >> timer_wheel_level_shift(level)) & TIMER_WHEEL_SLOT_MASK;
+    entry->slot = (uint16_t) (level * TIMER_WHEEL_SLOT_COUNT + index);
+    timer_wheel_list_append(&wheel->slots[entry->slot], entry);
+    wheel->occupied[level] |= UINT64_C(1) << index;
+}
+
+static void timer_wheel_unlink(struct timer_wheel* wheel, struct timer_wheel_entry* entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+
+    if (entry->slot != TIMER_WHEEL_SLOT_EXPIRED) {
+        const struct timer_wheel_entry* head = &wheel->slots[entry->slot];
+        if (head->next == head) {
+            wheel->occupied[entry->slot / TIMER_WHEEL_SLOT_COUNT] &=
+                ~(UINT64_C(1) << (entry->slot & TIMER_WHEEL_SLOT_MASK));
+        }
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/**
+ * @brief processes every tick up to |now| (included), jumping straight over the ticks where nothing can happen.
+ */
+static void timer_wheel_advance(struct timer_wheel* wheel, uint64_t now)
+{
+    while (wheel->current <= now) {
+        unsigned level = 0;
+        while (level < TIMER_WHEEL_LEVEL_COUNT && wheel->occupied[level] == 0) {
+            level++;
+        }
+
+        if (level == TIMER_WHEEL_LEVEL_COUNT) {
+            wheel->current = now + 1;
+            return;
+        }
+
+        // the levels below are empty: nothing happens before the next visit of a slot of this one
+        if (level > 0) {
+            const uint64_t width = UINT64_C(1) << timer_wheel_level_shift(level);
+            const uint64_t next_visit = (wheel->current + width - 1) & ~(width - 1);
+            if (next_visit > now) {
+                wheel->current = now + 1;
+                return;
+            }
+            wheel->current = next_visit;
+        }
+
+        timer_wheel_process_tick(wheel);
+        wheel->current++;
+    }
+}
+
+/**
+ * @brief cascades the slots whose time has come down a level (the highest first), then expires the level 0 slot.
+ */
+static void timer_wheel_process_tick(struct timer_wheel* wheel)
+{
+    const uint64_t tick = wheel->current;
+
+    for (unsigned level = TIMER_WHEEL_LEVEL_COUNT - 1; level > 0; level--) {
+        const unsigned shift = timer_wheel_level_shift(level);
+        if ((tick & ((UINT64_C(1) << shift) - 1)) != 0) {
+            continue;
+        }
+
+        const unsigned index = (unsigned) (tick >> shift) & TIMER_WHEEL_SLOT_MASK;
+        if (!(wheel->occupied[level] & (UINT64_C(1) << index))) {
+            continue;
+        }
+
+        // detached first: entries may be placed back in the same slot (parked far deadlines)
+        struct timer_wheel_entry pending;
+        struct timer_wheel_entry* head = &wheel->slots[level * TIMER_WHEEL_SLOT_COUNT + index];
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        timer_wheel_list_init(head);
+        wheel->occupied[level] &= ~(UINT64_C(1) << index);
+
+        while (pending.next != &pending) {
+            struct timer_wheel_entry* entry = pending.next;
+            pending.next = entry->next;
+            entry->next->prev = &pending;
+            timer_wheel_place(wheel, entry);
+        }
+    }
+
+    const unsigned index = (unsigned) tick & TIMER_WHEEL_SLOT_MASK;
+    if (!(wheel->occupied[0] & (UINT64_C(1) << index))) {
+        return;
+    }
+
+    struct timer_wheel_entry* head = &wheel->slots[index];
+    while (head->next != head) {
+        struct timer_wheel_entry* entry = head->next;
+        head->next = entry->next;
+        entry->next->prev = head;
+        entry->slot = TIMER_WHEEL_SLOT_EXPIRED;
+        timer_wheel_list_append(&wheel->expired, entry);
+    }
+    wheel->occupied[0] &= ~(UINT64_C(1) << index);
+}
+
+static unsigned timer_wheel_level_shift(unsigned level)
+{
+    return level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static uint64_t rotate_right(uint64_t bits, unsigned count)
+{
+    return (bits >> count) | (bits << ((64 - count) & 63));
+}
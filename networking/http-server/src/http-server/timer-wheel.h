@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * A hierarchical timing wheel: deadlines (in ticks, e.g. CLOCK_MONOTONIC ms) of intrusive entries.
+ *
+ * Level 0 has a slot per tick for the next TIMER_WHEEL_SLOT_COUNT ticks, and every level above has slots
+ * TIMER_WHEEL_SLOT_COUNT times wider than the one below. An entry goes to the slot of the lowest level covering its
+ * deadline, and is cascaded down a level every time the time reaches its slot, until it expires from level 0. So
+ * arming, re-arming and cancelling are a few pointer writes, and expiring costs at most one move per level.
+ *
+ * Per-level occupancy bitmaps let the wheel skip empty slots, both when catching up after a long wait and when
+ * computing the next expiry for the event loop timeout.
+ *
+ * It is not thread-safe: each worker owns its own wheel.
+ */
+
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOT_COUNT (1u << TIMER_WHEEL_SLOT_BITS)
+
+/**
+ * @brief 4 levels of 64 slots cover 2^24 ticks (over 4 hours in ms). Later deadlines wait in the last level and are
+ *        re-cascaded there until they get close enough.
+ */
+#define TIMER_WHEEL_LEVEL_COUNT 4
+
+/**
+ * @brief embedded in the object having a deadline (found back with CONTAINER_OF).
+ */
+struct timer_wheel_entry {
+    struct timer_wheel_entry* prev;
+    struct timer_wheel_entry* next;
+    uint64_t deadline;
+
+    /**
+     * @brief the slot (level * TIMER_WHEEL_SLOT_COUNT + index) the entry is linked in, or the expired list
+     */
+    uint16_t slot;
+};
+
+struct timer_wheel {
+    /**
+     * @brief the next tick to process: every deadline before it has expired
+     */
+    uint64_t current;
+
+    /**
+     * @brief circular lists with a sentinel each, so that unlinking never needs to know the list
+     */
+    struct timer_wheel_entry slots[TIMER_WHEEL_LEVEL_COUNT * TIMER_WHEEL_SLOT_COUNT];
+    uint64_t occupied[TIMER_WHEEL_LEVEL_COUNT];
+
+    /**
+     * @brief entries whose deadline is reached, waiting to be popped
+     */
+    struct timer_wheel_entry expired;
+
+    /**
+     * @brief armed entries
+     */
+    size_t count;
+};
+
+void timer_wheel_init(struct timer_wheel* wheel, uint64_t now);
+
+void timer_wheel_entry_init(struct timer_wheel_entry* entry);
+
+static inline bool timer_wheel_entry_is_armed(const struct timer_wheel_entry* entry)
+{
+    return entry->next != NULL;
+}
+
+/**
+ * @brief (re-)arms |entry| to expire at |deadline|, which may already be passed.
+ */
+void timer_wheel_arm(struct timer_wheel* wheel, struct timer_wheel_entry* entry, uint64_t deadline);
+
+/**
+ * @brief does nothing when |entry| is not armed.
+ */
+void timer_wheel_cancel(struct timer_wheel* wheel, struct timer_wheel_entry* entry);
+
+/**
+ * @brief advances the wheel to |now| and unlinks one entry whose deadline is <= |now|.
+ *
+ * @return NULL when there is none. Entries popped are not armed anymore.
+ */
+struct timer_wheel_entry* timer_wheel_pop_expired(struct timer_wheel* wheel, uint64_t now);
+
+/**
+ * @brief when timer_wheel_pop_expired may return something next: a lower bound of the earliest deadline (a slot
+ *        above level 0 only tells when it must be cascaded), 0 when some deadline is already reached or UINT64_MAX when
+ *        nothing is armed.
+ */
+uint64_t timer_wheel_next_expiry(const struct timer_wheel* wheel);
@@ -0,0 +1,204 @@
+/**
+ * Tests of the timer-wheel.h deadlines against a brute force model: random arms, re-arms and cancels of deadlines
+ * from a few ticks to days away, with time moving in small steps and big jumps. Every entry must expire exactly on
+ * the first advance past its deadline, and the next expiry must never be after the earliest deadline.
+ *
+ * Usage: timer-wheel-test [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <http-server/commons.h>
+#include <http-server/timer-wheel.h>
+#include <http-server/test.h>
+
+#define ENTRY_COUNT 512
+#define ROUND_COUNT 200000
+
+struct timer {
+    struct timer_wheel_entry entry;
+    bool armed;
+    uint64_t deadline;
+};
+
+static uint64_t random_state;
+
+static uint64_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+/**
+ * @brief mostly near deadlines (like request timeouts), some far ones crossing every level, a few past ones
+ */
+static uint64_t random_delay(void)
+{
+    switch (random_next() % 8) {
+        case 0:
+            return 0;
+        case 1:
+            return random_next() % 64;
+        case 2:
+            return random_next() % 5000;
+        case 3:
+            return random_next() % 300000;
+        case 4:
+            return random_next() % (UINT64_C(1) << 26);
+        default:
+            return random_next() % 30000;
+    }
+}
+
+static uint64_t random_step(void)
+{
+    switch (random_next() % 16) {
+        case 0:
+            return random_next() % (UINT64_C(1) << 25);
+        case 1:
+            return random_next() % 100000;
+        default:
+            return random_next() % 50;
+    }
+}
+
+static void test_basics(void)
+{
+    struct timer_wheel* wheel = malloc(sizeof(struct timer_wheel));
+    if (wheel == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+
+    timer_wheel_init(wheel, 1000);
+    CHECK(timer_wheel_next_expiry(wheel) == UINT64_MAX);
+    CHECK(timer_wheel_pop_expired(wheel, 5000) == NULL);
+
+    struct timer_wheel_entry a, b;
+    timer_wheel_entry_init(&a);
+    timer_wheel_entry_init(&b);
+    CHECK(!timer_wheel_entry_is_armed(&a));
+
+    timer_wheel_arm(wheel, &a, 5010);
+    timer_wheel_arm(wheel, &b, 9000);
+    CHECK(timer_wheel_entry_is_armed(&a));
+    CHECK(wheel->count == 2);
+    CHECK(timer_wheel_next_expiry(wheel) == 5010);
+
+    // re-arming moves the deadline, cancelling twice is fine
+    timer_wheel_arm(wheel, &a, 5020);
+    CHECK(wheel->count == 2);
+    CHECK(timer_wheel_pop_expired(wheel, 5019) == NULL);
+    CHECK(timer_wheel_pop_expired(wheel, 5020) == &a);
+    CHECK(!timer_wheel_entry_is_armed(&a));
+    timer_wheel_cancel(wheel, &b);
+    timer_wheel_cancel(wheel, &b);
+    CHECK(wheel->count == 0);
+    CHECK(timer_wheel_pop_expired(wheel, 20000) == NULL);
+
+    // a deadline already passed expires on the next pop
+    timer_wheel_arm(wheel, &a, 10);
+    CHECK(timer_wheel_next_expiry(wheel) == 0);
+    CHECK(timer_wheel_pop_expired(wheel, 20000) == &a);
+
+    free(wheel);
+}
+
+static void test_against_model(uint64_t seed)
+{
+    struct timer_wheel* wheel = malloc(sizeof(struct timer_wheel));
+    struct timer* timers = calloc(ENTRY_COUNT, sizeof(struct timer));
+    if (wheel == NULL || timers == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+
+    random_state = seed;
+    uint64_t now = random_next() % (UINT64_C(1) << 40);
+    timer_wheel_init(wheel, now);
+    for (size_t i = 0; i < ENTRY_COUNT; i++) {
+        timer_wheel_entry_init(&timers[i].entry);
+    }
+
+    size_t expired_count = 0;
+    for (size_t round = 0; round < ROUND_COUNT; round++) {
+        struct timer* timer = &timers[random_next() % ENTRY_COUNT];
+        if (timer->armed && random_next() % 4 == 0) {
+            timer_wheel_cancel(wheel, &timer->entry);
+            timer->armed = false;
+        } else {
+            const uint64_t delay = random_delay();
+            // now and then in the past
+            timer->deadline = random_next() % 32 == 0 && now > delay ? now - delay : now + delay;
+            timer->armed = true;
+            timer_wheel_arm(wheel, &timer->entry, timer->deadline);
+        }
+
+        if (random_next() % 4 != 0) {
+            continue;
+        }
+
+        uint64_t earliest = UINT64_MAX;
+        size_t armed_count = 0;
+        for (size_t i = 0; i < ENTRY_COUNT; i++) {
+            if (timers[i].armed) {
+                earliest = MIN(earliest, timers[i].deadline);
+                armed_count++;
+            }
+        }
+        CHECK(wheel->count == armed_count);
+        CHECK(timer_wheel_next_expiry(wheel) <= earliest);
+
+        now += random_step();
+
+        struct timer_wheel_entry* entry;
+        while ((entry = timer_wheel_pop_expired(wheel, now)) != NULL) {
+            struct timer* expired = CONTAINER_OF(entry, struct timer, entry);
+            CHECK(expired->armed);
+            CHECK(expired->deadline <= now);
+            expired->armed = false;
+            expired_count++;
+        }
+
+        // nothing due is left behind
+        for (size_t i = 0; i < ENTRY_COUNT; i++) {
+            CHECK(!timers[i].armed || timers[i].deadline > now);
+            CHECK(timers[i].armed == timer_wheel_entry_is_armed(&timers[i].entry));
+        }
+        CHECK(timer_wheel_next_expiry(wheel) > now);
+
+        if (test_failures > 0) {
+            fprintf(stderr, "seed %llu: failed at round %zu\n", (unsigned long long) seed, round);
+            break;
+        }
+    }
+
+    CHECK(expired_count > ROUND_COUNT / 8);
+
+    free(timers);
+    free(wheel);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+    if (argc > 1 && (parse_ull(argv[1], &seed) != RESULT_OK || seed == 0)) {
+        fprintf(stderr, "usage: %s [seed]\n", argv[0]);
+        return 1;
+    }
+
+    test_basics();
+    test_against_model(seed);
+
+    if (test_failed()) {
+        return 1;
+    }
+
+    printf("all timer wheel checks passed\n");
+    return 0;
+}
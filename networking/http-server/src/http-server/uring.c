@@ -0,0 +1,231 @@
+#include "uring.h"
+
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "commons.h"
+#include "io.h"
+#include "log.h"
+#define LOG_NAME "uring"
+
+/**
+ * the ring layout we rely on (single mmap), completions never dropped and waits with a timeout (5.11+). The requests
+ * themselves are probed by their users (see uring_supports).
+ */
+#define URING_REQUIRED_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)
+
+static int uring_sys_setup(unsigned entries, struct io_uring_params* params);
+static int uring_sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size);
+static int uring_sys_register(int fd, unsigned opcode, void* arg, unsigned nr_args);
+static enum result uring_probe(struct uring* ring);
+
+enum result uring_init(struct uring* ring, unsigned entries)
+{
+    assert(ring != NULL);
+    assert(entries > 0);
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    ring->fd = uring_sys_setup(entries, &params);
+    if (ring->fd < 0) {
+        int error_code = errno;
+        LOG_ERRORF("io_uring_setup failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    if ((params.features & URING_REQUIRED_FEATURES) != URING_REQUIRED_FEATURES) {
+        LOG_ERRORF("io_uring is missing required features: features=0x%x", params.features);
+        close(ring->fd);
+        ring->fd = -1;
+        return RESULT_ERR;
+    }
+
+    const size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = MAX(sq_ring_size, cq_ring_size);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // both rings share a single mapping (IORING_FEAT_SINGLE_MMAP)
+    ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        int error_code = errno;
+        LOG_ERRORF("failed to map the io_uring rings: %s", strerror(error_code));
+        close(ring->fd);
+        ring->fd = -1;
+        return RESULT_ERR;
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        int error_code = errno;
+        LOG_ERRORF("failed to map the io_uring submission entries: %s", strerror(error_code));
+        munmap(ring->ring_ptr, ring->ring_size);
+        close(ring->fd);
+        ring->fd = -1;
+        return RESULT_ERR;
+    }
+
+    char* base = ring->ring_ptr;
+    ring->sq_head = (unsigned*) (base + params.sq_off.head);
+    ring->sq_tail = (unsigned*) (base + params.sq_off.tail);
+    ring->sq_array = (unsigned*) (base + params.sq_off.array);
+    ring->sq_mask = *(unsigned*) (base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+
+    ring->cq_head = (unsigned*) (base + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*) (base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (base + params.cq_off.cqes);
+
+    if (uring_probe(ring) != RESULT_OK) {
+        uring_free(ring);
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+void uring_free(struct uring* ring)
+{
+    assert(ring != NULL);
+
+    if (ring->fd < 0) {
+        return;
+    }
+
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_ptr, ring->ring_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+struct io_uring_sqe* uring_get_sqe(struct uring* ring)
+{
+    assert(ring != NULL);
+
+    if (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries) {
+        // the kernel consumes the entries as they are submitted, so this frees the whole ring
+        if (uring_enter(ring, 0, 0) != RESULT_OK
+            || ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+
+    const unsigned index = ring->sqe_tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+
+    return sqe;
+}
+
+enum result uring_enter(struct uring* ring, unsigned min_complete, int timeout_ms)
+{
+    assert(ring != NULL);
+
+    // publishes the entries filled since the last call
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    unsigned flags = 0;
+    struct timespec ts;
+    struct io_uring_getevents_arg arg = {0};
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long) (timeout_ms % 1000) * 1000000L;
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+        }
+    }
+
+    if (to_submit == 0 && flags == 0) {
+        return RESULT_OK;
+    }
+
+    int rc = uring_sys_enter(ring->fd, to_submit, min_complete, flags, flags != 0 ? &arg : NULL, sizeof(arg));
+    if (rc < 0) {
+        int error_code = errno;
+        // EBUSY: the completion ring overflowed (nothing is lost), it is drained on the next wait
+        if (error_code == ETIME || error_code == EINTR || error_code == EBUSY) {
+            return RESULT_OK;
+        }
+        LOG_ERRORF("io_uring_enter failed: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+enum result uring_register(struct uring* ring, unsigned opcode, void* arg, unsigned nr_args)
+{
+    assert(ring != NULL);
+
+    if (uring_sys_register(ring->fd, opcode, arg, nr_args) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("io_uring_register failed: opcode=%u: %s", opcode, strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    return RESULT_OK;
+}
+
+/**
+ * @brief fills the supported opcodes of |ring| (IORING_REGISTER_PROBE).
+ */
+static enum result uring_probe(struct uring* ring)
+{
+    memset(ring->supported_ops, 0, sizeof(ring->supported_ops));
+
+    // the probe ends with an entry per opcode
+    _Alignas(struct io_uring_probe)
+    uint8_t storage[sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)];
+    memset(storage, 0, sizeof(storage));
+    struct io_uring_probe* probe = (struct io_uring_probe*) storage;
+
+    if (uring_sys_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) != 0) {
+        int error_code = errno;
+        LOG_ERRORF("failed to probe the io_uring requests: %s", strerror(error_code));
+        return RESULT_ERR;
+    }
+
+    for (unsigned i = 0; i < probe->ops_len; i++) {
+        if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+            const uint8_t opcode = probe->ops[i].op;
+            ring->supported_ops[opcode / 64] |= (uint64_t) 1 << (opcode % 64);
+        }
+    }
+
+    return RESULT_OK;
+}
+
+static int uring_sys_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size)
+{
+    io_count_syscall();
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int uring_sys_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    io_count_syscall();
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <linux/io_uring.h>
+
+#include "error.h"
+
+/**
+ * A minimal io_uring instance over the raw syscalls (there is no liburing here): the submission and completion
+ * rings shared with the kernel, mapped once, and just what the event loop needs from them.
+ *
+ * Submission entries are only handed to the kernel by uring_enter, so any number of them costs a single syscall.
+ */
+struct uring {
+    int fd;
+
+    /**
+     * @brief the submission ring. |sqe_tail| runs ahead of the kernel tail until the next uring_enter.
+     */
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    struct io_uring_sqe* sqes;
+
+    /**
+     * @brief the completion ring
+     */
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+
+    /**
+     * @brief the opcodes (IORING_OP_*) the kernel supports, one bit each (see uring_supports)
+     */
+    uint64_t supported_ops[4];
+};
+
+/**
+ * @brief sets up a ring of |entries| submission entries (and 4 times more completion entries).
+ *
+ * @return RESULT_ERR when io_uring is not available (or the kernel is older than 5.11).
+ */
+enum result uring_init(struct uring* ring, unsigned entries);
+void uring_free(struct uring* ring);
+
+/**
+ * @brief whether the kernel supports the request |opcode| (IORING_OP_*). Its flags are not probed: a multishot
+ *        variant, for instance, may still be missing.
+ */
+static inline bool uring_supports(const struct uring* ring, uint8_t opcode)
+{
+    return (ring->supported_ops[opcode / 64] >> (opcode % 64)) & 1;
+}
+
+/**
+ * @brief the next free submission entry, zeroed. It is submitted by the next uring_enter.
+ *
+ * @return NULL when the ring is full and could not be flushed.
+ */
+struct io_uring_sqe* uring_get_sqe(struct uring* ring);
+
+/**
+ * @brief submits every queued entry and waits for at least |min_complete| completions, up to |timeout_ms| (-1 means
+ *        forever).
+ *
+ * @return RESULT_ERR on failure. Timeouts and signals are not failures.
+ */
+enum result uring_enter(struct uring* ring, unsigned min_complete, int timeout_ms);
+
+/**
+ * @brief io_uring_register(2) of |nr_args| |arg| items for |opcode| (IORING_REGISTER_*).
+ */
+enum result uring_register(struct uring* ring, unsigned opcode, void* arg, unsigned nr_args);
+
+/**
+ * @brief the oldest completion not consumed yet, or NULL when there is none. uring_cq_advance consumes it.
+ */
+static inline struct io_uring_cqe* uring_peek_cqe(struct uring* ring)
+{
+    const unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+static inline void uring_cq_advance(struct uring* ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static inline bool uring_has_pending_sqes(const struct uring* ring)
+{
+    return ring->sqe_tail != __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}